@@ -328,30 +328,75 @@ bgp_adj_out_remove (struct bgp_node *rn, struct bgp_adj_out *adj,
   bgp_adj_out_free (adj);
 }
 
+/* Record ATTR, an interned reference which is taken over, as the
+   attribute PEER sent for RN.  RI is PEER's route at RN as the update
+   left it, if it was accepted.  A route accepted unchanged by inbound
+   policy stands for its own Adj-RIB-In entry, so only routes policy
+   denied or modified need a bgp_adj_in of their own. */
 void
-bgp_adj_in_set (struct bgp_node *rn, struct peer *peer, struct attr *attr)
+bgp_adj_in_set (struct bgp_node *rn, struct peer *peer, struct attr *attr,
+		struct bgp_info *ri)
 {
   struct bgp_adj_in *adj;
+  struct bgp_info *bi;
+  int shared;
+
+  shared = (ri && ri->attr == attr
+	    && ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED|BGP_INFO_HISTORY));
+
+  for (bi = rn->info; bi; bi = bi->next)
+    if (bi->peer == peer)
+      {
+	if (shared && bi == ri)
+	  SET_FLAG (bi->flags, BGP_INFO_ADJ_IN);
+	else
+	  UNSET_FLAG (bi->flags, BGP_INFO_ADJ_IN);
+      }
 
   for (adj = rn->adj_in; adj; adj = adj->next)
+    if (adj->peer == peer)
+      break;
+
+  if (shared)
     {
-      if (adj->peer == peer)
+      if (adj)
 	{
-	  if (adj->attr != attr)
-	    {
-	      bgp_attr_unintern (&adj->attr);
-	      adj->attr = bgp_attr_intern (attr);
-	    }
-	  return;
+	  bgp_adj_in_remove (rn, adj);
+	  bgp_unlock_node (rn);
 	}
+      bgp_attr_unintern (&attr);
+      return;
+    }
+
+  if (adj)
+    {
+      bgp_attr_unintern (&adj->attr);
+      adj->attr = attr;
+      return;
     }
   adj = XCALLOC (MTYPE_BGP_ADJ_IN, sizeof (struct bgp_adj_in));
   adj->peer = peer_lock (peer); /* adj_in peer reference */
-  adj->attr = bgp_attr_intern (attr);
+  adj->attr = attr;
   BGP_ADJ_IN_ADD (rn, adj);
   bgp_lock_node (rn);
 }
 
+/* The attribute PEER sent for RN, if kept. */
+struct attr *
+bgp_adj_in_lookup (struct bgp_node *rn, const struct peer *peer)
+{
+  struct bgp_adj_in *adj;
+  struct bgp_info *ri;
+
+  for (adj = rn->adj_in; adj; adj = adj->next)
+    if (adj->peer == peer)
+      return adj->attr;
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->peer == peer && CHECK_FLAG (ri->flags, BGP_INFO_ADJ_IN))
+      return ri->attr;
+  return NULL;
+}
+
 void
 bgp_adj_in_remove (struct bgp_node *rn, struct bgp_adj_in *bai)
 {
@@ -365,6 +410,11 @@ void
 bgp_adj_in_unset (struct bgp_node *rn, struct peer *peer)
 {
   struct bgp_adj_in *adj;
+  struct bgp_info *ri;
+
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->peer == peer)
+      UNSET_FLAG (ri->flags, BGP_INFO_ADJ_IN);
 
   for (adj = rn->adj_in; adj; adj = adj->next)
     if (adj->peer == peer)
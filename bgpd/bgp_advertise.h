@@ -73,7 +73,8 @@ struct bgp_adj_out
   struct bgp_advertise *adv;
 };
 
-/* BGP adjacency in. */
+/* BGP adjacency in.  Only for routes inbound policy denied or
+   modified, the others are flagged BGP_INFO_ADJ_IN instead. */
 struct bgp_adj_in
 {
   /* Linked list pointer.  */
@@ -132,7 +133,9 @@ extern void bgp_adj_out_remove (struct bgp_node *, struct bgp_adj_out *,
 extern int bgp_adj_out_lookup (struct peer *, struct prefix *, afi_t, safi_t,
 			struct bgp_node *);
 
-extern void bgp_adj_in_set (struct bgp_node *, struct peer *, struct attr *);
+extern void bgp_adj_in_set (struct bgp_node *, struct peer *, struct attr *,
+			    struct bgp_info *);
+extern struct attr *bgp_adj_in_lookup (struct bgp_node *, const struct peer *);
 extern void bgp_adj_in_unset (struct bgp_node *, struct peer *);
 extern void bgp_adj_in_remove (struct bgp_node *, struct bgp_adj_in *);
 
@@ -406,6 +406,9 @@ aspath_count_confeds (struct aspath *aspath)
   int count = 0;
   struct assegment *seg = aspath->segments;
   
+  if (aspath->refcnt)
+    return aspath->confeds;
+
   while (seg)
     {
       if (seg->type == AS_CONFED_SEQUENCE)
@@ -424,6 +427,9 @@ aspath_count_hops (struct aspath *aspath)
   int count = 0;
   struct assegment *seg = aspath->segments;
   
+  if (aspath->refcnt)
+    return aspath->hops;
+
   while (seg)
     {
       if (seg->type == AS_SEQUENCE)
@@ -464,6 +470,9 @@ aspath_highest (struct aspath *aspath)
   as_t highest = 0;
   unsigned int i;
   
+  if (aspath->refcnt)
+    return aspath->highest;
+
   while (seg)
     {
       for (i = 0; i < seg->length; i++)
@@ -483,6 +492,9 @@ aspath_leftmost (struct aspath *aspath)
   struct assegment *seg = aspath->segments;
   as_t leftmost = 0;
 
+  if (aspath->refcnt)
+    return aspath->leftmost;
+
   if (seg && seg->length && seg->type == AS_SEQUENCE)
     leftmost = seg->as[0];
 
@@ -621,6 +633,40 @@ aspath_str_update (struct aspath *as)
   aspath_make_str_count (as);
 }
 
+/* Work out what the interned path keeps of its segments, while it is
+   still uninterned, so with the walking versions of the functions. */
+static void
+aspath_meta_make (struct aspath *aspath)
+{
+  struct assegment *seg;
+  unsigned int bit;
+  int i;
+
+  assert (aspath->refcnt == 0);
+
+  aspath->hops = aspath_count_hops (aspath);
+  aspath->confeds = aspath_count_confeds (aspath);
+  aspath->leftmost = aspath_leftmost (aspath);
+  aspath->highest = aspath_highest (aspath);
+
+  memset (aspath->filter_cache, 0, sizeof (aspath->filter_cache));
+
+  aspath->asmask[0] = aspath->asmask[1] = 0;
+  for (seg = aspath->segments; seg; seg = seg->next)
+    for (i = 0; i < seg->length; i++)
+      {
+	bit = ASPATH_MASK_BIT (seg->as[i]);
+	aspath->asmask[bit / 32] |= 1U << (bit % 32);
+      }
+}
+
+static void *
+aspath_intern_alloc (void *arg)
+{
+  aspath_meta_make (arg);
+  return arg;
+}
+
 /* Intern allocated AS path. */
 struct aspath *
 aspath_intern (struct aspath *aspath)
@@ -633,7 +679,7 @@ aspath_intern (struct aspath *aspath)
   assert (aspath->str);
 
   /* Check AS path hash. */
-  find = hash_get (ashash, aspath, hash_alloc_intern);
+  find = hash_get (ashash, aspath, aspath_intern_alloc);
   if (find != aspath)
     aspath_free (aspath);
 
@@ -689,6 +735,7 @@ aspath_hash_alloc (void *arg)
   new->segments = aspath->segments;
   new->str = aspath->str;
   new->str_len = aspath->str_len;
+  aspath_meta_make (new);
 
   return new;
 }
@@ -790,6 +837,8 @@ assegments_parse (struct stream *s, size_t length,
   return 0;
 }
 
+static struct aspath *aspath_parse_intern (struct aspath *);
+
 /* AS path parse function.  pnt is a pointer to byte stream and length
    is length of byte stream.  If there is same AS path in the the AS
    path hash then return it else make new AS path structure. 
@@ -815,8 +864,47 @@ aspath_parse (struct stream *s, size_t length, int use32bit)
   if (assegments_parse (s, length, &as.segments, use32bit) < 0)
     return NULL;
 
+  return aspath_parse_intern (&as);
+}
+
+/* Same as aspath_parse(), from NSEGS segments that were checked and
+   decoded already: segment I has TYPES[I] and LENGTHS[I] AS numbers,
+   taken in order from AS. */
+struct aspath *
+aspath_parse_flat (int nsegs, const u_char *types, const u_char *lengths,
+		   const as_t *as)
+{
+  struct aspath aspath;
+  struct assegment *seg, *prev = NULL, *head = NULL;
+  int i;
+
+  for (i = 0; i < nsegs; i++)
+    {
+      seg = assegment_new (types[i], lengths[i]);
+      memcpy (seg->as, as, lengths[i] * sizeof (as_t));
+      as += lengths[i];
+
+      if (head)
+	prev->next = seg;
+      else
+	head = seg;
+      prev = seg;
+    }
+
+  memset (&aspath, 0, sizeof (struct aspath));
+  aspath.segments = assegment_normalise (head);
+
+  return aspath_parse_intern (&aspath);
+}
+
+/* Find or add a freshly parsed AS path in the hash. */
+static struct aspath *
+aspath_parse_intern (struct aspath *as)
+{
+  struct aspath *find;
+
   /* If already same aspath exist then return it. */
-  find = hash_get (ashash, &as, aspath_hash_alloc);
+  find = hash_get (ashash, as, aspath_hash_alloc);
 
   /* bug! should not happen, let the daemon crash below */
   assert (find);
@@ -824,9 +912,9 @@ aspath_parse (struct stream *s, size_t length, int use32bit)
   /* if the aspath was already hashed free temporary memory. */
   if (find->refcnt)
     {
-      assegment_free_all (as.segments);
+      assegment_free_all (as->segments);
       /* aspath_key_make() always updates the string */
-      XFREE (MTYPE_AS_STR, as.str);
+      XFREE (MTYPE_AS_STR, as->str);
     }
 
   find->refcnt++;
@@ -1118,6 +1206,12 @@ aspath_loop_check (struct aspath *aspath, as_t asno)
   if ( (aspath == NULL) || (aspath->segments == NULL) )
     return 0;
   
+  /* Mostly the AS is not there at all. */
+  if (aspath->refcnt
+      && ! (aspath->asmask[ASPATH_MASK_BIT (asno) / 32]
+	    & (1U << (ASPATH_MASK_BIT (asno) % 32))))
+    return 0;
+
   seg = aspath->segments;
   
   while (seg)
@@ -1579,6 +1673,38 @@ aspath_cmp_left_confed (const struct aspath *aspath1, const struct aspath *aspat
   return 0;
 }
 
+/* The AS aspath_cmp_left() compares two paths on, returning 0 if
+   there is none. */
+int
+aspath_left_as (const struct aspath *aspath, as_t *as)
+{
+  const struct assegment *seg = aspath->segments;
+
+  while (seg && ((seg->type == AS_CONFED_SEQUENCE)
+		 || (seg->type == AS_CONFED_SET)))
+    seg = seg->next;
+
+  if (!(seg && seg->length && seg->type == AS_SEQUENCE))
+    return 0;
+
+  *as = seg->as[0];
+  return 1;
+}
+
+/* The AS aspath_cmp_left_confed() compares two paths on, returning 0
+   if there is none. */
+int
+aspath_left_confed (const struct aspath *aspath, as_t *as)
+{
+  const struct assegment *seg = aspath->segments;
+
+  if (!(seg && seg->length && seg->type == AS_CONFED_SEQUENCE))
+    return 0;
+
+  *as = seg->as[0];
+  return 1;
+}
+
 /* Delete all leading AS_CONFED_SEQUENCE/SET segments from aspath.
  * See RFC3065, 6.1 c1 */
 struct aspath *
@@ -46,6 +46,9 @@ struct assegment
   u_char type;
 };
 
+/* How many as-path access-list results a path keeps. */
+#define ASPATH_FILTER_CACHE 4
+
 /* AS path may be include some AsSegments.  */
 struct aspath 
 {
@@ -59,14 +62,37 @@ struct aspath
      and AS path regular expression match.  */
   char *str;
   unsigned short str_len;
+
+  /* Worked out once when the path is interned, after which it does
+     not change, so the hot path need not walk the segments.  Not
+     valid while refcnt is 0.  */
+  unsigned int hops;		/* aspath_count_hops () */
+  unsigned int confeds;		/* aspath_count_confeds () */
+  as_t leftmost;		/* aspath_leftmost () */
+  as_t highest;			/* aspath_highest () */
+  u_int32_t asmask[2];		/* ASPATH_MASK_BIT () of each AS */
+
+  /* Results of as-path access-lists, by list generation, see
+     as_list_apply ().  Only used while interned. */
+  struct aspath_filter_cache
+  {
+    u_int32_t gen;
+    u_int32_t type;
+  } filter_cache[ASPATH_FILTER_CACHE];
 };
 
+/* Which bit of aspath->asmask an AS sets.  If it is clear, the path
+   does not contain the AS. */
+#define ASPATH_MASK_BIT(as)	(((u_int32_t) (as) * 2654435761U) >> 26)
+
 #define ASPATH_STR_DEFAULT_LEN 32
 
 /* Prototypes. */
 extern void aspath_init (void);
 extern void aspath_finish (void);
 extern struct aspath *aspath_parse (struct stream *, size_t, int);
+extern struct aspath *aspath_parse_flat (int, const u_char *, const u_char *,
+					 const as_t *);
 extern struct aspath *aspath_dup (struct aspath *);
 extern struct aspath *aspath_aggregate (struct aspath *, struct aspath *);
 extern struct aspath *aspath_prepend (struct aspath *, struct aspath *);
@@ -77,6 +103,8 @@ extern struct aspath *aspath_add_confed_seq (struct aspath *, as_t);
 extern int aspath_cmp (const void *, const void *);
 extern int aspath_cmp_left (const struct aspath *, const struct aspath *);
 extern int aspath_cmp_left_confed (const struct aspath *, const struct aspath *);
+extern int aspath_left_as (const struct aspath *, as_t *);
+extern int aspath_left_confed (const struct aspath *, as_t *);
 extern struct aspath *aspath_delete_confed_seq (struct aspath *);
 extern struct aspath *aspath_empty (void);
 extern struct aspath *aspath_empty_get (void);
@@ -29,6 +29,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "log.h"
 #include "hash.h"
 #include "jhash.h"
+#include "routemap.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_attr.h"
@@ -38,6 +39,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_debug.h"
 #include "bgpd/bgp_packet.h"
 #include "bgpd/bgp_ecommunity.h"
+#include "bgpd/bgp_parse.h"
 
 /* Attribute strings for logging. */
 static const struct message attr_str [] = 
@@ -465,7 +467,7 @@ attr_show_all_iterator (struct hash_backet *backet, struct vty *vty)
 {
   struct attr *attr = backet->data;
 
-  vty_out (vty, "attr[%ld] nexthop %s%s", attr->refcnt, 
+  vty_out (vty, "attr[%u] nexthop %s%s", attr->refcnt, 
 	   inet_ntoa (attr->nexthop), VTY_NEWLINE);
 }
 
@@ -478,6 +480,29 @@ attr_show_all (struct vty *vty)
 		vty);
 }
 
+/* Fill in the decision process key of an attribute being interned. */
+static void
+bgp_attr_cmp_set (struct attr *attr)
+{
+  struct attr_cmp *cmp = &attr->cmp;
+
+  memset (cmp, 0, sizeof (struct attr_cmp));
+  attr->cmp_flags = 0;
+
+  if (attr->extra)
+    cmp->weight = attr->extra->weight;
+
+  if (attr->aspath)
+    {
+      cmp->hops = aspath_count_hops (attr->aspath);
+      cmp->confeds = aspath_count_confeds (attr->aspath);
+      if (aspath_left_as (attr->aspath, &cmp->left_as))
+	attr->cmp_flags |= ATTR_CMP_LEFT_AS;
+      if (aspath_left_confed (attr->aspath, &cmp->left_confed))
+	attr->cmp_flags |= ATTR_CMP_LEFT_CONFED;
+    }
+}
+
 static void *
 bgp_attr_hash_alloc (void *p)
 {
@@ -492,6 +517,7 @@ bgp_attr_hash_alloc (void *p)
       *attr->extra = *val->extra;
     }
   attr->refcnt = 0;
+  bgp_attr_cmp_set (attr);
   return attr;
 }
 
@@ -691,6 +717,7 @@ bgp_attr_unintern (struct attr **pattr)
   /* If reference becomes zero then free attribute object. */
   if (attr->refcnt == 0)
     {
+      route_map_cache_forget (attr);
       ret = hash_release (attrhash, attr);
       assert (ret != NULL);
       bgp_attr_extra_free (attr);
@@ -982,8 +1009,10 @@ bgp_attr_aspath (struct bgp_attr_parser_args *args)
    * peer with AS4 => will get 4Byte ASnums
    * otherwise, will get 16 Bit
    */
-  attr->aspath = aspath_parse (peer->ibuf, length, 
-                               CHECK_FLAG (peer->cap, PEER_CAP_AS4_RCV));
+  attr->aspath = bgp_parsed_aspath (peer, BGP_ATTR_AS_PATH, length);
+  if (! attr->aspath)
+    attr->aspath = aspath_parse (peer->ibuf, length, 
+                                 CHECK_FLAG (peer->cap, PEER_CAP_AS4_RCV));
 
   /* In case of IBGP, length will be zero. */
   if (! attr->aspath)
@@ -1059,7 +1088,9 @@ bgp_attr_as4_path (struct bgp_attr_parser_args *args, struct aspath **as4_path)
   struct attr *const attr = args->attr;
   const bgp_size_t length = args->length;
   
-  *as4_path = aspath_parse (peer->ibuf, length, 1);
+  *as4_path = bgp_parsed_aspath (peer, BGP_ATTR_AS4_PATH, length);
+  if (! *as4_path)
+    *as4_path = aspath_parse (peer->ibuf, length, 1);
 
   /* In case of IBGP, length will be zero. */
   if (!*as4_path)
@@ -1393,11 +1424,15 @@ bgp_attr_community (struct bgp_attr_parser_args *args)
       return BGP_ATTR_PARSE_PROCEED;
     }
   
-  attr->community =
-    community_parse ((u_int32_t *)stream_pnt (peer->ibuf), length);
+  attr->community = bgp_parsed_community (peer, length);
+  if (! attr->community)
+    {
+      attr->community =
+        community_parse ((u_int32_t *)stream_pnt (peer->ibuf), length);
   
-  /* XXX: fix community_parse to use stream API and remove this */
-  stream_forward_getp (peer->ibuf, length);
+      /* XXX: fix community_parse to use stream API and remove this */
+      stream_forward_getp (peer->ibuf, length);
+    }
 
   if (!attr->community)
     return bgp_attr_malformed (args,
@@ -1573,7 +1608,8 @@ bgp_mp_reach_parse (struct bgp_attr_parser_args *args,
       return BGP_ATTR_PARSE_ERROR_NOTIFYPLS;
     }
  
-  if (safi != SAFI_MPLS_LABELED_VPN)
+  if (safi != SAFI_MPLS_LABELED_VPN
+      && ! bgp_parsed_nlri_valid (peer, stream_pnt (s), nlri_len))
     {
       ret = bgp_nlri_sanity_check (peer, afi, stream_pnt (s), nlri_len);
       if (ret < 0) 
@@ -1622,7 +1658,8 @@ bgp_mp_unreach_parse (struct bgp_attr_parser_args *args,
   
   withdraw_len = length - BGP_MP_UNREACH_MIN_SIZE;
 
-  if (safi != SAFI_MPLS_LABELED_VPN)
+  if (safi != SAFI_MPLS_LABELED_VPN
+      && ! bgp_parsed_nlri_valid (peer, stream_pnt (s), withdraw_len))
     {
       ret = bgp_nlri_sanity_check (peer, afi, stream_pnt (s), withdraw_len);
       if (ret < 0)
@@ -87,7 +87,32 @@ struct attr_extra
   u_char mp_nexthop_len;
 };
 
-/* BGP core attribute structure. */
+/* What the decision process needs of the AS path and the extra
+   attributes, copied into an interned attribute by bgp_attr_intern()
+   so bgp_info_cmp() compares candidates without leaving their first
+   cache line.  Not valid in attributes that are being built. */
+struct attr_cmp
+{
+  /* Local weight, as in attr_extra */
+  u_int32_t weight;
+
+  /* First AS, as aspath_cmp_left() and aspath_cmp_left_confed() see
+     them, if ATTR_CMP_LEFT_AS and ATTR_CMP_LEFT_CONFED are set */
+  as_t left_as;
+  as_t left_confed;
+
+  /* aspath_count_hops() and aspath_count_confeds() */
+  u_int16_t hops;
+  u_int16_t confeds;
+};
+
+#define ATTR_CMP_LEFT_AS	(1 << 0)
+#define ATTR_CMP_LEFT_CONFED	(1 << 1)
+
+/* BGP core attribute structure.  The fields bgp_info_cmp() reads all
+   fit in 64 bytes, the whole of it on LP64 hosts, and the slab
+   allocator places objects of that size on a cache line each.  It is
+   not declared aligned, as plain malloc() would not honour that. */
 struct attr
 {
   /* AS Path structure */
@@ -99,9 +124,6 @@ struct attr
   /* Lazily allocated pointer to extra attributes */
   struct attr_extra *extra;
   
-  /* Reference count of this attribute. */
-  unsigned long refcnt;
-
   /* Flag of attribute is set or not. */
   u_int32_t flag;
   
@@ -110,8 +132,17 @@ struct attr
   u_int32_t med;
   u_int32_t local_pref;
   
+  /* Reference count of this attribute. */
+  u_int32_t refcnt;
+
   /* Path origin attribute */
   u_char origin;
+
+  /* ATTR_CMP_* flags */
+  u_char cmp_flags;
+
+  /* Decision process key, when interned */
+  struct attr_cmp cmp;
 };
 
 /* Router Reflector related structure. */
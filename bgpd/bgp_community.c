@@ -360,6 +360,21 @@ community_parse (u_int32_t *pnt, u_short length)
   return community_intern (new);
 }
 
+/* Same as community_parse(), from COUNT values that are sorted and
+   without duplicates already. */
+struct community *
+community_parse_sorted (u_int32_t *pnt, u_short count)
+{
+  struct community *new;
+
+  new = community_new ();
+  new->size = count;
+  new->val = XMALLOC (MTYPE_COMMUNITY_VAL, com_length (new));
+  memcpy (new->val, pnt, com_length (new));
+
+  return community_intern (new);
+}
+
 struct community *
 community_dup (struct community *com)
 {
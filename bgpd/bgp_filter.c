@@ -61,7 +61,7 @@ struct as_filter
 
   enum as_filter_type type;
 
-  regex_t *reg;
+  struct bgp_asregex *reg;
   char *reg_str;
 };
 
@@ -83,8 +83,14 @@ struct as_list
 
   struct as_filter *head;
   struct as_filter *tail;
+
+  /* Changed whenever the filters are, for the results aspaths keep. */
+  u_int32_t gen;
 };
 
+/* Generation of the last as_list change. */
+static u_int32_t as_list_gen;
+
 /* ip as-path access-list 10 permit AS1. */
 
 static struct as_list_master as_list_master =
@@ -95,6 +101,16 @@ static struct as_list_master as_list_master =
   NULL
 };
 
+/* Give the list a new generation, so no result aspaths keep for it
+   is used again. */
+static void
+as_list_changed (struct as_list *aslist)
+{
+  if (++as_list_gen == 0)
+    ++as_list_gen;
+  aslist->gen = as_list_gen;
+}
+
 /* Allocate new AS filter. */
 static struct as_filter *
 as_filter_new (void)
@@ -107,7 +123,7 @@ static void
 as_filter_free (struct as_filter *asfilter)
 {
   if (asfilter->reg)
-    bgp_regex_free (asfilter->reg);
+    bgp_asregex_free (asfilter->reg);
   if (asfilter->reg_str)
     XFREE (MTYPE_AS_FILTER_STR, asfilter->reg_str);
   XFREE (MTYPE_AS_FILTER, asfilter);
@@ -115,7 +131,8 @@ as_filter_free (struct as_filter *asfilter)
 
 /* Make new AS filter. */
 static struct as_filter *
-as_filter_make (regex_t *reg, const char *reg_str, enum as_filter_type type)
+as_filter_make (struct bgp_asregex *reg, const char *reg_str,
+		enum as_filter_type type)
 {
   struct as_filter *asfilter;
 
@@ -142,6 +159,8 @@ as_filter_lookup (struct as_list *aslist, const char *reg_str,
 static void
 as_list_filter_add (struct as_list *aslist, struct as_filter *asfilter)
 {
+  as_list_changed (aslist);
+
   asfilter->next = NULL;
   asfilter->prev = aslist->tail;
 
@@ -204,6 +223,7 @@ as_list_insert (const char *name)
   aslist = as_list_new ();
   aslist->name = strdup (name);
   assert (aslist->name);
+  as_list_changed (aslist);
 
   /* If name is made by all digit character.  We treat it as
      number. */
@@ -350,6 +370,8 @@ as_list_empty (struct as_list *aslist)
 static void
 as_list_filter_delete (struct as_list *aslist, struct as_filter *asfilter)
 {
+  as_list_changed (aslist);
+
   if (asfilter->next)
     asfilter->next->prev = asfilter->prev;
   else
@@ -374,7 +396,7 @@ as_list_filter_delete (struct as_list *aslist, struct as_filter *asfilter)
 static int
 as_filter_match (struct as_filter *asfilter, struct aspath *aspath)
 {
-  if (bgp_regexec (asfilter->reg, aspath) != REG_NOMATCH)
+  if (bgp_asregexec (asfilter->reg, aspath) != REG_NOMATCH)
     return 1;
   return 0;
 }
@@ -385,18 +407,37 @@ as_list_apply (struct as_list *aslist, void *object)
 {
   struct as_filter *asfilter;
   struct aspath *aspath;
+  struct aspath_filter_cache *cache = NULL;
+  enum as_filter_type type = AS_FILTER_DENY;
 
   aspath = (struct aspath *) object;
 
   if (aslist == NULL)
     return AS_FILTER_DENY;
 
+  /* Far fewer paths than routes, and interned ones do not change. */
+  if (aspath->refcnt)
+    {
+      cache = &aspath->filter_cache[aslist->gen % ASPATH_FILTER_CACHE];
+      if (cache->gen == aslist->gen)
+	return cache->type;
+    }
+
   for (asfilter = aslist->head; asfilter; asfilter = asfilter->next)
     {
       if (as_filter_match (asfilter, aspath))
-	return asfilter->type;
+	{
+	  type = asfilter->type;
+	  break;
+	}
     }
-  return AS_FILTER_DENY;
+
+  if (cache)
+    {
+      cache->gen = aslist->gen;
+      cache->type = type;
+    }
+  return type;
 }
 
 /* Add hook function. */
@@ -440,7 +481,7 @@ DEFUN (ip_as_path, ip_as_path_cmd,
   enum as_filter_type type;
   struct as_filter *asfilter;
   struct as_list *aslist;
-  regex_t *regex;
+  struct bgp_asregex *regex;
   char *regstr;
 
   /* Check the filter type. */
@@ -457,7 +498,7 @@ DEFUN (ip_as_path, ip_as_path_cmd,
   /* Check AS path regex. */
   regstr = argv_concat(argv, argc, 2);
 
-  regex = bgp_regcomp (regstr);
+  regex = bgp_asregcomp (regstr);
   if (!regex)
     {
       XFREE (MTYPE_TMP, regstr);
@@ -40,6 +40,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_route.h"
 #include "bgpd/bgp_dump.h"
 #include "bgpd/bgp_open.h"
+#include "bgpd/bgp_io.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -194,8 +195,12 @@ bgp_timer_set (struct peer *peer)
 	{
 	  BGP_TIMER_ON (peer->t_holdtime, bgp_holdtime_timer,
 			peer->v_holdtime);
-	  BGP_TIMER_ON (peer->t_keepalive, bgp_keepalive_timer,
-			peer->v_keepalive);
+	  /* The I/O thread sends the KEEPALIVEs itself. */
+	  if (peer->io)
+	    BGP_TIMER_OFF (peer->t_keepalive);
+	  else
+	    BGP_TIMER_ON (peer->t_keepalive, bgp_keepalive_timer,
+			  peer->v_keepalive);
 	}
       BGP_TIMER_OFF (peer->t_asorig);
       break;
@@ -258,9 +263,18 @@ bgp_holdtime_timer (struct thread *thread)
 {
   struct peer *peer;
 
+  int left;
+
   peer = THREAD_ARG (thread);
   peer->t_holdtime = NULL;
 
+  /* Messages may have arrived that are not processed yet. */
+  if (peer->io && (left = bgp_io_holdtime_left (peer)) > 0)
+    {
+      BGP_TIMER_ON (peer->t_holdtime, bgp_holdtime_timer, left);
+      return 0;
+    }
+
   if (BGP_DEBUG (fsm, FSM))
     zlog (peer->log, LOG_DEBUG,
 	  "%s [FSM] Timer (holdtime timer expire)",
@@ -438,6 +452,10 @@ bgp_stop (struct peer *peer)
   safi_t safi;
   char orf_name[BUFSIZ];
 
+  /* Take the socket back from the I/O thread first, its read and
+     write events are among those flushed below. */
+  bgp_io_unregister (peer);
+
   /* Can't do this in Clearing; events are used for state transitions */
   if (peer->status != Clearing)
     {
@@ -814,6 +832,7 @@ bgp_establish (struct peer *peer)
   /* Increment established count. */
   peer->established++;
   bgp_fsm_change_status (peer, Established);
+  bgp_io_register (peer);
 
   /* bgp log-neighbor-changes of neighbor Up */
   if (bgp_flag_check (peer->bgp, BGP_FLAG_LOG_NEIGHBOR_CHANGES))
@@ -22,11 +22,17 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #ifndef _QUAGGA_BGP_FSM_H
 #define _QUAGGA_BGP_FSM_H
 
-/* Macro for BGP read, write and timer thread.  */
+/* Macro for BGP read, write and timer thread.  While the I/O thread
+   has the socket, reading and writing are events it triggers. */
 #define BGP_READ_ON(T,F,V)			\
   do {						\
     if (!(T) && (peer->status != Deleted))	\
-      THREAD_READ_ON(master,T,F,peer,V);	\
+      {						\
+	if (peer->io)				\
+	  (T) = thread_add_event (master, (F), peer, 0); \
+	else					\
+	  THREAD_READ_ON(master,T,F,peer,V);	\
+      }						\
   } while (0)
 
 #define BGP_READ_OFF(T)				\
@@ -38,7 +44,12 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define BGP_WRITE_ON(T,F,V)			\
   do {						\
     if (!(T) && (peer->status != Deleted))	\
-      THREAD_WRITE_ON(master,(T),(F),peer,(V)); \
+      {						\
+	if (peer->io)				\
+	  (T) = thread_add_event (master, (F), peer, 0); \
+	else					\
+	  THREAD_WRITE_ON(master,(T),(F),peer,(V)); \
+      }						\
   } while (0)
     
 #define BGP_WRITE_OFF(T)			\
@@ -0,0 +1,1121 @@
+/*
+ * BGP packet I/O thread
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "stream.h"
+#include "memory.h"
+#include "log.h"
+#include "network.h"
+#include "sockunion.h"
+#include "vty.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_fsm.h"
+#include "bgpd/bgp_packet.h"
+#include "bgpd/bgp_io.h"
+#include "bgpd/bgp_parse.h"
+
+#if defined (HAVE_PTHREADS) && defined (HAVE_CLOCK_MONOTONIC)
+
+#include <pthread.h>
+#include <poll.h>
+
+/* Size of each ring, a power of two holding several messages of the
+   maximum size, so the thread can read ahead of the main thread. */
+#define BGP_IO_RING_SIZE	(16 * BGP_MAX_PACKET_SIZE)
+#define BGP_IO_RING_MASK	(BGP_IO_RING_SIZE - 1)
+
+/* Parse results per message, more than messages fit in a ring. */
+#define BGP_IO_PREP_SIZE	4096
+#define BGP_IO_PREP_MASK	(BGP_IO_PREP_SIZE - 1)
+
+/* Parse workers started when asked for any, and no more than. */
+#define BGP_PARSE_THREADS_MAX	8
+
+/* What the thread has to tell the main thread about a peer. */
+#define BGP_IO_EV_READ		(1 << 0)  /* Messages in the input ring. */
+#define BGP_IO_EV_ERROR		(1 << 1)  /* Connection closed or failed. */
+#define BGP_IO_EV_SPACE		(1 << 2)  /* Room in the output ring again. */
+#define BGP_IO_EV_KEEPALIVE	(1 << 3)  /* KEEPALIVEs were sent. */
+
+/* Single producer, single consumer byte ring.  Positions run freely
+   and are masked on access; only whole messages are ever published. */
+struct bgp_io_ring
+{
+  u_char *data;
+  size_t head;			/* Moved by the producer only. */
+  size_t tail;			/* Moved by the consumer only. */
+};
+
+struct bgp_io
+{
+  /* Main thread only; NULL once unregistered. */
+  struct peer *peer;
+
+  /* Registered sockets, under bgp_io_mutex. */
+  struct bgp_io *next;
+
+  int fd;
+  u_int32_t v_keepalive;	/* Milliseconds, 0 for none. */
+
+  struct bgp_io_ring in;	/* Produced by the thread. */
+  struct bgp_io_ring out;	/* Produced by the main thread. */
+
+  /* Shared, always accessed atomically. */
+  int events;			/* BGP_IO_EV_*, queued for main if set. */
+  int in_full;			/* Thread waits for room in the input. */
+  int out_full;			/* Main waits for room in the output. */
+  int out_idle;			/* Thread found the output ring empty. */
+  int failed;			/* Connection gone, ERROR holds errno. */
+  int error;
+  u_int32_t keepalives;		/* Sent, not yet counted by main. */
+  time_t last_read;		/* Last UPDATE or KEEPALIVE, seconds. */
+
+  /* Thread only. */
+  int pfd;			/* Index in the poll set, 0 if none. */
+  int stopped;			/* No more I/O on this socket. */
+  int in_blocked;		/* Input ring was full. */
+  int want_write;		/* Socket buffer was full. */
+  size_t in_unpub;		/* Read past in.head, not a whole message. */
+  size_t out_msg_left;		/* Rest of the message being written. */
+  size_t ka_left;		/* Rest of the KEEPALIVE being written. */
+  u_int64_t last_write;		/* Milliseconds. */
+
+  /* Parse stage, if there are workers.  Every message before
+     in_parsed has an entry in prep, the decoded UPDATE or NULL. */
+  int as4;			/* Peer sends 4-octet AS numbers. */
+  size_t in_parsed;		/* Worker, accessed atomically. */
+  struct bgp_update_parsed **prep;
+  size_t prep_head;		/* Worker. */
+  size_t prep_tail;		/* Main thread. */
+
+  /* Under bgp_parse_mutex. */
+  struct bgp_io *parse_next;
+  int parse_queued;		/* In the work queue. */
+  int parse_busy;		/* A worker has it. */
+  int parse_again;		/* More came in meanwhile. */
+  int parse_dead;		/* Being unregistered. */
+};
+
+/* Registered sockets and the thread's view of them.  The thread holds
+   the mutex all the time except while it sleeps in poll(). */
+static pthread_mutex_t bgp_io_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bgp_io_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t bgp_io_thread_id;
+static struct bgp_io *bgp_io_list;
+static unsigned int bgp_io_gen;		/* Bumped on list changes. */
+static unsigned int bgp_io_gen_seen;	/* The poll set is built from. */
+static int bgp_io_stop;
+
+static int bgp_io_running;
+static int bgp_io_disabled;
+
+/* Pipes to wake either side: [0] is read, [1] is written.  The pending
+   flags save the write when the other side is known to be awake. */
+static int bgp_io_wake_thread[2] = { -1, -1 };
+static int bgp_io_wake_main[2] = { -1, -1 };
+static int bgp_io_thread_pending;
+static int bgp_io_main_pending;
+static struct thread *t_bgp_io_ready;
+
+/* Sockets with events for the main thread.  A socket is queued when
+   its events go from none to some, so it is never in here twice, and
+   the ring always has room for every bgp_io allocated.  The I/O thread
+   and the parse workers add to it under the mutex. */
+static pthread_mutex_t bgp_io_ready_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct bgp_io **bgp_io_ready;
+static size_t bgp_io_ready_size;
+static size_t bgp_io_ready_head;	/* Under the mutex. */
+static size_t bgp_io_ready_tail;	/* Main thread. */
+static size_t bgp_io_count;
+
+/* UPDATE parse workers and the sockets with messages for them.  One
+   worker at a time takes a socket, so its messages are parsed in
+   order; different sockets are parsed in parallel. */
+static pthread_mutex_t bgp_parse_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bgp_parse_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t bgp_parse_idle_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t bgp_parse_thread_id[BGP_PARSE_THREADS_MAX];
+static int bgp_parse_threads = -1;	/* As configured, -1 for auto. */
+static int bgp_parse_running;
+static int bgp_parse_stop;
+static struct bgp_io *bgp_parse_head;
+static struct bgp_io *bgp_parse_tail;
+
+static const u_char bgp_io_keepalive[BGP_HEADER_SIZE] =
+{
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0x00, BGP_HEADER_SIZE, BGP_MSG_KEEPALIVE
+};
+
+static u_int64_t
+bgp_io_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (u_int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+bgp_io_wake (int *pending, int fd)
+{
+  u_char c = 0;
+
+  if (__atomic_exchange_n (pending, 1, __ATOMIC_SEQ_CST))
+    return;
+  while (write (fd, &c, 1) < 0 && errno == EINTR)
+    ;
+}
+
+static void
+bgp_io_drain (int *pending, int fd)
+{
+  u_char buf[64];
+
+  while (read (fd, buf, sizeof (buf)) > 0)
+    ;
+  __atomic_store_n (pending, 0, __ATOMIC_SEQ_CST);
+}
+
+/* Length field of the message starting at POS. */
+static size_t
+bgp_io_msg_rawlen (struct bgp_io_ring *r, size_t pos)
+{
+  return (r->data[(pos + BGP_MARKER_SIZE) & BGP_IO_RING_MASK] << 8)
+         | r->data[(pos + BGP_MARKER_SIZE + 1) & BGP_IO_RING_MASK];
+}
+
+/* Length of the message starting at POS, or of its header alone when
+   the length field is out of range: framing is lost after it, and
+   bgp_read() will reject the header. */
+static size_t
+bgp_io_msg_len (struct bgp_io_ring *r, size_t pos)
+{
+  size_t len = bgp_io_msg_rawlen (r, pos);
+
+  if (len < BGP_HEADER_SIZE || len > BGP_MAX_PACKET_SIZE)
+    return BGP_HEADER_SIZE;
+  return len;
+}
+
+/* Thread or worker: hand events over to the main thread. */
+static void
+bgp_io_post (struct bgp_io *io, int events)
+{
+  size_t head;
+
+  if (__atomic_fetch_or (&io->events, events, __ATOMIC_SEQ_CST))
+    return;
+
+  pthread_mutex_lock (&bgp_io_ready_mutex);
+  head = bgp_io_ready_head;
+  bgp_io_ready[head & (bgp_io_ready_size - 1)] = io;
+  __atomic_store_n (&bgp_io_ready_head, head + 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock (&bgp_io_ready_mutex);
+
+  bgp_io_wake (&bgp_io_main_pending, bgp_io_wake_main[1]);
+}
+
+static void
+bgp_io_fail (struct bgp_io *io, int error)
+{
+  io->stopped = 1;
+  io->error = error;
+  __atomic_store_n (&io->failed, 1, __ATOMIC_SEQ_CST);
+  bgp_io_post (io, BGP_IO_EV_ERROR);
+}
+
+/* Thread: have a worker parse the messages published for IO. */
+static void
+bgp_parse_kick (struct bgp_io *io)
+{
+  pthread_mutex_lock (&bgp_parse_mutex);
+  if (io->parse_busy)
+    io->parse_again = 1;
+  else if (! io->parse_queued)
+    {
+      io->parse_queued = 1;
+      io->parse_next = NULL;
+      if (bgp_parse_tail)
+	bgp_parse_tail->parse_next = io;
+      else
+	bgp_parse_head = io;
+      bgp_parse_tail = io;
+      pthread_cond_signal (&bgp_parse_cond);
+    }
+  pthread_mutex_unlock (&bgp_parse_mutex);
+}
+
+/* Worker: decode the UPDATEs between in_parsed and in.head, which
+   stay put until the main thread has taken them. */
+static void
+bgp_parse_run (struct bgp_io *io)
+{
+  u_char buf[BGP_MAX_PACKET_SIZE];
+  struct bgp_update_parsed *up;
+  size_t pos, head, len, first;
+  const u_char *msg;
+
+  pos = io->in_parsed;
+  head = __atomic_load_n (&io->in.head, __ATOMIC_ACQUIRE);
+  if (pos == head)
+    return;
+
+  for (; pos != head; pos += len)
+    {
+      len = bgp_io_msg_len (&io->in, pos);
+      up = NULL;
+      if (io->in.data[(pos + BGP_MARKER_SIZE + 2) & BGP_IO_RING_MASK]
+	  == BGP_MSG_UPDATE && len == bgp_io_msg_rawlen (&io->in, pos))
+	{
+	  first = BGP_IO_RING_SIZE - (pos & BGP_IO_RING_MASK);
+	  if (first >= len)
+	    msg = io->in.data + (pos & BGP_IO_RING_MASK);
+	  else
+	    {
+	      memcpy (buf, io->in.data + (pos & BGP_IO_RING_MASK), first);
+	      memcpy (buf + first, io->in.data, len - first);
+	      msg = buf;
+	    }
+	  up = bgp_update_preparse (msg, len, io->as4);
+	}
+      io->prep[io->prep_head++ & BGP_IO_PREP_MASK] = up;
+    }
+
+  __atomic_store_n (&io->in_parsed, pos, __ATOMIC_RELEASE);
+  bgp_io_post (io, BGP_IO_EV_READ);
+}
+
+static void *
+bgp_parse_thread (void *arg)
+{
+  struct bgp_io *io;
+
+  pthread_mutex_lock (&bgp_parse_mutex);
+  while (! bgp_parse_stop)
+    {
+      if ((io = bgp_parse_head) == NULL)
+	{
+	  pthread_cond_wait (&bgp_parse_cond, &bgp_parse_mutex);
+	  continue;
+	}
+      if ((bgp_parse_head = io->parse_next) == NULL)
+	bgp_parse_tail = NULL;
+      io->parse_queued = 0;
+      io->parse_busy = 1;
+      pthread_mutex_unlock (&bgp_parse_mutex);
+
+      bgp_parse_run (io);
+
+      pthread_mutex_lock (&bgp_parse_mutex);
+      io->parse_busy = 0;
+      if (io->parse_dead)
+	pthread_cond_broadcast (&bgp_parse_idle_cond);
+      else if (io->parse_again)
+	{
+	  io->parse_again = 0;
+	  io->parse_queued = 1;
+	  io->parse_next = NULL;
+	  if (bgp_parse_tail)
+	    bgp_parse_tail->parse_next = io;
+	  else
+	    bgp_parse_head = io;
+	  bgp_parse_tail = io;
+	}
+    }
+  pthread_mutex_unlock (&bgp_parse_mutex);
+
+  return NULL;
+}
+
+/* Main thread: make sure no worker has IO or will take it. */
+static void
+bgp_parse_detach (struct bgp_io *io)
+{
+  struct bgp_io **iop;
+
+  pthread_mutex_lock (&bgp_parse_mutex);
+  io->parse_dead = 1;
+  if (io->parse_queued)
+    {
+      for (iop = &bgp_parse_head; *iop != io; iop = &(*iop)->parse_next)
+	;
+      *iop = io->parse_next;
+      if (bgp_parse_tail == io)
+	{
+	  for (bgp_parse_tail = bgp_parse_head;
+	       bgp_parse_tail && bgp_parse_tail->parse_next;
+	       bgp_parse_tail = bgp_parse_tail->parse_next)
+	    ;
+	}
+      io->parse_queued = 0;
+    }
+  while (io->parse_busy)
+    pthread_cond_wait (&bgp_parse_idle_cond, &bgp_parse_mutex);
+  pthread_mutex_unlock (&bgp_parse_mutex);
+
+  while (io->prep_tail != io->prep_head)
+    bgp_update_parsed_free (io->prep[io->prep_tail++ & BGP_IO_PREP_MASK]);
+}
+
+/* Thread: read what the socket has, and publish the whole messages. */
+static void
+bgp_io_input (struct bgp_io *io, u_int64_t now)
+{
+  size_t head, tail, pos, room, chunk, len;
+  ssize_t nbytes;
+  u_char type;
+  int got = 0;
+
+  head = io->in.head;
+  while (! io->stopped)
+    {
+      tail = __atomic_load_n (&io->in.tail, __ATOMIC_ACQUIRE);
+      pos = head + io->in_unpub;
+      room = BGP_IO_RING_SIZE - (pos - tail);
+      if (room == 0)
+	{
+	  /* Leave the rest in the socket until the main thread has
+	     made room, which it will tell us about. */
+	  __atomic_store_n (&io->in_full, 1, __ATOMIC_SEQ_CST);
+	  if (__atomic_load_n (&io->in.tail, __ATOMIC_SEQ_CST) == tail)
+	    {
+	      io->in_blocked = 1;
+	      break;
+	    }
+	  __atomic_store_n (&io->in_full, 0, __ATOMIC_SEQ_CST);
+	  continue;
+	}
+
+      chunk = BGP_IO_RING_SIZE - (pos & BGP_IO_RING_MASK);
+      if (chunk > room)
+	chunk = room;
+
+      nbytes = read (io->fd, io->in.data + (pos & BGP_IO_RING_MASK), chunk);
+      if (nbytes < 0)
+	{
+	  if (ERRNO_IO_RETRY (errno))
+	    break;
+	  bgp_io_fail (io, errno);
+	  break;
+	}
+      if (nbytes == 0)
+	{
+	  bgp_io_fail (io, 0);
+	  break;
+	}
+      io->in_unpub += nbytes;
+
+      while (io->in_unpub >= BGP_HEADER_SIZE)
+	{
+	  len = bgp_io_msg_len (&io->in, head);
+	  if (len != bgp_io_msg_rawlen (&io->in, head))
+	    io->stopped = 1;
+	  else if (io->in_unpub < len)
+	    break;
+
+	  type = io->in.data[(head + BGP_MARKER_SIZE + 2) & BGP_IO_RING_MASK];
+	  if (type == BGP_MSG_UPDATE || type == BGP_MSG_KEEPALIVE)
+	    __atomic_store_n (&io->last_read, (time_t) (now / 1000),
+			      __ATOMIC_RELEASE);
+
+	  head += len;
+	  io->in_unpub -= len;
+	  got = 1;
+
+	  if (io->stopped)
+	    break;
+	}
+
+      if ((size_t) nbytes < chunk)
+	break;
+    }
+
+  if (got)
+    {
+      __atomic_store_n (&io->in.head, head, __ATOMIC_RELEASE);
+      if (io->prep)
+	bgp_parse_kick (io);
+      else
+	bgp_io_post (io, BGP_IO_EV_READ);
+    }
+}
+
+/* Thread: write out what the main thread queued, and a KEEPALIVE
+   between two messages whenever nothing was sent for a while. */
+static void
+bgp_io_output (struct bgp_io *io, u_int64_t now)
+{
+  size_t head, tail, chunk, done, step;
+  ssize_t nbytes;
+  int sent = 0;
+
+  io->want_write = 0;
+  while (! io->stopped)
+    {
+      if (! io->ka_left && io->v_keepalive
+	  && now >= io->last_write + io->v_keepalive)
+	io->ka_left = BGP_HEADER_SIZE;
+
+      if (io->ka_left && ! io->out_msg_left)
+	{
+	  nbytes = write (io->fd,
+			  bgp_io_keepalive + BGP_HEADER_SIZE - io->ka_left,
+			  io->ka_left);
+	  if (nbytes < 0)
+	    goto error;
+	  io->ka_left -= nbytes;
+	  if (io->ka_left)
+	    {
+	      io->want_write = 1;
+	      break;
+	    }
+	  io->last_write = now;
+	  __atomic_fetch_add (&io->keepalives, 1, __ATOMIC_SEQ_CST);
+	  bgp_io_post (io, BGP_IO_EV_KEEPALIVE);
+	  continue;
+	}
+
+      tail = io->out.tail;
+      head = __atomic_load_n (&io->out.head, __ATOMIC_ACQUIRE);
+      if (head == tail)
+	{
+	  __atomic_store_n (&io->out_idle, 1, __ATOMIC_SEQ_CST);
+	  if (__atomic_load_n (&io->out.head, __ATOMIC_SEQ_CST) == tail)
+	    break;
+	  __atomic_store_n (&io->out_idle, 0, __ATOMIC_SEQ_CST);
+	  continue;
+	}
+
+      chunk = BGP_IO_RING_SIZE - (tail & BGP_IO_RING_MASK);
+      if (chunk > head - tail)
+	chunk = head - tail;
+      /* A KEEPALIVE is due, only finish the message under way. */
+      if (io->ka_left && chunk > io->out_msg_left)
+	chunk = io->out_msg_left;
+
+      nbytes = write (io->fd, io->out.data + (tail & BGP_IO_RING_MASK), chunk);
+      if (nbytes < 0)
+	goto error;
+
+      /* Keep track of where messages end. */
+      for (done = 0; done < (size_t) nbytes; done += step)
+	{
+	  if (! io->out_msg_left)
+	    io->out_msg_left = bgp_io_msg_len (&io->out, tail + done);
+	  step = MIN (io->out_msg_left, nbytes - done);
+	  io->out_msg_left -= step;
+	}
+      __atomic_store_n (&io->out.tail, tail + nbytes, __ATOMIC_SEQ_CST);
+      io->last_write = now;
+      sent = 1;
+
+      if ((size_t) nbytes < chunk)
+	{
+	  io->want_write = 1;
+	  break;
+	}
+    }
+
+  if (sent && __atomic_exchange_n (&io->out_full, 0, __ATOMIC_SEQ_CST))
+    bgp_io_post (io, BGP_IO_EV_SPACE);
+  return;
+
+ error:
+  if (ERRNO_IO_RETRY (errno))
+    io->want_write = 1;
+  else
+    bgp_io_fail (io, errno);
+  if (sent && __atomic_exchange_n (&io->out_full, 0, __ATOMIC_SEQ_CST))
+    bgp_io_post (io, BGP_IO_EV_SPACE);
+}
+
+static void *
+bgp_io_thread (void *arg)
+{
+  struct pollfd *pfds = NULL;
+  size_t pfds_size = 0;
+  struct bgp_io *io;
+  u_int64_t now, due;
+  int n, timeout;
+  short revents;
+
+  pthread_mutex_lock (&bgp_io_mutex);
+  while (! bgp_io_stop)
+    {
+      /* Poll set; grown with plain realloc(), the memory statistics
+	 are the main thread's. */
+      if (pfds_size < bgp_io_ready_size + 1)
+	{
+	  pfds_size = bgp_io_ready_size + 1;
+	  pfds = realloc (pfds, pfds_size * sizeof (struct pollfd));
+	  assert (pfds);
+	}
+
+      now = bgp_io_now ();
+      timeout = -1;
+      pfds[0].fd = bgp_io_wake_thread[0];
+      pfds[0].events = POLLIN;
+      n = 1;
+      for (io = bgp_io_list; io; io = io->next)
+	{
+	  io->pfd = 0;
+	  if (io->stopped)
+	    continue;
+
+	  /* A KEEPALIVE waiting for socket space is sent on POLLOUT. */
+	  if (io->v_keepalive && ! io->ka_left && ! io->want_write)
+	    {
+	      due = io->last_write + io->v_keepalive;
+	      due = due > now ? due - now : 0;
+	      if (timeout < 0 || due < (u_int64_t) timeout)
+		timeout = due;
+	    }
+
+	  pfds[n].fd = io->fd;
+	  pfds[n].events = (io->in_blocked ? 0 : POLLIN)
+	                   | (io->want_write ? POLLOUT : 0);
+	  pfds[n].revents = 0;
+	  io->pfd = n++;
+	}
+
+      bgp_io_gen_seen = bgp_io_gen;
+      pthread_cond_broadcast (&bgp_io_cond);
+      pthread_mutex_unlock (&bgp_io_mutex);
+
+      if (poll (pfds, n, timeout) < 0 && errno != EINTR)
+	pfds[0].revents = 0;
+
+      pthread_mutex_lock (&bgp_io_mutex);
+      if (pfds[0].revents)
+	bgp_io_drain (&bgp_io_thread_pending, bgp_io_wake_thread[0]);
+
+      /* Sockets registered while we slept have no poll entry, but may
+	 already have output queued. */
+      now = bgp_io_now ();
+      for (io = bgp_io_list; io; io = io->next)
+	{
+	  if (io->stopped)
+	    continue;
+	  revents = io->pfd ? pfds[io->pfd].revents : 0;
+
+	  if (io->in_blocked
+	      && ! __atomic_load_n (&io->in_full, __ATOMIC_SEQ_CST))
+	    {
+	      io->in_blocked = 0;
+	      revents |= POLLIN;
+	    }
+	  if (revents & (POLLIN | POLLHUP | POLLERR))
+	    bgp_io_input (io, now);
+
+	  if (revents & (POLLOUT | POLLHUP | POLLERR))
+	    io->want_write = 0;
+	  if (! io->want_write)
+	    bgp_io_output (io, now);
+	}
+    }
+  pthread_mutex_unlock (&bgp_io_mutex);
+
+  free (pfds);
+  return NULL;
+}
+
+static void
+bgp_io_free (struct bgp_io *io)
+{
+  XFREE (MTYPE_BGP_IO_BUF, io->in.data);
+  XFREE (MTYPE_BGP_IO_BUF, io->out.data);
+  if (io->prep)
+    XFREE (MTYPE_BGP_IO_BUF, io->prep);
+  XFREE (MTYPE_BGP_IO, io);
+  bgp_io_count--;
+}
+
+/* Main thread: act on what the I/O thread reported. */
+static int
+bgp_io_ready_process (struct thread *thread)
+{
+  struct bgp_io *io;
+  struct peer *peer;
+  int events;
+
+  t_bgp_io_ready = thread_add_read (master, bgp_io_ready_process, NULL,
+				    bgp_io_wake_main[0]);
+  bgp_io_drain (&bgp_io_main_pending, bgp_io_wake_main[0]);
+
+  while (bgp_io_ready_tail
+	 != __atomic_load_n (&bgp_io_ready_head, __ATOMIC_SEQ_CST))
+    {
+      io = bgp_io_ready[bgp_io_ready_tail++ & (bgp_io_ready_size - 1)];
+      events = __atomic_exchange_n (&io->events, 0, __ATOMIC_SEQ_CST);
+
+      if ((peer = io->peer) == NULL)
+	{
+	  bgp_io_free (io);
+	  continue;
+	}
+
+      if (events & BGP_IO_EV_KEEPALIVE)
+	peer->keepalive_out += __atomic_exchange_n (&io->keepalives, 0,
+						    __ATOMIC_SEQ_CST);
+      if (events & (BGP_IO_EV_READ | BGP_IO_EV_ERROR))
+	BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+      if (events & BGP_IO_EV_SPACE)
+	BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+    }
+
+  return 0;
+}
+
+/* Start the parse workers, by default one for each processor not
+   taken by the main thread.  Without any, the main thread parses. */
+static void
+bgp_parse_start (void)
+{
+  int n = bgp_parse_threads;
+  int ret;
+
+  if (n < 0)
+    n = sysconf (_SC_NPROCESSORS_ONLN) - 1;
+  if (n > BGP_PARSE_THREADS_MAX)
+    n = BGP_PARSE_THREADS_MAX;
+
+  for (bgp_parse_running = 0; bgp_parse_running < n; bgp_parse_running++)
+    {
+      ret = pthread_create (&bgp_parse_thread_id[bgp_parse_running], NULL,
+			    bgp_parse_thread, NULL);
+      if (ret)
+	{
+	  zlog_err ("Can't start BGP parse thread: %s", safe_strerror (ret));
+	  break;
+	}
+    }
+}
+
+static void
+bgp_parse_finish (void)
+{
+  int i;
+
+  pthread_mutex_lock (&bgp_parse_mutex);
+  bgp_parse_stop = 1;
+  pthread_cond_broadcast (&bgp_parse_cond);
+  pthread_mutex_unlock (&bgp_parse_mutex);
+
+  for (i = 0; i < bgp_parse_running; i++)
+    pthread_join (bgp_parse_thread_id[i], NULL);
+  bgp_parse_running = 0;
+  bgp_parse_stop = 0;
+}
+
+/* Number of UPDATE parse workers, -1 for one per spare processor.
+   Takes effect when the I/O thread starts. */
+void
+bgp_io_parse_threads_set (int n)
+{
+  bgp_parse_threads = n;
+}
+
+static int
+bgp_io_start (void)
+{
+  sigset_t all, old;
+  int ret;
+
+  if (pipe (bgp_io_wake_thread) < 0)
+    goto fail;
+  if (pipe (bgp_io_wake_main) < 0)
+    {
+      close (bgp_io_wake_thread[0]);
+      close (bgp_io_wake_thread[1]);
+      goto fail;
+    }
+  set_nonblocking (bgp_io_wake_thread[0]);
+  set_nonblocking (bgp_io_wake_thread[1]);
+  set_nonblocking (bgp_io_wake_main[0]);
+  set_nonblocking (bgp_io_wake_main[1]);
+
+  /* Signals are for the main thread. */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  ret = pthread_create (&bgp_io_thread_id, NULL, bgp_io_thread, NULL);
+  if (ret == 0)
+    bgp_parse_start ();
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+  if (ret)
+    {
+      errno = ret;
+      close (bgp_io_wake_thread[0]);
+      close (bgp_io_wake_thread[1]);
+      close (bgp_io_wake_main[0]);
+      close (bgp_io_wake_main[1]);
+      goto fail;
+    }
+
+  t_bgp_io_ready = thread_add_read (master, bgp_io_ready_process, NULL,
+				    bgp_io_wake_main[0]);
+  bgp_io_running = 1;
+  return 0;
+
+ fail:
+  zlog_err ("Can't start the BGP I/O thread, doing I/O in bgpd itself: %s",
+	    safe_strerror (errno));
+  bgp_io_disabled = 1;
+  return -1;
+}
+
+/* Hand the socket of an Established peer over to the I/O thread.  */
+void
+bgp_io_register (struct peer *peer)
+{
+  struct bgp_io *io;
+  struct bgp_io **ready;
+  struct stream *s;
+  size_t len, i;
+
+  if (peer->io || peer->fd < 0 || bgp_io_disabled)
+    return;
+  if (! bgp_io_running && bgp_io_start () < 0)
+    return;
+
+  BGP_READ_OFF (peer->t_read);
+  BGP_WRITE_OFF (peer->t_write);
+
+  io = XCALLOC (MTYPE_BGP_IO, sizeof (struct bgp_io));
+  io->in.data = XMALLOC (MTYPE_BGP_IO_BUF, BGP_IO_RING_SIZE);
+  io->out.data = XMALLOC (MTYPE_BGP_IO_BUF, BGP_IO_RING_SIZE);
+  io->peer = peer;
+  io->fd = peer->fd;
+  if (bgp_parse_running)
+    {
+      io->prep = XCALLOC (MTYPE_BGP_IO_BUF,
+			  BGP_IO_PREP_SIZE * sizeof (struct bgp_update_parsed *));
+      io->as4 = CHECK_FLAG (peer->cap, PEER_CAP_AS4_RCV) ? 1 : 0;
+    }
+  if (peer->v_holdtime)
+    io->v_keepalive = peer->v_keepalive * 1000;
+  io->last_write = bgp_io_now ();
+  io->last_read = io->last_write / 1000;
+
+  /* Carry over a message bgp_read() has read in part, and the rest of
+     one bgp_write() has written in part. */
+  len = stream_get_endp (peer->ibuf);
+  memcpy (io->in.data, STREAM_DATA (peer->ibuf), len);
+  io->in_unpub = len;
+  stream_reset (peer->ibuf);
+  peer->packet_size = 0;
+
+  s = stream_fifo_head (peer->obuf);
+  if (s && stream_get_getp (s))
+    {
+      len = stream_get_endp (s) - stream_get_getp (s);
+      memcpy (io->out.data, STREAM_PNT (s), len);
+      io->out.head = len;
+      io->out_msg_left = len;
+      stream_free (stream_fifo_pop (peer->obuf));
+    }
+
+  pthread_mutex_lock (&bgp_io_mutex);
+  pthread_mutex_lock (&bgp_io_ready_mutex);
+  if (bgp_io_count + 1 > bgp_io_ready_size)
+    {
+      len = bgp_io_ready_size ? bgp_io_ready_size * 2 : 16;
+      ready = XCALLOC (MTYPE_BGP_IO, len * sizeof (struct bgp_io *));
+      for (i = 0; bgp_io_ready_tail + i != bgp_io_ready_head; i++)
+	ready[i] = bgp_io_ready[(bgp_io_ready_tail + i)
+	                        & (bgp_io_ready_size - 1)];
+      if (bgp_io_ready)
+	XFREE (MTYPE_BGP_IO, bgp_io_ready);
+      bgp_io_ready = ready;
+      bgp_io_ready_size = len;
+      bgp_io_ready_tail = 0;
+      bgp_io_ready_head = i;
+    }
+  bgp_io_count++;
+  pthread_mutex_unlock (&bgp_io_ready_mutex);
+  io->next = bgp_io_list;
+  bgp_io_list = io;
+  bgp_io_gen++;
+  pthread_mutex_unlock (&bgp_io_mutex);
+
+  peer->io = io;
+  bgp_io_wake (&bgp_io_thread_pending, bgp_io_wake_thread[1]);
+
+  if (stream_fifo_head (peer->obuf))
+    BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+}
+
+/* Best effort at writing out what the thread left, so that a
+   NOTIFICATION queued last still goes out.  The socket is nonblocking,
+   whatever does not fit now is dropped. */
+static void
+bgp_io_flush (struct bgp_io *io)
+{
+  size_t tail, chunk;
+  ssize_t nbytes;
+
+  if (io->stopped)
+    return;
+
+  if (io->ka_left && ! io->out_msg_left)
+    {
+      nbytes = write (io->fd,
+		      bgp_io_keepalive + BGP_HEADER_SIZE - io->ka_left,
+		      io->ka_left);
+      if (nbytes != (ssize_t) io->ka_left)
+	return;
+      io->keepalives++;
+    }
+
+  for (tail = io->out.tail; tail != io->out.head; tail += nbytes)
+    {
+      chunk = BGP_IO_RING_SIZE - (tail & BGP_IO_RING_MASK);
+      if (chunk > io->out.head - tail)
+	chunk = io->out.head - tail;
+      nbytes = write (io->fd, io->out.data + (tail & BGP_IO_RING_MASK), chunk);
+      if (nbytes <= 0)
+	return;
+    }
+}
+
+/* Take the socket back from the I/O thread, before it is closed or
+   written to directly.  Messages not processed yet are dropped, the
+   session is going down. */
+void
+bgp_io_unregister (struct peer *peer)
+{
+  struct bgp_io *io = peer->io;
+  struct bgp_io **iop;
+
+  if (! io)
+    return;
+
+  BGP_READ_OFF (peer->t_read);
+  BGP_WRITE_OFF (peer->t_write);
+
+  /* Once the thread has built its poll set without the socket, it will
+     not look at it again. */
+  pthread_mutex_lock (&bgp_io_mutex);
+  for (iop = &bgp_io_list; *iop != io; iop = &(*iop)->next)
+    ;
+  *iop = io->next;
+  bgp_io_gen++;
+  bgp_io_wake (&bgp_io_thread_pending, bgp_io_wake_thread[1]);
+  while (bgp_io_gen_seen != bgp_io_gen)
+    pthread_cond_wait (&bgp_io_cond, &bgp_io_mutex);
+  pthread_mutex_unlock (&bgp_io_mutex);
+
+  if (io->prep)
+    bgp_parse_detach (io);
+  bgp_io_flush (io);
+  peer->keepalive_out += io->keepalives;
+  io->keepalives = 0;
+
+  peer->io = NULL;
+  io->peer = NULL;
+
+  /* Still queued for the main thread, freed when it comes up. */
+  if (! io->events)
+    bgp_io_free (io);
+}
+
+/* Move the next message received into S, and its decoded form into
+   PARSED if a worker decoded it.  Returns 1 if there was one, 0 if
+   not, or -1 with errno set (0 for an orderly close) when there will
+   not be any more. */
+int
+bgp_io_read (struct peer *peer, struct stream *s,
+	     struct bgp_update_parsed **parsed)
+{
+  struct bgp_io *io = peer->io;
+  size_t head, tail, len, first;
+
+  *parsed = NULL;
+  tail = io->in.tail;
+  head = __atomic_load_n (&io->in.head, __ATOMIC_ACQUIRE);
+  if (head == tail)
+    {
+      if (__atomic_load_n (&io->failed, __ATOMIC_ACQUIRE))
+	{
+	  errno = io->error;
+	  return -1;
+	}
+      return 0;
+    }
+
+  /* Not parsed yet, the worker will say when. */
+  if (io->prep)
+    {
+      if (__atomic_load_n (&io->in_parsed, __ATOMIC_ACQUIRE) == tail)
+	return 0;
+      *parsed = io->prep[io->prep_tail++ & BGP_IO_PREP_MASK];
+    }
+
+  len = bgp_io_msg_len (&io->in, tail);
+  first = BGP_IO_RING_SIZE - (tail & BGP_IO_RING_MASK);
+  if (first > len)
+    first = len;
+
+  stream_reset (s);
+  stream_put (s, io->in.data + (tail & BGP_IO_RING_MASK), first);
+  if (len > first)
+    stream_put (s, io->in.data, len - first);
+
+  __atomic_store_n (&io->in.tail, tail + len, __ATOMIC_SEQ_CST);
+  if (__atomic_exchange_n (&io->in_full, 0, __ATOMIC_SEQ_CST))
+    bgp_io_wake (&bgp_io_thread_pending, bgp_io_wake_thread[1]);
+
+  return 1;
+}
+
+/* Queue the unsent part of S for the thread to write.  Returns the
+   number of bytes queued, or -1 with errno EAGAIN if there is no room;
+   the write thread is then called again once there is. */
+int
+bgp_io_write (struct peer *peer, struct stream *s)
+{
+  struct bgp_io *io = peer->io;
+  size_t head, tail, len, first;
+
+  len = stream_get_endp (s) - stream_get_getp (s);
+  head = io->out.head;
+  tail = __atomic_load_n (&io->out.tail, __ATOMIC_ACQUIRE);
+  if (BGP_IO_RING_SIZE - (head - tail) < len)
+    {
+      __atomic_store_n (&io->out_full, 1, __ATOMIC_SEQ_CST);
+      tail = __atomic_load_n (&io->out.tail, __ATOMIC_SEQ_CST);
+      if (BGP_IO_RING_SIZE - (head - tail) < len)
+	{
+	  errno = EAGAIN;
+	  return -1;
+	}
+      __atomic_store_n (&io->out_full, 0, __ATOMIC_SEQ_CST);
+    }
+
+  first = BGP_IO_RING_SIZE - (head & BGP_IO_RING_MASK);
+  if (first > len)
+    first = len;
+  memcpy (io->out.data + (head & BGP_IO_RING_MASK), STREAM_PNT (s), first);
+  if (len > first)
+    memcpy (io->out.data, STREAM_PNT (s) + first, len - first);
+
+  __atomic_store_n (&io->out.head, head + len, __ATOMIC_SEQ_CST);
+  if (__atomic_exchange_n (&io->out_idle, 0, __ATOMIC_SEQ_CST))
+    bgp_io_wake (&bgp_io_thread_pending, bgp_io_wake_thread[1]);
+
+  return len;
+}
+
+/* Seconds until the hold time expires, going by the messages the
+   thread has received rather than those processed so far. */
+int
+bgp_io_holdtime_left (struct peer *peer)
+{
+  time_t last;
+
+  last = __atomic_load_n (&peer->io->last_read, __ATOMIC_ACQUIRE);
+  return (int) peer->v_holdtime - (int) (bgp_io_now () / 1000 - last);
+}
+
+/* Stop the thread; all peers must have been stopped already. */
+void
+bgp_io_finish (void)
+{
+  struct bgp_io *io;
+
+  if (! bgp_io_running)
+    return;
+
+  pthread_mutex_lock (&bgp_io_mutex);
+  bgp_io_stop = 1;
+  pthread_mutex_unlock (&bgp_io_mutex);
+  bgp_io_wake (&bgp_io_thread_pending, bgp_io_wake_thread[1]);
+  pthread_join (bgp_io_thread_id, NULL);
+  bgp_parse_finish ();
+
+  THREAD_OFF (t_bgp_io_ready);
+  while (bgp_io_ready_tail != bgp_io_ready_head)
+    {
+      io = bgp_io_ready[bgp_io_ready_tail++ & (bgp_io_ready_size - 1)];
+      if (io->peer == NULL)
+	bgp_io_free (io);
+    }
+  if (bgp_io_ready)
+    XFREE (MTYPE_BGP_IO, bgp_io_ready);
+  bgp_io_ready_size = 0;
+
+  close (bgp_io_wake_thread[0]);
+  close (bgp_io_wake_thread[1]);
+  close (bgp_io_wake_main[0]);
+  close (bgp_io_wake_main[1]);
+  bgp_io_running = 0;
+  bgp_io_stop = 0;
+}
+
+#else /* ! HAVE_PTHREADS || ! HAVE_CLOCK_MONOTONIC */
+
+void
+bgp_io_register (struct peer *peer)
+{
+}
+
+void
+bgp_io_unregister (struct peer *peer)
+{
+}
+
+int
+bgp_io_read (struct peer *peer, struct stream *s,
+	     struct bgp_update_parsed **parsed)
+{
+  *parsed = NULL;
+  return 0;
+}
+
+int
+bgp_io_write (struct peer *peer, struct stream *s)
+{
+  errno = EAGAIN;
+  return -1;
+}
+
+int
+bgp_io_holdtime_left (struct peer *peer)
+{
+  return 0;
+}
+
+void
+bgp_io_finish (void)
+{
+}
+
+void
+bgp_io_parse_threads_set (int n)
+{
+}
+
+#endif /* HAVE_PTHREADS && HAVE_CLOCK_MONOTONIC */
@@ -0,0 +1,51 @@
+/*
+ * BGP packet I/O thread
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_IO_H
+#define _QUAGGA_BGP_IO_H
+
+/* Once a session is Established its socket is handed to a separate
+   thread, which reads and frames messages, writes whatever the main
+   thread queued and sends the KEEPALIVEs.  Messages travel between
+   the two threads through a pair of single producer, single consumer
+   byte rings per peer; neither side takes a lock to use them.  While
+   peer->io is set, BGP_READ_ON and BGP_WRITE_ON schedule events
+   instead of watching the socket, bgp_read() takes messages from
+   bgp_io_read() and bgp_write() hands them to bgp_io_write().
+
+   UPDATEs can be decoded by a pool of parse workers on the way, see
+   bgp_parse.h.
+
+   Without thread support all of this compiles to nothing and
+   peer->io is never set. */
+struct bgp_io;
+struct bgp_update_parsed;
+
+extern void bgp_io_register (struct peer *);
+extern void bgp_io_unregister (struct peer *);
+extern int bgp_io_read (struct peer *, struct stream *,
+			struct bgp_update_parsed **);
+extern int bgp_io_write (struct peer *, struct stream *);
+extern int bgp_io_holdtime_left (struct peer *);
+extern void bgp_io_finish (void);
+extern void bgp_io_parse_threads_set (int);
+
+#endif /* _QUAGGA_BGP_IO_H */
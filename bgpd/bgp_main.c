@@ -49,6 +49,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_debug.h"
 #include "bgpd/bgp_filter.h"
 #include "bgpd/bgp_zebra.h"
+#include "bgpd/bgp_io.h"
+#include "bgpd/bgp_select.h"
 
 /* bgpd options, we use GNU getopt library. */
 static const struct option longopts[] = 
@@ -67,6 +69,8 @@ static const struct option longopts[] =
   { "group",       required_argument, NULL, 'g'},
   { "version",     no_argument,       NULL, 'v'},
   { "dryrun",      no_argument,       NULL, 'C'},
+  { "parse_threads", required_argument, NULL, 'T'},
+  { "select_threads", required_argument, NULL, 'S'},
   { "help",        no_argument,       NULL, 'h'},
   { 0 }
 };
@@ -164,6 +168,8 @@ redistribution between different routing protocols.\n\n\
 -g, --group        Group to run as\n\
 -v, --version      Print program version\n\
 -C, --dryrun       Check configuration for validity and exit\n\
+-T, --parse_threads Set number of UPDATE parsing threads\n\
+-S, --select_threads Set number of best path selection threads\n\
 -h, --help         Display this help and exit\n\
 \n\
 Report bugs to %s\n", progname, ZEBRA_BUG_ADDRESS);
@@ -237,6 +243,10 @@ bgp_exit (int status)
     bgp_delete (bgp);
   list_free (bm->bgp);
 
+  /* all peers are stopped, so is the I/O thread */
+  bgp_io_finish ();
+  bgp_select_finish ();
+
   /* reverse bgp_master_init */
   for (ALL_LIST_ELEMENTS_RO(bm->listen_sockets, node, socket))
     {
@@ -343,7 +353,7 @@ main (int argc, char **argv)
   /* Command line argument treatment. */
   while (1) 
     {
-      opt = getopt_long (argc, argv, "df:i:z:hp:l:A:P:rnu:g:vC", longopts, 0);
+      opt = getopt_long (argc, argv, "df:i:z:hp:l:A:P:rnu:g:vCT:S:", longopts, 0);
     
       if (opt == EOF)
 	break;
@@ -389,6 +399,12 @@ main (int argc, char **argv)
 	case 'r':
 	  retain_mode = 1;
 	  break;
+	case 'T':
+	  bgp_io_parse_threads_set (atoi (optarg));
+	  break;
+	case 'S':
+	  bgp_select_threads_set (atoi (optarg));
+	  break;
 	case 'l':
 	  bm->address = optarg;
 	  /* listenon implies -n */
@@ -41,11 +41,6 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "zebra/rib.h"
 #include "zebra/zserv.h"	/* For ZEBRA_SERV_PATH. */
 
-struct bgp_nexthop_cache *zlookup_query (struct in_addr);
-#ifdef HAVE_IPV6
-struct bgp_nexthop_cache *zlookup_query_ipv6 (struct in6_addr *);
-#endif /* HAVE_IPV6 */
-
 /* Only one BGP scan thread are activated at the same time. */
 static struct thread *bgp_scan_thread = NULL;
 
@@ -60,8 +55,6 @@ static int bgp_import_interval;
 
 /* Route table for next-hop lookup cache. */
 static struct bgp_table *bgp_nexthop_cache_table[AFI_MAX];
-static struct bgp_table *cache1_table[AFI_MAX];
-static struct bgp_table *cache2_table[AFI_MAX];
 
 /* Route table for connected route. */
 static struct bgp_table *bgp_connected_table[AFI_MAX];
@@ -69,6 +62,9 @@ static struct bgp_table *bgp_connected_table[AFI_MAX];
 /* BGP nexthop lookup query client. */
 struct zclient *zlookup = NULL;
 
+/* Zebra client nexthops are registered with, see bgp_zebra.c. */
+extern struct zclient *zclient;
+
 /* Add nexthop to the end of the list.  */
 static void
 bnc_nexthop_add (struct bgp_nexthop_cache *bnc, struct nexthop *nexthop)
@@ -219,126 +215,171 @@ bgp_nexthop_onlink (afi_t afi, struct attr *attr)
   return 0;
 }
 
-#ifdef HAVE_IPV6
-/* Check specified next-hop is reachable or not. */
-static int
-bgp_nexthop_lookup_ipv6 (struct peer *peer, struct bgp_info *ri, int *changed,
-			 int *metricchanged)
+/* Nexthop tracking.  Each nexthop address used by a BGP path has a
+   cache entry, registered with zebra when created.  Zebra sends a
+   ZEBRA_NEXTHOP_UPDATE whenever the route resolving the address
+   changes and only the paths linked to that entry are re-evaluated. */
+
+static void
+bgp_nexthop_register (int command, struct prefix *p)
+{
+  struct stream *s;
+
+  if (! zclient || zclient->sock < 0)
+    return;
+
+  s = zclient->obuf;
+  stream_reset (s);
+  zclient_create_header (s, command);
+  stream_putc (s, p->family);
+  stream_put (s, &p->u.prefix, prefix_blen (p));
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  zclient_send_message (zclient);
+}
+
+/* Zebra forgets registrations with the connection; register every
+   cached nexthop again once it is back. */
+void
+bgp_nexthop_register_all (void)
 {
   struct bgp_node *rn;
-  struct prefix p;
-  struct bgp_nexthop_cache *bnc;
-  struct attr *attr;
-  
-  /* If lookup is not enabled, return valid. */
-  if (zlookup->sock < 0)
+  afi_t afi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    if (bgp_nexthop_cache_table[afi])
+      for (rn = bgp_table_top (bgp_nexthop_cache_table[afi]); rn;
+	   rn = bgp_route_next (rn))
+	if (rn->info)
+	  bgp_nexthop_register (ZEBRA_NEXTHOP_REGISTER, &rn->p);
+}
+
+/* Store in P the address RI's nexthop is tracked under.  Return 0 if
+   the nexthop is not tracked. */
+static int
+bgp_nexthop_key (afi_t afi, struct bgp_info *ri, struct prefix *p)
+{
+  memset (p, 0, sizeof (struct prefix));
+
+  if (afi == AFI_IP)
     {
-      if (ri->extra)
-        ri->extra->igpmetric = 0;
+      p->family = AF_INET;
+      p->prefixlen = IPV4_MAX_BITLEN;
+      p->u.prefix4 = ri->attr->nexthop;
       return 1;
     }
-  
-  /* Only check IPv6 global address only nexthop. */
-  attr = ri->attr;
+#ifdef HAVE_IPV6
+  if (afi == AFI_IP6)
+    {
+      struct attr_extra *extra = ri->attr->extra;
 
-  if (attr->extra->mp_nexthop_len != 16 
-      || IN6_IS_ADDR_LINKLOCAL (&attr->extra->mp_nexthop_global))
-    return 1;
+      /* Only check IPv6 global address only nexthop. */
+      if (! extra || extra->mp_nexthop_len != 16
+	  || IN6_IS_ADDR_LINKLOCAL (&extra->mp_nexthop_global))
+	return 0;
 
-  memset (&p, 0, sizeof (struct prefix));
-  p.family = AF_INET6;
-  p.prefixlen = IPV6_MAX_BITLEN;
-  p.u.prefix6 = attr->extra->mp_nexthop_global;
+      p->family = AF_INET6;
+      p->prefixlen = IPV6_MAX_BITLEN;
+      p->u.prefix6 = extra->mp_nexthop_global;
+      return 1;
+    }
+#endif /* HAVE_IPV6 */
+  return 0;
+}
 
-  /* IBGP or ebgp-multihop */
-  rn = bgp_node_get (bgp_nexthop_cache_table[AFI_IP6], &p);
+/* Drop RI from the paths of its nexthop cache entry, freeing the entry
+   once nothing uses it. */
+void
+bgp_nexthop_unlink (struct bgp_info *ri)
+{
+  struct bgp_nexthop_cache *bnc = ri->nexthop;
+  struct bgp_node *rn;
 
-  if (rn->info)
-    {
-      bnc = rn->info;
-      bgp_unlock_node (rn);
-    }
+  if (! bnc)
+    return;
+
+  if (ri->nh_next)
+    ri->nh_next->nh_prev = ri->nh_prev;
+  if (ri->nh_prev)
+    ri->nh_prev->nh_next = ri->nh_next;
   else
-    {
-      if (NULL == (bnc = zlookup_query_ipv6 (&attr->extra->mp_nexthop_global)))
-	bnc = bnc_new ();
-      else
-	{
-	  if (changed)
-	    {
-	      struct bgp_table *old;
-	      struct bgp_node *oldrn;
+    bnc->paths = ri->nh_next;
+  ri->nexthop = NULL;
+  ri->nh_next = ri->nh_prev = NULL;
+  bnc->path_count--;
 
-	      if (bgp_nexthop_cache_table[AFI_IP6] == cache1_table[AFI_IP6])
-		old = cache2_table[AFI_IP6];
-	      else
-		old = cache1_table[AFI_IP6];
+  if (bnc->paths)
+    return;
 
-	      oldrn = bgp_node_lookup (old, &p);
-	      if (oldrn)
-		{
-		  struct bgp_nexthop_cache *oldbnc = oldrn->info;
+  rn = bnc->node;
+  bgp_nexthop_register (ZEBRA_NEXTHOP_UNREGISTER, &rn->p);
+  bnc_free (bnc);
+  rn->info = NULL;
+  bgp_unlock_node (rn);
+}
 
-		  bnc->changed = bgp_nexthop_cache_different (bnc, oldbnc);
+static void
+bgp_nexthop_link (struct bgp_nexthop_cache *bnc, struct bgp_info *ri)
+{
+  if (ri->nexthop == bnc)
+    return;
 
-		  if (bnc->metric != oldbnc->metric)
-		    bnc->metricchanged = 1;
+  bgp_nexthop_unlink (ri);
 
-                  bgp_unlock_node (oldrn);
-		}
-	    }
-	}
-      rn->info = bnc;
-    }
+  ri->nexthop = bnc;
+  ri->nh_prev = NULL;
+  ri->nh_next = bnc->paths;
+  if (bnc->paths)
+    bnc->paths->nh_prev = ri;
+  bnc->paths = ri;
+  bnc->path_count++;
+}
 
-  if (changed)
-    *changed = bnc->changed;
+/* Whether RI is usable given what is known about its nexthop. */
+static int
+bgp_nexthop_path_valid (afi_t afi, struct bgp_nexthop_cache *bnc,
+			struct bgp_info *ri)
+{
+  int valid;
+
+  /* Single-hop EBGP nexthops must be on a connected network. */
+  if (ri->peer->sort == BGP_PEER_EBGP && ri->peer->ttl == 1
+      && ! CHECK_FLAG (ri->peer->flags, PEER_FLAG_DISABLE_CONNECTED_CHECK))
+    return bgp_nexthop_onlink (afi, ri->attr);
 
-  if (metricchanged)
-    *metricchanged = bnc->metricchanged;
+  /* Until zebra has answered, trust the nexthop if there is no zebra
+     to ask. */
+  if (bnc->answered)
+    valid = bnc->valid;
+  else
+    valid = (! zclient || zclient->sock < 0);
 
-  if (bnc->valid && bnc->metric)
+  if (valid && bnc->metric)
     (bgp_info_extra_get (ri))->igpmetric = bnc->metric;
   else if (ri->extra)
     ri->extra->igpmetric = 0;
 
-  return bnc->valid;
+  return valid;
 }
-#endif /* HAVE_IPV6 */
 
-/* Check specified next-hop is reachable or not. */
+/* Check specified next-hop is reachable or not, and keep track of it
+   from now on. */
 int
-bgp_nexthop_lookup (afi_t afi, struct peer *peer, struct bgp_info *ri,
-		    int *changed, int *metricchanged)
+bgp_nexthop_lookup (afi_t afi, struct bgp_info *ri)
 {
   struct bgp_node *rn;
   struct prefix p;
   struct bgp_nexthop_cache *bnc;
-  struct in_addr addr;
-  
-  /* If lookup is not enabled, return valid. */
-  if (zlookup->sock < 0)
+
+  if (! bgp_nexthop_key (afi, ri, &p))
     {
+      bgp_nexthop_unlink (ri);
       if (ri->extra)
-        ri->extra->igpmetric = 0;
+	ri->extra->igpmetric = 0;
       return 1;
     }
-  
-#ifdef HAVE_IPV6
-  if (afi == AFI_IP6)
-    return bgp_nexthop_lookup_ipv6 (peer, ri, changed, metricchanged);
-#endif /* HAVE_IPV6 */
-
-  addr = ri->attr->nexthop;
-
-  memset (&p, 0, sizeof (struct prefix));
-  p.family = AF_INET;
-  p.prefixlen = IPV4_MAX_BITLEN;
-  p.u.prefix4 = addr;
-
-  /* IBGP or ebgp-multihop */
-  rn = bgp_node_get (bgp_nexthop_cache_table[AFI_IP], &p);
 
+  rn = bgp_node_get (bgp_nexthop_cache_table[afi], &p);
   if (rn->info)
     {
       bnc = rn->info;
@@ -346,49 +387,174 @@ bgp_nexthop_lookup (afi_t afi, struct peer *peer, struct bgp_info *ri,
     }
   else
     {
-      if (NULL == (bnc = zlookup_query (addr)))
-	bnc = bnc_new ();
+      bnc = bnc_new ();
+      bnc->node = rn;
+      rn->info = bnc;
+      bgp_nexthop_register (ZEBRA_NEXTHOP_REGISTER, &p);
+    }
+
+  bgp_nexthop_link (bnc, ri);
+
+  return bgp_nexthop_path_valid (afi, bnc, ri);
+}
+
+/* Re-evaluate a path after the resolution of its nexthop changed. */
+static void
+bgp_nexthop_path_update (afi_t afi, struct bgp_nexthop_cache *bnc,
+			 struct bgp_info *ri, int changed)
+{
+  struct bgp_node *rn = ri->net;
+  struct bgp *bgp = ri->peer->bgp;
+  int valid;
+  int current;
+
+  if (! rn || CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+    return;
+
+  valid = bgp_nexthop_path_valid (afi, bnc, ri);
+  current = CHECK_FLAG (ri->flags, BGP_INFO_VALID) ? 1 : 0;
+
+  if (changed)
+    SET_FLAG (ri->flags, BGP_INFO_IGP_CHANGED);
+
+  if (valid != current)
+    {
+      if (CHECK_FLAG (ri->flags, BGP_INFO_VALID))
+	{
+	  bgp_aggregate_decrement (bgp, &rn->p, ri, afi, SAFI_UNICAST);
+	  bgp_info_unset_flag (rn, ri, BGP_INFO_VALID);
+	}
       else
 	{
-	  if (changed)
-	    {
-	      struct bgp_table *old;
-	      struct bgp_node *oldrn;
+	  bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
+	  bgp_aggregate_increment (bgp, &rn->p, ri, afi, SAFI_UNICAST);
+	}
+    }
 
-	      if (bgp_nexthop_cache_table[AFI_IP] == cache1_table[AFI_IP])
-		old = cache2_table[AFI_IP];
-	      else
-		old = cache1_table[AFI_IP];
+  bgp_process (bgp, rn, afi, SAFI_UNICAST);
+}
 
-	      oldrn = bgp_node_lookup (old, &p);
-	      if (oldrn)
-		{
-		  struct bgp_nexthop_cache *oldbnc = oldrn->info;
+/* Read the nexthops of a lookup reply or nexthop update. */
+static void
+bnc_nexthops_read (struct stream *s, struct bgp_nexthop_cache *bnc,
+		   u_char nexthop_num)
+{
+  struct nexthop *nexthop;
+  int i;
 
-		  bnc->changed = bgp_nexthop_cache_different (bnc, oldbnc);
+  for (i = 0; i < nexthop_num; i++)
+    {
+      nexthop = XCALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+      nexthop->type = stream_getc (s);
+      switch (nexthop->type)
+	{
+	case ZEBRA_NEXTHOP_IPV4:
+	  nexthop->gate.ipv4.s_addr = stream_get_ipv4 (s);
+	  break;
+	case ZEBRA_NEXTHOP_IPV4_IFINDEX:
+	  nexthop->gate.ipv4.s_addr = stream_get_ipv4 (s);
+	  nexthop->ifindex = stream_getl (s);
+	  break;
+#ifdef HAVE_IPV6
+	case ZEBRA_NEXTHOP_IPV6:
+	  stream_get (&nexthop->gate.ipv6, s, 16);
+	  break;
+	case ZEBRA_NEXTHOP_IPV6_IFINDEX:
+	case ZEBRA_NEXTHOP_IPV6_IFNAME:
+	  stream_get (&nexthop->gate.ipv6, s, 16);
+	  nexthop->ifindex = stream_getl (s);
+	  break;
+#endif /* HAVE_IPV6 */
+	case ZEBRA_NEXTHOP_IFINDEX:
+	case ZEBRA_NEXTHOP_IFNAME:
+	  nexthop->ifindex = stream_getl (s);
+	  break;
+	default:
+	  /* do nothing */
+	  break;
+	}
+      bnc_nexthop_add (bnc, nexthop);
+    }
+}
 
-		  if (bnc->metric != oldbnc->metric)
-		    bnc->metricchanged = 1;
+/* Zebra tells the resolution of a registered nexthop changed. */
+int
+bgp_nexthop_update (int command, struct zclient *zclient,
+		    zebra_size_t length)
+{
+  struct stream *s;
+  struct prefix p;
+  struct bgp_node *rn;
+  struct bgp_nexthop_cache *bnc;
+  struct bgp_nexthop_cache new;
+  struct bgp_info *ri;
+  struct bgp_info *next;
+  int changed;
+  afi_t afi;
+  char buf[INET6_ADDRSTRLEN];
 
-                  bgp_unlock_node (oldrn);
-		}
-	    }
-	}
-      rn->info = bnc;
+  s = zclient->ibuf;
+
+  memset (&p, 0, sizeof (struct prefix));
+  p.family = stream_getc (s);
+  if (p.family == AF_INET)
+    p.prefixlen = IPV4_MAX_BITLEN;
+#ifdef HAVE_IPV6
+  else if (p.family == AF_INET6)
+    p.prefixlen = IPV6_MAX_BITLEN;
+#endif /* HAVE_IPV6 */
+  else
+    return -1;
+  stream_get (&p.u.prefix, s, prefix_blen (&p));
+  afi = family2afi (p.family);
+
+  memset (&new, 0, sizeof (struct bgp_nexthop_cache));
+  new.metric = stream_getl (s);
+  new.nexthop_num = stream_getc (s);
+  new.valid = (new.nexthop_num != 0);
+  bnc_nexthops_read (s, &new, new.nexthop_num);
+
+  /* May have been unregistered meanwhile. */
+  rn = bgp_node_lookup (bgp_nexthop_cache_table[afi], &p);
+  if (! rn || ! rn->info)
+    {
+      if (rn)
+	bgp_unlock_node (rn);
+      bnc_nexthop_free (&new);
+      return 0;
     }
+  bnc = rn->info;
+  bgp_unlock_node (rn);
 
-  if (changed)
-    *changed = bnc->changed;
+  changed = (bnc->answered && bgp_nexthop_cache_different (bnc, &new));
 
-  if (metricchanged)
-    *metricchanged = bnc->metricchanged;
+  if (bnc->answered && ! changed
+      && bnc->valid == new.valid && bnc->metric == new.metric)
+    {
+      bnc_nexthop_free (&new);
+      return 0;
+    }
 
-  if (bnc->valid && bnc->metric)
-    (bgp_info_extra_get(ri))->igpmetric = bnc->metric;
-  else if (ri->extra)
-    ri->extra->igpmetric = 0;
+  if (BGP_DEBUG (events, EVENTS))
+    zlog_debug ("nexthop %s is %s, metric %u, %lu paths to check",
+		inet_ntop (p.family, &p.u.prefix, buf, sizeof (buf)),
+		new.valid ? "reachable" : "unreachable", new.metric,
+		bnc->path_count);
 
-  return bnc->valid;
+  bnc_nexthop_free (bnc);
+  bnc->nexthop = new.nexthop;
+  bnc->nexthop_num = new.nexthop_num;
+  bnc->metric = new.metric;
+  bnc->valid = new.valid;
+  bnc->answered = 1;
+
+  for (ri = bnc->paths; ri; ri = next)
+    {
+      next = ri->nh_next;
+      bgp_nexthop_path_update (afi, bnc, ri, changed);
+    }
+
+  return 0;
 }
 
 /* Reset and free all BGP nexthop cache. */
@@ -397,16 +563,21 @@ bgp_nexthop_cache_reset (struct bgp_table *table)
 {
   struct bgp_node *rn;
   struct bgp_nexthop_cache *bnc;
+  struct bgp_info *ri;
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
     if ((bnc = rn->info) != NULL)
       {
+	for (ri = bnc->paths; ri; ri = ri->nh_next)
+	  ri->nexthop = NULL;
 	bnc_free (bnc);
 	rn->info = NULL;
 	bgp_unlock_node (rn);
       }
 }
 
+/* Periodic housekeeping which does not depend on nexthops: maximum
+   prefix and dampening timeouts, default-originate route-maps. */
 static void
 bgp_scan (afi_t afi, safi_t safi)
 {
@@ -416,16 +587,7 @@ bgp_scan (afi_t afi, safi_t safi)
   struct bgp_info *next;
   struct peer *peer;
   struct listnode *node, *nnode;
-  int valid;
-  int current;
-  int changed;
-  int metricchanged;
-
-  /* Change cache. */
-  if (bgp_nexthop_cache_table[afi] == cache1_table[afi])
-    bgp_nexthop_cache_table[afi] = cache2_table[afi];
-  else
-    bgp_nexthop_cache_table[afi] = cache1_table[afi];
+  int damped;
 
   /* Get default bgp. */
   bgp = bgp_get_default ();
@@ -446,64 +608,30 @@ bgp_scan (afi_t afi, safi_t safi)
 	bgp_maximum_prefix_overflow (peer, afi, SAFI_MPLS_VPN, 1);
     }
 
-  for (rn = bgp_table_top (bgp->rib[afi][SAFI_UNICAST]); rn;
-       rn = bgp_route_next (rn))
-    {
-      for (bi = rn->info; bi; bi = next)
-	{
-	  next = bi->next;
+  /* Nexthops are tracked by zebra now, the table only needs walking
+     for dampening. */
+  if (CHECK_FLAG (bgp->af_flags[afi][SAFI_UNICAST], BGP_CONFIG_DAMPENING))
+    for (rn = bgp_table_top (bgp->rib[afi][SAFI_UNICAST]); rn;
+	 rn = bgp_route_next (rn))
+      {
+	damped = 0;
+	for (bi = rn->info; bi; bi = next)
+	  {
+	    next = bi->next;
 
-	  if (bi->type == ZEBRA_ROUTE_BGP && bi->sub_type == BGP_ROUTE_NORMAL)
-	    {
-	      changed = 0;
-	      metricchanged = 0;
-
-	      if (bi->peer->sort == BGP_PEER_EBGP && bi->peer->ttl == 1
-		  && !CHECK_FLAG(bi->peer->flags, PEER_FLAG_DISABLE_CONNECTED_CHECK))
-		valid = bgp_nexthop_onlink (afi, bi->attr);
-	      else
-		valid = bgp_nexthop_lookup (afi, bi->peer, bi,
-					    &changed, &metricchanged);
-
-	      current = CHECK_FLAG (bi->flags, BGP_INFO_VALID) ? 1 : 0;
-
-	      if (changed)
-		SET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
-	      else
-		UNSET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
-
-	      if (valid != current)
-		{
-		  if (CHECK_FLAG (bi->flags, BGP_INFO_VALID))
-		    {
-		      bgp_aggregate_decrement (bgp, &rn->p, bi,
-					       afi, SAFI_UNICAST);
-		      bgp_info_unset_flag (rn, bi, BGP_INFO_VALID);
-		    }
-		  else
-		    {
-		      bgp_info_set_flag (rn, bi, BGP_INFO_VALID);
-		      bgp_aggregate_increment (bgp, &rn->p, bi,
-					       afi, SAFI_UNICAST);
-		    }
-		}
-
-              if (CHECK_FLAG (bgp->af_flags[afi][SAFI_UNICAST],
-		  BGP_CONFIG_DAMPENING)
-                  &&  bi->extra && bi->extra->damp_info )
-                if (bgp_damp_scan (bi, afi, SAFI_UNICAST))
+	    if (bi->type == ZEBRA_ROUTE_BGP
+		&& bi->sub_type == BGP_ROUTE_NORMAL
+		&& bi->extra && bi->extra->damp_info)
+	      {
+		damped = 1;
+		if (bgp_damp_scan (bi, afi, SAFI_UNICAST))
 		  bgp_aggregate_increment (bgp, &rn->p, bi,
 					   afi, SAFI_UNICAST);
-	    }
-	}
-      bgp_process (bgp, rn, afi, SAFI_UNICAST);
-    }
-
-  /* Flash old cache. */
-  if (bgp_nexthop_cache_table[afi] == cache1_table[afi])
-    bgp_nexthop_cache_reset (cache2_table[afi]);
-  else
-    bgp_nexthop_cache_reset (cache1_table[afi]);
+	      }
+	  }
+	if (damped)
+	  bgp_process (bgp, rn, afi, SAFI_UNICAST);
+      }
 
   if (BGP_DEBUG (events, EVENTS))
     {
@@ -524,7 +652,7 @@ bgp_scan (afi_t afi, safi_t safi)
     }
 }
 
-/* BGP scan thread.  This thread check nexthop reachability. */
+/* BGP scan thread.  This thread runs the periodic housekeeping. */
 static int
 bgp_scan_timer (struct thread *t)
 {
@@ -782,236 +910,6 @@ bgp_nexthop_self (struct attr *attr)
   return 0;
 }
 
-static struct bgp_nexthop_cache *
-zlookup_read (void)
-{
-  struct stream *s;
-  uint16_t length;
-  u_char marker;
-  u_char version;
-  uint16_t command __attribute__((unused));
-  int nbytes __attribute__((unused));
-  struct in_addr raddr __attribute__((unused));
-  uint32_t metric;
-  int i;
-  u_char nexthop_num;
-  struct nexthop *nexthop;
-  struct bgp_nexthop_cache *bnc;
-
-  s = zlookup->ibuf;
-  stream_reset (s);
-
-  /* nbytes not being checked */
-  nbytes = stream_read (s, zlookup->sock, 2);
-  length = stream_getw (s);
-
-  nbytes = stream_read (s, zlookup->sock, length - 2);
-  marker = stream_getc (s);
-  version = stream_getc (s);
-  
-  if (version != ZSERV_VERSION || marker != ZEBRA_HEADER_MARKER)
-    {
-      zlog_err("%s: socket %d version mismatch, marker %d, version %d",
-               __func__, zlookup->sock, marker, version);
-      return NULL;
-    }
-  
-  /* XXX: not checking command */
-  command = stream_getw (s);
-  
-  /* XXX: not doing anything with raddr */
-  raddr.s_addr = stream_get_ipv4 (s);
-  metric = stream_getl (s);
-  nexthop_num = stream_getc (s);
-
-  if (nexthop_num)
-    {
-      bnc = bnc_new ();
-      bnc->valid = 1;
-      bnc->metric = metric;
-      bnc->nexthop_num = nexthop_num;
-
-      for (i = 0; i < nexthop_num; i++)
-	{
-	  nexthop = XCALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
-	  nexthop->type = stream_getc (s);
-	  switch (nexthop->type)
-	    {
-	    case ZEBRA_NEXTHOP_IPV4:
-	      nexthop->gate.ipv4.s_addr = stream_get_ipv4 (s);
-	      break;
-	    case ZEBRA_NEXTHOP_IPV4_IFINDEX:
-	      nexthop->gate.ipv4.s_addr = stream_get_ipv4 (s);
-	      nexthop->ifindex = stream_getl (s);
-	      break;
-	    case ZEBRA_NEXTHOP_IFINDEX:
-	    case ZEBRA_NEXTHOP_IFNAME:
-	      nexthop->ifindex = stream_getl (s);
-	      break;
-            default:
-              /* do nothing */
-              break;
-	    }
-	  bnc_nexthop_add (bnc, nexthop);
-	}
-    }
-  else
-    return NULL;
-
-  return bnc;
-}
-
-struct bgp_nexthop_cache *
-zlookup_query (struct in_addr addr)
-{
-  int ret;
-  struct stream *s;
-
-  /* Check socket. */
-  if (zlookup->sock < 0)
-    return NULL;
-
-  s = zlookup->obuf;
-  stream_reset (s);
-  zclient_create_header (s, ZEBRA_IPV4_NEXTHOP_LOOKUP);
-  stream_put_in_addr (s, &addr);
-  
-  stream_putw_at (s, 0, stream_get_endp (s));
-  
-  ret = writen (zlookup->sock, s->data, stream_get_endp (s));
-  if (ret < 0)
-    {
-      zlog_err ("can't write to zlookup->sock");
-      close (zlookup->sock);
-      zlookup->sock = -1;
-      return NULL;
-    }
-  if (ret == 0)
-    {
-      zlog_err ("zlookup->sock connection closed");
-      close (zlookup->sock);
-      zlookup->sock = -1;
-      return NULL;
-    }
-
-  return zlookup_read ();
-}
-
-#ifdef HAVE_IPV6
-static struct bgp_nexthop_cache *
-zlookup_read_ipv6 (void)
-{
-  struct stream *s;
-  uint16_t length;
-  u_char version, marker;
-  struct in6_addr raddr;
-  uint32_t metric;
-  int i;
-  u_char nexthop_num;
-  struct nexthop *nexthop;
-  struct bgp_nexthop_cache *bnc;
-
-  s = zlookup->ibuf;
-  stream_reset (s);
-
-  /* XXX: ignoring nbytes, see also zread_lookup */
-  stream_read (s, zlookup->sock, 2);
-  length = stream_getw (s);
-
-  stream_read (s, zlookup->sock, length - 2);
-  marker = stream_getc (s);
-  version = stream_getc (s);
-  
-  if (version != ZSERV_VERSION || marker != ZEBRA_HEADER_MARKER)
-    {
-      zlog_err("%s: socket %d version mismatch, marker %d, version %d",
-               __func__, zlookup->sock, marker, version);
-      return NULL;
-    }
-  
-  /* XXX: ignoring command */  
-  stream_getw (s);
-  
-  /* XXX: not actually doing anything with raddr */
-  stream_get (&raddr, s, 16);
-
-  metric = stream_getl (s);
-  nexthop_num = stream_getc (s);
-
-  if (nexthop_num)
-    {
-      bnc = bnc_new ();
-      bnc->valid = 1;
-      bnc->metric = metric;
-      bnc->nexthop_num = nexthop_num;
-
-      for (i = 0; i < nexthop_num; i++)
-	{
-	  nexthop = XCALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
-	  nexthop->type = stream_getc (s);
-	  switch (nexthop->type)
-	    {
-	    case ZEBRA_NEXTHOP_IPV6:
-	      stream_get (&nexthop->gate.ipv6, s, 16);
-	      break;
-	    case ZEBRA_NEXTHOP_IPV6_IFINDEX:
-	    case ZEBRA_NEXTHOP_IPV6_IFNAME:
-	      stream_get (&nexthop->gate.ipv6, s, 16);
-	      nexthop->ifindex = stream_getl (s);
-	      break;
-	    case ZEBRA_NEXTHOP_IFINDEX:
-	    case ZEBRA_NEXTHOP_IFNAME:
-	      nexthop->ifindex = stream_getl (s);
-	      break;
-	    default:
-	      /* do nothing */
-	      break;
-	    }
-	  bnc_nexthop_add (bnc, nexthop);
-	}
-    }
-  else
-    return NULL;
-
-  return bnc;
-}
-
-struct bgp_nexthop_cache *
-zlookup_query_ipv6 (struct in6_addr *addr)
-{
-  int ret;
-  struct stream *s;
-
-  /* Check socket. */
-  if (zlookup->sock < 0)
-    return NULL;
-
-  s = zlookup->obuf;
-  stream_reset (s);
-  zclient_create_header (s, ZEBRA_IPV6_NEXTHOP_LOOKUP);
-  stream_put (s, addr, 16);
-  stream_putw_at (s, 0, stream_get_endp (s));
-  
-  ret = writen (zlookup->sock, s->data, stream_get_endp (s));
-  if (ret < 0)
-    {
-      zlog_err ("can't write to zlookup->sock");
-      close (zlookup->sock);
-      zlookup->sock = -1;
-      return NULL;
-    }
-  if (ret == 0)
-    {
-      zlog_err ("zlookup->sock connection closed");
-      close (zlookup->sock);
-      zlookup->sock = -1;
-      return NULL;
-    }
-
-  return zlookup_read_ipv6 ();
-}
-#endif /* HAVE_IPV6 */
-
 static int
 bgp_import_check (struct prefix *p, u_int32_t *igpmetric,
                   struct in_addr *igpnexthop)
@@ -1251,6 +1149,33 @@ bgp_multiaccess_check_v4 (struct in_addr nexthop, char *peer)
   return 0;
 }
 
+/* Store in KEY the connected network bgp_multiaccess_check_v4() would
+   find for the peer address PEER, or a zeroed prefix if there is none.
+   Peers with equal keys get the same answer for every nexthop. */
+void
+bgp_multiaccess_key_v4 (char *peer, struct prefix *key)
+{
+  struct bgp_node *rn;
+  struct prefix p;
+  struct in_addr addr;
+
+  memset (key, 0, sizeof (struct prefix));
+
+  if (! inet_aton (peer, &addr) || zlookup->sock < 0)
+    return;
+
+  memset (&p, 0, sizeof (struct prefix));
+  p.family = AF_INET;
+  p.prefixlen = IPV4_MAX_BITLEN;
+  p.u.prefix4 = addr;
+
+  rn = bgp_node_match (bgp_connected_table[AFI_IP], &p);
+  if (! rn)
+    return;
+  prefix_copy (key, &rn->p);
+  bgp_unlock_node (rn);
+}
+
 DEFUN (bgp_scan_time,
        bgp_scan_time_cmd,
        "bgp scan-time <5-60>",
@@ -1297,13 +1222,66 @@ ALIAS (no_bgp_scan_time,
        "Configure background scanner interval\n"
        "Scanner interval (seconds)\n")
 
+static void
+show_ip_bgp_nexthop_table (struct vty *vty, afi_t afi, const char detail)
+{
+  struct bgp_node *rn;
+  struct bgp_nexthop_cache *bnc;
+  struct nexthop *nexthop;
+  char buf[INET6_ADDRSTRLEN];
+
+  for (rn = bgp_table_top (bgp_nexthop_cache_table[afi]); rn;
+       rn = bgp_route_next (rn))
+    if ((bnc = rn->info) != NULL)
+      {
+	inet_ntop (rn->p.family, &rn->p.u.prefix, buf, INET6_ADDRSTRLEN);
+	if (! bnc->answered)
+	  vty_out (vty, " %s pending, %lu paths%s", buf, bnc->path_count,
+		   VTY_NEWLINE);
+	else if (! bnc->valid)
+	  vty_out (vty, " %s invalid, %lu paths%s", buf, bnc->path_count,
+		   VTY_NEWLINE);
+	else
+	  {
+	    vty_out (vty, " %s valid [IGP metric %d], %lu paths%s",
+		     buf, bnc->metric, bnc->path_count, VTY_NEWLINE);
+	    if (detail)
+	      for (nexthop = bnc->nexthop; nexthop; nexthop = nexthop->next)
+		switch (nexthop->type)
+		  {
+		  case NEXTHOP_TYPE_IPV4:
+		    vty_out (vty, "  gate %s%s", inet_ntop (AF_INET, &nexthop->gate.ipv4, buf, INET6_ADDRSTRLEN), VTY_NEWLINE);
+		    break;
+		  case NEXTHOP_TYPE_IPV4_IFINDEX:
+		    vty_out (vty, "  gate %s", inet_ntop (AF_INET, &nexthop->gate.ipv4, buf, INET6_ADDRSTRLEN));
+		    vty_out (vty, " ifidx %u%s", nexthop->ifindex, VTY_NEWLINE);
+		    break;
+#ifdef HAVE_IPV6
+		  case NEXTHOP_TYPE_IPV6:
+		    vty_out (vty, "  gate %s%s", inet_ntop (AF_INET6, &nexthop->gate.ipv6, buf, INET6_ADDRSTRLEN), VTY_NEWLINE);
+		    break;
+		  case NEXTHOP_TYPE_IPV6_IFINDEX:
+		  case NEXTHOP_TYPE_IPV6_IFNAME:
+		    vty_out (vty, "  gate %s", inet_ntop (AF_INET6, &nexthop->gate.ipv6, buf, INET6_ADDRSTRLEN));
+		    vty_out (vty, " ifidx %u%s", nexthop->ifindex, VTY_NEWLINE);
+		    break;
+#endif /* HAVE_IPV6 */
+		  case NEXTHOP_TYPE_IFINDEX:
+		  case NEXTHOP_TYPE_IFNAME:
+		    vty_out (vty, "  ifidx %u%s", nexthop->ifindex, VTY_NEWLINE);
+		    break;
+		  default:
+		    vty_out (vty, "  invalid nexthop type %u%s", nexthop->type, VTY_NEWLINE);
+		  }
+	  }
+      }
+}
+
 static int
 show_ip_bgp_scan_tables (struct vty *vty, const char detail)
 {
   struct bgp_node *rn;
-  struct bgp_nexthop_cache *bnc;
   char buf[INET6_ADDRSTRLEN];
-  u_char i;
 
   if (bgp_scan_thread)
     vty_out (vty, "BGP scan is running%s", VTY_NEWLINE);
@@ -1312,68 +1290,9 @@ show_ip_bgp_scan_tables (struct vty *vty, const char detail)
   vty_out (vty, "BGP scan interval is %d%s", bgp_scan_interval, VTY_NEWLINE);
 
   vty_out (vty, "Current BGP nexthop cache:%s", VTY_NEWLINE);
-  for (rn = bgp_table_top (bgp_nexthop_cache_table[AFI_IP]); rn; rn = bgp_route_next (rn))
-    if ((bnc = rn->info) != NULL)
-      {
-	if (bnc->valid)
-	{
-	  vty_out (vty, " %s valid [IGP metric %d]%s",
-		   inet_ntop (AF_INET, &rn->p.u.prefix4, buf, INET6_ADDRSTRLEN), bnc->metric, VTY_NEWLINE);
-	  if (detail)
-	    for (i = 0; i < bnc->nexthop_num; i++)
-	      switch (bnc->nexthop[i].type)
-	      {
-	      case NEXTHOP_TYPE_IPV4:
-		vty_out (vty, "  gate %s%s", inet_ntop (AF_INET, &bnc->nexthop[i].gate.ipv4, buf, INET6_ADDRSTRLEN), VTY_NEWLINE);
-		break;
-	      case NEXTHOP_TYPE_IPV4_IFINDEX:
-		vty_out (vty, "  gate %s", inet_ntop (AF_INET, &bnc->nexthop[i].gate.ipv4, buf, INET6_ADDRSTRLEN));
-		vty_out (vty, " ifidx %u%s", bnc->nexthop[i].ifindex, VTY_NEWLINE);
-		break;
-	      case NEXTHOP_TYPE_IFINDEX:
-		vty_out (vty, "  ifidx %u%s", bnc->nexthop[i].ifindex, VTY_NEWLINE);
-		break;
-	      default:
-		vty_out (vty, "  invalid nexthop type %u%s", bnc->nexthop[i].type, VTY_NEWLINE);
-	      }
-	}
-	else
-	  vty_out (vty, " %s invalid%s",
-		   inet_ntop (AF_INET, &rn->p.u.prefix4, buf, INET6_ADDRSTRLEN), VTY_NEWLINE);
-      }
-
+  show_ip_bgp_nexthop_table (vty, AFI_IP, detail);
 #ifdef HAVE_IPV6
-  {
-    for (rn = bgp_table_top (bgp_nexthop_cache_table[AFI_IP6]); 
-         rn; 
-         rn = bgp_route_next (rn))
-      if ((bnc = rn->info) != NULL)
-	{
-	  if (bnc->valid)
-	  {
-	    vty_out (vty, " %s valid [IGP metric %d]%s",
-		     inet_ntop (AF_INET6, &rn->p.u.prefix6, buf, INET6_ADDRSTRLEN),
-		     bnc->metric, VTY_NEWLINE);
-	    if (detail)
-	      for (i = 0; i < bnc->nexthop_num; i++)
-		switch (bnc->nexthop[i].type)
-		{
-		case NEXTHOP_TYPE_IPV6:
-		  vty_out (vty, "  gate %s%s", inet_ntop (AF_INET6, &bnc->nexthop[i].gate.ipv6, buf, INET6_ADDRSTRLEN), VTY_NEWLINE);
-		  break;
-		case NEXTHOP_TYPE_IFINDEX:
-		  vty_out (vty, "  ifidx %u%s", bnc->nexthop[i].ifindex, VTY_NEWLINE);
-		  break;
-		default:
-		  vty_out (vty, "  invalid nexthop type %u%s", bnc->nexthop[i].type, VTY_NEWLINE);
-		}
-	  }
-	  else
-	    vty_out (vty, " %s invalid%s",
-		     inet_ntop (AF_INET6, &rn->p.u.prefix6, buf, INET6_ADDRSTRLEN),
-		     VTY_NEWLINE);
-	}
-  }
+  show_ip_bgp_nexthop_table (vty, AFI_IP6, detail);
 #endif /* HAVE_IPV6 */
 
   vty_out (vty, "BGP connected route:%s", VTY_NEWLINE);
@@ -1441,16 +1360,11 @@ bgp_scan_init (void)
   bgp_scan_interval = BGP_SCAN_INTERVAL_DEFAULT;
   bgp_import_interval = BGP_IMPORT_INTERVAL_DEFAULT;
 
-  cache1_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
-  cache2_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
-  bgp_nexthop_cache_table[AFI_IP] = cache1_table[AFI_IP];
-
+  bgp_nexthop_cache_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
   bgp_connected_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
 
 #ifdef HAVE_IPV6
-  cache1_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
-  cache2_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
-  bgp_nexthop_cache_table[AFI_IP6] = cache1_table[AFI_IP6];
+  bgp_nexthop_cache_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
   bgp_connected_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
 #endif /* HAVE_IPV6 */
 
@@ -1473,27 +1387,17 @@ bgp_scan_init (void)
 void
 bgp_scan_finish (void)
 {
-  /* Only the current one needs to be reset. */
   bgp_nexthop_cache_reset (bgp_nexthop_cache_table[AFI_IP]);
-
-  bgp_table_unlock (cache1_table[AFI_IP]);
-  cache1_table[AFI_IP] = NULL;
-
-  bgp_table_unlock (cache2_table[AFI_IP]);
-  cache2_table[AFI_IP] = NULL;
+  bgp_table_unlock (bgp_nexthop_cache_table[AFI_IP]);
+  bgp_nexthop_cache_table[AFI_IP] = NULL;
 
   bgp_table_unlock (bgp_connected_table[AFI_IP]);
   bgp_connected_table[AFI_IP] = NULL;
 
 #ifdef HAVE_IPV6
-  /* Only the current one needs to be reset. */
   bgp_nexthop_cache_reset (bgp_nexthop_cache_table[AFI_IP6]);
-
-  bgp_table_unlock (cache1_table[AFI_IP6]);
-  cache1_table[AFI_IP6] = NULL;
-
-  bgp_table_unlock (cache2_table[AFI_IP6]);
-  cache2_table[AFI_IP6] = NULL;
+  bgp_table_unlock (bgp_nexthop_cache_table[AFI_IP6]);
+  bgp_nexthop_cache_table[AFI_IP6] = NULL;
 
   bgp_table_unlock (bgp_connected_table[AFI_IP6]);
   bgp_connected_table[AFI_IP6] = NULL;
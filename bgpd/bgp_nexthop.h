@@ -22,6 +22,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define _QUAGGA_BGP_NEXTHOP_H
 
 #include "if.h"
+#include "zclient.h"
 
 #define BGP_SCAN_INTERVAL_DEFAULT   60
 #define BGP_IMPORT_INTERVAL_DEFAULT 15
@@ -29,14 +30,14 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 /* BGP nexthop cache value structure. */
 struct bgp_nexthop_cache
 {
+  /* Node in the nexthop cache table, keyed by the address. */
+  struct bgp_node *node;
+
   /* This nexthop exists in IGP. */
   u_char valid;
 
-  /* Nexthop is changed. */
-  u_char changed;
-
-  /* Nexthop is changed. */
-  u_char metricchanged;
+  /* Zebra has told the resolution of the address. */
+  u_char answered;
 
   /* IGP route's metric. */
   u_int32_t metric;
@@ -44,15 +45,22 @@ struct bgp_nexthop_cache
   /* Nexthop number and nexthop linked list.*/
   u_char nexthop_num;
   struct nexthop *nexthop;
+
+  /* Paths using this nexthop, linked through bgp_info nh_next. */
+  struct bgp_info *paths;
+  unsigned long path_count;
 };
 
 extern void bgp_scan_init (void);
 extern void bgp_scan_finish (void);
-extern int bgp_nexthop_lookup (afi_t, struct peer *peer, struct bgp_info *,
-			int *, int *);
+extern int bgp_nexthop_lookup (afi_t, struct bgp_info *);
+extern void bgp_nexthop_unlink (struct bgp_info *);
+extern int bgp_nexthop_update (int, struct zclient *, zebra_size_t);
+extern void bgp_nexthop_register_all (void);
 extern void bgp_connected_add (struct connected *c);
 extern void bgp_connected_delete (struct connected *c);
 extern int bgp_multiaccess_check_v4 (struct in_addr, char *);
+extern void bgp_multiaccess_key_v4 (char *, struct prefix *);
 extern int bgp_config_write_scan_time (struct vty *);
 extern int bgp_nexthop_onlink (afi_t, struct attr *);
 extern int bgp_nexthop_self (struct attr *);
@@ -47,6 +47,9 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_mplsvpn.h"
 #include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_io.h"
+#include "bgpd/bgp_parse.h"
 
 int stream_put_prefix (struct stream *, struct prefix *);
 
@@ -137,34 +140,80 @@ bgp_connect_check (struct peer *peer)
     }
 }
 
+/* Record that the prefix of ADV has been put into an UPDATE and
+   return the next advertisement with the same attribute.  */
+static struct bgp_advertise *
+bgp_update_packet_sync (struct peer *peer, struct bgp_advertise *adv,
+			afi_t afi, safi_t safi)
+{
+  struct bgp_adj_out *adj = adv->adj;
+  struct bgp_node *rn = adv->rn;
+
+  if (BGP_DEBUG (update, UPDATE_OUT))
+    {
+      char buf[INET6_BUFSIZ];
+
+      zlog (peer->log, LOG_DEBUG, "%s send UPDATE %s/%d",
+	    peer->host,
+	    inet_ntop (rn->p.family, &(rn->p.u.prefix), buf, INET6_BUFSIZ),
+	    rn->p.prefixlen);
+    }
+
+  /* Synchnorize attribute.  */
+  if (adj->attr)
+    bgp_attr_unintern (&adj->attr);
+  else
+    peer->scount[afi][safi]++;
+
+  adj->attr = bgp_attr_intern (adv->baa->attr);
+
+  return bgp_advertise_clean (peer, adj, afi, safi);
+}
+
 /* Make BGP update packet.  */
 static struct stream *
 bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 {
   struct stream *s;
   struct stream *snlri;
-  struct bgp_adj_out *adj;
   struct bgp_advertise *adv;
   struct stream *packet;
   struct bgp_node *rn = NULL;
   struct bgp_info *binfo = NULL;
+  struct peer *from = NULL;
+  struct attr *attr = NULL;
   bgp_size_t total_attr_len = 0;
   unsigned long attrlen_pos = 0;
   size_t mpattrlen_pos = 0;
   size_t mpattr_pos = 0;
+  unsigned int count = 0;
+  unsigned int i;
+  static struct bgp_node *packed[BGP_MAX_PACKET_SIZE];
+
+  adv = BGP_ADV_FIFO_HEAD (&peer->sync[afi][safi]->update);
+
+  /* Another member of the update group may have encoded this very
+     UPDATE already. */
+  if (adv
+      && (packet = bgp_updgrp_packet_lookup (peer, afi, safi, adv, &count)))
+    {
+      for (i = 0; i < count; i++)
+	adv = bgp_update_packet_sync (peer, adv, afi, safi);
+
+      bgp_packet_add (peer, packet);
+      BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+      return packet;
+    }
 
   s = peer->work;
   stream_reset (s);
   snlri = peer->scratch;
   stream_reset (snlri);
 
-  adv = BGP_ADV_FIFO_HEAD (&peer->sync[afi][safi]->update);
-
   while (adv)
     {
       assert (adv->rn);
       rn = adv->rn;
-      adj = adv->adj;
       if (adv->binfo)
         binfo = adv->binfo;
 
@@ -176,10 +225,9 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
       /* If packet is empty, set attribute. */
       if (stream_empty (s))
 	{
-	  struct peer *from = NULL;
-
           if (binfo)
 	    from = binfo->peer;
+	  attr = adv->baa->attr;
 
 	  /* 1: Write the BGP message header - 16 bytes marker, 2 bytes length,
 	   * one byte message type.
@@ -224,25 +272,9 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 						    adv->baa->attr);
 	  bgp_packet_mpattr_prefix(snlri, afi, safi, &rn->p, prd, tag);
 	}
-      if (BGP_DEBUG (update, UPDATE_OUT))
-        {
-          char buf[INET6_BUFSIZ];
-
-          zlog (peer->log, LOG_DEBUG, "%s send UPDATE %s/%d",
-                peer->host,
-                inet_ntop (rn->p.family, &(rn->p.u.prefix), buf, INET6_BUFSIZ),
-                rn->p.prefixlen);
-        }
-
-      /* Synchnorize attribute.  */
-      if (adj->attr)
-	bgp_attr_unintern (&adj->attr);
-      else
-	peer->scount[afi][safi]++;
+      packed[count++] = rn;
 
-      adj->attr = bgp_attr_intern (adv->baa->attr);
-
-      adv = bgp_advertise_clean (peer, adj, afi, safi);
+      adv = bgp_update_packet_sync (peer, adv, afi, safi);
     }
 
   if (! stream_empty (s))
@@ -262,6 +294,8 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 	packet = stream_dup (s);
       bgp_packet_set_size (packet);
       bgp_packet_add (peer, packet);
+      bgp_updgrp_packet_add (peer, afi, safi, packet, attr, from,
+			     packed, count);
       BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
       stream_reset (s);
       stream_reset (snlri);
@@ -698,7 +732,8 @@ bgp_write (struct thread *thread)
   if (!s)
     return 0;	/* nothing to send */
 
-  sockopt_cork (peer->fd, 1);
+  if (! peer->io)
+    sockopt_cork (peer->fd, 1);
 
   /* Nonblocking write until TCP output buffer is full.  */
   do
@@ -708,8 +743,11 @@ bgp_write (struct thread *thread)
       /* Number of bytes to be sent.  */
       writenum = stream_get_endp (s) - stream_get_getp (s);
 
-      /* Call write() system call.  */
-      num = write (peer->fd, STREAM_PNT (s), writenum);
+      /* Call write() system call, or queue it for the I/O thread.  */
+      if (peer->io)
+	num = bgp_io_write (peer, s);
+      else
+	num = write (peer->fd, STREAM_PNT (s), writenum);
       if (num < 0)
 	{
 	  /* write failed either retry needed or error */
@@ -770,11 +808,13 @@ bgp_write (struct thread *thread)
   while (++count < BGP_WRITE_PACKET_MAX &&
 	 (s = bgp_write_packet (peer)) != NULL);
   
-  if (bgp_write_proceed (peer))
+  /* With the I/O thread's queue full, wait until it has room. */
+  if (bgp_write_proceed (peer) && ! (peer->io && num < 0))
     BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
 
  done:
-  sockopt_cork (peer->fd, 0);
+  if (! peer->io)
+    sockopt_cork (peer->fd, 0);
   return 0;
 }
 
@@ -792,6 +832,9 @@ bgp_write_notify (struct peer *peer)
     return 0;
   assert (stream_get_endp (s) >= BGP_HEADER_SIZE);
 
+  /* Write it directly, after whatever the I/O thread still had. */
+  bgp_io_unregister (peer);
+
   /* Stop collecting data within the socket */
   sockopt_cork (peer->fd, 0);
 
@@ -1596,6 +1639,20 @@ bgp_open_receive (struct peer *peer, bgp_size_t size)
   return 0;
 }
 
+/* Does the peer run an inbound route-map in any address family? */
+static int
+bgp_peer_rmap_in (struct peer *peer)
+{
+  afi_t afi;
+  safi_t safi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      if (ROUTE_MAP_IN_NAME (&peer->filter[afi][safi]))
+	return 1;
+  return 0;
+}
+
 /* Parse BGP Update packet and make attribute object. */
 static int
 bgp_update_receive (struct peer *peer, bgp_size_t size)
@@ -1612,6 +1669,7 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
   struct bgp_nlri withdraw;
   struct bgp_nlri mp_update;
   struct bgp_nlri mp_withdraw;
+  struct attr *attr_key = NULL;
 
   /* Status must be Established. */
   if (peer->status != Established) 
@@ -1665,9 +1723,13 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
   /* Unfeasible Route packet format check. */
   if (withdraw_len > 0)
     {
-      ret = bgp_nlri_sanity_check (peer, AFI_IP, stream_pnt (s), withdraw_len);
-      if (ret < 0)
-	return -1;
+      if (! bgp_parsed_nlri_valid (peer, stream_pnt (s), withdraw_len))
+	{
+	  ret = bgp_nlri_sanity_check (peer, AFI_IP, stream_pnt (s),
+				       withdraw_len);
+	  if (ret < 0)
+	    return -1;
+	}
 
       if (BGP_DEBUG (packet, PACKET_RECV))
 	zlog_debug ("%s [Update:RECV] Unfeasible NLRI received", peer->host);
@@ -1715,7 +1777,8 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
   /* This define morphs the update case into a withdraw when lower levels
    * have signalled an error condition where this is best.
    */
-#define NLRI_ATTR_ARG (attr_parse_ret != BGP_ATTR_PARSE_WITHDRAW ? &attr : NULL)
+#define NLRI_ATTR_ARG (attr_parse_ret != BGP_ATTR_PARSE_WITHDRAW \
+		       ? (attr_key ? attr_key : &attr) : NULL)
 
   /* Parse attribute when it exists. */
   if (attribute_len)
@@ -1756,11 +1819,15 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
   if (update_len)
     {
       /* Check NLRI packet format and prefix length. */
-      ret = bgp_nlri_sanity_check (peer, AFI_IP, stream_pnt (s), update_len);
-      if (ret < 0)
-        {
-          bgp_attr_unintern_sub (&attr);
-	  return -1;
+      if (! bgp_parsed_nlri_valid (peer, stream_pnt (s), update_len))
+	{
+	  ret = bgp_nlri_sanity_check (peer, AFI_IP, stream_pnt (s),
+				       update_len);
+	  if (ret < 0)
+	    {
+	      bgp_attr_unintern_sub (&attr);
+	      return -1;
+	    }
 	}
 
       /* Set NLRI portion to structure. */
@@ -1771,6 +1838,18 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
       stream_forward_getp (s, update_len);
     }
 
+  /* Interned, the attributes key what inbound route-maps remember of
+     them, for every prefix of the message. */
+  if (attribute_len && attr_parse_ret == BGP_ATTR_PARSE_PROCEED
+      && bgp_peer_rmap_in (peer))
+    attr_key = bgp_attr_intern (&attr);
+
+  /* Use the prefixes a parse worker decoded, if it did. */
+  bgp_parsed_nlri_attach (peer, &withdraw);
+  bgp_parsed_nlri_attach (peer, &update);
+  bgp_parsed_nlri_attach (peer, &mp_update);
+  bgp_parsed_nlri_attach (peer, &mp_withdraw);
+
   /* NLRI is processed only when the peer is configured specific
      Address Family and Subsequent Address Family. */
   if (peer->afc[AFI_IP][SAFI_UNICAST])
@@ -1920,6 +1999,8 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
 
   /* Everything is done.  We unintern temporary structures which
      interned in bgp_attr_parse(). */
+  if (attr_key)
+    bgp_attr_unintern (&attr_key);
   bgp_attr_unintern_sub (&attr);
 
   /* If peering is stopped due to some reason, do not generate BGP
@@ -2375,6 +2456,31 @@ bgp_capability_receive (struct peer *peer, bgp_size_t size)
   return bgp_capability_msg_parse (peer, pnt, size);
 }
 
+/* The connection failed with ERROR, or was closed if that is zero. */
+static void
+bgp_read_fail (struct peer *peer, int error)
+{
+  if (error)
+    plog_err (peer->log, "%s [Error] bgp_read_packet error: %s",
+	      peer->host, safe_strerror (error));
+  else if (BGP_DEBUG (events, EVENTS))
+    plog_debug (peer->log, "%s [Event] BGP connection closed fd %d",
+		peer->host, peer->fd);
+
+  if (peer->status == Established) 
+    {
+      if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
+	{
+	  peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
+	  SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
+	}
+      else
+	peer->last_reset = PEER_DOWN_CLOSE_SESSION;
+    }
+
+  BGP_EVENT_ADD (peer, error ? TCP_fatal_error : TCP_connection_closed);
+}
+
 /* BGP read utility function. */
 static int
 bgp_read_packet (struct peer *peer)
@@ -2398,43 +2504,14 @@ bgp_read_packet (struct peer *peer)
       if (nbytes == -2)
 	return -1;
 
-      plog_err (peer->log, "%s [Error] bgp_read_packet error: %s",
-		 peer->host, safe_strerror (errno));
-
-      if (peer->status == Established) 
-	{
-	  if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
-	    {
-	      peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
-	      SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
-	    }
-	  else
-	    peer->last_reset = PEER_DOWN_CLOSE_SESSION;
-	}
-
-      BGP_EVENT_ADD (peer, TCP_fatal_error);
+      bgp_read_fail (peer, errno);
       return -1;
     }  
 
   /* When read byte is zero : clear bgp peer and return */
   if (nbytes == 0) 
     {
-      if (BGP_DEBUG (events, EVENTS))
-	plog_debug (peer->log, "%s [Event] BGP connection closed fd %d",
-		   peer->host, peer->fd);
-
-      if (peer->status == Established) 
-	{
-	  if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
-	    {
-	      peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
-	      SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
-	    }
-	  else
-	    peer->last_reset = PEER_DOWN_CLOSE_SESSION;
-	}
-
-      BGP_EVENT_ADD (peer, TCP_connection_closed);
+      bgp_read_fail (peer, 0);
       return -1;
     }
 
@@ -2476,6 +2553,7 @@ bgp_read (struct thread *thread)
   struct peer *peer;
   bgp_size_t size;
   char notify_data_length[2];
+  struct bgp_update_parsed *parsed = NULL;
 
   /* Yes first of all get peer pointer. */
   peer = THREAD_ARG (thread);
@@ -2494,6 +2572,19 @@ bgp_read (struct thread *thread)
 	  zlog_err ("bgp_read peer's fd is negative value %d", peer->fd);
 	  return -1;
 	}
+      if (! peer->io)
+	BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+    }
+
+  /* The I/O thread hands over whole messages, take one and give other
+     work a turn before the next. */
+  if (peer->io)
+    {
+      ret = bgp_io_read (peer, peer->ibuf, &parsed);
+      if (ret < 0)
+	bgp_read_fail (peer, errno);
+      if (ret <= 0)
+	goto done;
       BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
     }
 
@@ -2501,13 +2592,16 @@ bgp_read (struct thread *thread)
   if (peer->packet_size == 0)
     peer->packet_size = BGP_HEADER_SIZE;
 
-  if (stream_get_endp (peer->ibuf) < BGP_HEADER_SIZE)
+  if (peer->io || stream_get_endp (peer->ibuf) < BGP_HEADER_SIZE)
     {
-      ret = bgp_read_packet (peer);
+      if (! peer->io)
+	{
+	  ret = bgp_read_packet (peer);
 
-      /* Header read error or partial read packet. */
-      if (ret < 0) 
-	goto done;
+	  /* Header read error or partial read packet. */
+	  if (ret < 0) 
+	    goto done;
+	}
 
       /* Get size and type. */
       stream_forward_getp (peer->ibuf, BGP_MARKER_SIZE);
@@ -2574,9 +2668,12 @@ bgp_read (struct thread *thread)
       peer->packet_size = size;
     }
 
-  ret = bgp_read_packet (peer);
-  if (ret < 0) 
-    goto done;
+  if (! peer->io)
+    {
+      ret = bgp_read_packet (peer);
+      if (ret < 0) 
+	goto done;
+    }
 
   /* Get size and type again. */
   size = stream_getw_from (peer->ibuf, BGP_MARKER_SIZE);
@@ -2596,7 +2693,9 @@ bgp_read (struct thread *thread)
       break;
     case BGP_MSG_UPDATE:
       peer->readtime = bgp_recent_clock ();
+      peer->parsed = parsed;
       bgp_update_receive (peer, size);
+      peer->parsed = NULL;
       break;
     case BGP_MSG_NOTIFY:
       bgp_notify_receive (peer, size);
@@ -2622,6 +2721,7 @@ bgp_read (struct thread *thread)
     stream_reset (peer->ibuf);
 
  done:
+  bgp_update_parsed_free (parsed);
   if (CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
     {
       if (BGP_DEBUG (events, EVENTS))
@@ -0,0 +1,477 @@
+/*
+ * BGP UPDATE message pre-parsing
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "stream.h"
+#include "vty.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_community.h"
+#include "bgpd/bgp_parse.h"
+
+#define BGP_PARSE_GETW(P)	(((P)[0] << 8) | (P)[1])
+#define BGP_PARSE_GETL(P)	(((u_int32_t) (P)[0] << 24) | ((P)[1] << 16) \
+				 | ((P)[2] << 8) | (P)[3])
+
+/* Decode a field of NLRI, checked as bgp_nlri_sanity_check() does. */
+static int
+bgp_preparse_nlri (struct bgp_parsed_nlri *n, const u_char *msg,
+		   const u_char *pnt, bgp_size_t length, afi_t afi)
+{
+  const u_char *end = pnt + length;
+  const u_char *p;
+  struct prefix *prefix;
+  int maxlen, psize;
+  int count = 0;
+
+  if (afi == AFI_IP)
+    maxlen = 32;
+  else if (afi == AFI_IP6)
+    maxlen = 128;
+  else
+    return 0;			/* Left to the main thread. */
+
+  for (p = pnt; p < end; p += psize)
+    {
+      if (*p > maxlen)
+	return -1;
+      psize = PSIZE (*p++);
+      if (p + psize > end)
+	return -1;
+      count++;
+    }
+
+  if (count)
+    {
+      n->prefixes = calloc (count, sizeof (struct prefix));
+      if (n->prefixes == NULL)
+	return -1;
+    }
+
+  for (p = pnt, prefix = n->prefixes; p < end; p += psize, prefix++)
+    {
+      prefix->family = afi2family (afi);
+      prefix->prefixlen = *p++;
+      psize = PSIZE (prefix->prefixlen);
+      memcpy (&prefix->u.prefix, p, psize);
+    }
+
+  n->offset = pnt - msg;
+  n->length = length;
+  n->count = count;
+  return 0;
+}
+
+/* Decode an AS path, checked as assegments_parse() does. */
+static struct bgp_parsed_aspath *
+bgp_preparse_aspath (const u_char *msg, const u_char *pnt, bgp_size_t length,
+		     int use32bit)
+{
+  struct bgp_parsed_aspath *pa;
+  size_t asize = use32bit ? 4 : 2;
+  size_t bytes, seg_size;
+  int nsegs = 0, nas = 0;
+  int i, j;
+  as_t *as;
+
+  if (length % 2)
+    return NULL;
+
+  for (bytes = 0; bytes < length; bytes += seg_size)
+    {
+      if (length - bytes <= 2)
+	return NULL;
+      seg_size = 2 + pnt[bytes + 1] * asize;
+      if (bytes + seg_size > length || pnt[bytes + 1] == 0)
+	return NULL;
+      switch (pnt[bytes])
+	{
+	case AS_SEQUENCE:
+	case AS_SET:
+	case AS_CONFED_SEQUENCE:
+	case AS_CONFED_SET:
+	  break;
+	default:
+	  return NULL;
+	}
+      nsegs++;
+      nas += pnt[bytes + 1];
+    }
+
+  pa = calloc (1, sizeof (struct bgp_parsed_aspath));
+  if (pa == NULL)
+    return NULL;
+  pa->offset = pnt - msg;
+  pa->length = length;
+  pa->use32bit = use32bit;
+  pa->nsegs = nsegs;
+  if (nsegs)
+    {
+      pa->types = malloc (nsegs);
+      pa->lengths = malloc (nsegs);
+      pa->as = malloc (nas * sizeof (as_t));
+      if (! pa->types || ! pa->lengths || ! pa->as)
+	{
+	  free (pa->types);
+	  free (pa->lengths);
+	  free (pa->as);
+	  free (pa);
+	  return NULL;
+	}
+    }
+
+  for (bytes = 0, i = 0, as = pa->as; i < nsegs; i++)
+    {
+      pa->types[i] = pnt[bytes++];
+      pa->lengths[i] = pnt[bytes++];
+      for (j = 0; j < pa->lengths[i]; j++, bytes += asize)
+	*as++ = use32bit ? BGP_PARSE_GETL (pnt + bytes)
+	                 : BGP_PARSE_GETW (pnt + bytes);
+    }
+
+  return pa;
+}
+
+static void
+bgp_parsed_aspath_free (struct bgp_parsed_aspath *pa)
+{
+  if (pa == NULL)
+    return;
+  free (pa->types);
+  free (pa->lengths);
+  free (pa->as);
+  free (pa);
+}
+
+static int
+bgp_preparse_community_cmp (const void *a, const void *b)
+{
+  u_int32_t v1 = ntohl (*(const u_int32_t *) a);
+  u_int32_t v2 = ntohl (*(const u_int32_t *) b);
+
+  return v1 < v2 ? -1 : v1 > v2;
+}
+
+/* Sort and dedup a COMMUNITIES value, as community_uniq_sort() does. */
+static struct bgp_parsed_community *
+bgp_preparse_community (const u_char *msg, const u_char *pnt,
+			bgp_size_t length)
+{
+  struct bgp_parsed_community *pc;
+  int i, n;
+
+  if (length == 0 || length % 4)
+    return NULL;
+
+  pc = calloc (1, sizeof (struct bgp_parsed_community));
+  if (pc == NULL)
+    return NULL;
+  pc->val = malloc (length);
+  if (pc->val == NULL)
+    {
+      free (pc);
+      return NULL;
+    }
+  memcpy (pc->val, pnt, length);
+  n = length / 4;
+  qsort (pc->val, n, sizeof (u_int32_t), bgp_preparse_community_cmp);
+  for (i = 1, pc->count = 1; i < n; i++)
+    if (pc->val[i] != pc->val[pc->count - 1])
+      pc->val[pc->count++] = pc->val[i];
+
+  pc->offset = pnt - msg;
+  pc->length = length;
+  return pc;
+}
+
+static void
+bgp_parsed_community_free (struct bgp_parsed_community *pc)
+{
+  if (pc == NULL)
+    return;
+  free (pc->val);
+  free (pc);
+}
+
+/* MP_REACH_NLRI, framed as bgp_mp_reach_parse() expects. */
+static int
+bgp_preparse_mp_reach (struct bgp_update_parsed *up, const u_char *msg,
+		       const u_char *pnt, bgp_size_t length)
+{
+  afi_t afi;
+  safi_t safi;
+  bgp_size_t nhlen;
+
+  if (length < 5)
+    return -1;
+  afi = BGP_PARSE_GETW (pnt);
+  safi = pnt[2];
+  nhlen = pnt[3];
+  if (nhlen != 4 && nhlen != 12 && nhlen != 16 && nhlen != 32)
+    return -1;
+  /* Nexthop, then the SNPA byte, then at least some NLRI. */
+  if (length <= 4 + nhlen + 1)
+    return -1;
+  if (safi == SAFI_MPLS_LABELED_VPN)
+    return 0;
+  return bgp_preparse_nlri (&up->nlri[BGP_PARSED_MP_UPDATE], msg,
+			    pnt + 4 + nhlen + 1, length - 4 - nhlen - 1, afi);
+}
+
+static int
+bgp_preparse_mp_unreach (struct bgp_update_parsed *up, const u_char *msg,
+			 const u_char *pnt, bgp_size_t length)
+{
+  if (length < 3)
+    return -1;
+  if (pnt[2] == SAFI_MPLS_LABELED_VPN)
+    return 0;
+  return bgp_preparse_nlri (&up->nlri[BGP_PARSED_MP_WITHDRAW], msg,
+			    pnt + 3, length - 3, BGP_PARSE_GETW (pnt));
+}
+
+/* Decode the UPDATE message MSG of LEN bytes, header included, from a
+   peer that sends 4-octet AS numbers if AS4.  Returns NULL for
+   anything that is not plainly well formed, the main thread then
+   parses and reports it as usual. */
+struct bgp_update_parsed *
+bgp_update_preparse (const u_char *msg, size_t len, int as4)
+{
+  struct bgp_update_parsed *up;
+  const u_char *pnt, *end, *attr_end;
+  bgp_size_t withdraw_len, attr_len, length;
+  u_char seen[BGP_ATTR_BITMAP_SIZE];
+  u_char flag, type;
+
+  if (len < BGP_HEADER_SIZE + 4 || len > BGP_MAX_PACKET_SIZE
+      || msg[BGP_MARKER_SIZE + 2] != BGP_MSG_UPDATE)
+    return NULL;
+
+  up = calloc (1, sizeof (struct bgp_update_parsed));
+  if (up == NULL)
+    return NULL;
+
+  pnt = msg + BGP_HEADER_SIZE;
+  end = msg + len;
+
+  withdraw_len = BGP_PARSE_GETW (pnt);
+  pnt += 2;
+  if (pnt + withdraw_len + 2 > end)
+    goto malformed;
+  if (withdraw_len
+      && bgp_preparse_nlri (&up->nlri[BGP_PARSED_WITHDRAW], msg, pnt,
+			    withdraw_len, AFI_IP) < 0)
+    goto malformed;
+  pnt += withdraw_len;
+
+  attr_len = BGP_PARSE_GETW (pnt);
+  pnt += 2;
+  attr_end = pnt + attr_len;
+  if (attr_end > end)
+    goto malformed;
+
+  memset (seen, 0, BGP_ATTR_BITMAP_SIZE);
+  while (pnt < attr_end)
+    {
+      if (attr_end - pnt < BGP_ATTR_MIN_LEN)
+	goto malformed;
+      flag = pnt[0];
+      type = pnt[1];
+      if (CHECK_FLAG (flag, BGP_ATTR_FLAG_EXTLEN))
+	{
+	  if (attr_end - pnt < BGP_ATTR_MIN_LEN + 1)
+	    goto malformed;
+	  length = BGP_PARSE_GETW (pnt + 2);
+	  pnt += 4;
+	}
+      else
+	{
+	  length = pnt[2];
+	  pnt += 3;
+	}
+      if (CHECK_BITMAP (seen, type) || pnt + length > attr_end)
+	goto malformed;
+      SET_BITMAP (seen, type);
+
+      switch (type)
+	{
+	case BGP_ATTR_AS_PATH:
+	  up->aspath = bgp_preparse_aspath (msg, pnt, length, as4);
+	  if (up->aspath == NULL)
+	    goto malformed;
+	  break;
+	case BGP_ATTR_AS4_PATH:
+	  up->as4_path = bgp_preparse_aspath (msg, pnt, length, 1);
+	  if (up->as4_path == NULL)
+	    goto malformed;
+	  break;
+	case BGP_ATTR_COMMUNITIES:
+	  /* An empty one is not worth handing over. */
+	  if (length == 0)
+	    break;
+	  up->community = bgp_preparse_community (msg, pnt, length);
+	  if (up->community == NULL)
+	    goto malformed;
+	  break;
+	case BGP_ATTR_MP_REACH_NLRI:
+	  if (bgp_preparse_mp_reach (up, msg, pnt, length) < 0)
+	    goto malformed;
+	  break;
+	case BGP_ATTR_MP_UNREACH_NLRI:
+	  if (bgp_preparse_mp_unreach (up, msg, pnt, length) < 0)
+	    goto malformed;
+	  break;
+	}
+      pnt += length;
+    }
+
+  if (pnt < end
+      && bgp_preparse_nlri (&up->nlri[BGP_PARSED_UPDATE], msg, pnt,
+			    end - pnt, AFI_IP) < 0)
+    goto malformed;
+
+  return up;
+
+ malformed:
+  bgp_update_parsed_free (up);
+  return NULL;
+}
+
+void
+bgp_update_parsed_free (struct bgp_update_parsed *up)
+{
+  int i;
+
+  if (up == NULL)
+    return;
+  for (i = 0; i < BGP_PARSED_NLRI_MAX; i++)
+    free (up->nlri[i].prefixes);
+  bgp_parsed_aspath_free (up->aspath);
+  bgp_parsed_aspath_free (up->as4_path);
+  bgp_parsed_community_free (up->community);
+  free (up);
+}
+
+/* Position of PNT in the message being processed. */
+static bgp_size_t
+bgp_parsed_offset (struct peer *peer, const u_char *pnt)
+{
+  return pnt - STREAM_DATA (peer->ibuf);
+}
+
+/* Give PACKET the decoded prefixes of its field, if there are any. */
+void
+bgp_parsed_nlri_attach (struct peer *peer, struct bgp_nlri *packet)
+{
+  struct bgp_parsed_nlri *n;
+  bgp_size_t offset;
+  int i;
+
+  if (peer->parsed == NULL || packet->length == 0)
+    return;
+
+  offset = bgp_parsed_offset (peer, packet->nlri);
+  for (i = 0; i < BGP_PARSED_NLRI_MAX; i++)
+    {
+      n = &peer->parsed->nlri[i];
+      if (n->offset == offset && n->length == packet->length)
+	{
+	  packet->prefixes = n->prefixes;
+	  packet->count = n->count;
+	  return;
+	}
+    }
+}
+
+/* Whether the field of NLRI at PNT was checked already. */
+int
+bgp_parsed_nlri_valid (struct peer *peer, u_char *pnt, bgp_size_t length)
+{
+  bgp_size_t offset;
+  int i;
+
+  if (peer->parsed == NULL)
+    return 0;
+
+  offset = bgp_parsed_offset (peer, pnt);
+  for (i = 0; i < BGP_PARSED_NLRI_MAX; i++)
+    if (peer->parsed->nlri[i].offset == offset
+	&& peer->parsed->nlri[i].length == length)
+      return 1;
+  return 0;
+}
+
+/* Intern the AS_PATH or AS4_PATH value of LENGTH bytes at the input
+   position, if it was decoded, and move past it.  NULL if it was
+   not, the caller parses it itself. */
+struct aspath *
+bgp_parsed_aspath (struct peer *peer, u_char type, bgp_size_t length)
+{
+  struct bgp_parsed_aspath *pa;
+  struct aspath *aspath;
+  int use32bit;
+
+  if (peer->parsed == NULL)
+    return NULL;
+
+  if (type == BGP_ATTR_AS_PATH)
+    {
+      pa = peer->parsed->aspath;
+      use32bit = CHECK_FLAG (peer->cap, PEER_CAP_AS4_RCV) ? 1 : 0;
+    }
+  else
+    {
+      pa = peer->parsed->as4_path;
+      use32bit = 1;
+    }
+
+  if (pa == NULL || pa->use32bit != use32bit || pa->length != length
+      || pa->offset != stream_get_getp (peer->ibuf))
+    return NULL;
+
+  aspath = aspath_parse_flat (pa->nsegs, pa->types, pa->lengths, pa->as);
+  stream_forward_getp (peer->ibuf, length);
+  return aspath;
+}
+
+/* The same for a COMMUNITIES value. */
+struct community *
+bgp_parsed_community (struct peer *peer, bgp_size_t length)
+{
+  struct bgp_parsed_community *pc;
+  struct community *com;
+
+  if (peer->parsed == NULL)
+    return NULL;
+
+  pc = peer->parsed->community;
+  if (pc == NULL || pc->length != length
+      || pc->offset != stream_get_getp (peer->ibuf))
+    return NULL;
+
+  com = community_parse_sorted (pc->val, pc->count);
+  stream_forward_getp (peer->ibuf, length);
+  return com;
+}
@@ -0,0 +1,91 @@
+/*
+ * BGP UPDATE message pre-parsing
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_PARSE_H
+#define _QUAGGA_BGP_PARSE_H
+
+/* An UPDATE is decoded ahead of time, off the main thread, into what
+   bgp_update_receive() would otherwise extract itself: the prefixes of
+   each NLRI field, the AS paths and the sorted communities.  Only the
+   decoding happens there; interning into the shared hashes and all
+   error handling stay with the main thread, which falls back to its
+   own parsing for anything the decoder did not vouch for.
+
+   bgp_update_preparse() uses neither the memory statistics nor the
+   logging, so it is safe to call from any thread.  Offsets are from
+   the start of the message header. */
+
+/* A field of NLRI, syntactically valid. */
+struct bgp_parsed_nlri
+{
+  bgp_size_t offset;
+  bgp_size_t length;
+  int count;
+  struct prefix *prefixes;
+};
+
+/* An AS_PATH or AS4_PATH attribute value, checked as aspath_parse()
+   would and decoded to host order. */
+struct bgp_parsed_aspath
+{
+  bgp_size_t offset;
+  bgp_size_t length;
+  int use32bit;
+  int nsegs;
+  u_char *types;
+  u_char *lengths;
+  as_t *as;
+};
+
+/* A COMMUNITIES value, sorted and without duplicates. */
+struct bgp_parsed_community
+{
+  bgp_size_t offset;
+  bgp_size_t length;
+  int count;
+  u_int32_t *val;		/* Network byte order. */
+};
+
+#define BGP_PARSED_WITHDRAW	0
+#define BGP_PARSED_UPDATE	1
+#define BGP_PARSED_MP_UPDATE	2
+#define BGP_PARSED_MP_WITHDRAW	3
+#define BGP_PARSED_NLRI_MAX	4
+
+struct bgp_update_parsed
+{
+  struct bgp_parsed_nlri nlri[BGP_PARSED_NLRI_MAX];
+  struct bgp_parsed_aspath *aspath;
+  struct bgp_parsed_aspath *as4_path;
+  struct bgp_parsed_community *community;
+};
+
+extern struct bgp_update_parsed *bgp_update_preparse (const u_char *, size_t,
+						      int);
+extern void bgp_update_parsed_free (struct bgp_update_parsed *);
+
+/* For the main thread, while peer->parsed is set. */
+extern void bgp_parsed_nlri_attach (struct peer *, struct bgp_nlri *);
+extern int bgp_parsed_nlri_valid (struct peer *, u_char *, bgp_size_t);
+extern struct aspath *bgp_parsed_aspath (struct peer *, u_char, bgp_size_t);
+extern struct community *bgp_parsed_community (struct peer *, bgp_size_t);
+
+#endif /* _QUAGGA_BGP_PARSE_H */
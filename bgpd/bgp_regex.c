@@ -91,3 +91,665 @@ bgp_regex_free (regex_t *regex)
   regfree (regex);
   XFREE (MTYPE_BGP_REGEXP, regex);
 }
+
+/* AS path regular expressions matched over the ASes of the path.
+
+   The patterns of as-path access-lists are mostly a few AS numbers
+   between `_', `^' and `$'.  Rather than run regexec() over the path
+   string for them, bgp_asregcomp() compiles such a pattern into an
+   automaton whose steps are whole AS numbers, the spaces between them
+   and the ends of the path.  The automaton runs over the places just
+   before and just after each AS of the path:
+
+     "^ 100 200 300 $"
+      0   1 2   3 4   5
+
+   where 0 is also the beginning and 5 also the end of the string.  An
+   AS word steps from an even place over the AS to the odd one after
+   it, `_' from an odd place over the space, or stays at the beginning
+   or the end.  A word can only be matched over a whole AS this way, so
+   the compiler only takes patterns where every word starts after `_',
+   `^' or a space and is followed by `_', a space or `$', and nothing
+   but those follows `.*' or `.+'; regexec() is kept for everything
+   else, and for paths with sets or confederations. */
+
+/* Where in the path a step of the automaton may leave it. */
+#define ASRE_AT_START	0x01	/* even place, or the beginning or end */
+#define ASRE_AT_END	0x02	/* odd place, just after an AS */
+#define ASRE_AT_ANY	0x04	/* anywhere, after `.*' */
+
+enum asregex_op
+{
+  ASRE_SPLIT,			/* go to both out and out1 */
+  ASRE_NOP,			/* go to out */
+  ASRE_BOUNDARY,		/* `_' */
+  ASRE_SPACE,			/* ` ' */
+  ASRE_BOL,			/* `^' */
+  ASRE_EOL,			/* `$' */
+  ASRE_ANY,			/* `.*' */
+  ASRE_ANY1,			/* `.+' */
+  ASRE_WORD,			/* one AS */
+  ASRE_MATCH,
+};
+
+struct asregex_state
+{
+  enum asregex_op op;
+  int out;
+  int out1;
+  int word;			/* index into words, for ASRE_WORD */
+};
+
+/* A digit or bracket expression of digits, with its repeat. */
+struct asregex_atom
+{
+  u_int16_t digits;		/* bit n set if digit n matches */
+  u_char min;
+  u_char max;			/* 1, or 0 for no limit */
+};
+
+struct asregex_word
+{
+  int atom;			/* first of natoms atoms */
+  int natoms;
+  int literal;			/* plain AS number, as in as */
+  as_t as;
+  int nullable;			/* may match without an AS */
+};
+
+struct bgp_asregex
+{
+  regex_t *reg;
+
+  /* NULL if the pattern is left to regexec (). */
+  struct asregex_state *states;
+  int nstates;
+  int start;
+
+  struct asregex_word *words;
+  int nwords;
+
+  struct asregex_atom *atoms;
+  int natoms;
+
+  int has_text_words;		/* some word is not a plain AS number */
+};
+
+/* A piece of the automaton: enter at start, leave through the out of
+   end, which is left unset. */
+struct asregex_frag
+{
+  int start;
+  int end;
+};
+
+struct asregex_parse
+{
+  const char *p;
+  struct bgp_asregex *re;
+};
+
+static int
+asregex_state_new (struct bgp_asregex *re, enum asregex_op op)
+{
+  if ((re->nstates & 15) == 0)
+    re->states = XREALLOC (MTYPE_BGP_REGEXP, re->states,
+			   (re->nstates + 16) * sizeof (struct asregex_state));
+  re->states[re->nstates].op = op;
+  re->states[re->nstates].out = -1;
+  re->states[re->nstates].out1 = -1;
+  re->states[re->nstates].word = -1;
+  return re->nstates++;
+}
+
+static int asregex_parse_alt (struct asregex_parse *, int,
+			      struct asregex_frag *, int *);
+
+/* Parse a word of digits and digit bracket expressions. */
+static int
+asregex_parse_word (struct asregex_parse *ps, struct asregex_frag *frag)
+{
+  struct bgp_asregex *re = ps->re;
+  struct asregex_word *word;
+  struct asregex_atom *atom;
+  const char *p = ps->p;
+  int lo, hi, i;
+
+  if ((re->nwords & 7) == 0)
+    re->words = XREALLOC (MTYPE_BGP_REGEXP, re->words,
+			  (re->nwords + 8) * sizeof (struct asregex_word));
+  word = &re->words[re->nwords];
+  word->atom = re->natoms;
+  word->natoms = 0;
+  word->literal = 1;
+  word->as = 0;
+  word->nullable = 1;
+
+  while (isdigit ((int) *p) || *p == '[')
+    {
+      if ((re->natoms & 15) == 0)
+	re->atoms = XREALLOC (MTYPE_BGP_REGEXP, re->atoms,
+			      (re->natoms + 16)
+			      * sizeof (struct asregex_atom));
+      atom = &re->atoms[re->natoms++];
+      word->natoms++;
+      atom->digits = 0;
+      atom->min = atom->max = 1;
+
+      if (*p == '[')
+	{
+	  p++;
+	  if (*p == ']' || *p == '^')
+	    return -1;
+	  while (*p != ']')
+	    {
+	      if (! isdigit ((int) *p))
+		return -1;
+	      lo = hi = *p++ - '0';
+	      if (*p == '-' && isdigit ((int) p[1]))
+		{
+		  hi = p[1] - '0';
+		  p += 2;
+		}
+	      if (lo > hi)
+		return -1;
+	      for (i = lo; i <= hi; i++)
+		atom->digits |= 1 << i;
+	    }
+	  p++;
+	  word->literal = 0;
+	}
+      else
+	{
+	  atom->digits = 1 << (*p - '0');
+	  /* Leading zeroes are text, and so is anything too long. */
+	  if ((word->natoms == 1 && *p == '0' && isdigit ((int) p[1]))
+	      || word->natoms > 10
+	      || word->as > (BGP_AS4_MAX - (*p - '0')) / 10)
+	    word->literal = 0;
+	  else
+	    word->as = word->as * 10 + (*p - '0');
+	  p++;
+	}
+
+      switch (*p)
+	{
+	case '?':
+	  atom->min = 0;
+	  p++;
+	  break;
+	case '*':
+	  atom->min = 0;
+	  atom->max = 0;
+	  p++;
+	  break;
+	case '+':
+	  atom->max = 0;
+	  p++;
+	  break;
+	}
+      if (*p == '?' || *p == '*' || *p == '+' || *p == '{')
+	return -1;
+      if (atom->min != 1 || atom->max != 1)
+	word->literal = 0;
+      if (atom->min)
+	word->nullable = 0;
+    }
+
+  if (! word->literal)
+    re->has_text_words = 1;
+
+  frag->start = frag->end = asregex_state_new (re, ASRE_WORD);
+  re->states[frag->start].word = re->nwords++;
+  ps->p = p;
+  return 0;
+}
+
+/* Parse one item of a sequence, given where the sequence may be when
+   it gets there, and work out where it may be afterwards. */
+static int
+asregex_parse_piece (struct asregex_parse *ps, int in,
+		     struct asregex_frag *frag, int *out)
+{
+  struct bgp_asregex *re = ps->re;
+  struct asregex_frag inner;
+  const char *start;
+  int nstates, nwords, natoms;
+  int mask, gout;
+  int split, nop;
+
+  switch (*ps->p)
+    {
+    case '_':
+    case ' ':
+    case '^':
+    case '$':
+      frag->start = frag->end
+	= asregex_state_new (re, (*ps->p == '_' ? ASRE_BOUNDARY
+				  : *ps->p == ' ' ? ASRE_SPACE
+				  : *ps->p == '^' ? ASRE_BOL : ASRE_EOL));
+      ps->p++;
+      *out = ASRE_AT_START;
+      break;
+
+    case '.':
+      /* Only from where nothing of an AS can be left over, as the
+	 automaton cannot stop part way through one, and `.+' only
+	 from the start or end of one. */
+      if (in & ASRE_AT_END)
+	return -1;
+      if (ps->p[1] == '+' && (in & ASRE_AT_ANY))
+	return -1;
+      if (ps->p[1] != '*' && ps->p[1] != '+')
+	return -1;
+      frag->start = frag->end
+	= asregex_state_new (re, ps->p[1] == '*' ? ASRE_ANY : ASRE_ANY1);
+      ps->p += 2;
+      *out = ASRE_AT_ANY;
+      break;
+
+    case '(':
+      /* Parse the group again for as long as going round it lets it
+	 start in more places, so every word in it is checked. */
+      start = ++ps->p;
+      nstates = re->nstates;
+      nwords = re->nwords;
+      natoms = re->natoms;
+      mask = in;
+      for (;;)
+	{
+	  ps->p = start;
+	  re->nstates = nstates;
+	  re->nwords = nwords;
+	  re->natoms = natoms;
+	  if (asregex_parse_alt (ps, mask, &inner, &gout) < 0)
+	    return -1;
+	  if (*ps->p != ')')
+	    return -1;
+	  if ((ps->p[1] == '*' || ps->p[1] == '+') && (gout & ~mask))
+	    {
+	      mask |= gout;
+	      continue;
+	    }
+	  break;
+	}
+      ps->p++;
+
+      switch (*ps->p)
+	{
+	case '?':
+	  split = asregex_state_new (re, ASRE_SPLIT);
+	  nop = asregex_state_new (re, ASRE_NOP);
+	  re->states[split].out = inner.start;
+	  re->states[split].out1 = nop;
+	  re->states[inner.end].out = nop;
+	  frag->start = split;
+	  frag->end = nop;
+	  *out = gout | in;
+	  ps->p++;
+	  break;
+	case '*':
+	case '+':
+	  split = asregex_state_new (re, ASRE_SPLIT);
+	  nop = asregex_state_new (re, ASRE_NOP);
+	  re->states[split].out = inner.start;
+	  re->states[split].out1 = nop;
+	  re->states[inner.end].out = split;
+	  frag->start = (*ps->p == '*' ? split : inner.start);
+	  frag->end = nop;
+	  *out = (*ps->p == '*' ? gout | in : gout);
+	  ps->p++;
+	  break;
+	default:
+	  *frag = inner;
+	  *out = gout;
+	  break;
+	}
+      if (*ps->p == '?' || *ps->p == '*' || *ps->p == '+' || *ps->p == '{')
+	return -1;
+      return 0;
+
+    case '[':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+      /* A word has to start at the start of an AS. */
+      if (in & ~ASRE_AT_START)
+	return -1;
+      if (asregex_parse_word (ps, frag) < 0)
+	return -1;
+      *out = ASRE_AT_END;
+      if (re->words[re->states[frag->start].word].nullable)
+	*out |= ASRE_AT_START;
+      return 0;
+
+    default:
+      return -1;
+    }
+
+  /* No repeats of anything else. */
+  if (*ps->p == '?' || *ps->p == '*' || *ps->p == '+' || *ps->p == '{')
+    return -1;
+  return 0;
+}
+
+static int
+asregex_parse_seq (struct asregex_parse *ps, int in,
+		   struct asregex_frag *frag, int *out)
+{
+  struct asregex_frag next;
+
+  if (*ps->p == '\0' || *ps->p == '|' || *ps->p == ')')
+    return -1;
+
+  if (asregex_parse_piece (ps, in, frag, out) < 0)
+    return -1;
+
+  while (*ps->p != '\0' && *ps->p != '|' && *ps->p != ')')
+    {
+      if (asregex_parse_piece (ps, *out, &next, out) < 0)
+	return -1;
+      ps->re->states[frag->end].out = next.start;
+      frag->end = next.end;
+    }
+  return 0;
+}
+
+static int
+asregex_parse_alt (struct asregex_parse *ps, int in,
+		   struct asregex_frag *frag, int *out)
+{
+  struct bgp_asregex *re = ps->re;
+  struct asregex_frag alt;
+  int split, nop, last;
+  int altout;
+
+  if (asregex_parse_seq (ps, in, frag, out) < 0)
+    return -1;
+  if (*ps->p != '|')
+    return 0;
+
+  /* Each alternative leaves through one join. */
+  nop = asregex_state_new (re, ASRE_NOP);
+  re->states[frag->end].out = nop;
+  last = -1;
+  while (*ps->p == '|')
+    {
+      ps->p++;
+      if (asregex_parse_seq (ps, in, &alt, &altout) < 0)
+	return -1;
+      *out |= altout;
+      re->states[alt.end].out = nop;
+
+      split = asregex_state_new (re, ASRE_SPLIT);
+      re->states[split].out1 = alt.start;
+      if (last < 0)
+	{
+	  re->states[split].out = frag->start;
+	  frag->start = split;
+	}
+      else
+	{
+	  re->states[split].out = re->states[last].out1;
+	  re->states[last].out1 = split;
+	}
+      last = split;
+    }
+  frag->end = nop;
+  return 0;
+}
+
+/* Compile the token automaton, or leave states NULL. */
+static void
+asregex_compile (struct bgp_asregex *re, const char *regstr)
+{
+  struct asregex_parse ps;
+  struct asregex_frag frag;
+  int out;
+  int match;
+
+  ps.p = regstr;
+  ps.re = re;
+
+  if (asregex_parse_alt (&ps, ASRE_AT_ANY, &frag, &out) < 0
+      || *ps.p != '\0'
+      /* Unanchored, a word at the end could match a part of an AS. */
+      || (out & ASRE_AT_END))
+    {
+      if (re->states)
+	XFREE (MTYPE_BGP_REGEXP, re->states);
+      if (re->words)
+	XFREE (MTYPE_BGP_REGEXP, re->words);
+      if (re->atoms)
+	XFREE (MTYPE_BGP_REGEXP, re->atoms);
+      re->states = NULL;
+      re->words = NULL;
+      re->atoms = NULL;
+      re->nstates = re->nwords = re->natoms = 0;
+      re->has_text_words = 0;
+      return;
+    }
+
+  match = asregex_state_new (re, ASRE_MATCH);
+  re->states[frag.end].out = match;
+  re->start = frag.start;
+}
+
+struct bgp_asregex *
+bgp_asregcomp (const char *regstr)
+{
+  struct bgp_asregex *re;
+  regex_t *reg;
+
+  reg = bgp_regcomp (regstr);
+  if (! reg)
+    return NULL;
+
+  re = XCALLOC (MTYPE_BGP_REGEXP, sizeof (struct bgp_asregex));
+  re->reg = reg;
+  asregex_compile (re, regstr);
+  return re;
+}
+
+void
+bgp_asregex_free (struct bgp_asregex *re)
+{
+  bgp_regex_free (re->reg);
+  if (re->states)
+    XFREE (MTYPE_BGP_REGEXP, re->states);
+  if (re->words)
+    XFREE (MTYPE_BGP_REGEXP, re->words);
+  if (re->atoms)
+    XFREE (MTYPE_BGP_REGEXP, re->atoms);
+  XFREE (MTYPE_BGP_REGEXP, re);
+}
+
+/* Match atoms against all of str. */
+static int
+asregex_atoms_match (const struct asregex_atom *atom, int natoms,
+		     const char *str)
+{
+  int i, n;
+
+  if (natoms == 0)
+    return *str == '\0';
+
+  for (n = 0; str[n] && (atom->digits & (1 << (str[n] - '0'))); n++)
+    if (atom->max == 1)
+      {
+	n++;
+	break;
+      }
+
+  for (i = n; i >= atom->min; i--)
+    if (asregex_atoms_match (atom + 1, natoms - 1, str + i))
+      return 1;
+  return 0;
+}
+
+static int
+asregex_word_match (const struct bgp_asregex *re,
+		    const struct asregex_word *word, as_t as,
+		    const char *text)
+{
+  if (word->literal)
+    return as == word->as;
+  return asregex_atoms_match (re->atoms + word->atom, word->natoms, text);
+}
+
+/* Whether the path is only AS_SEQUENCE segments, which are printed as
+   their ASes with a space between each. */
+static int
+asregex_path_plain (struct aspath *aspath, int *count)
+{
+  struct assegment *seg;
+
+  *count = 0;
+  for (seg = aspath->segments; seg; seg = seg->next)
+    {
+      if (seg->type != AS_SEQUENCE || seg->length == 0)
+	return 0;
+      *count += seg->length;
+    }
+  return 1;
+}
+
+#define ASREGEX_STACK_MARKS 4096
+
+/* Returns 0 on a match and REG_NOMATCH otherwise, like regexec(). */
+int
+bgp_asregexec (struct bgp_asregex *re, struct aspath *aspath)
+{
+  struct assegment *seg;
+  const struct asregex_state *st;
+  u_char marks_buf[ASREGEX_STACK_MARKS];
+  u_char *marks;
+  int *stack;
+  as_t *ases = NULL;
+  char (*text)[11] = NULL;
+  int count, npos, last;
+  int pos, q, sp, s, i, k;
+  int ret = REG_NOMATCH;
+
+  if (! re->states || ! asregex_path_plain (aspath, &count))
+    return regexec (re->reg, aspath->str, 0, NULL, 0);
+
+  /* Flatten the ASes, and print them if some word needs that. */
+  if (count)
+    {
+      if (aspath->segments->next == NULL)
+	ases = aspath->segments->as;
+      else
+	{
+	  ases = XMALLOC (MTYPE_TMP, count * sizeof (as_t));
+	  for (i = 0, seg = aspath->segments; seg; seg = seg->next)
+	    for (k = 0; k < seg->length; k++)
+	      ases[i++] = seg->as[k];
+	}
+      if (re->has_text_words)
+	{
+	  text = XMALLOC (MTYPE_TMP, count * sizeof (*text));
+	  for (i = 0; i < count; i++)
+	    snprintf (text[i], sizeof (text[i]), "%u", ases[i]);
+	}
+    }
+
+  npos = count ? 2 * count : 1;
+  last = npos - 1;
+
+  if (npos * re->nstates <= ASREGEX_STACK_MARKS)
+    {
+      marks = marks_buf;
+      memset (marks, 0, npos * re->nstates);
+    }
+  else
+    marks = XCALLOC (MTYPE_TMP, npos * re->nstates);
+  stack = XMALLOC (MTYPE_TMP, re->nstates * sizeof (int));
+
+#define MARK(P,S)	(marks[(P) * re->nstates + (S)])
+#define ADD(P,S)							\
+  do {									\
+    if (! MARK ((P), (S)))						\
+      {									\
+	MARK ((P), (S)) = 1;						\
+	if ((P) == pos)							\
+	  stack[sp++] = (S);						\
+      }									\
+  } while (0)
+
+  /* Unanchored, the match may start anywhere. */
+  for (pos = 0; pos < npos; pos++)
+    MARK (pos, re->start) = 1;
+
+  for (pos = 0; pos < npos; pos++)
+    {
+      for (sp = 0, s = 0; s < re->nstates; s++)
+	if (MARK (pos, s))
+	  stack[sp++] = s;
+
+      while (sp)
+	{
+	  s = stack[--sp];
+	  st = &re->states[s];
+	  switch (st->op)
+	    {
+	    case ASRE_MATCH:
+	      ret = 0;
+	      goto done;
+	    case ASRE_SPLIT:
+	      ADD (pos, st->out);
+	      ADD (pos, st->out1);
+	      break;
+	    case ASRE_NOP:
+	      ADD (pos, st->out);
+	      break;
+	    case ASRE_BOUNDARY:
+	      if (pos == 0 || pos == last)
+		ADD (pos, st->out);
+	      else if (pos & 1)
+		ADD (pos + 1, st->out);
+	      break;
+	    case ASRE_SPACE:
+	      if ((pos & 1) && pos != last)
+		ADD (pos + 1, st->out);
+	      break;
+	    case ASRE_BOL:
+	      if (pos == 0)
+		ADD (pos, st->out);
+	      break;
+	    case ASRE_EOL:
+	      if (pos == last)
+		ADD (pos, st->out);
+	      break;
+	    case ASRE_ANY:
+	      ADD (pos, st->out);
+	      /* fall through */
+	    case ASRE_ANY1:
+	      for (q = pos + 1; q < npos; q++)
+		ADD (q, st->out);
+	      break;
+	    case ASRE_WORD:
+	      if (re->words[st->word].nullable)
+		ADD (pos, st->out);
+	      if (count && ! (pos & 1)
+		  && asregex_word_match (re, &re->words[st->word],
+					 ases[pos / 2],
+					 text ? text[pos / 2] : NULL))
+		ADD (pos + 1, st->out);
+	      break;
+	    }
+	}
+    }
+
+#undef ADD
+#undef MARK
+
+ done:
+  XFREE (MTYPE_TMP, stack);
+  if (marks != marks_buf)
+    XFREE (MTYPE_TMP, marks);
+  if (text)
+    XFREE (MTYPE_TMP, text);
+  if (ases && ases != aspath->segments->as)
+    XFREE (MTYPE_TMP, ases);
+  return ret;
+}
@@ -37,4 +37,12 @@ extern void bgp_regex_free (regex_t *regex);
 extern regex_t *bgp_regcomp (const char *str);
 extern int bgp_regexec (regex_t *regex, struct aspath *aspath);
 
+/* AS path regular expression, matched over the ASes of a path where
+   it can be, see bgp_regex.c. */
+struct bgp_asregex;
+
+extern struct bgp_asregex *bgp_asregcomp (const char *);
+extern int bgp_asregexec (struct bgp_asregex *, struct aspath *);
+extern void bgp_asregex_free (struct bgp_asregex *);
+
 #endif /* _QUAGGA_BGP_REGEX_H */
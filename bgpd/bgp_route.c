@@ -55,6 +55,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_zebra.h"
 #include "bgpd/bgp_vty.h"
 #include "bgpd/bgp_mpath.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_select.h"
 
 /* Extern from bgp_dump.c */
 extern const char *bgp_origin_str[];
@@ -142,6 +144,7 @@ bgp_info_free (struct bgp_info *binfo)
   
   bgp_info_extra_free (&binfo->extra);
   bgp_info_mpath_free (&binfo->mpath);
+  bgp_nexthop_unlink (binfo);
 
   peer_unlock (binfo->peer); /* bgp_info peer reference */
 
@@ -194,6 +197,7 @@ bgp_info_add (struct bgp_node *rn, struct bgp_info *ri)
   if (top)
     top->prev = ri;
   rn->info = ri;
+  ri->net = rn;
   
   bgp_info_lock (ri);
   bgp_lock_node (rn);
@@ -322,20 +326,19 @@ bgp_med_value (struct attr *attr, struct bgp *bgp)
 }
 
 /* Compare two bgp route entity.  br is preferable then return 1. */
-static int
+int
 bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
 	      int *paths_eq)
 {
   struct attr *newattr, *existattr;
   struct attr_extra *newattre, *existattre;
+  struct attr_cmp *newcmp, *existcmp;
   bgp_peer_sort_t new_sort;
   bgp_peer_sort_t exist_sort;
   u_int32_t new_pref;
   u_int32_t exist_pref;
   u_int32_t new_med;
   u_int32_t exist_med;
-  u_int32_t new_weight;
-  u_int32_t exist_weight;
   uint32_t newm, existm;
   struct in_addr new_id;
   struct in_addr exist_id;
@@ -358,17 +361,15 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
   newattre = newattr->extra;
   existattre = existattr->extra;
 
-  /* 1. Weight check. */
-  new_weight = exist_weight = 0;
-
-  if (newattre)
-    new_weight = newattre->weight;
-  if (existattre)
-    exist_weight = existattre->weight;
+  /* Up to the IGP metric, all that is needed of aspath and extra is
+     in the interned attributes' decision process keys. */
+  newcmp = &newattr->cmp;
+  existcmp = &existattr->cmp;
 
-  if (new_weight > exist_weight)
+  /* 1. Weight check. */
+  if (newcmp->weight > existcmp->weight)
     return 1;
-  if (new_weight < exist_weight)
+  if (newcmp->weight < existcmp->weight)
     return 0;
 
   /* 2. Local preference check. */
@@ -397,15 +398,14 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
   /* 4. AS path length check. */
   if (! bgp_flag_check (bgp, BGP_FLAG_ASPATH_IGNORE))
     {
-      int exist_hops = aspath_count_hops (existattr->aspath);
-      int exist_confeds = aspath_count_confeds (existattr->aspath);
+      int exist_hops = existcmp->hops;
+      int exist_confeds = existcmp->confeds;
       
       if (bgp_flag_check (bgp, BGP_FLAG_ASPATH_CONFED))
 	{
 	  int aspath_hops;
 	  
-	  aspath_hops = aspath_count_hops (newattr->aspath);
-          aspath_hops += aspath_count_confeds (newattr->aspath);
+	  aspath_hops = newcmp->hops + newcmp->confeds;
           
 	  if ( aspath_hops < (exist_hops + exist_confeds))
 	    return 1;
@@ -414,7 +414,7 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
 	}
       else
 	{
-	  int newhops = aspath_count_hops (newattr->aspath);
+	  int newhops = newcmp->hops;
 	  
 	  if (newhops < exist_hops)
 	    return 1;
@@ -430,18 +430,19 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
     return 0;
 
   /* 6. MED check. */
-  internal_as_route = (aspath_count_hops (newattr->aspath) == 0
-		      && aspath_count_hops (existattr->aspath) == 0);
-  confed_as_route = (aspath_count_confeds (newattr->aspath) > 0
-		    && aspath_count_confeds (existattr->aspath) > 0
-		    && aspath_count_hops (newattr->aspath) == 0
-		    && aspath_count_hops (existattr->aspath) == 0);
+  internal_as_route = (newcmp->hops == 0 && existcmp->hops == 0);
+  confed_as_route = (newcmp->confeds > 0 && existcmp->confeds > 0
+		     && internal_as_route);
   
   if (bgp_flag_check (bgp, BGP_FLAG_ALWAYS_COMPARE_MED)
       || (bgp_flag_check (bgp, BGP_FLAG_MED_CONFED)
 	 && confed_as_route)
-      || aspath_cmp_left (newattr->aspath, existattr->aspath)
-      || aspath_cmp_left_confed (newattr->aspath, existattr->aspath)
+      || (CHECK_FLAG (newattr->cmp_flags & existattr->cmp_flags,
+		      ATTR_CMP_LEFT_AS)
+	  && newcmp->left_as == existcmp->left_as)
+      || (CHECK_FLAG (newattr->cmp_flags & existattr->cmp_flags,
+		      ATTR_CMP_LEFT_CONFED)
+	  && newcmp->left_confed == existcmp->left_confed)
       || internal_as_route)
     {
       new_med = bgp_med_value (new->attr, bgp);
@@ -684,9 +685,12 @@ bgp_cluster_filter (struct peer *peer, struct attr *attr)
   return 0;
 }
 
+/* attr_key, if not NULL, is the interned attribute attr was copied
+   from, which route-map matches that only look at the attributes can
+   remember their results for. */
 static int
 bgp_input_modifier (struct peer *peer, struct prefix *p, struct attr *attr,
-		    afi_t afi, safi_t safi)
+		    struct attr *attr_key, afi_t afi, safi_t safi)
 {
   struct bgp_filter *filter;
   struct bgp_info info;
@@ -708,7 +712,8 @@ bgp_input_modifier (struct peer *peer, struct prefix *p, struct attr *attr,
       SET_FLAG (peer->rmap_type, PEER_RMAP_TYPE_IN); 
 
       /* Apply BGP route map to the attribute. */
-      ret = route_map_apply (ROUTE_MAP_IN (filter), p, RMAP_BGP, &info);
+      ret = route_map_apply_cached (ROUTE_MAP_IN (filter), p, RMAP_BGP, &info,
+				    attr_key);
 
       peer->rmap_type = 0;
 
@@ -1306,10 +1311,13 @@ struct bgp_info_pair
   struct bgp_info *new;
 };
 
+/* Select the best path of RN.  If PRESELECTED, result->new is the
+   choice bgp_best_select_job() made already and only the bookkeeping
+   is left to do. */
 static void
 bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
 		    struct bgp_maxpaths_cfg *mpath_cfg,
-		    struct bgp_info_pair *result)
+		    struct bgp_info_pair *result, int preselected)
 {
   struct bgp_info *new_select;
   struct bgp_info *old_select;
@@ -1378,7 +1386,7 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
 
   /* Check old selected route and new selected route. */
   old_select = NULL;
-  new_select = NULL;
+  new_select = preselected ? result->new : NULL;
   for (ri = rn->info; (ri != NULL) && (nextri = ri->next, 1); ri = nextri)
     {
       if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
@@ -1405,6 +1413,9 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
       bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_CHECK);
       bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_SELECTED);
 
+      if (preselected)
+	continue;
+
       if (bgp_info_cmp (bgp, ri, new_select, &paths_eq))
 	{
 	  if (do_mpath && bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
@@ -1438,6 +1449,36 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
   return;
 }
 
+/* Whether bgp_best_select_job() can stand in for the comparisons of
+   bgp_best_selection(), which it can unless deterministic-med or
+   multipath have it record more than the winner. */
+static int
+bgp_best_select_plain (struct bgp *bgp, afi_t afi, safi_t safi)
+{
+  return ! bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED)
+    && bgp->maxpaths[afi][safi].maxpaths_ebgp == BGP_DEFAULT_MAXPATHS
+    && bgp->maxpaths[afi][safi].maxpaths_ibgp == BGP_DEFAULT_MAXPATHS;
+}
+
+/* The comparisons of bgp_best_selection() alone, changing nothing,
+   for the best path workers. */
+static void
+bgp_best_select_job (struct bgp_select_job *job)
+{
+  struct bgp_info *ri;
+  struct bgp_info *new_select = NULL;
+  int paths_eq;
+
+  for (ri = job->rn->info; ri; ri = ri->next)
+    {
+      if (BGP_INFO_HOLDDOWN (ri))
+	continue;
+      if (bgp_info_cmp (job->bgp, ri, new_select, &paths_eq))
+	new_select = ri;
+    }
+  job->select = new_select;
+}
+
 static int
 bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
                                struct bgp_node *rn, afi_t afi, safi_t safi)
@@ -1488,14 +1529,136 @@ bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
   return 0;
 }
 
+/* The checks of bgp_announce_check() that depend on the identity of
+   the peer rather than on its export policy. */
+static int
+bgp_announce_check_peer (struct bgp_info *ri, struct peer *peer)
+{
+  struct attr *riattr;
+
+  if (ri->peer == peer)
+    return 0;
+
+  riattr = bgp_info_mpath_count (ri) ? bgp_info_mpath_attr (ri) : ri->attr;
+  if ((riattr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID))
+      && IPV4_ADDR_SAME (&peer->remote_id, &riattr->extra->originator_id))
+    return 0;
+
+  return 1;
+}
+
+/* Announce the selected route to the members of an update group.  The
+   export policy is evaluated for the first member it applies to and
+   the result reused for the others. */
+static void
+bgp_process_announce_updgrp (struct update_group *updgrp,
+			     struct bgp_info *selected, struct bgp_node *rn,
+			     afi_t afi, safi_t safi)
+{
+  struct prefix *p;
+  struct listnode *node;
+  struct peer *peer;
+  struct attr attr;
+  struct attr_extra extra;
+  int evaluated = 0;
+  int permit = 0;
+
+  p = &rn->p;
+
+  /* It's initialized in bgp_announce_check() */
+  attr.extra = &extra;
+
+  for (ALL_LIST_ELEMENTS_RO (updgrp->peer, node, peer))
+    {
+      /* First update is deferred until ORF or ROUTE-REFRESH is received */
+      if (CHECK_FLAG (peer->af_sflags[afi][safi],
+		      PEER_STATUS_ORF_WAIT_REFRESH))
+	continue;
+
+      if (! selected || ! bgp_announce_check_peer (selected, peer))
+	{
+	  bgp_adj_out_unset (rn, peer, p, afi, safi);
+	  continue;
+	}
+
+      if (! evaluated)
+	{
+	  permit = bgp_announce_check (selected, peer, p, &attr, afi, safi);
+	  evaluated = 1;
+	  updgrp->policy_run++;
+	}
+      else
+	updgrp->policy_shared++;
+
+      if (permit)
+	bgp_adj_out_set (rn, peer, p, &attr, afi, safi, selected);
+      else
+	bgp_adj_out_unset (rn, peer, p, afi, safi);
+    }
+}
+
 struct bgp_process_queue 
 {
   struct bgp *bgp;
   struct bgp_node *rn;
   afi_t afi;
   safi_t safi;
+
+  /* Best path chosen ahead by the workers, valid while the queue run
+     it was chosen in lasts.  The run is counted from 1. */
+  struct bgp_info *new_select;
+  unsigned long select_run;
+  u_char selected;
 };
 
+/* Nodes looked at ahead per queue run, when enough are waiting. */
+#define BGP_PROCESS_BATCH_MIN	64
+#define BGP_PROCESS_BATCH_MAX	1024
+
+/* Have the best path workers select for the nodes waiting in WQ, up to
+   a batch, that were not looked at in this run yet.  Nothing else runs
+   until the run ends, so the choices hold until then. */
+static void
+bgp_process_preselect (struct work_queue *wq)
+{
+  static struct bgp_select_job jobs[BGP_PROCESS_BATCH_MAX];
+  static struct bgp_process_queue *batch[BGP_PROCESS_BATCH_MAX];
+  struct bgp_process_queue *pq;
+  unsigned long run = wq->runs + 1;
+  unsigned int count = work_queue_item_count (wq);
+  unsigned int j;
+  int n = 0, looked = 0;
+  int i;
+
+  if (count < BGP_PROCESS_BATCH_MIN || bgp_select_threads () == 0)
+    return;
+
+  for (j = 0; j < count; j++)
+    {
+      pq = work_queue_item_peek (wq, j);
+      if (pq->select_run == run)
+	continue;
+      if (looked++ == BGP_PROCESS_BATCH_MAX)
+	break;
+      pq->select_run = run;
+      pq->selected = 0;
+      if (! bgp_best_select_plain (pq->bgp, pq->afi, pq->safi))
+	continue;
+      jobs[n].bgp = pq->bgp;
+      jobs[n].rn = pq->rn;
+      batch[n++] = pq;
+    }
+
+  if (n == 0 || ! bgp_select_run (jobs, n, bgp_best_select_job))
+    return;
+
+  for (i = 0; i < n; i++)
+    {
+      batch[i]->new_select = jobs[i].select;
+      batch[i]->selected = 1;
+    }
+}
+
 static wq_item_status
 bgp_process_rsclient (struct work_queue *wq, void *data)
 {
@@ -1511,7 +1674,7 @@ bgp_process_rsclient (struct work_queue *wq, void *data)
   struct peer *rsclient = bgp_node_table (rn)->owner;
   
   /* Best path selection. */
-  bgp_best_selection (bgp, rn, &bgp->maxpaths[afi][safi], &old_and_new);
+  bgp_best_selection (bgp, rn, &bgp->maxpaths[afi][safi], &old_and_new, 0);
   new_select = old_and_new.new;
   old_select = old_and_new.old;
 
@@ -1570,11 +1733,18 @@ bgp_process_main (struct work_queue *wq, void *data)
   struct bgp_info *new_select;
   struct bgp_info *old_select;
   struct bgp_info_pair old_and_new;
-  struct listnode *node, *nnode;
-  struct peer *peer;
+  struct listnode *node;
+  struct update_group *updgrp;
+  int preselected;
   
-  /* Best path selection. */
-  bgp_best_selection (bgp, rn, &bgp->maxpaths[afi][safi], &old_and_new);
+  /* Best path selection, for a whole batch at once if there are
+     workers to share it. */
+  if (pq->select_run != wq->runs + 1)
+    bgp_process_preselect (wq);
+  preselected = (pq->selected && pq->select_run == wq->runs + 1);
+  old_and_new.new = pq->new_select;
+  bgp_best_selection (bgp, rn, &bgp->maxpaths[afi][safi], &old_and_new,
+		      preselected);
   old_select = old_and_new.old;
   new_select = old_and_new.new;
 
@@ -1587,6 +1757,7 @@ bgp_process_main (struct work_queue *wq, void *data)
 	      CHECK_FLAG (old_select->flags, BGP_INFO_MULTIPATH_CHG))
             bgp_zebra_announce (p, old_select, bgp, safi);
           
+	  UNSET_FLAG (old_select->flags, BGP_INFO_IGP_CHANGED);
 	  UNSET_FLAG (old_select->flags, BGP_INFO_MULTIPATH_CHG);
           UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
           return WQ_SUCCESS;
@@ -1599,15 +1770,16 @@ bgp_process_main (struct work_queue *wq, void *data)
     {
       bgp_info_set_flag (rn, new_select, BGP_INFO_SELECTED);
       bgp_info_unset_flag (rn, new_select, BGP_INFO_ATTR_CHANGED);
+      UNSET_FLAG (new_select->flags, BGP_INFO_IGP_CHANGED);
       UNSET_FLAG (new_select->flags, BGP_INFO_MULTIPATH_CHG);
     }
 
 
-  /* Check each BGP peer. */
-  for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
-    {
-      bgp_process_announce_selected (peer, new_select, rn, afi, safi);
-    }
+  /* Check each BGP peer, once per update group.  Peer state cannot
+     change while the queue runs, so regroup only once per run. */
+  bgp_updgrp_refresh (bgp, afi, safi, wq->runs + 1);
+  for (ALL_LIST_ELEMENTS_RO (bgp->update_groups[afi][safi], node, updgrp))
+    bgp_process_announce_updgrp (updgrp, new_select, rn, afi, safi);
 
   /* FIB update. */
   if ((safi == SAFI_UNICAST || safi == SAFI_MULTICAST) && (! bgp->name &&
@@ -2074,6 +2246,7 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
   struct attr new_attr;
   struct attr_extra new_extra;
   struct attr *attr_new;
+  struct attr *attr_in = NULL;
   struct bgp_info *ri;
   struct bgp_info *new;
   const char *reason;
@@ -2083,10 +2256,11 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
   rn = bgp_afi_node_get (bgp->rib[afi][safi], afi, safi, p, prd);
   
   /* When peer's soft reconfiguration enabled.  Record input packet in
-     Adj-RIBs-In.  */
-  if (! soft_reconfig && CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_SOFT_RECONFIG)
+     Adj-RIBs-In, once it is known whether the route was accepted as
+     received.  */
+  if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_SOFT_RECONFIG)
       && peer != bgp->peer_self)
-    bgp_adj_in_set (rn, peer, attr);
+    attr_in = bgp_attr_intern (attr);
 
   /* Check previously received route. */
   for (ri = rn->info; ri; ri = ri->next)
@@ -2145,7 +2319,8 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
    * NB: new_attr may now contain newly allocated values from route-map "set"
    * commands, so we need bgp_attr_flush in the error paths, until we intern
    * the attr (which takes over the memory references) */
-  if (bgp_input_modifier (peer, p, &new_attr, afi, safi) == RMAP_DENY)
+  if (bgp_input_modifier (peer, p, &new_attr,
+			  attr->refcnt ? attr : attr_in, afi, safi) == RMAP_DENY)
     {
       reason = "route-map;";
       bgp_attr_flush (&new_attr);
@@ -2224,6 +2399,8 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
 		}
 	    }
 
+	  if (attr_in)
+	    bgp_adj_in_set (rn, peer, attr_in, ri);
 	  bgp_unlock_node (rn);
 	  bgp_attr_unintern (&attr_new);
 
@@ -2278,6 +2455,9 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
       if (safi == SAFI_MPLS_VPN)
         memcpy ((bgp_info_extra_get (ri))->tag, tag, 3);
 
+      if (attr_in)
+	bgp_adj_in_set (rn, peer, attr_in, ri);
+
       /* Update bgp route dampening information.  */
       if (CHECK_FLAG (bgp->af_flags[afi][safi], BGP_CONFIG_DAMPENING)
 	  && peer->sort == BGP_PEER_EBGP)
@@ -2292,14 +2472,9 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
 	}
 
       /* Nexthop reachability check. */
-      if ((afi == AFI_IP || afi == AFI_IP6)
-	  && safi == SAFI_UNICAST 
-	  && (peer->sort == BGP_PEER_IBGP
-              || peer->sort == BGP_PEER_CONFED
-	      || (peer->sort == BGP_PEER_EBGP && peer->ttl != 1)
-	      || CHECK_FLAG (peer->flags, PEER_FLAG_DISABLE_CONNECTED_CHECK)))
+      if ((afi == AFI_IP || afi == AFI_IP6) && safi == SAFI_UNICAST)
 	{
-	  if (bgp_nexthop_lookup (afi, peer, ri, NULL, NULL))
+	  if (bgp_nexthop_lookup (afi, ri))
 	    bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
 	  else
 	    bgp_info_unset_flag (rn, ri, BGP_INFO_VALID);
@@ -2338,14 +2513,9 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
     memcpy ((bgp_info_extra_get (new))->tag, tag, 3);
 
   /* Nexthop reachability check. */
-  if ((afi == AFI_IP || afi == AFI_IP6)
-      && safi == SAFI_UNICAST
-      && (peer->sort == BGP_PEER_IBGP
-          || peer->sort == BGP_PEER_CONFED
-	  || (peer->sort == BGP_PEER_EBGP && peer->ttl != 1)
-	  || CHECK_FLAG (peer->flags, PEER_FLAG_DISABLE_CONNECTED_CHECK)))
-    {
-      if (bgp_nexthop_lookup (afi, peer, new, NULL, NULL))
+  if ((afi == AFI_IP || afi == AFI_IP6) && safi == SAFI_UNICAST)
+    {
+      if (bgp_nexthop_lookup (afi, new))
 	bgp_info_set_flag (rn, new, BGP_INFO_VALID);
       else
         bgp_info_unset_flag (rn, new, BGP_INFO_VALID);
@@ -2358,6 +2528,9 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
   
   /* Register new BGP information. */
   bgp_info_add (rn, new);
+
+  if (attr_in)
+    bgp_adj_in_set (rn, peer, attr_in, new);
   
   /* route_node_get lock */
   bgp_unlock_node (rn);
@@ -2385,6 +2558,9 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
   if (ri)
     bgp_rib_remove (rn, ri, peer, afi, safi);
 
+  if (attr_in)
+    bgp_adj_in_set (rn, peer, attr_in, NULL);
+
   bgp_unlock_node (rn);
 
   return 0;
@@ -2653,19 +2829,27 @@ bgp_soft_reconfig_table_rsclient (struct peer *rsclient, afi_t afi,
 {
   struct bgp_node *rn;
   struct bgp_adj_in *ain;
+  struct bgp_info *ri;
 
   if (! table)
     table = rsclient->bgp->rib[afi][safi];
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain; ain = ain->next)
-      {
-        struct bgp_info *ri = rn->info;
-        u_char *tag = (ri && ri->extra) ? ri->extra->tag : NULL;
+    {
+      u_char *tag;
+
+      ri = rn->info;
+      tag = (ri && ri->extra) ? ri->extra->tag : NULL;
 
+      for (ain = rn->adj_in; ain; ain = ain->next)
         bgp_update_rsclient (rsclient, afi, safi, ain->attr, ain->peer,
                 &rn->p, ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, prd, tag);
-      }
+
+      for (ri = rn->info; ri; ri = ri->next)
+        if (CHECK_FLAG (ri->flags, BGP_INFO_ADJ_IN))
+          bgp_update_rsclient (rsclient, afi, safi, ri->attr, ri->peer,
+                  &rn->p, ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, prd, tag);
+    }
 }
 
 void
@@ -2697,29 +2881,28 @@ bgp_soft_reconfig_table (struct peer *peer, afi_t afi, safi_t safi,
 {
   int ret;
   struct bgp_node *rn;
-  struct bgp_adj_in *ain;
+  struct attr *attr;
 
   if (! table)
     table = peer->bgp->rib[afi][safi];
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain; ain = ain->next)
+    if ((attr = bgp_adj_in_lookup (rn, peer)) != NULL)
       {
-	if (ain->peer == peer)
-	  {
-	    struct bgp_info *ri = rn->info;
-	    u_char *tag = (ri && ri->extra) ? ri->extra->tag : NULL;
+	struct bgp_info *ri = rn->info;
+	u_char *tag = (ri && ri->extra) ? ri->extra->tag : NULL;
 
-	    ret = bgp_update (peer, &rn->p, ain->attr, afi, safi,
-			      ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL,
-			      prd, tag, 1);
+	/* The route may hold the only other reference. */
+	attr = bgp_attr_intern (attr);
+	ret = bgp_update (peer, &rn->p, attr, afi, safi,
+			  ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL,
+			  prd, tag, 1);
+	bgp_attr_unintern (&attr);
 
-	    if (ret < 0)
-	      {
-		bgp_unlock_node (rn);
-		return;
-	      }
-	    continue;
+	if (ret < 0)
+	  {
+	    bgp_unlock_node (rn);
+	    return;
 	  }
       }
 }
@@ -2902,6 +3085,8 @@ bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
           {
             struct bgp_clear_node_queue *cnq;
 
+            UNSET_FLAG (ri->flags, BGP_INFO_ADJ_IN);
+
             /* both unlocked in bgp_clear_node_queue_del */
             bgp_table_lock (bgp_node_table (rn));
             bgp_lock_node (rn);
@@ -3008,18 +3193,11 @@ bgp_clear_adj_in (struct peer *peer, afi_t afi, safi_t safi)
 {
   struct bgp_table *table;
   struct bgp_node *rn;
-  struct bgp_adj_in *ain;
 
   table = peer->bgp->rib[afi][safi];
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain ; ain = ain->next)
-      if (ain->peer == peer)
-	{
-          bgp_adj_in_remove (rn, ain);
-          bgp_unlock_node (rn);
-          break;
-	}
+    bgp_adj_in_unset (rn, peer);
 }
 
 void
@@ -3084,6 +3262,67 @@ bgp_reset (void)
   prefix_list_reset ();
 }
 
+/* Update or withdraw one prefix of NLRI.  Returns -1 when the rest
+   of the NLRI is to be ignored. */
+static int
+bgp_nlri_parse_prefix (struct peer *peer, struct attr *attr,
+		       struct bgp_nlri *packet, struct prefix *p)
+{
+  int ret;
+
+  /* Check address. */
+  if (packet->afi == AFI_IP && packet->safi == SAFI_UNICAST)
+    {
+      if (IN_CLASSD (ntohl (p->u.prefix4.s_addr)))
+	{
+	 /* 
+	  * From draft-ietf-idr-bgp4-22, Section 6.3: 
+	  * If a BGP router receives an UPDATE message with a
+	  * semantically incorrect NLRI field, in which a prefix is
+	  * semantically incorrect (eg. an unexpected multicast IP
+	  * address), it should ignore the prefix.
+	  */
+	  zlog (peer->log, LOG_ERR, 
+		"IPv4 unicast NLRI is multicast address %s",
+		inet_ntoa (p->u.prefix4));
+
+	  return -1;
+	}
+    }
+
+#ifdef HAVE_IPV6
+  /* Check address. */
+  if (packet->afi == AFI_IP6 && packet->safi == SAFI_UNICAST)
+    {
+      if (IN6_IS_ADDR_LINKLOCAL (&p->u.prefix6))
+	{
+	  char buf[BUFSIZ];
+
+	  zlog (peer->log, LOG_WARNING, 
+		"IPv6 link-local NLRI received %s ignore this NLRI",
+		inet_ntop (AF_INET6, &p->u.prefix6, buf, BUFSIZ));
+
+	  return 0;
+	}
+    }
+#endif /* HAVE_IPV6 */
+
+  /* Normal process. */
+  if (attr)
+    ret = bgp_update (peer, p, attr, packet->afi, packet->safi, 
+		      ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL, 0);
+  else
+    ret = bgp_withdraw (peer, p, attr, packet->afi, packet->safi, 
+			ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL);
+
+  /* Address family configuration mismatch or maximum-prefix count
+     overflow. */
+  if (ret < 0)
+    return -1;
+
+  return 0;
+}
+
 /* Parse NLRI stream.  Withdraw NLRI is recognized by NULL attr
    value. */
 int
@@ -3093,11 +3332,21 @@ bgp_nlri_parse (struct peer *peer, struct attr *attr, struct bgp_nlri *packet)
   u_char *lim;
   struct prefix p;
   int psize;
-  int ret;
+  int i;
 
   /* Check peer status. */
   if (peer->status != Established)
     return 0;
+
+  /* Decoded already. */
+  if (packet->prefixes)
+    {
+      for (i = 0; i < packet->count; i++)
+	if (bgp_nlri_parse_prefix (peer, attr, packet,
+				   &packet->prefixes[i]) < 0)
+	  return -1;
+      return 0;
+    }
   
   pnt = packet->nlri;
   lim = pnt + packet->length;
@@ -3127,54 +3376,7 @@ bgp_nlri_parse (struct peer *peer, struct attr *attr, struct bgp_nlri *packet)
       /* Fetch prefix from NLRI packet. */
       memcpy (&p.u.prefix, pnt, psize);
 
-      /* Check address. */
-      if (packet->afi == AFI_IP && packet->safi == SAFI_UNICAST)
-	{
-	  if (IN_CLASSD (ntohl (p.u.prefix4.s_addr)))
-	    {
-	     /* 
- 	      * From draft-ietf-idr-bgp4-22, Section 6.3: 
-	      * If a BGP router receives an UPDATE message with a
-	      * semantically incorrect NLRI field, in which a prefix is
-	      * semantically incorrect (eg. an unexpected multicast IP
-	      * address), it should ignore the prefix.
-	      */
-	      zlog (peer->log, LOG_ERR, 
-		    "IPv4 unicast NLRI is multicast address %s",
-		    inet_ntoa (p.u.prefix4));
-
-	      return -1;
-	    }
-	}
-
-#ifdef HAVE_IPV6
-      /* Check address. */
-      if (packet->afi == AFI_IP6 && packet->safi == SAFI_UNICAST)
-	{
-	  if (IN6_IS_ADDR_LINKLOCAL (&p.u.prefix6))
-	    {
-	      char buf[BUFSIZ];
-
-	      zlog (peer->log, LOG_WARNING, 
-		    "IPv6 link-local NLRI received %s ignore this NLRI",
-		    inet_ntop (AF_INET6, &p.u.prefix6, buf, BUFSIZ));
-
-	      continue;
-	    }
-	}
-#endif /* HAVE_IPV6 */
-
-      /* Normal process. */
-      if (attr)
-	ret = bgp_update (peer, &p, attr, packet->afi, packet->safi, 
-			  ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL, 0);
-      else
-	ret = bgp_withdraw (peer, &p, attr, packet->afi, packet->safi, 
-			    ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL);
-
-      /* Address family configuration mismatch or maximum-prefix count
-         overflow. */
-      if (ret < 0)
+      if (bgp_nlri_parse_prefix (peer, attr, packet, &p) < 0)
 	return -1;
     }
 
@@ -9638,12 +9840,10 @@ bgp_peer_count_walker (struct thread *t)
   
   for (rn = bgp_table_top (pc->table); rn; rn = bgp_route_next (rn))
     {
-      struct bgp_adj_in *ain;
       struct bgp_info *ri;
       
-      for (ain = rn->adj_in; ain; ain = ain->next)
-        if (ain->peer == peer)
-          pc->count[PCOUNT_ADJ_IN]++;
+      if (bgp_adj_in_lookup (rn, peer))
+        pc->count[PCOUNT_ADJ_IN]++;
 
       for (ri = rn->info; ri; ri = ri->next)
         {
@@ -9834,7 +10034,7 @@ show_adj_route (struct vty *vty, struct peer *peer, afi_t afi, safi_t safi,
 		int in)
 {
   struct bgp_table *table;
-  struct bgp_adj_in *ain;
+  struct attr *attr;
   struct bgp_adj_out *adj;
   unsigned long output_count;
   struct bgp_node *rn;
@@ -9866,27 +10066,23 @@ show_adj_route (struct vty *vty, struct peer *peer, afi_t afi, safi_t safi,
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
     if (in)
       {
-	for (ain = rn->adj_in; ain; ain = ain->next)
-	  if (ain->peer == peer)
-	    {
-	      if (header1)
-		{
-		  vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (bgp->router_id), VTY_NEWLINE);
-		  vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		  vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		  header1 = 0;
-		}
-	      if (header2)
-		{
-		  vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
-		  header2 = 0;
-		}
-	      if (ain->attr)
-		{ 
-		  route_vty_out_tmp (vty, &rn->p, ain->attr, safi);
-		  output_count++;
-		}
-	    }
+	if ((attr = bgp_adj_in_lookup (rn, peer)) != NULL)
+	  {
+	    if (header1)
+	      {
+		vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (bgp->router_id), VTY_NEWLINE);
+		vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+		vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+		header1 = 0;
+	      }
+	    if (header2)
+	      {
+		vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
+		header2 = 0;
+	      }
+	    route_vty_out_tmp (vty, &rn->p, attr, safi);
+	    output_count++;
+	  }
       }
     else
       {
@@ -61,6 +61,14 @@ struct bgp_info
   /* Multipath information */
   struct bgp_info_mpath *mpath;
 
+  /* Node the path belongs to. */
+  struct bgp_node *net;
+
+  /* Nexthop cache entry the path depends on, see bgp_nexthop.c. */
+  struct bgp_nexthop_cache *nexthop;
+  struct bgp_info *nh_next;
+  struct bgp_info *nh_prev;
+
   /* Uptime.  */
   time_t uptime;
 
@@ -82,6 +90,7 @@ struct bgp_info
 #define BGP_INFO_COUNTED	(1 << 10)
 #define BGP_INFO_MULTIPATH      (1 << 11)
 #define BGP_INFO_MULTIPATH_CHG  (1 << 12)
+#define BGP_INFO_ADJ_IN         (1 << 13)	/* attr is also as received */
 
   /* BGP route type.  This can be static, RIP, OSPF, BGP etc.  */
   u_char type;
@@ -192,6 +201,8 @@ extern void bgp_info_delete (struct bgp_node *rn, struct bgp_info *ri);
 extern struct bgp_info_extra *bgp_info_extra_get (struct bgp_info *);
 extern void bgp_info_set_flag (struct bgp_node *, struct bgp_info *, u_int32_t);
 extern void bgp_info_unset_flag (struct bgp_node *, struct bgp_info *, u_int32_t);
+extern int bgp_info_cmp (struct bgp *, struct bgp_info *, struct bgp_info *,
+			 int *);
 
 extern int bgp_nlri_sanity_check (struct peer *, int, u_char *, bgp_size_t);
 extern int bgp_nlri_parse (struct peer *, struct attr *, struct bgp_nlri *);
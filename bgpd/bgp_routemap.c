@@ -310,7 +310,8 @@ struct route_map_rule_cmd route_match_ip_next_hop_cmd =
   "ip next-hop",
   route_match_ip_next_hop,
   route_match_ip_next_hop_compile,
-  route_match_ip_next_hop_free
+  route_match_ip_next_hop_free,
+  1
 };
 
 /* `match ip route-source ACCESS-LIST' */
@@ -455,7 +456,8 @@ struct route_map_rule_cmd route_match_ip_next_hop_prefix_list_cmd =
   "ip next-hop prefix-list",
   route_match_ip_next_hop_prefix_list,
   route_match_ip_next_hop_prefix_list_compile,
-  route_match_ip_next_hop_prefix_list_free
+  route_match_ip_next_hop_prefix_list_free,
+  1
 };
 
 /* `match ip route-source prefix-list PREFIX_LIST' */
@@ -573,7 +575,8 @@ struct route_map_rule_cmd route_match_metric_cmd =
   "metric",
   route_match_metric,
   route_match_metric_compile,
-  route_match_metric_free
+  route_match_metric_free,
+  1
 };
 
 /* `match as-path ASPATH' */
@@ -621,7 +624,8 @@ struct route_map_rule_cmd route_match_aspath_cmd =
   "as-path",
   route_match_aspath,
   route_match_aspath_compile,
-  route_match_aspath_free
+  route_match_aspath_free,
+  1
 };
 
 /* `match community COMMUNIY' */
@@ -705,7 +709,8 @@ struct route_map_rule_cmd route_match_community_cmd =
   "community",
   route_match_community,
   route_match_community_compile,
-  route_match_community_free
+  route_match_community_free,
+  1
 };
 
 /* Match function for extcommunity match. */
@@ -754,7 +759,8 @@ struct route_map_rule_cmd route_match_ecommunity_cmd =
   "extcommunity",
   route_match_ecommunity,
   route_match_ecommunity_compile,
-  route_match_ecommunity_free
+  route_match_ecommunity_free,
+  1
 };
 
 /* `match nlri` and `set nlri` are replaced by `address-family ipv4`
@@ -810,7 +816,8 @@ struct route_map_rule_cmd route_match_origin_cmd =
   "origin",
   route_match_origin,
   route_match_origin_compile,
-  route_match_origin_free
+  route_match_origin_free,
+  1
 };
 
 /* match probability  { */
@@ -1880,7 +1887,8 @@ struct route_map_rule_cmd route_match_ipv6_next_hop_cmd =
   "ipv6 next-hop",
   route_match_ipv6_next_hop,
   route_match_ipv6_next_hop_compile,
-  route_match_ipv6_next_hop_free
+  route_match_ipv6_next_hop_free,
+  1
 };
 
 /* `match ipv6 address prefix-list PREFIX_LIST' */
@@ -0,0 +1,244 @@
+/*
+ * BGP best path selection workers
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "jhash.h"
+#include "log.h"
+#include "memory.h"
+#include "vty.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_select.h"
+
+#ifdef HAVE_PTHREADS
+
+#include <pthread.h>
+
+/* Workers started when asked for any, and no more than. */
+#define BGP_SELECT_THREADS_MAX	16
+
+static pthread_mutex_t bgp_select_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bgp_select_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t bgp_select_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t bgp_select_thread_id[BGP_SELECT_THREADS_MAX];
+static int bgp_select_shard_id[BGP_SELECT_THREADS_MAX];
+
+/* Configured number of workers, -1 for one per spare processor. */
+static int bgp_select_threads_conf = -1;
+static int bgp_select_started;
+static int bgp_select_running;
+static int bgp_select_stop;
+
+/* The batch being worked on, under bgp_select_mutex. */
+static unsigned long bgp_select_gen;
+static int bgp_select_pending;
+static struct bgp_select_job *bgp_select_jobs;
+static int bgp_select_njobs;
+static void (*bgp_select_func) (struct bgp_select_job *);
+static u_char *bgp_select_shard;
+static int bgp_select_shard_size;
+
+static void *
+bgp_select_thread (void *arg)
+{
+  int shard = *(int *) arg;
+  unsigned long gen = 0;
+  struct bgp_select_job *jobs;
+  void (*func) (struct bgp_select_job *);
+  int i, n;
+
+  pthread_mutex_lock (&bgp_select_mutex);
+  for (;;)
+    {
+      while (! bgp_select_stop && gen == bgp_select_gen)
+	pthread_cond_wait (&bgp_select_cond, &bgp_select_mutex);
+      if (bgp_select_stop)
+	break;
+      gen = bgp_select_gen;
+      jobs = bgp_select_jobs;
+      n = bgp_select_njobs;
+      func = bgp_select_func;
+      pthread_mutex_unlock (&bgp_select_mutex);
+
+      for (i = 0; i < n; i++)
+	if (bgp_select_shard[i] == shard)
+	  func (&jobs[i]);
+
+      pthread_mutex_lock (&bgp_select_mutex);
+      if (--bgp_select_pending == 0)
+	pthread_cond_signal (&bgp_select_done_cond);
+    }
+  pthread_mutex_unlock (&bgp_select_mutex);
+
+  return NULL;
+}
+
+/* Start the workers, by default one for each processor besides the
+   one the main thread runs on. */
+static void
+bgp_select_start (void)
+{
+  sigset_t all, old;
+  int n = bgp_select_threads_conf;
+  int ret;
+
+  bgp_select_started = 1;
+  if (n < 0)
+    n = sysconf (_SC_NPROCESSORS_ONLN) - 1;
+  if (n > BGP_SELECT_THREADS_MAX)
+    n = BGP_SELECT_THREADS_MAX;
+
+  /* Signals are for the main thread. */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  for (bgp_select_running = 0; bgp_select_running < n; bgp_select_running++)
+    {
+      bgp_select_shard_id[bgp_select_running] = bgp_select_running + 1;
+      ret = pthread_create (&bgp_select_thread_id[bgp_select_running], NULL,
+			    bgp_select_thread,
+			    &bgp_select_shard_id[bgp_select_running]);
+      if (ret)
+	{
+	  zlog_err ("Can't start BGP best path thread: %s",
+		    safe_strerror (ret));
+	  break;
+	}
+    }
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+}
+
+/* Number of workers, starting them if that was not tried yet. */
+int
+bgp_select_threads (void)
+{
+  if (! bgp_select_started)
+    bgp_select_start ();
+  return bgp_select_running;
+}
+
+/* Run FUNC on each of the N JOBS, spread over the workers and the
+   main thread by prefix. */
+int
+bgp_select_run (struct bgp_select_job *jobs, int n,
+		void (*func) (struct bgp_select_job *))
+{
+  struct prefix *p;
+  int nshards;
+  int i;
+
+  if (bgp_select_threads () == 0)
+    return 0;
+
+  if (n > bgp_select_shard_size)
+    {
+      bgp_select_shard = XREALLOC (MTYPE_BGP_SELECT, bgp_select_shard, n);
+      bgp_select_shard_size = n;
+    }
+
+  nshards = bgp_select_running + 1;
+  for (i = 0; i < n; i++)
+    {
+      p = &jobs[i].rn->p;
+      bgp_select_shard[i] = jhash (&p->u.prefix, PSIZE (p->prefixlen),
+				   p->prefixlen) % nshards;
+    }
+
+  pthread_mutex_lock (&bgp_select_mutex);
+  bgp_select_jobs = jobs;
+  bgp_select_njobs = n;
+  bgp_select_func = func;
+  bgp_select_pending = bgp_select_running;
+  bgp_select_gen++;
+  pthread_cond_broadcast (&bgp_select_cond);
+  pthread_mutex_unlock (&bgp_select_mutex);
+
+  for (i = 0; i < n; i++)
+    if (bgp_select_shard[i] == 0)
+      func (&jobs[i]);
+
+  pthread_mutex_lock (&bgp_select_mutex);
+  while (bgp_select_pending)
+    pthread_cond_wait (&bgp_select_done_cond, &bgp_select_mutex);
+  pthread_mutex_unlock (&bgp_select_mutex);
+
+  return 1;
+}
+
+/* Number of workers, -1 for one per spare processor.  Takes effect
+   when best paths are next selected. */
+void
+bgp_select_threads_set (int n)
+{
+  bgp_select_finish ();
+  bgp_select_threads_conf = n;
+}
+
+void
+bgp_select_finish (void)
+{
+  int i;
+
+  pthread_mutex_lock (&bgp_select_mutex);
+  bgp_select_stop = 1;
+  pthread_cond_broadcast (&bgp_select_cond);
+  pthread_mutex_unlock (&bgp_select_mutex);
+
+  for (i = 0; i < bgp_select_running; i++)
+    pthread_join (bgp_select_thread_id[i], NULL);
+
+  bgp_select_running = 0;
+  bgp_select_started = 0;
+  bgp_select_stop = 0;
+  bgp_select_gen = 0;
+  if (bgp_select_shard)
+    XFREE (MTYPE_BGP_SELECT, bgp_select_shard);
+  bgp_select_shard_size = 0;
+}
+
+#else /* ! HAVE_PTHREADS */
+
+int
+bgp_select_run (struct bgp_select_job *jobs, int n,
+		void (*func) (struct bgp_select_job *))
+{
+  return 0;
+}
+
+int
+bgp_select_threads (void)
+{
+  return 0;
+}
+
+void
+bgp_select_threads_set (int n)
+{
+}
+
+void
+bgp_select_finish (void)
+{
+}
+
+#endif /* HAVE_PTHREADS */
@@ -0,0 +1,47 @@
+/*
+ * BGP best path selection workers
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_SELECT_H
+#define _QUAGGA_BGP_SELECT_H
+
+/* The decision process for a batch of nodes waiting in the process
+   queue can be run by a pool of worker threads, each taking the nodes
+   whose prefix hashes to it, while the main thread does its own share
+   and waits for the rest.  Nothing else runs meanwhile, so the job
+   function may read the RIB freely, but it must not change anything
+   nor allocate, log or take the time.  Applying the result stays with
+   the main thread, in queue order. */
+struct bgp_select_job
+{
+  struct bgp *bgp;
+  struct bgp_node *rn;
+  struct bgp_info *select;	/* Set by the job function. */
+};
+
+/* Returns 0 if there are no workers, the caller then runs the jobs
+   itself as needed. */
+extern int bgp_select_run (struct bgp_select_job *, int,
+			   void (*) (struct bgp_select_job *));
+extern int bgp_select_threads (void);
+extern void bgp_select_threads_set (int);
+extern void bgp_select_finish (void);
+
+#endif /* _QUAGGA_BGP_SELECT_H */
@@ -0,0 +1,498 @@
+/*
+ * BGP update groups
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Peers of an address family that would be sent identical UPDATEs are
+   collected into update groups.  The export policy for a prefix is then
+   evaluated once per group instead of once per peer, and an UPDATE
+   encoded for one member is handed to the others as a shared stream
+   when their advertisement queues line up.  Adj-RIB-Out state is still
+   kept per peer, so members that fall behind or diverge simply encode
+   their own packets. */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "linklist.h"
+#include "memory.h"
+#include "hash.h"
+#include "jhash.h"
+#include "stream.h"
+#include "command.h"
+#include "routemap.h"
+#include "sockunion.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_advertise.h"
+#include "bgpd/bgp_nexthop.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+
+/* Size of the part of the signature compared with memcmp. */
+#define UPDGRP_SIG_SIZE offsetof (struct update_group_sig, filter)
+
+static unsigned int updgrp_id;
+
+/* Route-map rules whose outcome depends on the peer being announced
+   to rather than on the route. */
+static int
+bgp_updgrp_rmap_peer_specific (struct route_map *map)
+{
+  return (route_map_has_rule (map, "peer", NULL)
+	  || route_map_has_rule (map, "ip route-source", NULL)
+	  || route_map_has_rule (map, "ip route-source prefix-list", NULL)
+	  || route_map_has_rule (map, "ip next-hop", "peer-address")
+	  || route_map_has_rule (map, "ipv6 next-hop peer-address", NULL));
+}
+
+static void
+bgp_updgrp_sig_make (struct peer *peer, afi_t afi, safi_t safi,
+		     struct update_group_sig *sig)
+{
+  struct bgp_filter *filter = &peer->filter[afi][safi];
+
+  memset (sig, 0, sizeof (struct update_group_sig));
+
+  if ((CHECK_FLAG (peer->af_cap[afi][safi], PEER_CAP_ORF_PREFIX_RM_ADV)
+       && (CHECK_FLAG (peer->af_cap[afi][safi], PEER_CAP_ORF_PREFIX_SM_RCV)
+	   || CHECK_FLAG (peer->af_cap[afi][safi],
+			  PEER_CAP_ORF_PREFIX_SM_OLD_RCV)))
+      || bgp_updgrp_rmap_peer_specific (ROUTE_MAP_OUT (filter))
+      || bgp_updgrp_rmap_peer_specific (UNSUPPRESS_MAP (filter)))
+    sig->peer = peer;
+
+  sig->sort = peer->sort;
+  sig->as = peer->as;
+  sig->local_as = peer->local_as;
+  sig->change_local_as = peer->change_local_as;
+  sig->flags = peer->flags & (PEER_FLAG_LOCAL_AS_NO_PREPEND
+			      | PEER_FLAG_LOCAL_AS_REPLACE_AS);
+  sig->af_flags = peer->af_flags[afi][safi];
+  sig->af_sflags = peer->af_sflags[afi][safi] & PEER_STATUS_DEFAULT_ORIGINATE;
+  sig->cap = peer->cap & PEER_CAP_AS4_RCV;
+
+  sig->shared_network = peer->shared_network;
+  sig->nexthop = peer->nexthop.v4;
+#ifdef HAVE_IPV6
+  sig->nexthop_global = peer->nexthop.v6_global;
+  sig->nexthop_local = peer->nexthop.v6_local;
+#endif /* HAVE_IPV6 */
+
+  if (peer->sort == BGP_PEER_EBGP)
+    bgp_multiaccess_key_v4 (peer->host, &sig->connected);
+
+  sig->filter[0] = DISTRIBUTE_OUT_NAME (filter);
+  sig->filter[1] = PREFIX_LIST_OUT_NAME (filter);
+  sig->filter[2] = FILTER_LIST_OUT_NAME (filter);
+  sig->filter[3] = ROUTE_MAP_OUT_NAME (filter);
+  sig->filter[4] = UNSUPPRESS_MAP_NAME (filter);
+}
+
+static int
+bgp_updgrp_sig_cmp (const struct update_group_sig *s1,
+		    const struct update_group_sig *s2)
+{
+  int i;
+
+  if (memcmp (s1, s2, UPDGRP_SIG_SIZE))
+    return 0;
+
+  for (i = 0; i < UPDGRP_FILTER_MAX; i++)
+    {
+      if (s1->filter[i] == NULL || s2->filter[i] == NULL)
+	{
+	  if (s1->filter[i] != s2->filter[i])
+	    return 0;
+	}
+      else if (strcmp (s1->filter[i], s2->filter[i]))
+	return 0;
+    }
+  return 1;
+}
+
+static unsigned int
+bgp_updgrp_hash_key (void *arg)
+{
+  struct update_group *updgrp = arg;
+  unsigned int key;
+  int i;
+
+  key = jhash (&updgrp->sig, UPDGRP_SIG_SIZE, 0);
+  for (i = 0; i < UPDGRP_FILTER_MAX; i++)
+    if (updgrp->sig.filter[i])
+      key = jhash_1word (string_hash_make (updgrp->sig.filter[i]), key);
+
+  return key;
+}
+
+static int
+bgp_updgrp_hash_cmp (const void *p1, const void *p2)
+{
+  const struct update_group *g1 = p1;
+  const struct update_group *g2 = p2;
+
+  return bgp_updgrp_sig_cmp (&g1->sig, &g2->sig);
+}
+
+static void *
+bgp_updgrp_hash_alloc (void *arg)
+{
+  struct update_group *ref = arg;
+  struct update_group *updgrp;
+  int i;
+
+  updgrp = XCALLOC (MTYPE_BGP_UPDGRP, sizeof (struct update_group));
+  updgrp->bgp = ref->bgp;
+  updgrp->afi = ref->afi;
+  updgrp->safi = ref->safi;
+  updgrp->sig = ref->sig;
+  for (i = 0; i < UPDGRP_FILTER_MAX; i++)
+    if (ref->sig.filter[i])
+      updgrp->sig.filter[i] = XSTRDUP (MTYPE_BGP_UPDGRP, ref->sig.filter[i]);
+  updgrp->id = ++updgrp_id;
+  updgrp->peer = list_new ();
+
+  listnode_add (ref->bgp->update_groups[ref->afi][ref->safi], updgrp);
+
+  return updgrp;
+}
+
+static void
+bgp_updgrp_packet_free (struct update_group_packet *pkt)
+{
+  unsigned int i;
+
+  stream_free (pkt->s);
+  bgp_attr_unintern (&pkt->attr);
+  for (i = 0; i < pkt->count; i++)
+    bgp_unlock_node (pkt->rn[i]);
+  XFREE (MTYPE_BGP_UPDGRP_PACKET, pkt->rn);
+  XFREE (MTYPE_BGP_UPDGRP_PACKET, pkt);
+}
+
+static void
+bgp_updgrp_cache_flush (struct update_group *updgrp)
+{
+  int i;
+
+  for (i = 0; i < UPDGRP_PACKET_CACHE; i++)
+    if (updgrp->cache[i])
+      {
+	bgp_updgrp_packet_free (updgrp->cache[i]);
+	updgrp->cache[i] = NULL;
+      }
+}
+
+static void
+bgp_updgrp_free (struct update_group *updgrp)
+{
+  struct bgp *bgp = updgrp->bgp;
+  int i;
+
+  hash_release (bgp->update_group_hash[updgrp->afi][updgrp->safi], updgrp);
+  listnode_delete (bgp->update_groups[updgrp->afi][updgrp->safi], updgrp);
+  bgp_updgrp_cache_flush (updgrp);
+  list_delete (updgrp->peer);
+  for (i = 0; i < UPDGRP_FILTER_MAX; i++)
+    if (updgrp->sig.filter[i])
+      XFREE (MTYPE_BGP_UPDGRP, updgrp->sig.filter[i]);
+  XFREE (MTYPE_BGP_UPDGRP, updgrp);
+}
+
+/* Rebuild the update groups of an address family from the current
+   peer configuration and state.  Calls with the same non-zero STAMP
+   after the first are no-ops, which lets the route processing queue
+   regroup once per run; a zero STAMP always regroups. */
+void
+bgp_updgrp_refresh (struct bgp *bgp, afi_t afi, safi_t safi,
+		    unsigned long stamp)
+{
+  struct update_group ref;
+  struct update_group *updgrp;
+  struct listnode *node, *nnode;
+  struct peer *peer;
+
+  if (bgp->update_groups[afi][safi] == NULL)
+    {
+      bgp->update_groups[afi][safi] = list_new ();
+      bgp->update_group_hash[afi][safi] =
+	hash_create (bgp_updgrp_hash_key, bgp_updgrp_hash_cmp);
+    }
+  else if (stamp && bgp->update_group_stamp[afi][safi] == stamp)
+    return;
+
+  bgp->update_group_stamp[afi][safi] = stamp;
+
+  /* Groups are kept across refreshes so their packet caches survive;
+     only the ones left without members are freed. */
+  for (ALL_LIST_ELEMENTS_RO (bgp->update_groups[afi][safi], node, updgrp))
+    list_delete_all_node (updgrp->peer);
+
+  ref.bgp = bgp;
+  ref.afi = afi;
+  ref.safi = safi;
+
+  for (ALL_LIST_ELEMENTS_RO (bgp->peer, node, peer))
+    {
+      peer->updgrp[afi][safi] = NULL;
+
+      if (peer->status != Established || ! peer->afc_nego[afi][safi])
+	continue;
+
+      bgp_updgrp_sig_make (peer, afi, safi, &ref.sig);
+      updgrp = hash_get (bgp->update_group_hash[afi][safi], &ref,
+			 bgp_updgrp_hash_alloc);
+
+      listnode_add (updgrp->peer, peer);
+      peer->updgrp[afi][safi] = updgrp;
+    }
+
+  for (ALL_LIST_ELEMENTS (bgp->update_groups[afi][safi], node, nnode, updgrp))
+    if (listcount (updgrp->peer) == 0)
+      bgp_updgrp_free (updgrp);
+}
+
+void
+bgp_updgrp_finish (struct bgp *bgp)
+{
+  afi_t afi;
+  safi_t safi;
+  struct update_group *updgrp;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      {
+	if (bgp->update_groups[afi][safi] == NULL)
+	  continue;
+
+	while (listcount (bgp->update_groups[afi][safi]))
+	  {
+	    updgrp = listgetdata (listhead (bgp->update_groups[afi][safi]));
+	    bgp_updgrp_free (updgrp);
+	  }
+	list_delete (bgp->update_groups[afi][safi]);
+	hash_free (bgp->update_group_hash[afi][safi]);
+	bgp->update_groups[afi][safi] = NULL;
+	bgp->update_group_hash[afi][safi] = NULL;
+      }
+}
+
+/* Return the update group PEER may share UPDATEs with, regrouping if
+   its configuration changed since the last refresh. */
+struct update_group *
+bgp_updgrp_peer_get (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct update_group_sig sig;
+  struct update_group *updgrp;
+
+  if (peer->status != Established
+      || safi == SAFI_MPLS_VPN
+      || CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+    return NULL;
+
+  bgp_updgrp_sig_make (peer, afi, safi, &sig);
+
+  updgrp = peer->updgrp[afi][safi];
+  if (updgrp && bgp_updgrp_sig_cmp (&updgrp->sig, &sig))
+    return updgrp;
+
+  bgp_updgrp_refresh (peer->bgp, afi, safi, 0);
+  return peer->updgrp[afi][safi];
+}
+
+static void
+bgp_updgrp_from_key (struct peer *from, int *ibgp, struct in_addr *id)
+{
+  if (from && from->sort == BGP_PEER_IBGP)
+    {
+      *ibgp = 1;
+      *id = from->remote_id;
+    }
+  else
+    {
+      *ibgp = 0;
+      id->s_addr = 0;
+    }
+}
+
+/* Does PKT carry exactly the prefixes bgp_update_packet() would take
+   from the head of the queue?  It packs HEAD first and then walks the
+   advertisements sharing its attribute. */
+static int
+bgp_updgrp_packet_match (struct update_group_packet *pkt,
+			 struct bgp_advertise *head)
+{
+  struct bgp_advertise *adv;
+  unsigned int i = 1;
+
+  if (head->rn != pkt->rn[0] || head->baa->attr != pkt->attr)
+    return 0;
+
+  for (adv = head->baa->adv; adv && i < pkt->count; adv = adv->next)
+    {
+      if (adv == head)
+	continue;
+      if (adv->rn != pkt->rn[i])
+	return 0;
+      i++;
+    }
+  return i == pkt->count;
+}
+
+/* Find a packet encoded for another group member that can be sent to
+   PEER as the next UPDATE of the address family, starting with HEAD.
+   Returns a shared copy of it and the number of prefixes it carries in
+   COUNT.  A packet is dropped once every other member has taken it. */
+struct stream *
+bgp_updgrp_packet_lookup (struct peer *peer, afi_t afi, safi_t safi,
+			  struct bgp_advertise *head, unsigned int *count)
+{
+  struct stream *s;
+  struct update_group *updgrp;
+  struct update_group_packet *pkt;
+  struct in_addr from_id;
+  int from_ibgp;
+  int i;
+
+  updgrp = bgp_updgrp_peer_get (peer, afi, safi);
+  if (! updgrp || listcount (updgrp->peer) < 2)
+    return NULL;
+
+  bgp_updgrp_from_key (head->binfo ? head->binfo->peer : NULL,
+		       &from_ibgp, &from_id);
+
+  for (i = 0; i < UPDGRP_PACKET_CACHE; i++)
+    {
+      pkt = updgrp->cache[i];
+      if (pkt
+	  && pkt->from_ibgp == from_ibgp
+	  && IPV4_ADDR_SAME (&pkt->from_id, &from_id)
+	  && bgp_updgrp_packet_match (pkt, head))
+	{
+	  updgrp->packet_shared++;
+	  s = stream_share (pkt->s);
+	  *count = pkt->count;
+
+	  if (++pkt->users >= listcount (updgrp->peer) - 1)
+	    {
+	      bgp_updgrp_packet_free (pkt);
+	      updgrp->cache[i] = NULL;
+	    }
+	  return s;
+	}
+    }
+  return NULL;
+}
+
+/* Remember an UPDATE just encoded for PEER so the other members of its
+   group can reuse it.  RN lists the COUNT prefixes packed into it. */
+void
+bgp_updgrp_packet_add (struct peer *peer, afi_t afi, safi_t safi,
+		       struct stream *s, struct attr *attr, struct peer *from,
+		       struct bgp_node **rn, unsigned int count)
+{
+  struct update_group *updgrp;
+  struct update_group_packet *pkt;
+  unsigned int i;
+
+  updgrp = bgp_updgrp_peer_get (peer, afi, safi);
+  if (! updgrp || count == 0)
+    return;
+
+  updgrp->packet_built++;
+
+  if (listcount (updgrp->peer) < 2)
+    return;
+
+  pkt = XCALLOC (MTYPE_BGP_UPDGRP_PACKET, sizeof (struct update_group_packet));
+  pkt->s = stream_share (s);
+  pkt->attr = bgp_attr_intern (attr);
+  bgp_updgrp_from_key (from, &pkt->from_ibgp, &pkt->from_id);
+  pkt->count = count;
+  pkt->rn = XMALLOC (MTYPE_BGP_UPDGRP_PACKET, count * sizeof (struct bgp_node *));
+  for (i = 0; i < count; i++)
+    pkt->rn[i] = bgp_lock_node (rn[i]);
+
+  if (updgrp->cache[updgrp->cache_next])
+    bgp_updgrp_packet_free (updgrp->cache[updgrp->cache_next]);
+  updgrp->cache[updgrp->cache_next] = pkt;
+  updgrp->cache_next = (updgrp->cache_next + 1) % UPDGRP_PACKET_CACHE;
+}
+
+static void
+bgp_show_updgrp (struct vty *vty, struct bgp *bgp, afi_t afi, safi_t safi)
+{
+  struct update_group *updgrp;
+  struct listnode *node, *pnode;
+  struct peer *peer;
+
+  bgp_updgrp_refresh (bgp, afi, safi, 0);
+
+  for (ALL_LIST_ELEMENTS_RO (bgp->update_groups[afi][safi], node, updgrp))
+    {
+      vty_out (vty, "Update group %u, %s, %d member%s%s", updgrp->id,
+	       afi_safi_print (afi, safi), listcount (updgrp->peer),
+	       listcount (updgrp->peer) == 1 ? "" : "s", VTY_NEWLINE);
+      vty_out (vty, "  Policy evaluations: %lu run, %lu shared%s",
+	       updgrp->policy_run, updgrp->policy_shared, VTY_NEWLINE);
+      vty_out (vty, "  UPDATE packets: %lu built, %lu shared%s",
+	       updgrp->packet_built, updgrp->packet_shared, VTY_NEWLINE);
+      vty_out (vty, "  Members:");
+      for (ALL_LIST_ELEMENTS_RO (updgrp->peer, pnode, peer))
+	vty_out (vty, " %s", peer->host);
+      vty_out (vty, "%s", VTY_NEWLINE);
+    }
+}
+
+DEFUN (show_ip_bgp_update_groups,
+       show_ip_bgp_update_groups_cmd,
+       "show ip bgp update-groups",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "Update groups of peers sharing outbound UPDATEs\n")
+{
+  struct bgp *bgp;
+  afi_t afi;
+  safi_t safi;
+
+  bgp = bgp_get_default ();
+  if (bgp == NULL)
+    {
+      vty_out (vty, "No BGP process is configured%s", VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      bgp_show_updgrp (vty, bgp, afi, safi);
+
+  return CMD_SUCCESS;
+}
+
+void
+bgp_updgrp_init (void)
+{
+  install_element (VIEW_NODE, &show_ip_bgp_update_groups_cmd);
+  install_element (ENABLE_NODE, &show_ip_bgp_update_groups_cmd);
+}
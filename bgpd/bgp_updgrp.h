@@ -0,0 +1,117 @@
+/*
+ * BGP update groups
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_UPDGRP_H
+#define _QUAGGA_BGP_UPDGRP_H
+
+/* Everything bgp_announce_check() and bgp_packet_attribute() look at
+   when deciding what to send to a peer.  Established peers of an
+   address family with equal signatures get identical UPDATEs. */
+struct update_group_sig
+{
+  /* Set for peers whose policy depends on their identity (ORF,
+     peer-specific route-map rules); such peers get a group of their
+     own. */
+  struct peer *peer;
+
+  bgp_peer_sort_t sort;
+  as_t as;
+  as_t local_as;
+  as_t change_local_as;
+  u_int32_t flags;
+  u_int32_t af_flags;
+  u_int16_t af_sflags;
+  u_int16_t cap;
+
+  int shared_network;
+  struct in_addr nexthop;
+#ifdef HAVE_IPV6
+  struct in6_addr nexthop_global;
+  struct in6_addr nexthop_local;
+#endif /* HAVE_IPV6 */
+
+  /* Connected network of an EBGP peer, see bgp_multiaccess_key_v4. */
+  struct prefix connected;
+
+  /* Outbound filter names, compared by value.  Must stay last. */
+#define UPDGRP_FILTER_MAX 5
+  char *filter[UPDGRP_FILTER_MAX];
+};
+
+/* An encoded UPDATE kept for reuse by the other group members.  */
+struct update_group_packet
+{
+  /* Shared copy of the packet, see stream_share(). */
+  struct stream *s;
+
+  /* Attribute and originating peer details the packet was encoded
+     with. */
+  struct attr *attr;
+  int from_ibgp;
+  struct in_addr from_id;
+
+  /* NLRI in the order they were packed, each node locked. */
+  unsigned int count;
+  struct bgp_node **rn;
+
+  /* Members that reused the packet. */
+  unsigned int users;
+};
+
+#define UPDGRP_PACKET_CACHE 32
+
+struct update_group
+{
+  struct bgp *bgp;
+  afi_t afi;
+  safi_t safi;
+
+  unsigned int id;
+
+  struct update_group_sig sig;
+
+  /* Member peers, rebuilt by bgp_updgrp_refresh(). */
+  struct list *peer;
+
+  /* Recently built packets. */
+  struct update_group_packet *cache[UPDGRP_PACKET_CACHE];
+  unsigned int cache_next;
+
+  /* Statistics. */
+  unsigned long policy_run;	/* Export policy evaluations.  */
+  unsigned long policy_shared;	/* Evaluations saved by sharing.  */
+  unsigned long packet_built;	/* UPDATEs encoded.  */
+  unsigned long packet_shared;	/* UPDATEs reused from another member. */
+};
+
+extern void bgp_updgrp_init (void);
+extern void bgp_updgrp_finish (struct bgp *);
+extern void bgp_updgrp_refresh (struct bgp *, afi_t, safi_t, unsigned long);
+extern struct update_group *bgp_updgrp_peer_get (struct peer *, afi_t, safi_t);
+extern struct stream *bgp_updgrp_packet_lookup (struct peer *, afi_t, safi_t,
+						struct bgp_advertise *,
+						unsigned int *);
+extern void bgp_updgrp_packet_add (struct peer *, afi_t, safi_t,
+				   struct stream *, struct attr *,
+				   struct peer *, struct bgp_node **,
+				   unsigned int);
+
+#endif /* _QUAGGA_BGP_UPDGRP_H */
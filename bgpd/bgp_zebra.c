@@ -1076,6 +1076,13 @@ bgp_zclient_reset (void)
   zclient_reset (zclient);
 }
 
+/* Zebra connection is up. */
+static void
+bgp_zebra_connected (struct zclient *zclient)
+{
+  bgp_nexthop_register_all ();
+}
+
 void
 bgp_zebra_init (void)
 {
@@ -1091,6 +1098,8 @@ bgp_zebra_init (void)
   zclient->ipv4_route_delete = zebra_read_ipv4;
   zclient->interface_up = bgp_interface_up;
   zclient->interface_down = bgp_interface_down;
+  zclient->nexthop_update = bgp_nexthop_update;
+  zclient->zebra_connected = bgp_zebra_connected;
 #ifdef HAVE_IPV6
   zclient->ipv6_route_add = zebra_read_ipv6;
   zclient->ipv6_route_delete = zebra_read_ipv6;
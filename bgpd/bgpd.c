@@ -58,6 +58,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_network.h"
 #include "bgpd/bgp_vty.h"
 #include "bgpd/bgp_mpath.h"
+#include "bgpd/bgp_updgrp.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -2179,6 +2180,8 @@ bgp_free (struct bgp *bgp)
   afi_t afi;
   safi_t safi;
 
+  bgp_updgrp_finish (bgp);
+
   list_delete (bgp->group);
   list_delete (bgp->peer);
   list_delete (bgp->rsclient);
@@ -3797,6 +3800,9 @@ peer_distribute_update (struct access_list *access)
   struct peer_group *group;
   struct bgp_filter *filter;
 
+  /* Route-map next-hop matches may use the list. */
+  route_map_cache_flush ();
+
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
       for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
@@ -3956,6 +3962,9 @@ peer_prefix_list_update (struct prefix_list *plist)
   safi_t safi;
   int direct;
 
+  /* Route-map next-hop matches may use the list. */
+  route_map_cache_flush ();
+
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
       for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
@@ -4110,6 +4119,9 @@ peer_aslist_update (void)
   struct peer_group *group;
   struct bgp_filter *filter;
 
+  /* Route-map as-path matches may use the list. */
+  route_map_cache_flush ();
+
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
       for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
@@ -5433,6 +5445,7 @@ bgp_init (void)
   bgp_address_init ();
   bgp_scan_init ();
   bgp_mplsvpn_init ();
+  bgp_updgrp_init ();
 
   /* Access list initialize. */
   access_list_init ();
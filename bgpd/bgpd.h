@@ -172,6 +172,11 @@ struct bgp
     u_int16_t maxpaths_ebgp;
     u_int16_t maxpaths_ibgp;
   } maxpaths[AFI_MAX][SAFI_MAX];
+
+  /* Update groups, see bgp_updgrp.c.  */
+  struct list *update_groups[AFI_MAX][SAFI_MAX];
+  struct hash *update_group_hash[AFI_MAX][SAFI_MAX];
+  unsigned long update_group_stamp[AFI_MAX][SAFI_MAX];
 };
 
 /* BGP peer-group support. */
@@ -310,6 +315,12 @@ struct peer
   /* Peer specific RIB when configured as route-server-client. */
   struct bgp_table *rib[AFI_MAX][SAFI_MAX];
 
+  /* Packet I/O thread state, when it has the socket. */
+  struct bgp_io *io;
+
+  /* Decoded form of the UPDATE in ibuf, while it is processed. */
+  struct bgp_update_parsed *parsed;
+
   /* Packet receive and send buffer. */
   struct stream *ibuf;
   struct stream_fifo *obuf;
@@ -515,6 +526,9 @@ struct peer
   /* Announcement attribute hash.  */
   struct hash *hash[AFI_MAX][SAFI_MAX];
 
+  /* Update group, valid while Established.  */
+  struct update_group *updgrp[AFI_MAX][SAFI_MAX];
+
   /* Notify data. */
   struct bgp_notify notify;
 
@@ -594,6 +608,10 @@ struct bgp_nlri
 
   /* Length of whole NLRI.  */
   bgp_size_t length;
+
+  /* Same NLRI decoded, when a parse worker did it already.  */
+  struct prefix *prefixes;
+  int count;
 };
 
 /* BGP versions.  */
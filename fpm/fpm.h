@@ -85,6 +85,13 @@
  * If the connection to the FPM goes down for some reason, the client
  * (zebra) should send the FPM a complete copy of the forwarding
  * table(s) when it reconnects.
+ *
+ * An FPM that would rather not parse netlink may send zebra an
+ * FPM_MSG_TYPE_CAPS message as soon as it accepts the connection. From
+ * then on, zebra sends routes in FPM_MSG_TYPE_ROUTES messages instead,
+ * many to a message, in the compact encoding described further below.
+ * Zebra waits a little for the message before it sends the full table,
+ * but updates it had already queued may still arrive as netlink.
  */
 
 #define FPM_DEFAULT_PORT 2620
@@ -94,6 +101,14 @@
  */
 #define FPM_MAX_MSG_LEN 4096
 
+/*
+ * Largest FPM_MSG_TYPE_ROUTES message, the most msg_len can hold at
+ * the message alignment. Zebra only sends messages longer than
+ * FPM_MAX_MSG_LEN if the FPM asked for them in its FPM_MSG_TYPE_CAPS
+ * message.
+ */
+#define FPM_MAX_ROUTES_MSG_LEN 65532
+
 /*
  * Header that precedes each fpm message to/from the FPM.
  */
@@ -133,6 +148,17 @@ typedef enum fpm_msg_type_e_ {
    * message.
    */
   FPM_MSG_TYPE_NETLINK = 1,
+
+  /*
+   * Indicates that the payload is a batch of routes in the compact
+   * encoding, see fpm_routes_hdr_t.
+   */
+  FPM_MSG_TYPE_ROUTES = 2,
+
+  /*
+   * Sent by the FPM to zebra, with an fpm_caps_t payload.
+   */
+  FPM_MSG_TYPE_CAPS = 3,
 } fpm_msg_type_e;
 
 /*
@@ -239,7 +265,11 @@ fpm_msg_hdr_ok (const fpm_msg_hdr_t *hdr)
 
   msg_len = fpm_msg_len (hdr);
 
-  if (msg_len < FPM_MSG_HDR_LEN || msg_len > FPM_MAX_MSG_LEN)
+  if (msg_len < FPM_MSG_HDR_LEN)
+    return 0;
+
+  if (msg_len > (hdr->msg_type == FPM_MSG_TYPE_ROUTES ?
+		 FPM_MAX_ROUTES_MSG_LEN : FPM_MAX_MSG_LEN))
     return 0;
 
   if (fpm_msg_align (msg_len) != msg_len)
@@ -270,4 +300,290 @@ fpm_msg_ok (const fpm_msg_hdr_t *hdr, size_t len)
   return 1;
 }
 
+/*
+ * Payload of an FPM_MSG_TYPE_CAPS message. All fields are in network
+ * byte order.
+ */
+typedef struct fpm_caps_t_
+{
+  /*
+   * FPM_CAP_* flags for what the FPM understands.
+   */
+  uint32_t flags;
+
+  /*
+   * Largest message the FPM takes, between FPM_MAX_MSG_LEN and
+   * FPM_MAX_ROUTES_MSG_LEN. 0 means FPM_MAX_MSG_LEN.
+   */
+  uint16_t max_msg_len;
+
+  uint16_t reserved;
+} fpm_caps_t;
+
+/*
+ * The FPM takes FPM_MSG_TYPE_ROUTES messages.
+ */
+#define FPM_CAP_ROUTES 0x00000001
+
+/*
+ * The payload of an FPM_MSG_TYPE_ROUTES message is this header,
+ * followed by num_routes routes, each an fpm_route_t followed by:
+ *
+ * - the prefix, fpm_route_prefix_len() bytes, padded with zeros;
+ *
+ * - the preferred source address, if FPM_ROUTE_F_SRC is set;
+ *
+ * - num_nhs nexthops, each the outgoing interface index as a 32 bit
+ *   integer in network byte order and the gateway address, all zeros
+ *   if there is none.
+ *
+ * Addresses are 4 bytes long for FPM_ROUTE_AF_INET and 16 bytes for
+ * FPM_ROUTE_AF_INET6, so everything stays at a 4 byte alignment.
+ */
+typedef struct fpm_routes_hdr_t_
+{
+  /*
+   * Number of routes in the message, in network byte order.
+   */
+  uint16_t num_routes;
+
+  uint16_t reserved;
+} fpm_routes_hdr_t;
+
+typedef struct fpm_route_t_
+{
+  /*
+   * Length of the route, including prefix and nexthops, in network
+   * byte order.
+   */
+  uint16_t len;
+
+  /*
+   * FPM_ROUTE_OP_ADD or FPM_ROUTE_OP_DEL. A delete carries no
+   * nexthops.
+   */
+  uint8_t op;
+
+  /*
+   * FPM_ROUTE_AF_*.
+   */
+  uint8_t family;
+
+  uint8_t prefixlen;
+
+  /*
+   * FPM_ROUTE_TYPE_*.
+   */
+  uint8_t type;
+
+  /*
+   * The zebra route type (ZEBRA_ROUTE_* in lib/route_types.h) of the
+   * route selected, 0 for deletes.
+   */
+  uint8_t protocol;
+
+  uint8_t num_nhs;
+
+  /*
+   * FPM_ROUTE_F_* flags.
+   */
+  uint8_t flags;
+
+  uint8_t reserved[3];
+
+  /*
+   * Routing table and metric, in network byte order.
+   */
+  uint32_t table_id;
+  uint32_t metric;
+} fpm_route_t;
+
+#define FPM_ROUTE_OP_ADD 1
+#define FPM_ROUTE_OP_DEL 2
+
+#define FPM_ROUTE_AF_INET  1
+#define FPM_ROUTE_AF_INET6 2
+
+#define FPM_ROUTE_TYPE_UNICAST     1
+#define FPM_ROUTE_TYPE_BLACKHOLE   2
+#define FPM_ROUTE_TYPE_UNREACHABLE 3
+
+/*
+ * A preferred source address follows the prefix.
+ */
+#define FPM_ROUTE_F_SRC 0x01
+
+/*
+ * fpm_route_addr_len
+ *
+ * Length of an address of the given FPM_ROUTE_AF_* family, 0 if the
+ * family is unknown.
+ */
+static inline size_t
+fpm_route_addr_len (uint8_t family)
+{
+  switch (family)
+    {
+    case FPM_ROUTE_AF_INET:
+      return 4;
+    case FPM_ROUTE_AF_INET6:
+      return 16;
+    default:
+      return 0;
+    }
+}
+
+/*
+ * fpm_route_prefix_len
+ *
+ * Space taken by a prefix of the given length.
+ */
+static inline size_t
+fpm_route_prefix_len (uint8_t prefixlen)
+{
+  return fpm_msg_align ((prefixlen + 7) / 8);
+}
+
+/*
+ * fpm_route_nh_len
+ *
+ * Space taken by each nexthop of a route of the given family.
+ */
+static inline size_t
+fpm_route_nh_len (uint8_t family)
+{
+  return 4 + fpm_route_addr_len (family);
+}
+
+/*
+ * A route decoded by fpm_route_decode(). The pointers point into the
+ * message.
+ */
+typedef struct fpm_route_info_t_
+{
+  uint8_t op;
+  uint8_t family;
+  uint8_t prefixlen;
+  uint8_t type;
+  uint8_t protocol;
+  uint32_t table_id;
+  uint32_t metric;
+
+  /*
+   * The prefix, of which the first (prefixlen + 7) / 8 bytes count,
+   * and the preferred source address or NULL.
+   */
+  const uint8_t *prefix;
+  const uint8_t *src;
+
+  int num_nhs;
+  const uint8_t *nhs;
+} fpm_route_info_t;
+
+/*
+ * fpm_route_decode
+ *
+ * Reference decoder for the routes in an FPM_MSG_TYPE_ROUTES
+ * message. Decodes the route at '*pos' into 'info', and moves '*pos'
+ * on to the next route. 'end' is the end of the message's payload.
+ *
+ * Returns TRUE on success, FALSE if the route is malformed. The rest
+ * of the message should then be dropped.
+ *
+ * A message is decoded with:
+ *
+ *   const fpm_routes_hdr_t *rh = fpm_msg_data (hdr);
+ *   const uint8_t *pos = (const uint8_t *) (rh + 1);
+ *   const uint8_t *end = (const uint8_t *) rh + fpm_msg_data_len (hdr);
+ *
+ *   for (i = 0; i < ntohs (rh->num_routes); i++)
+ *     if (!fpm_route_decode (&pos, end, &info))
+ *       ...
+ */
+static inline int
+fpm_route_decode (const uint8_t **pos, const uint8_t *end,
+		  fpm_route_info_t *info)
+{
+  const fpm_route_t *route;
+  const uint8_t *p;
+  size_t len, alen, need;
+
+  p = *pos;
+  if (end < p || (size_t) (end - p) < sizeof (fpm_route_t))
+    return 0;
+
+  route = (const fpm_route_t *) p;
+  len = ntohs (route->len);
+  if (len > (size_t) (end - p) || fpm_msg_align (len) != len)
+    return 0;
+
+  info->op = route->op;
+  info->family = route->family;
+  info->prefixlen = route->prefixlen;
+  info->type = route->type;
+  info->protocol = route->protocol;
+  info->table_id = ntohl (route->table_id);
+  info->metric = ntohl (route->metric);
+  info->num_nhs = route->num_nhs;
+
+  alen = fpm_route_addr_len (route->family);
+  if (!alen || route->prefixlen > alen * 8)
+    return 0;
+
+  if (route->op != FPM_ROUTE_OP_ADD
+      && (route->op != FPM_ROUTE_OP_DEL || route->num_nhs))
+    return 0;
+
+  need = sizeof (fpm_route_t) + fpm_route_prefix_len (route->prefixlen)
+    + route->num_nhs * fpm_route_nh_len (route->family);
+  if (route->flags & FPM_ROUTE_F_SRC)
+    need += alen;
+  if (need != len)
+    return 0;
+
+  p += sizeof (fpm_route_t);
+  info->prefix = p;
+  p += fpm_route_prefix_len (route->prefixlen);
+
+  info->src = NULL;
+  if (route->flags & FPM_ROUTE_F_SRC)
+    {
+      info->src = p;
+      p += alen;
+    }
+
+  info->nhs = p;
+  *pos += len;
+  return 1;
+}
+
+/*
+ * fpm_route_nh
+ *
+ * Get the interface index and gateway of the i'th nexthop of a
+ * decoded route. The gateway is NULL if the nexthop has none.
+ */
+static inline void
+fpm_route_nh (const fpm_route_info_t *info, int i, uint32_t *if_index,
+	      const uint8_t **gateway)
+{
+  const uint8_t *nh;
+  size_t alen, j;
+  uint32_t ifi;
+
+  alen = fpm_route_addr_len (info->family);
+  nh = info->nhs + i * fpm_route_nh_len (info->family);
+
+  memcpy (&ifi, nh, sizeof (ifi));
+  *if_index = ntohl (ifi);
+
+  *gateway = NULL;
+  for (j = 0; j < alen; j++)
+    if (nh[4 + j])
+      {
+	*gateway = nh + 4;
+	break;
+      }
+}
+
 #endif /* _FPM_H */
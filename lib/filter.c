@@ -28,6 +28,7 @@
 #include "sockunion.h"
 #include "buffer.h"
 #include "log.h"
+#include "table.h"
 
 struct filter_cisco
 {
@@ -68,6 +69,27 @@ struct filter
     } u;
 };
 
+/* Filters of an access-list indexed by the address bits they fix, so
+   that only those that can match a prefix are tried on it. */
+struct access_list_index
+{
+  /* Filters in list order. */
+  struct filter **filters;
+  int count;
+
+  /* Position of the next filter in the same node, or -1. */
+  int *chain;
+
+  /* Zebra filters by their prefix, and cisco ones by the address bits
+     before the first wildcard bit.  Node info points to the first
+     filter of the node in filters. */
+  struct route_table *zebra;
+  struct route_table *cisco;
+};
+
+/* Lists shorter than this are walked instead. */
+#define ACCESS_LIST_INDEX_MIN 8
+
 /* List of access_list. */
 struct access_list_list
 {
@@ -209,6 +231,129 @@ filter_match_zebra (struct filter *mfilter, struct prefix *p)
     return 0;
 }
 
+static void
+access_list_index_free (struct access_list *access)
+{
+  struct access_list_index *index = access->index;
+
+  if (! index)
+    return;
+
+  route_table_finish (index->zebra);
+  route_table_finish (index->cisco);
+  XFREE (MTYPE_ACCESS_LIST_INDEX, index->filters);
+  XFREE (MTYPE_ACCESS_LIST_INDEX, index->chain);
+  XFREE (MTYPE_ACCESS_LIST_INDEX, index);
+  access->index = NULL;
+}
+
+/* Where the filter goes in the index. */
+static struct route_table *
+access_list_index_key (struct access_list_index *index,
+		       struct filter *filter, struct prefix *key)
+{
+  u_int32_t wildcard;
+  int len;
+
+  if (! filter->cisco)
+    {
+      prefix_copy (key, &filter->u.zfilter.prefix);
+      apply_mask (key);
+      return index->zebra;
+    }
+
+  wildcard = ntohl (filter->u.cfilter.addr_mask.s_addr);
+  for (len = 0; len < IPV4_MAX_BITLEN; len++)
+    if (wildcard & (0x80000000 >> len))
+      break;
+
+  memset (key, 0, sizeof (struct prefix));
+  key->family = AF_INET;
+  key->prefixlen = len;
+  key->u.prefix4 = filter->u.cfilter.addr;
+  apply_mask (key);
+  return index->cisco;
+}
+
+static void
+access_list_index_build (struct access_list *access)
+{
+  struct access_list_index *index;
+  struct route_table *table;
+  struct route_node *rn;
+  struct filter *filter;
+  struct prefix key;
+  int i;
+
+  index = XCALLOC (MTYPE_ACCESS_LIST_INDEX,
+		   sizeof (struct access_list_index));
+  for (filter = access->head; filter; filter = filter->next)
+    index->count++;
+  index->filters = XMALLOC (MTYPE_ACCESS_LIST_INDEX,
+			    index->count * sizeof (index->filters[0]));
+  index->chain = XMALLOC (MTYPE_ACCESS_LIST_INDEX,
+			  index->count * sizeof (index->chain[0]));
+  index->zebra = route_table_init ();
+  index->cisco = route_table_init ();
+
+  for (i = 0, filter = access->head; filter; filter = filter->next)
+    index->filters[i++] = filter;
+
+  /* Last filter first, so that each node's chain comes out in list
+     order.  The nodes stay locked until the tables are freed. */
+  for (i = index->count - 1; i >= 0; i--)
+    {
+      table = access_list_index_key (index, index->filters[i], &key);
+      rn = route_node_get (table, &key);
+      if (rn->info)
+	{
+	  index->chain[i] = (struct filter **) rn->info - index->filters;
+	  route_unlock_node (rn);
+	}
+      else
+	index->chain[i] = -1;
+      rn->info = &index->filters[i];
+    }
+
+  access->index = index;
+}
+
+/* Position of the first filter in the table that matches the prefix,
+   if before best.  Every node whose key covers the one looked up is on
+   the way up from its longest match. */
+static int
+access_list_index_match (struct access_list_index *index,
+			 struct route_table *table, struct prefix *key,
+			 struct prefix *p, int best)
+{
+  struct route_node *match;
+  struct route_node *rn;
+  struct filter *filter;
+  int i;
+
+  match = route_node_match (table, key);
+  for (rn = match; rn; rn = rn->parent)
+    {
+      if (! rn->info)
+	continue;
+
+      for (i = (struct filter **) rn->info - index->filters;
+	   i >= 0 && i < best; i = index->chain[i])
+	{
+	  filter = index->filters[i];
+	  if (filter->cisco ? filter_match_cisco (filter, p)
+			    : filter_match_zebra (filter, p))
+	    {
+	      best = i;
+	      break;
+	    }
+	}
+    }
+  if (match)
+    route_unlock_node (match);
+  return best;
+}
+
 /* Allocate new access list structure. */
 static struct access_list *
 access_list_new (void)
@@ -233,6 +378,8 @@ access_list_delete (struct access_list *access)
   struct access_list_list *list;
   struct access_master *master;
 
+  access_list_index_free (access);
+
   for (filter = access->head; filter; filter = next)
     {
       next = filter->next;
@@ -395,6 +542,19 @@ access_list_get (afi_t afi, const char *name)
   return access;
 }
 
+/* Is the list long enough to be worth indexing? */
+static int
+access_list_indexable (struct access_list *access)
+{
+  struct filter *filter;
+  int count = 0;
+
+  for (filter = access->head; filter; filter = filter->next)
+    if (++count >= ACCESS_LIST_INDEX_MIN)
+      return 1;
+  return 0;
+}
+
 /* Apply access list to object (which should be struct prefix *). */
 enum filter_type
 access_list_apply (struct access_list *access, void *object)
@@ -407,6 +567,30 @@ access_list_apply (struct access_list *access, void *object)
   if (access == NULL)
     return FILTER_DENY;
 
+  if (access->index || access_list_indexable (access))
+    {
+      struct access_list_index *index;
+      struct prefix key;
+      int best;
+
+      if (! access->index)
+	access_list_index_build (access);
+      index = access->index;
+
+      /* Cisco filters look at the whole address. */
+      best = access_list_index_match (index, index->zebra, p, p,
+				      index->count);
+      memset (&key, 0, sizeof (struct prefix));
+      key.family = AF_INET;
+      key.prefixlen = IPV4_MAX_BITLEN;
+      key.u.prefix4 = p->u.prefix4;
+      best = access_list_index_match (index, index->cisco, &key, p, best);
+
+      if (best < index->count)
+	return index->filters[best]->type;
+      return FILTER_DENY;
+    }
+
   for (filter = access->head; filter; filter = filter->next)
     {
       if (filter->cisco)
@@ -448,6 +632,8 @@ access_list_delete_hook (void (*func) (struct access_list *access))
 static void
 access_list_filter_add (struct access_list *access, struct filter *filter)
 {
+  access_list_index_free (access);
+
   filter->next = NULL;
   filter->prev = access->tail;
 
@@ -481,6 +667,8 @@ access_list_filter_delete (struct access_list *access, struct filter *filter)
 
   master = access->master;
 
+  access_list_index_free (access);
+
   if (filter->next)
     filter->next->prev = filter->prev;
   else
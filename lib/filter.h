@@ -54,6 +54,9 @@ struct access_list
 
   struct filter *head;
   struct filter *tail;
+
+  /* Built on first use after the filters change. */
+  struct access_list_index *index;
 };
 
 /* Prototypes for access-list. */
@@ -890,6 +890,12 @@ static const struct zebra_desc_table command_types[] = {
   DESC_ENTRY	(ZEBRA_ROUTER_ID_DELETE),
   DESC_ENTRY	(ZEBRA_ROUTER_ID_UPDATE),
   DESC_ENTRY	(ZEBRA_HELLO),
+  DESC_ENTRY	(ZEBRA_NEXTHOP_REGISTER),
+  DESC_ENTRY	(ZEBRA_NEXTHOP_UNREGISTER),
+  DESC_ENTRY	(ZEBRA_NEXTHOP_UPDATE),
+  DESC_ENTRY	(ZEBRA_IPV4_ROUTE_BULK_ADD),
+  DESC_ENTRY	(ZEBRA_IPV4_ROUTE_BULK_DELETE),
+  DESC_ENTRY	(ZEBRA_RING_KICK),
 };
 #undef DESC_ENTRY
 
@@ -58,6 +58,252 @@ zerror (const char *fname, int type, size_t size)
   abort();
 }
 
+#ifdef HAVE_SLAB_ALLOC
+/*
+ * Slab allocation for the fixed-size types flagged MEMORY_SLAB in
+ * memtypes.c.  Objects are carved from large aligned pages, so the page
+ * an object lives on is found by masking its address.  Each type has a
+ * cache per object size seen, in practice just the one, with its pages
+ * on a partial, full or (at most one) empty list.
+ *
+ * The caches and their lists are not locked: types flagged MEMORY_SLAB
+ * may only be allocated and freed on the main thread.  Worker threads
+ * (bgpd's I/O, parse and selection threads) keep to plain malloc() or
+ * to types that are not flagged.
+ */
+#define SLAB_PAGE_SIZE	(64 * 1024)
+#define SLAB_ALIGN	16
+#define SLAB_ROUND(S)	(((S) + SLAB_ALIGN - 1) & ~((size_t) SLAB_ALIGN - 1))
+/* The page header is padded to a cache line, so objects sized in whole
+   cache lines are also aligned on them. */
+#define SLAB_LINE	64
+#define SLAB_HDR_SIZE	((sizeof (struct slab_page) + SLAB_LINE - 1) \
+			 & ~((size_t) SLAB_LINE - 1))
+/* Bigger objects get a page run to themselves. */
+#define SLAB_OBJ_MAX	(SLAB_PAGE_SIZE / 8)
+
+struct slab_cache;
+
+struct slab_page
+{
+  struct slab_cache *cache;	/* NULL for a page run of one big object */
+  struct slab_page *next;
+  struct slab_page *prev;
+  void *free;			/* freed objects */
+  unsigned int inuse;
+  unsigned int carved;		/* objects carved so far */
+  size_t size;			/* of the object, for a page run */
+};
+
+struct slab_cache
+{
+  struct slab_cache *next;	/* cache of another size, same type */
+  size_t size;
+  unsigned int per_page;
+  struct slab_page *partial;
+  struct slab_page *full;
+  struct slab_page *empty;
+  unsigned long pages;
+  unsigned long inuse;
+};
+
+static struct
+{
+  int enabled;
+  struct slab_cache *caches;
+  unsigned long runs;		/* pages held by big objects */
+} mslab[MTYPE_MAX];
+
+static int slab_inited;
+
+static void
+slab_init (void)
+{
+  struct mlist *ml;
+  struct memory_list *m;
+
+  for (ml = mlists; ml->list; ml++)
+    for (m = ml->list; m->index >= 0; m++)
+      if (m->index && (m->flags & MEMORY_SLAB))
+        mslab[m->index].enabled = 1;
+
+  slab_inited = 1;
+}
+
+static int
+slab_enabled (int type)
+{
+  if (!slab_inited)
+    slab_init ();
+  return mslab[type].enabled;
+}
+
+static void
+slab_page_link (struct slab_page **head, struct slab_page *page)
+{
+  page->prev = NULL;
+  page->next = *head;
+  if (*head)
+    (*head)->prev = page;
+  *head = page;
+}
+
+static void
+slab_page_unlink (struct slab_page **head, struct slab_page *page)
+{
+  if (page->prev)
+    page->prev->next = page->next;
+  else
+    *head = page->next;
+  if (page->next)
+    page->next->prev = page->prev;
+  page->next = page->prev = NULL;
+}
+
+static struct slab_page *
+slab_page_new (size_t size)
+{
+  void *page;
+
+  if (posix_memalign (&page, SLAB_PAGE_SIZE, size) != 0)
+    return NULL;
+  memset (page, 0, sizeof (struct slab_page));
+  return page;
+}
+
+static struct slab_cache *
+slab_cache_get (int type, size_t size)
+{
+  struct slab_cache *cache;
+
+  size = SLAB_ROUND (size ? size : 1);
+  for (cache = mslab[type].caches; cache; cache = cache->next)
+    if (cache->size == size)
+      return cache;
+
+  cache = calloc (1, sizeof (struct slab_cache));
+  if (cache == NULL)
+    return NULL;
+  cache->size = size;
+  cache->per_page = (SLAB_PAGE_SIZE - SLAB_HDR_SIZE) / size;
+  cache->next = mslab[type].caches;
+  mslab[type].caches = cache;
+  return cache;
+}
+
+static void *
+slab_alloc (int type, size_t size)
+{
+  struct slab_cache *cache;
+  struct slab_page *page;
+  void *obj;
+
+  if (size > SLAB_OBJ_MAX)
+    {
+      if ((page = slab_page_new (SLAB_HDR_SIZE + size)) == NULL)
+        return NULL;
+      page->size = size;
+      mslab[type].runs += (SLAB_HDR_SIZE + size + SLAB_PAGE_SIZE - 1)
+                          / SLAB_PAGE_SIZE;
+      return (char *) page + SLAB_HDR_SIZE;
+    }
+
+  if ((cache = slab_cache_get (type, size)) == NULL)
+    return NULL;
+
+  if ((page = cache->partial) == NULL)
+    {
+      if ((page = cache->empty) != NULL)
+        cache->empty = NULL;
+      else if ((page = slab_page_new (SLAB_PAGE_SIZE)) != NULL)
+        {
+          page->cache = cache;
+          cache->pages++;
+        }
+      else
+        return NULL;
+      slab_page_link (&cache->partial, page);
+    }
+
+  if (page->free)
+    {
+      obj = page->free;
+      page->free = *(void **) obj;
+    }
+  else
+    obj = (char *) page + SLAB_HDR_SIZE + page->carved++ * cache->size;
+
+  page->inuse++;
+  cache->inuse++;
+  if (page->inuse == cache->per_page)
+    {
+      slab_page_unlink (&cache->partial, page);
+      slab_page_link (&cache->full, page);
+    }
+  return obj;
+}
+
+static struct slab_page *
+slab_page_of (void *ptr)
+{
+  return (struct slab_page *) ((uintptr_t) ptr
+                               & ~((uintptr_t) SLAB_PAGE_SIZE - 1));
+}
+
+static size_t
+slab_size (void *ptr)
+{
+  struct slab_page *page = slab_page_of (ptr);
+
+  return page->cache ? page->cache->size : page->size;
+}
+
+static void
+slab_free (int type, void *ptr)
+{
+  struct slab_page *page = slab_page_of (ptr);
+  struct slab_cache *cache = page->cache;
+
+  if (cache == NULL)
+    {
+      mslab[type].runs -= (SLAB_HDR_SIZE + page->size + SLAB_PAGE_SIZE - 1)
+                          / SLAB_PAGE_SIZE;
+      free (page);
+      return;
+    }
+
+  if (page->inuse == cache->per_page)
+    {
+      slab_page_unlink (&cache->full, page);
+      slab_page_link (&cache->partial, page);
+    }
+
+  *(void **) ptr = page->free;
+  page->free = ptr;
+  page->inuse--;
+  cache->inuse--;
+
+  /* Keep one empty page around, so one object being allocated and
+   * freed repeatedly doesn't thrash the system allocator. */
+  if (page->inuse == 0)
+    {
+      slab_page_unlink (&cache->partial, page);
+      if (cache->empty)
+        {
+          free (page);
+          cache->pages--;
+        }
+      else
+        cache->empty = page;
+    }
+}
+#else
+#define slab_enabled(T)		0
+#define slab_alloc(T,S)		NULL
+#define slab_size(P)		0
+#define slab_free(T,P)
+#endif /* HAVE_SLAB_ALLOC */
+
 /*
  * Allocate memory of a given size, to be tracked by a given type.
  * Effects: Returns a pointer to usable memory.  If memory cannot
@@ -68,7 +314,10 @@ zmalloc (int type, size_t size)
 {
   void *memory;
 
-  memory = malloc (size);
+  if (slab_enabled (type))
+    memory = slab_alloc (type, size);
+  else
+    memory = malloc (size);
 
   if (memory == NULL)
     zerror ("malloc", type, size);
@@ -86,7 +335,13 @@ zcalloc (int type, size_t size)
 {
   void *memory;
 
-  memory = calloc (1, size);
+  if (slab_enabled (type))
+    {
+      if ((memory = slab_alloc (type, size)) != NULL)
+        memset (memory, 0, size);
+    }
+  else
+    memory = calloc (1, size);
 
   if (memory == NULL)
     zerror ("calloc", type, size);
@@ -108,7 +363,20 @@ zrealloc (int type, void *ptr, size_t size)
 {
   void *memory;
 
-  memory = realloc (ptr, size);
+  if (slab_enabled (type))
+    {
+      size_t oldsize = ptr ? slab_size (ptr) : 0;
+
+      if (ptr && size <= oldsize)
+        return ptr;
+      if ((memory = slab_alloc (type, size)) != NULL && ptr)
+        {
+          memcpy (memory, ptr, oldsize);
+          slab_free (type, ptr);
+        }
+    }
+  else
+    memory = realloc (ptr, size);
   if (memory == NULL)
     zerror ("realloc", type, size);
   if (ptr == NULL)
@@ -129,7 +397,10 @@ zfree (int type, void *ptr)
   if (ptr != NULL)
     {
       alloc_dec (type);
-      free (ptr);
+      if (slab_enabled (type))
+        slab_free (type, ptr);
+      else
+        free (ptr);
     }
 }
 
@@ -144,7 +415,13 @@ zstrdup (int type, const char *str)
 {
   void *dup;
 
-  dup = strdup (str);
+  if (slab_enabled (type))
+    {
+      if ((dup = slab_alloc (type, strlen (str) + 1)) != NULL)
+        strcpy (dup, str);
+    }
+  else
+    dup = strdup (str);
   if (dup == NULL)
     zerror ("strdup", type, strlen (str));
   alloc_inc (type);
@@ -392,6 +669,65 @@ show_memory_mallinfo (struct vty *vty)
 }
 #endif /* HAVE_MALLINFO */
 
+#ifdef HAVE_SLAB_ALLOC
+static int
+show_memory_slab_vty (struct vty *vty)
+{
+  struct mlist *ml;
+  struct memory_list *m;
+  int needsep = 0;
+
+  for (ml = mlists; ml->list; ml++)
+    for (m = ml->list; m->index >= 0; m++)
+      {
+        struct slab_cache *cache;
+
+        if (!m->index || !slab_enabled (m->index))
+          continue;
+
+        for (cache = mslab[m->index].caches; cache; cache = cache->next)
+          {
+            unsigned long capacity = cache->pages * cache->per_page;
+
+            if (!needsep)
+              vty_out (vty, "Slab allocator statistics:%s"
+                       "%-30s %6s %10s %8s %6s %6s%s", VTY_NEWLINE,
+                       "Type", "Size", "Objects", "Pages", "Used",
+                       "Frag", VTY_NEWLINE);
+            /* Frag: free slots on pages still in use, ie memory which
+             * can't be given back until more objects are freed. */
+            vty_out (vty, "%-30s %6lu %10lu %8lu %5lu%% %5lu%%%s",
+                     m->format, (unsigned long) cache->size,
+                     cache->inuse, cache->pages,
+                     capacity ? cache->inuse * 100 / capacity : 0,
+                     capacity ? (capacity - cache->inuse
+                                 - (cache->empty ? cache->per_page : 0))
+                                * 100 / capacity : 0,
+                     VTY_NEWLINE);
+            needsep = 1;
+          }
+        if (mslab[m->index].runs)
+          {
+            vty_out (vty, "%-30s %6s %10s %8lu%s", m->format, "big", "",
+                     mslab[m->index].runs, VTY_NEWLINE);
+            needsep = 1;
+          }
+      }
+  return needsep;
+}
+
+DEFUN (show_memory_slab,
+       show_memory_slab_cmd,
+       "show memory slab",
+       SHOW_STR
+       "Memory statistics\n"
+       "Slab allocator statistics\n")
+{
+  show_memory_slab_vty (vty);
+  return CMD_SUCCESS;
+}
+#endif /* HAVE_SLAB_ALLOC */
+
 DEFUN (show_memory_all,
        show_memory_all_cmd,
        "show memory all",
@@ -413,6 +749,12 @@ DEFUN (show_memory_all,
       needsep = show_memory_vty (vty, ml->list);
     }
 
+#ifdef HAVE_SLAB_ALLOC
+  if (needsep)
+    show_separator (vty);
+  show_memory_slab_vty (vty);
+#endif /* HAVE_SLAB_ALLOC */
+
   return CMD_SUCCESS;
 }
 
@@ -534,6 +876,9 @@ memory_init (void)
   install_element (RESTRICTED_NODE, &show_memory_ospf_cmd);
   install_element (RESTRICTED_NODE, &show_memory_ospf6_cmd);
   install_element (RESTRICTED_NODE, &show_memory_isis_cmd);
+#ifdef HAVE_SLAB_ALLOC
+  install_element (RESTRICTED_NODE, &show_memory_slab_cmd);
+#endif /* HAVE_SLAB_ALLOC */
 
   install_element (VIEW_NODE, &show_memory_cmd);
   install_element (VIEW_NODE, &show_memory_all_cmd);
@@ -545,6 +890,9 @@ memory_init (void)
   install_element (VIEW_NODE, &show_memory_ospf_cmd);
   install_element (VIEW_NODE, &show_memory_ospf6_cmd);
   install_element (VIEW_NODE, &show_memory_isis_cmd);
+#ifdef HAVE_SLAB_ALLOC
+  install_element (VIEW_NODE, &show_memory_slab_cmd);
+#endif /* HAVE_SLAB_ALLOC */
 
   install_element (ENABLE_NODE, &show_memory_cmd);
   install_element (ENABLE_NODE, &show_memory_all_cmd);
@@ -557,6 +905,9 @@ memory_init (void)
   install_element (ENABLE_NODE, &show_memory_ospf_cmd);
   install_element (ENABLE_NODE, &show_memory_ospf6_cmd);
   install_element (ENABLE_NODE, &show_memory_isis_cmd);
+#ifdef HAVE_SLAB_ALLOC
+  install_element (ENABLE_NODE, &show_memory_slab_cmd);
+#endif /* HAVE_SLAB_ALLOC */
 }
 
 /* Stats querying from users */
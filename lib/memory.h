@@ -28,8 +28,13 @@ struct memory_list
 {
   int index;
   const char *format;
+  int flags;
 };
 
+/* memory_list flags */
+/* Fixed-size objects, carve from slabs.  Main thread only, see memory.c. */
+#define MEMORY_SLAB	(1 << 0)
+
 struct mlist {
   struct memory_list *list;
   const char *name;
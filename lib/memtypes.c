@@ -18,9 +18,12 @@ struct memory_list memory_list_lib[] =
   { MTYPE_VECTOR_INDEX,		"Vector index"			},
   { MTYPE_LINK_LIST,		"Link List"			},
   { MTYPE_LINK_NODE,		"Link Node"			},
-  { MTYPE_THREAD,		"Thread"			},
+  { MTYPE_THREAD,		"Thread",		MEMORY_SLAB },
   { MTYPE_THREAD_MASTER,	"Thread master"			},
   { MTYPE_THREAD_STATS,		"Thread stats"			},
+  { MTYPE_THREAD_WHEEL,		"Thread timer wheel"		},
+  { MTYPE_THREAD_FD,		"Thread fd table"		},
+  { MTYPE_THREAD_IO,		"Thread I/O backend"		},
   { MTYPE_VTY,			"VTY"				},
   { MTYPE_VTY_OUT_BUF,		"VTY output buffer"		},
   { MTYPE_VTY_HIST,		"VTY history"			},
@@ -39,21 +42,25 @@ struct memory_list memory_list_lib[] =
   { MTYPE_HASH_BACKET,		"Hash Bucket"			},
   { MTYPE_HASH_INDEX,		"Hash Index"			},
   { MTYPE_ROUTE_TABLE,		"Route table"			},
-  { MTYPE_ROUTE_NODE,		"Route node"			},
+  { MTYPE_ROUTE_TABLE_INDEX,	"Route table index"		},
+  { MTYPE_ROUTE_NODE,		"Route node",		MEMORY_SLAB },
   { MTYPE_DISTRIBUTE,		"Distribute list"		},
   { MTYPE_DISTRIBUTE_IFNAME,	"Dist-list ifname"		},
   { MTYPE_ACCESS_LIST,		"Access List"			},
   { MTYPE_ACCESS_LIST_STR,	"Access List Str"		},
   { MTYPE_ACCESS_FILTER,	"Access Filter"			},
+  { MTYPE_ACCESS_LIST_INDEX,	"Access List Index"		},
   { MTYPE_PREFIX_LIST,		"Prefix List"			},
   { MTYPE_PREFIX_LIST_ENTRY,	"Prefix List Entry"		},
   { MTYPE_PREFIX_LIST_STR,	"Prefix List Str"		},
+  { MTYPE_PREFIX_LIST_TRIE,	"Prefix List Trie"		},
   { MTYPE_ROUTE_MAP,		"Route map"			},
   { MTYPE_ROUTE_MAP_NAME,	"Route map name"		},
   { MTYPE_ROUTE_MAP_INDEX,	"Route map index"		},
   { MTYPE_ROUTE_MAP_RULE,	"Route map rule"		},
   { MTYPE_ROUTE_MAP_RULE_STR,	"Route map rule str"		},
   { MTYPE_ROUTE_MAP_COMPILED,	"Route map compiled"		},
+  { MTYPE_ROUTE_MAP_CACHE,	"Route map cache"		},
   { MTYPE_CMD_TOKENS,		"Command desc"			},
   { MTYPE_KEY,			"Key"				},
   { MTYPE_KEYCHAIN,		"Key chain"			},
@@ -63,6 +70,7 @@ struct memory_list memory_list_lib[] =
   { MTYPE_PRIVS,		"Privilege information"		},
   { MTYPE_ZLOG,			"Logging"			},
   { MTYPE_ZCLIENT,		"Zclient"			},
+  { MTYPE_ZRING,		"Zserv shared-memory ring"	},
   { MTYPE_WORK_QUEUE,		"Work queue"			},
   { MTYPE_WORK_QUEUE_ITEM,	"Work queue item"		},
   { MTYPE_WORK_QUEUE_NAME,	"Work queue name string"	},
@@ -84,6 +92,7 @@ struct memory_list memory_list_zebra[] =
   { MTYPE_STATIC_IPV6,		"Static IPv6 route"		},
   { MTYPE_RIB_DEST,		"RIB destination"		},
   { MTYPE_RIB_TABLE_INFO,	"RIB table info"		},
+  { MTYPE_RNH,			"Registered nexthop"		},
   { -1, NULL },
 };
 
@@ -96,7 +105,7 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_PEER_GROUP,		"Peer group"			},
   { MTYPE_PEER_DESC,		"Peer description"		},
   { MTYPE_PEER_PASSWORD,	"Peer password string"		},
-  { MTYPE_ATTR,			"BGP attribute"			},
+  { MTYPE_ATTR,			"BGP attribute",		MEMORY_SLAB },
   { MTYPE_ATTR_EXTRA,		"BGP extra attributes"		},
   { MTYPE_AS_PATH,		"BGP aspath"			},
   { MTYPE_AS_SEG,		"BGP aspath seg"		},
@@ -104,17 +113,21 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_AS_STR,		"BGP aspath str"		},
   { 0, NULL },
   { MTYPE_BGP_TABLE,		"BGP table"			},
-  { MTYPE_BGP_NODE,		"BGP node"			},
-  { MTYPE_BGP_ROUTE,		"BGP route"			},
+  { MTYPE_BGP_NODE,		"BGP node",		MEMORY_SLAB },
+  { MTYPE_BGP_ROUTE,		"BGP route",		MEMORY_SLAB },
   { MTYPE_BGP_ROUTE_EXTRA,	"BGP ancillary route info"	},
   { MTYPE_BGP_CONN,		"BGP connected"			},
   { MTYPE_BGP_STATIC,		"BGP static"			},
   { MTYPE_BGP_ADVERTISE_ATTR,	"BGP adv attr"			},
-  { MTYPE_BGP_ADVERTISE,	"BGP adv"			},
+  { MTYPE_BGP_ADVERTISE,	"BGP adv",		MEMORY_SLAB },
   { MTYPE_BGP_SYNCHRONISE,	"BGP synchronise"		},
-  { MTYPE_BGP_ADJ_IN,		"BGP adj in"			},
-  { MTYPE_BGP_ADJ_OUT,		"BGP adj out"			},
+  { MTYPE_BGP_ADJ_IN,		"BGP adj in",		MEMORY_SLAB },
+  { MTYPE_BGP_ADJ_OUT,		"BGP adj out",		MEMORY_SLAB },
   { MTYPE_BGP_MPATH_INFO,	"BGP multipath info"		},
+  { MTYPE_BGP_UPDGRP,		"BGP update group"		},
+  { MTYPE_BGP_UPDGRP_PACKET,	"BGP update group packet"	},
+  { MTYPE_BGP_IO,		"BGP I/O thread state"		},
+  { MTYPE_BGP_IO_BUF,		"BGP I/O buffer"		},
   { 0, NULL },
   { MTYPE_AS_LIST,		"BGP AS list"			},
   { MTYPE_AS_FILTER,		"BGP AS filter"			},
@@ -138,6 +151,7 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_CLUSTER_VAL,		"Cluster list val"		},
   { 0, NULL },
   { MTYPE_BGP_PROCESS_QUEUE,	"BGP Process queue"		},
+  { MTYPE_BGP_SELECT,		"BGP best path batch"		},
   { MTYPE_BGP_CLEAR_NODE_QUEUE, "BGP node clear queue"		},
   { 0, NULL },
   { MTYPE_TRANSIT,		"BGP transit attr"		},
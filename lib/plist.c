@@ -111,6 +111,39 @@ static struct prefix_master prefix_master_orf =
   NULL,
 };
 
+/* Entries of a prefix-list indexed by their prefix bits, so that only
+   those on the path of a prefix need matching against it. */
+struct prefix_list_trie
+{
+  /* Entries in sequence order. */
+  struct prefix_list_entry **entries;
+  int count;
+
+  /* Index of the next entry at the same node, or -1. */
+  int *chain;
+
+  /* How many applies first matched each entry, the last counting those
+     that matched none, not yet added to the entries' counts. */
+  unsigned long *first;
+  int pending;
+
+  struct prefix_list_trie_node
+  {
+    /* Nodes one bit further down; node 0 is the root, so 0 is none. */
+    int link[2];
+
+    /* First entry, by index, of those whose prefix ends here. */
+    int entry;
+  } *nodes;
+  int node_count;
+  int node_size;
+};
+
+/* Lists shorter than this are walked instead. */
+#define PREFIX_LIST_TRIE_MIN 8
+
+static void prefix_list_trie_free (struct prefix_list *);
+
 static struct prefix_master *
 prefix_master_get (afi_t afi)
 {
@@ -293,6 +326,8 @@ prefix_list_delete (struct prefix_list *plist)
   struct prefix_list_entry *pentry;
   struct prefix_list_entry *next;
 
+  prefix_list_trie_free (plist);
+
   /* If prefix-list contain prefix_list_entry free all of it. */
   for (pentry = plist->head; pentry; pentry = next)
     {
@@ -437,6 +472,7 @@ prefix_list_entry_delete (struct prefix_list *plist,
 {
   if (plist == NULL || pentry == NULL)
     return;
+  prefix_list_trie_free (plist);
   if (pentry->prev)
     pentry->prev->next = pentry->next;
   else
@@ -473,6 +509,8 @@ prefix_list_entry_add (struct prefix_list *plist,
   if (pentry->seq == -1)
     pentry->seq = prefix_new_seq_get (plist);
 
+  prefix_list_trie_free (plist);
+
   /* Is there any same seq prefix list entry? */
   replace = prefix_seq_check (plist, pentry->seq);
   if (replace)
@@ -560,6 +598,139 @@ prefix_list_entry_match (struct prefix_list_entry *pentry, struct prefix *p)
   return 1;
 }
 
+/* Add the counts of applies through the trie to the entries. */
+static void
+prefix_list_trie_sync (struct prefix_list *plist)
+{
+  struct prefix_list_trie *trie = plist->trie;
+  unsigned long tried;
+  int i;
+
+  if (! trie || ! trie->pending)
+    return;
+
+  /* An entry was tried by every apply that first matched it or a
+     later entry, or none. */
+  tried = trie->first[trie->count];
+  for (i = trie->count - 1; i >= 0; i--)
+    {
+      tried += trie->first[i];
+      trie->entries[i]->refcnt += tried;
+      trie->entries[i]->hitcnt += trie->first[i];
+    }
+  memset (trie->first, 0, (trie->count + 1) * sizeof (trie->first[0]));
+  trie->pending = 0;
+}
+
+static void
+prefix_list_trie_free (struct prefix_list *plist)
+{
+  struct prefix_list_trie *trie = plist->trie;
+
+  if (! trie)
+    return;
+
+  prefix_list_trie_sync (plist);
+  XFREE (MTYPE_PREFIX_LIST_TRIE, trie->entries);
+  XFREE (MTYPE_PREFIX_LIST_TRIE, trie->chain);
+  XFREE (MTYPE_PREFIX_LIST_TRIE, trie->first);
+  XFREE (MTYPE_PREFIX_LIST_TRIE, trie->nodes);
+  XFREE (MTYPE_PREFIX_LIST_TRIE, trie);
+  plist->trie = NULL;
+}
+
+/* Bit n of the prefix, counting from the most significant. */
+static inline int
+prefix_list_trie_bit (const struct prefix *p, int n)
+{
+  return ((&p->u.prefix)[n / 8] >> (7 - n % 8)) & 1;
+}
+
+static void
+prefix_list_trie_build (struct prefix_list *plist)
+{
+  struct prefix_list_trie *trie;
+  struct prefix_list_entry *pentry;
+  struct prefix_list_trie_node *node;
+  int i, n, bit, next;
+
+  trie = XCALLOC (MTYPE_PREFIX_LIST_TRIE, sizeof (struct prefix_list_trie));
+  trie->entries = XMALLOC (MTYPE_PREFIX_LIST_TRIE,
+			   plist->count * sizeof (trie->entries[0]));
+  trie->chain = XMALLOC (MTYPE_PREFIX_LIST_TRIE,
+			 plist->count * sizeof (trie->chain[0]));
+  trie->first = XCALLOC (MTYPE_PREFIX_LIST_TRIE,
+			 (plist->count + 1) * sizeof (trie->first[0]));
+  trie->node_size = plist->count + 1;
+  trie->nodes = XMALLOC (MTYPE_PREFIX_LIST_TRIE,
+			 trie->node_size * sizeof (trie->nodes[0]));
+  trie->nodes[0].link[0] = trie->nodes[0].link[1] = 0;
+  trie->nodes[0].entry = -1;
+  trie->node_count = 1;
+
+  for (pentry = plist->head; pentry; pentry = pentry->next)
+    trie->entries[trie->count++] = pentry;
+
+  /* Last entry first, so that each node's chain comes out in sequence
+     order. */
+  for (i = trie->count - 1; i >= 0; i--)
+    {
+      pentry = trie->entries[i];
+
+      for (n = 0, next = 0; n < pentry->prefix.prefixlen; n++)
+	{
+	  bit = prefix_list_trie_bit (&pentry->prefix, n);
+	  if (! trie->nodes[next].link[bit])
+	    {
+	      if (trie->node_count == trie->node_size)
+		{
+		  trie->node_size *= 2;
+		  trie->nodes = XREALLOC (MTYPE_PREFIX_LIST_TRIE, trie->nodes,
+					  trie->node_size
+					  * sizeof (trie->nodes[0]));
+		}
+	      node = &trie->nodes[trie->node_count];
+	      node->link[0] = node->link[1] = 0;
+	      node->entry = -1;
+	      trie->nodes[next].link[bit] = trie->node_count++;
+	    }
+	  next = trie->nodes[next].link[bit];
+	}
+
+      trie->chain[i] = trie->nodes[next].entry;
+      trie->nodes[next].entry = i;
+    }
+
+  plist->trie = trie;
+}
+
+/* Index of the first entry matching the prefix, or the entry count.
+   Only entries whose prefix covers it can, and those are on its path
+   down the trie. */
+static int
+prefix_list_trie_match (struct prefix_list_trie *trie, struct prefix *p)
+{
+  int best = trie->count;
+  int n, i, next;
+
+  for (n = 0, next = 0; ; n++)
+    {
+      for (i = trie->nodes[next].entry; i >= 0 && i < best; i = trie->chain[i])
+	if (prefix_list_entry_match (trie->entries[i], p))
+	  {
+	    best = i;
+	    break;
+	  }
+
+      if (n >= p->prefixlen)
+	break;
+      next = trie->nodes[next].link[prefix_list_trie_bit (p, n)];
+      if (! next)
+	break;
+    }
+  return best;
+}
+
 enum prefix_list_type
 prefix_list_apply (struct prefix_list *plist, void *object)
 {
@@ -574,6 +745,21 @@ prefix_list_apply (struct prefix_list *plist, void *object)
   if (plist->count == 0)
     return PREFIX_PERMIT;
 
+  if (plist->count >= PREFIX_LIST_TRIE_MIN)
+    {
+      int i;
+
+      if (! plist->trie)
+	prefix_list_trie_build (plist);
+
+      i = prefix_list_trie_match (plist->trie, p);
+      plist->trie->first[i]++;
+      plist->trie->pending = 1;
+      if (i < plist->trie->count)
+	return plist->trie->entries[i]->type;
+      return PREFIX_DENY;
+    }
+
   for (pentry = plist->head; pentry; pentry = pentry->next)
     {
       pentry->refcnt++;
@@ -926,6 +1112,8 @@ vty_show_prefix_entry (struct vty *vty, afi_t afi, struct prefix_list *plist,
 {
   struct prefix_list_entry *pentry;
 
+  prefix_list_trie_sync (plist);
+
   /* Print the name of the protocol */
   if (zlog_default)
       vty_out (vty, "%s: ", zlog_proto_names[zlog_default->protocol]);
@@ -1061,6 +1249,8 @@ vty_show_prefix_list_prefix (struct vty *vty, afi_t afi, const char *name,
       return CMD_WARNING;
     }
 
+  prefix_list_trie_sync (plist);
+
   for (pentry = plist->head; pentry; pentry = pentry->next)
     {
       match = 0;
@@ -1126,12 +1316,18 @@ vty_clear_prefix_list (struct vty *vty, afi_t afi, const char *name,
   if (name == NULL && prefix == NULL)
     {
       for (plist = master->num.head; plist; plist = plist->next)
-	for (pentry = plist->head; pentry; pentry = pentry->next)
-	  pentry->hitcnt = 0;
+	{
+	  prefix_list_trie_sync (plist);
+	  for (pentry = plist->head; pentry; pentry = pentry->next)
+	    pentry->hitcnt = 0;
+	}
 
       for (plist = master->str.head; plist; plist = plist->next)
-	for (pentry = plist->head; pentry; pentry = pentry->next)
-	  pentry->hitcnt = 0;
+	{
+	  prefix_list_trie_sync (plist);
+	  for (pentry = plist->head; pentry; pentry = pentry->next)
+	    pentry->hitcnt = 0;
+	}
     }
   else
     {
@@ -1152,6 +1348,7 @@ vty_clear_prefix_list (struct vty *vty, afi_t afi, const char *name,
 	    }
 	}
 
+      prefix_list_trie_sync (plist);
       for (pentry = plist->head; pentry; pentry = pentry->next)
 	{
 	  if (prefix)
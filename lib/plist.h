@@ -49,6 +49,9 @@ struct prefix_list
   int count;
   int rangecount;
 
+  /* Built on first use after the entries change. */
+  struct prefix_list_trie *trie;
+
   struct prefix_list_entry *head;
   struct prefix_list_entry *tail;
 
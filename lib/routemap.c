@@ -28,6 +28,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "command.h"
 #include "vty.h"
 #include "log.h"
+#include "hash.h"
+#include "jhash.h"
 
 /* Vector for route match rules. */
 static vector route_match_vec;
@@ -66,6 +68,29 @@ struct route_map_list
 /* Master list of route map. */
 static struct route_map_list route_map_master = { NULL, NULL, NULL, NULL };
 
+/* Results of the attr_only matches of each index, remembered for a key
+   given to route_map_apply_cached (). */
+struct route_map_cache
+{
+  const void *key;
+
+  /* route_map_cache_gen the results are for. */
+  unsigned int gen;
+
+  int count;
+  int size;
+  struct route_map_cache_result
+  {
+    struct route_map_index *index;
+    route_map_result_t result;
+  } *results;
+};
+
+static struct hash *route_map_cache_hash;
+
+/* Changed by anything that can change the results. */
+static unsigned int route_map_cache_gen;
+
 static void
 route_map_rule_delete (struct route_map_rule_list *,
 		       struct route_map_rule *);
@@ -198,6 +223,108 @@ route_map_empty (struct route_map *map)
     return 0;
 }
 
+static unsigned int
+route_map_cache_key (void *arg)
+{
+  const struct route_map_cache *cache = arg;
+
+  return jhash_1word ((u_int32_t) (uintptr_t) cache->key, 0);
+}
+
+static int
+route_map_cache_cmp (const void *arg1, const void *arg2)
+{
+  const struct route_map_cache *cache1 = arg1;
+  const struct route_map_cache *cache2 = arg2;
+
+  return cache1->key == cache2->key;
+}
+
+static void *
+route_map_cache_alloc (void *arg)
+{
+  struct route_map_cache *cache;
+
+  cache = XCALLOC (MTYPE_ROUTE_MAP_CACHE, sizeof (struct route_map_cache));
+  cache->key = ((struct route_map_cache *) arg)->key;
+  cache->gen = route_map_cache_gen;
+  return cache;
+}
+
+static void
+route_map_cache_free (void *arg)
+{
+  struct route_map_cache *cache = arg;
+
+  if (cache->results)
+    XFREE (MTYPE_ROUTE_MAP_CACHE, cache->results);
+  XFREE (MTYPE_ROUTE_MAP_CACHE, cache);
+}
+
+static struct route_map_cache *
+route_map_cache_get (const void *key)
+{
+  struct route_map_cache lookup;
+  struct route_map_cache *cache;
+
+  lookup.key = key;
+  cache = hash_get (route_map_cache_hash, &lookup, route_map_cache_alloc);
+  if (cache->gen != route_map_cache_gen)
+    {
+      cache->gen = route_map_cache_gen;
+      cache->count = 0;
+    }
+  return cache;
+}
+
+static struct route_map_cache_result *
+route_map_cache_lookup (struct route_map_cache *cache,
+			struct route_map_index *index)
+{
+  int i;
+
+  for (i = 0; i < cache->count; i++)
+    if (cache->results[i].index == index)
+      return &cache->results[i];
+  return NULL;
+}
+
+static void
+route_map_cache_add (struct route_map_cache *cache,
+		     struct route_map_index *index, route_map_result_t result)
+{
+  if (cache->count == cache->size)
+    {
+      cache->size = cache->size ? cache->size * 2 : 4;
+      cache->results = XREALLOC (MTYPE_ROUTE_MAP_CACHE, cache->results,
+				 cache->size * sizeof (cache->results[0]));
+    }
+  cache->results[cache->count].index = index;
+  cache->results[cache->count].result = result;
+  cache->count++;
+}
+
+void
+route_map_cache_flush (void)
+{
+  route_map_cache_gen++;
+}
+
+void
+route_map_cache_forget (const void *key)
+{
+  struct route_map_cache lookup;
+  struct route_map_cache *cache;
+
+  if (! route_map_cache_hash)
+    return;
+
+  lookup.key = key;
+  cache = hash_release (route_map_cache_hash, &lookup);
+  if (cache)
+    route_map_cache_free (cache);
+}
+
 /* show route-map */
 static void
 vty_show_route_map_entry (struct vty *vty, struct route_map *map)
@@ -245,6 +372,10 @@ vty_show_route_map_entry (struct vty *vty, struct route_map *map)
         vty_out (vty, "    Continue to next entry%s", VTY_NEWLINE);
       else if (index->exitpolicy == RMAP_EXIT)
         vty_out (vty, "    Exit routemap%s", VTY_NEWLINE);
+
+      if (index->cache_hit || index->cache_miss)
+        vty_out (vty, "  Match cache: %lu hits, %lu misses%s",
+                 index->cache_hit, index->cache_miss, VTY_NEWLINE);
     }
 }
 
@@ -318,6 +449,8 @@ route_map_index_delete (struct route_map_index *index, int notify)
   if (index->nextrm)
     XFREE (MTYPE_ROUTE_MAP_NAME, index->nextrm);
 
+  route_map_cache_flush ();
+
     /* Execute event hook. */
   if (route_map_master.event_hook && notify)
     (*route_map_master.event_hook) (RMAP_EVENT_INDEX_DELETED,
@@ -384,6 +517,8 @@ route_map_index_add (struct route_map *map, enum route_map_type type,
       point->prev = index;
     }
 
+  route_map_cache_flush ();
+
   /* Execute event hook. */
   if (route_map_master.event_hook)
     (*route_map_master.event_hook) (RMAP_EVENT_INDEX_ADDED,
@@ -475,6 +610,8 @@ route_map_rule_add (struct route_map_rule_list *list,
   else
     list->head = rule;
   list->tail = rule;
+
+  route_map_cache_flush ();
 }
 
 /* Delete rule from rule list. */
@@ -498,6 +635,8 @@ route_map_rule_delete (struct route_map_rule_list *list,
     list->head = rule->next;
 
   XFREE (MTYPE_ROUTE_MAP_RULE, rule);
+
+  route_map_cache_flush ();
 }
 
 /* strcmp wrapper function which don't crush even argument is NULL. */
@@ -739,10 +878,46 @@ route_map_delete_set (struct route_map_index *index, const char *set_name,
    We need to make sure our route-map processing matches the above
 */
 
+/* Apply the attr_only matches of the index, or look up what they gave
+   last time for the key of the cache. */
 static route_map_result_t
-route_map_apply_match (struct route_map_rule_list *match_list,
+route_map_apply_match_cached (struct route_map_index *index,
+                              struct prefix *prefix, route_map_object_t type,
+                              void *object, struct route_map_cache *cache)
+{
+  struct route_map_cache_result *cached;
+  route_map_result_t ret = RMAP_MATCH;
+  struct route_map_rule *match;
+  int found = 0;
+
+  cached = route_map_cache_lookup (cache, index);
+  if (cached)
+    {
+      index->cache_hit++;
+      return cached->result;
+    }
+
+  for (match = index->match_list.head; match; match = match->next)
+    if (match->cmd->attr_only)
+      {
+        found = 1;
+        ret = (*match->cmd->func_apply) (match->value, prefix, type, object);
+        if (ret != RMAP_MATCH)
+          break;
+      }
+
+  if (found)
+    {
+      index->cache_miss++;
+      route_map_cache_add (cache, index, ret);
+    }
+  return ret;
+}
+
+static route_map_result_t
+route_map_apply_match (struct route_map_index *index,
                        struct prefix *prefix, route_map_object_t type,
-                       void *object)
+                       void *object, struct route_map_cache *cache)
 {
   route_map_result_t ret = RMAP_NOMATCH;
   struct route_map_rule *match;
@@ -750,12 +925,25 @@ route_map_apply_match (struct route_map_rule_list *match_list,
 
   /* Check all match rule and if there is no match rule, go to the
      set statement. */
-  if (!match_list->head)
+  if (!index->match_list.head)
     ret = RMAP_MATCH;
   else
     {
-      for (match = match_list->head; match; match = match->next)
+      /* All of them have to match, so the remembered ones can go
+         first. */
+      if (cache)
         {
+          ret = route_map_apply_match_cached (index, prefix, type, object,
+                                              cache);
+          if (ret != RMAP_MATCH)
+            return ret;
+        }
+
+      for (match = index->match_list.head; match; match = match->next)
+        {
+          if (cache && match->cmd->attr_only)
+            continue;
+
           /* Try each match statement in turn, If any do not return
              RMAP_MATCH, return, otherwise continue on to next match 
              statement. All match statements must match for end-result
@@ -773,11 +961,20 @@ route_map_apply_match (struct route_map_rule_list *match_list,
 route_map_result_t
 route_map_apply (struct route_map *map, struct prefix *prefix,
                  route_map_object_t type, void *object)
+{
+  return route_map_apply_cached (map, prefix, type, object, NULL);
+}
+
+route_map_result_t
+route_map_apply_cached (struct route_map *map, struct prefix *prefix,
+                        route_map_object_t type, void *object,
+                        const void *key)
 {
   static int recursion = 0;
   int ret = 0;
   struct route_map_index *index;
   struct route_map_rule *set;
+  struct route_map_cache *cache = NULL;
 
   if (recursion > RMAP_RECURSION_LIMIT)
     {
@@ -791,10 +988,13 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
   if (map == NULL)
     return RMAP_DENYMATCH;
 
+  if (key)
+    cache = route_map_cache_get (key);
+
   for (index = map->head; index; index = index->next)
     {
       /* Apply this index. */
-      ret = route_map_apply_match (&index->match_list, prefix, type, object);
+      ret = route_map_apply_match (index, prefix, type, object, cache);
 
       /* Now we apply the matrix from above */
       if (ret == RMAP_NOMATCH)
@@ -810,6 +1010,13 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
                 ret = (*set->cmd->func_apply) (set->value, prefix,
                                                type, object);
 
+              /* Which may change the object from what the key says. */
+              if (index->set_list.head)
+                {
+                  key = NULL;
+                  cache = NULL;
+                }
+
               /* Call another route-map if available */
               if (index->nextrm)
                 {
@@ -819,8 +1026,11 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
                   if (nextrm) /* Target route-map found, jump to it */
                     {
                       recursion++;
-                      ret = route_map_apply (nextrm, prefix, type, object);
+                      ret = route_map_apply_cached (nextrm, prefix, type,
+                                                    object, key);
                       recursion--;
+                      key = NULL;
+                      cache = NULL;
                     }
 
                   /* If nextrm returned 'deny', finish. */
@@ -864,6 +1074,50 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
   return RMAP_DENYMATCH;
 }
 
+static int
+route_map_rule_list_has (struct route_map_rule_list *list,
+                         const char *str, const char *arg)
+{
+  struct route_map_rule *rule;
+
+  for (rule = list->head; rule; rule = rule->next)
+    if (strcmp (rule->cmd->str, str) == 0
+        && (arg == NULL
+            || (rule->rule_str && strcmp (rule->rule_str, arg) == 0)))
+      return 1;
+  return 0;
+}
+
+/* Check whether any clause of the route map, or of a route map it
+   calls, has a match or set rule of type STR.  If ARG is not NULL the
+   rule's argument must also be ARG. */
+int
+route_map_has_rule (struct route_map *map, const char *str, const char *arg)
+{
+  static int recursion = 0;
+  struct route_map_index *index;
+  int ret = 0;
+
+  if (map == NULL || recursion > RMAP_RECURSION_LIMIT)
+    return 0;
+
+  for (index = map->head; index && ! ret; index = index->next)
+    {
+      if (route_map_rule_list_has (&index->match_list, str, arg)
+          || route_map_rule_list_has (&index->set_list, str, arg))
+        return 1;
+
+      if (index->nextrm)
+        {
+          recursion++;
+          ret = route_map_has_rule (route_map_lookup_by_name (index->nextrm),
+                                    str, arg);
+          recursion--;
+        }
+    }
+  return ret;
+}
+
 void
 route_map_add_hook (void (*func) (const char *))
 {
@@ -888,6 +1142,9 @@ route_map_init (void)
   /* Make vector for match and set. */
   route_match_vec = vector_init (1);
   route_set_vec = vector_init (1);
+
+  route_map_cache_hash = hash_create (route_map_cache_key,
+                                      route_map_cache_cmp);
 }
 
 void
@@ -897,6 +1154,10 @@ route_map_finish (void)
   route_match_vec = NULL;
   vector_free (route_set_vec);
   route_set_vec = NULL;
+
+  hash_clean (route_map_cache_hash, route_map_cache_free);
+  hash_free (route_map_cache_hash);
+  route_map_cache_hash = NULL;
 }
 
 /* VTY related functions. */
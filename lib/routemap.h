@@ -87,6 +87,10 @@ struct route_map_rule_cmd
 
   /* Free allocated value by func_compile (). */
   void (*func_free)(void *);
+
+  /* Set for a match that gives the same result for every object with
+     the same key, see route_map_apply_cached (). */
+  int attr_only;
 };
 
 /* Route map apply error. */
@@ -134,6 +138,10 @@ struct route_map_index
   /* Make linked list. */
   struct route_map_index *next;
   struct route_map_index *prev;
+
+  /* Results of the attr_only matches looked up and worked out. */
+  unsigned long cache_hit;
+  unsigned long cache_miss;
 };
 
 /* Route map list structure. */
@@ -191,6 +199,25 @@ extern route_map_result_t route_map_apply (struct route_map *map,
                                            route_map_object_t object_type,
                                            void *object);
 
+/* Apply route map to the object, taking the results of its attr_only
+   matches from those remembered for key, if it is not NULL.  key must
+   stay the same as long as what the attr_only matches look at does. */
+extern route_map_result_t route_map_apply_cached (struct route_map *map,
+                                                  struct prefix *,
+                                                  route_map_object_t,
+                                                  void *object,
+                                                  const void *key);
+
+/* Forget all remembered results, as something they depend on changed. */
+extern void route_map_cache_flush (void);
+
+/* Forget the results remembered for key, which is going away. */
+extern void route_map_cache_forget (const void *key);
+
+/* Check whether the route map uses a given match or set rule. */
+extern int route_map_has_rule (struct route_map *map, const char *str,
+                               const char *arg);
+
 extern void route_map_add_hook (void (*func) (const char *));
 extern void route_map_delete_hook (void (*func) (const char *));
 extern void route_map_event_hook (void (*func) (route_map_event_t, const char *));
@@ -120,6 +120,22 @@ stream_free (struct stream *s)
 {
   if (!s)
     return;
+
+  if (s->origin)
+    {
+      struct stream *origin = s->origin;
+
+      XFREE (MTYPE_STREAM, s);
+      stream_free (origin);
+      return;
+    }
+
+  /* Data still referenced by shared copies. */
+  if (s->refcnt)
+    {
+      s->refcnt--;
+      return;
+    }
   
   XFREE (MTYPE_STREAM_DATA, s->data);
   XFREE (MTYPE_STREAM, s);
@@ -154,6 +170,31 @@ stream_dup (struct stream *s)
   return (stream_copy (new, s));
 }
 
+/* Return a new stream referencing the data of S without copying it.
+ * The copy has its own getp, so it can be written out independently,
+ * but neither it nor S may be modified afterwards.  The data is freed
+ * with the last of S and its shared copies.
+ */
+struct stream *
+stream_share (struct stream *s)
+{
+  struct stream *new;
+
+  STREAM_VERIFY_SANE (s);
+
+  if (s->origin)
+    s = s->origin;
+
+  new = XCALLOC (MTYPE_STREAM, sizeof (struct stream));
+  new->data = s->data;
+  new->size = s->size;
+  new->endp = s->endp;
+  new->origin = s;
+  s->refcnt++;
+
+  return new;
+}
+
 struct stream *
 stream_dupcat (struct stream *s1, struct stream *s2, size_t offset)
 {
@@ -178,6 +219,7 @@ stream_resize (struct stream *s, size_t newsize)
 {
   u_char *newdata;
   STREAM_VERIFY_SANE (s);
+  assert (s->origin == NULL && s->refcnt == 0);
   
   newdata = XREALLOC (MTYPE_STREAM_DATA, s->data, newsize);
   
@@ -104,6 +104,12 @@ struct stream
   size_t endp;		/* last valid data position */
   size_t size;		/* size of data segment */
   unsigned char *data; /* data pointer */
+
+  /* Read-only sharing, see stream_share().  A shared stream points at
+   * the stream owning the data; the owner counts the extra references.
+   */
+  struct stream *origin;
+  unsigned int refcnt;
 };
 
 /* First in first out queue structure. */
@@ -142,6 +148,7 @@ extern struct stream *stream_new (size_t);
 extern void stream_free (struct stream *);
 extern struct stream * stream_copy (struct stream *, struct stream *src);
 extern struct stream *stream_dup (struct stream *);
+extern struct stream *stream_share (struct stream *);
 extern size_t stream_resize (struct stream *, size_t);
 extern size_t stream_get_getp (struct stream *);
 extern size_t stream_get_endp (struct stream *);
@@ -129,6 +129,8 @@ route_table_free (struct route_table *rt)
  
   assert (rt->count == 0);
 
+  if (rt->index)
+    XFREE (MTYPE_ROUTE_TABLE_INDEX, rt->index);
   XFREE (MTYPE_ROUTE_TABLE, rt);
   return;
 }
@@ -183,6 +185,87 @@ set_link (struct route_node *node, struct route_node *new)
   new->parent = node;
 }
 
+/* Index slot of the first ROUTE_TABLE_INDEX_BITS bits of a prefix. */
+static inline unsigned int
+route_index_slot (const struct prefix *p)
+{
+  const u_char *np = (const u_char *)&p->u.prefix;
+
+  return (np[0] << 8) | np[1];
+}
+
+/* Range of slots a node of at most ROUTE_TABLE_INDEX_BITS covers. */
+static inline unsigned int
+route_index_range (const struct route_node *node, unsigned int *first)
+{
+  unsigned int count = 1 << (ROUTE_TABLE_INDEX_BITS - node->p.prefixlen);
+
+  *first = route_index_slot (&node->p) & ~(count - 1);
+  return count;
+}
+
+/* A node was added to the tree: it is the deepest node for the slots
+   it covers but no deeper node does. */
+static void
+route_index_add (struct route_table *table, struct route_node *node)
+{
+  unsigned int i, first, count;
+
+  if (! table->index || node->p.prefixlen > ROUTE_TABLE_INDEX_BITS)
+    return;
+
+  count = route_index_range (node, &first);
+  for (i = first; i < first + count; i++)
+    if (! table->index[i]
+	|| table->index[i]->p.prefixlen < node->p.prefixlen)
+      table->index[i] = node;
+}
+
+/* A node is leaving the tree: its parent covers its slots. */
+static void
+route_index_delete (struct route_table *table, struct route_node *node)
+{
+  unsigned int i, first, count;
+
+  if (! table->index || node->p.prefixlen > ROUTE_TABLE_INDEX_BITS)
+    return;
+
+  count = route_index_range (node, &first);
+  for (i = first; i < first + count; i++)
+    if (table->index[i] == node)
+      table->index[i] = node->parent;
+}
+
+static void
+route_index_fill (struct route_table *table, struct route_node *node)
+{
+  if (! node || node->p.prefixlen > ROUTE_TABLE_INDEX_BITS)
+    return;
+
+  route_index_add (table, node);
+  route_index_fill (table, node->l_left);
+  route_index_fill (table, node->l_right);
+}
+
+static void
+route_index_build (struct route_table *table)
+{
+  table->index = XCALLOC (MTYPE_ROUTE_TABLE_INDEX,
+			  sizeof (struct route_node *)
+			  << ROUTE_TABLE_INDEX_BITS);
+  route_index_fill (table, table->top);
+}
+
+/* Where to start walking down the tree for the prefix, NULL for the
+   top.  Every node above it covers the prefix. */
+static inline struct route_node *
+route_index_start (const struct route_table *table, const struct prefix *p)
+{
+  if (! table->index || p->prefixlen < ROUTE_TABLE_INDEX_BITS)
+    return NULL;
+  return table->index[route_index_slot (p)];
+}
+
 /* Lock node. */
 struct route_node *
 route_lock_node (struct route_node *node)
@@ -208,9 +291,11 @@ route_node_match (const struct route_table *table, const struct prefix *p)
 {
   struct route_node *node;
   struct route_node *matched;
+  struct route_node *start;
 
   matched = NULL;
-  node = table->top;
+  start = route_index_start (table, p);
+  node = start ? start : table->top;
 
   /* Walk down tree.  If there is matched route then store it to
      matched. */
@@ -226,6 +311,15 @@ route_node_match (const struct route_table *table, const struct prefix *p)
       node = node->link[prefix_bit(&p->u.prefix, node->p.prefixlen)];
     }
 
+  /* Nodes above where the index started from match too. */
+  if (! matched && start)
+    for (node = start->parent; node; node = node->parent)
+      if (node->info)
+	{
+	  matched = node;
+	  break;
+	}
+
   /* If matched route found, return it. */
   if (matched)
     return route_lock_node (matched);
@@ -271,7 +365,9 @@ route_node_lookup (const struct route_table *table, struct prefix *p)
   u_char prefixlen = p->prefixlen;
   const u_char *prefix = &p->u.prefix;
 
-  node = table->top;
+  node = route_index_start (table, p);
+  if (! node)
+    node = table->top;
 
   while (node && node->p.prefixlen <= prefixlen &&
 	 prefix_match (&node->p, p))
@@ -296,7 +392,9 @@ route_node_get (struct route_table *const table, struct prefix *p)
   const u_char *prefix = &p->u.prefix;
 
   match = NULL;
-  node = table->top;
+  node = route_index_start (table, p);
+  if (! node)
+    node = table->top;
   while (node && node->p.prefixlen <= prefixlen &&
 	 prefix_match (&node->p, p))
     {
@@ -331,13 +429,19 @@ route_node_get (struct route_table *const table, struct prefix *p)
       if (new->p.prefixlen != p->prefixlen)
 	{
 	  match = new;
+	  route_index_add (table, match);
 	  new = route_node_set (table, p);
 	  set_link (match, new);
 	  table->count++;
 	}
     }
   table->count++;
+  route_index_add (table, new);
   route_lock_node (new);
+
+  if (! table->index && table->delegate->index_threshold
+      && table->count >= table->delegate->index_threshold)
+    route_index_build (table);
   
   return new;
 }
@@ -377,6 +481,7 @@ route_node_delete (struct route_node *node)
 
   node->table->count--;
 
+  route_index_delete (node->table, node);
   route_node_free (node->table, node);
 
   /* If parent node is stub then delete it also. */
@@ -517,7 +622,8 @@ route_node_destroy (route_table_delegate_t *delegate,
  */
 static route_table_delegate_t default_delegate = {
   .create_node = route_node_create,
-  .destroy_node = route_node_destroy
+  .destroy_node = route_node_destroy,
+  .index_threshold = ROUTE_TABLE_INDEX_THRESHOLD
 };
 
 /*
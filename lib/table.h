@@ -47,8 +47,18 @@ struct route_table_delegate_t_
 {
   route_table_create_node_func_t create_node;
   route_table_destroy_node_func_t destroy_node;
+
+  /*
+   * Tables of at least this many nodes get a direct index of their
+   * top ROUTE_TABLE_INDEX_BITS levels, which lookups of prefixes that
+   * long or longer start from.  0 for never.
+   */
+  unsigned long index_threshold;
 };
 
+#define ROUTE_TABLE_INDEX_BITS 16
+#define ROUTE_TABLE_INDEX_THRESHOLD 16384
+
 /* Routing table top structure. */
 struct route_table
 {
@@ -60,6 +70,13 @@ struct route_table
   route_table_delegate_t *delegate;
   
   unsigned long count;
+
+  /*
+   * Deepest node of at most ROUTE_TABLE_INDEX_BITS bits covering each
+   * value of the first ROUTE_TABLE_INDEX_BITS bits of a prefix, if the
+   * table is big enough.
+   */
+  struct route_node **index;
   
   /*
    * User data.
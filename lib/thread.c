@@ -40,6 +40,10 @@
 extern int agentx_enabled;
 #endif
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #if defined(__APPLE__)
 #include <mach/mach.h>
 #include <mach/mach_time.h>
@@ -57,6 +61,63 @@ static unsigned short timers_inited;
 
 static struct hash *cpu_record = NULL;
 
+/* Read and write threads pending on a file descriptor. */
+struct thread_fd
+{
+  struct thread *read;
+  struct thread *write;
+  u_int32_t events;		/* events registered with the backend */
+  u_char flags;
+#define THREAD_FD_CHANGED	(1 << 0) /* on the backend's change list */
+#define THREAD_FD_NOPOLL	(1 << 1) /* backend can't poll, always ready */
+};
+
+/* An I/O readiness backend for thread_fetch().
+ *
+ * update() is called whenever the read or write thread of an fd is set
+ * or cleared, and may refuse new threads by returning -1.  wait() blocks
+ * for at most the given time (for ever if NULL) and returns like
+ * select(), after which process() moves the threads of all ready fds
+ * onto the ready list.
+ */
+struct thread_io_ops
+{
+  enum thread_io_method method;
+  const char *name;
+  void *(*init) (struct thread_master *);
+  void (*finish) (struct thread_master *);
+  int (*update) (struct thread_master *, int);
+  int (*wait) (struct thread_master *, struct timeval *);
+  void (*process) (struct thread_master *);
+};
+
+/* Timing wheel for timers added with whole-second delays, which are the
+ * bulk of all timers (protocol keepalives, hold and dead intervals) and
+ * are often re-armed on every packet received.  Timers are hashed on the
+ * second they expire in, making add and cancel O(1), while the pqueue is
+ * left with the msec timers.  Expiry times are kept exact: a slot holds
+ * timers for the same second of later laps too, and each timer is only
+ * run once its own expiry time has passed.
+ */
+#define THREAD_WHEEL_SLOTS 512	/* power of 2, beyond most hold times */
+#define THREAD_WHEEL_SLOT(S) ((S) & (THREAD_WHEEL_SLOTS - 1))
+
+struct thread_wheel
+{
+  struct thread_list slots[THREAD_WHEEL_SLOTS];
+  time_t cursor;		/* second processed up to */
+  unsigned int count;
+  struct timeval next;		/* earliest expiry, if next_valid */
+  int next_valid;
+};
+
+#if defined HAVE_EPOLL && !(defined HAVE_SNMP && defined SNMP_AGENTX)
+#define THREAD_IO_DEFAULT THREAD_IO_EPOLL
+#else
+/* AgentX hands us an fd_set to wait on, so it needs select(). */
+#define THREAD_IO_DEFAULT THREAD_IO_SELECT
+#endif
+
 /* Struct timeval's tv_usec one second value.  */
 #define TIMER_SECOND_MICRO 1000000L
 
@@ -539,6 +600,13 @@ thread_master_create ()
   rv->timer->cmp = rv->background->cmp = thread_timer_cmp;
   rv->timer->update = rv->background->update = thread_timer_update;
 
+  rv->wheel = XCALLOC (MTYPE_THREAD_WHEEL, sizeof (struct thread_wheel));
+  quagga_get_relative (NULL);
+  rv->wheel->cursor = relative_time.tv_sec;
+
+  if (thread_master_set_io (rv, THREAD_IO_DEFAULT) < 0)
+    thread_master_set_io (rv, THREAD_IO_SELECT);
+
   return rv;
 }
 
@@ -612,6 +680,17 @@ thread_queue_free (struct thread_master *m, struct pqueue *queue)
   pqueue_delete(queue);
 }
 
+static void
+thread_wheel_free (struct thread_master *m, struct thread_wheel *wheel)
+{
+  int i;
+
+  for (i = 0; i < THREAD_WHEEL_SLOTS; i++)
+    thread_list_free (m, &wheel->slots[i]);
+
+  XFREE (MTYPE_THREAD_WHEEL, wheel);
+}
+
 /* Stop thread scheduler. */
 void
 thread_master_free (struct thread_master *m)
@@ -619,10 +698,15 @@ thread_master_free (struct thread_master *m)
   thread_list_free (m, &m->read);
   thread_list_free (m, &m->write);
   thread_queue_free (m, m->timer);
+  thread_wheel_free (m, m->wheel);
   thread_list_free (m, &m->event);
   thread_list_free (m, &m->ready);
   thread_list_free (m, &m->unuse);
   thread_queue_free (m, m->background);
+
+  m->io->finish (m);
+  if (m->fds)
+    XFREE (MTYPE_THREAD_FD, m->fds);
   
   XFREE (MTYPE_THREAD_MASTER, m);
 
@@ -650,6 +734,489 @@ thread_trim_head (struct thread_list *list)
   return NULL;
 }
 
+static void
+thread_wheel_add (struct thread_wheel *wheel, struct thread *thread)
+{
+  thread_list_add (&wheel->slots[THREAD_WHEEL_SLOT (thread->u.sands.tv_sec)],
+                   thread);
+  wheel->count++;
+
+  if (wheel->next_valid && timeval_cmp (thread->u.sands, wheel->next) < 0)
+    wheel->next = thread->u.sands;
+}
+
+static void
+thread_wheel_remove (struct thread_wheel *wheel, struct thread *thread)
+{
+  thread_list_delete (&wheel->slots[THREAD_WHEEL_SLOT (thread->u.sands.tv_sec)],
+                      thread);
+  wheel->count--;
+
+  if (wheel->next_valid && timeval_cmp (thread->u.sands, wheel->next) == 0)
+    wheel->next_valid = 0;
+}
+
+/* Look up the I/O threads of an fd, growing the table if needed. */
+static struct thread_fd *
+thread_fd_get (struct thread_master *m, int fd)
+{
+  assert (fd >= 0);
+
+  if (fd >= m->fds_size)
+    {
+      int size = m->fds_size ? m->fds_size : 64;
+
+      while (size <= fd)
+        size *= 2;
+
+      m->fds = XREALLOC (MTYPE_THREAD_FD, m->fds,
+                         size * sizeof (struct thread_fd));
+      memset (&m->fds[m->fds_size], 0,
+              (size - m->fds_size) * sizeof (struct thread_fd));
+      m->fds_size = size;
+    }
+  return &m->fds[fd];
+}
+
+/* The fd of an I/O thread is ready, move it to the ready list. */
+static void
+thread_fd_ready (struct thread_master *m, struct thread *thread)
+{
+  struct thread_fd *tfd = &m->fds[THREAD_FD (thread)];
+
+  if (thread->type == THREAD_READ)
+    {
+      tfd->read = NULL;
+      thread_list_delete (&m->read, thread);
+    }
+  else
+    {
+      tfd->write = NULL;
+      thread_list_delete (&m->write, thread);
+    }
+  m->io->update (m, THREAD_FD (thread));
+
+  thread->type = THREAD_READY;
+  thread_list_add (&m->ready, thread);
+}
+
+/* select() backend.  The interest sets are the master's readfd and
+ * writefd, which select() can only index up to FD_SETSIZE.
+ */
+struct thread_select_state
+{
+  fd_set readfd;
+  fd_set writefd;
+  fd_set exceptfd;
+};
+
+static void *
+thread_select_init (struct thread_master *m)
+{
+  FD_ZERO (&m->readfd);
+  FD_ZERO (&m->writefd);
+  FD_ZERO (&m->exceptfd);
+
+  return XCALLOC (MTYPE_THREAD_IO, sizeof (struct thread_select_state));
+}
+
+static void
+thread_select_finish (struct thread_master *m)
+{
+  XFREE (MTYPE_THREAD_IO, m->io_state);
+}
+
+static int
+thread_select_update (struct thread_master *m, int fd)
+{
+  struct thread_fd *tfd = &m->fds[fd];
+
+  if (fd >= FD_SETSIZE)
+    {
+      zlog_err ("fd %d is beyond the select() limit of %d", fd, FD_SETSIZE);
+      return -1;
+    }
+
+  if (tfd->read)
+    FD_SET (fd, &m->readfd);
+  else
+    FD_CLR (fd, &m->readfd);
+
+  if (tfd->write)
+    FD_SET (fd, &m->writefd);
+  else
+    FD_CLR (fd, &m->writefd);
+
+  return 0;
+}
+
+static int
+thread_select_wait (struct thread_master *m, struct timeval *timer_wait)
+{
+  struct thread_select_state *st = m->io_state;
+  int num;
+#if defined HAVE_SNMP && defined SNMP_AGENTX
+  struct timeval snmp_timer_wait;
+  int snmpblock = 0;
+  int fdsetsize;
+#endif
+
+  /* Structure copy.  */
+  st->readfd = m->readfd;
+  st->writefd = m->writefd;
+  st->exceptfd = m->exceptfd;
+
+#if defined HAVE_SNMP && defined SNMP_AGENTX
+  /* When SNMP is enabled, we may have to select() on additional
+     FD. snmp_select_info() will add them to `readfd'. The trick
+     with this function is its last argument. We need to set it to
+     0 if timer_wait is not NULL and we need to use the provided
+     new timer only if it is still set to 0. */
+  if (agentx_enabled)
+    {
+      fdsetsize = FD_SETSIZE;
+      snmpblock = 1;
+      if (timer_wait)
+        {
+          snmpblock = 0;
+          memcpy(&snmp_timer_wait, timer_wait, sizeof(struct timeval));
+        }
+      snmp_select_info(&fdsetsize, &st->readfd, &snmp_timer_wait, &snmpblock);
+      if (snmpblock == 0)
+        timer_wait = &snmp_timer_wait;
+    }
+#endif
+  num = select (FD_SETSIZE, &st->readfd, &st->writefd, &st->exceptfd,
+                timer_wait);
+
+#if defined HAVE_SNMP && defined SNMP_AGENTX
+  if (agentx_enabled && num >= 0)
+    {
+      if (num > 0)
+        snmp_read(&st->readfd);
+      else if (num == 0)
+        {
+          snmp_timeout();
+          run_alarms();
+        }
+      netsnmp_check_outstanding_agent_requests();
+    }
+#endif
+
+  return num;
+}
+
+static int
+thread_process_fd (struct thread_list *list, fd_set *fdset)
+{
+  struct thread *thread;
+  struct thread *next;
+  int ready = 0;
+  
+  assert (list);
+  
+  for (thread = list->head; thread; thread = next)
+    {
+      next = thread->next;
+
+      if (FD_ISSET (THREAD_FD (thread), fdset))
+        {
+          thread_fd_ready (thread->master, thread);
+          ready++;
+        }
+    }
+  return ready;
+}
+
+static void
+thread_select_process (struct thread_master *m)
+{
+  struct thread_select_state *st = m->io_state;
+
+  /* Normal priority read thead. */
+  thread_process_fd (&m->read, &st->readfd);
+  /* Write thead. */
+  thread_process_fd (&m->write, &st->writefd);
+}
+
+#ifdef HAVE_EPOLL
+/* epoll() backend.  Changes to an fd's threads are only noted when they
+ * are made and pushed to the kernel just before waiting, so that the
+ * common case of an I/O thread re-adding itself from its handler costs a
+ * single epoll_ctl() rather than a delete and an add.
+ */
+#define THREAD_EPOLL_EVENTS_MIN 64
+
+struct thread_epoll_state
+{
+  int epfd;
+  struct epoll_event *events;	/* results of the last wait */
+  int events_size;
+  int nevents;
+  int *changes;			/* fds with changed threads */
+  int changes_count;
+  int changes_size;
+  int nopoll;			/* number of fds with THREAD_FD_NOPOLL */
+};
+
+static void *
+thread_epoll_init (struct thread_master *m)
+{
+  struct thread_epoll_state *st;
+  int epfd;
+
+  if ((epfd = epoll_create (THREAD_EPOLL_EVENTS_MIN)) < 0)
+    {
+      zlog_warn ("epoll_create() failed: %s", safe_strerror (errno));
+      return NULL;
+    }
+  fcntl (epfd, F_SETFD, FD_CLOEXEC);
+
+  st = XCALLOC (MTYPE_THREAD_IO, sizeof (struct thread_epoll_state));
+  st->epfd = epfd;
+  st->events_size = THREAD_EPOLL_EVENTS_MIN;
+  st->events = XCALLOC (MTYPE_THREAD_IO,
+                        st->events_size * sizeof (struct epoll_event));
+  return st;
+}
+
+static void
+thread_epoll_finish (struct thread_master *m)
+{
+  struct thread_epoll_state *st = m->io_state;
+
+  close (st->epfd);
+  XFREE (MTYPE_THREAD_IO, st->events);
+  if (st->changes)
+    XFREE (MTYPE_THREAD_IO, st->changes);
+  XFREE (MTYPE_THREAD_IO, st);
+}
+
+static int
+thread_epoll_update (struct thread_master *m, int fd)
+{
+  struct thread_epoll_state *st = m->io_state;
+  struct thread_fd *tfd = &m->fds[fd];
+
+  if (CHECK_FLAG (tfd->flags, THREAD_FD_CHANGED))
+    return 0;
+
+  if (st->changes_count == st->changes_size)
+    {
+      st->changes_size = st->changes_size ? st->changes_size * 2
+                                          : THREAD_EPOLL_EVENTS_MIN;
+      st->changes = XREALLOC (MTYPE_THREAD_IO, st->changes,
+                              st->changes_size * sizeof (int));
+    }
+  st->changes[st->changes_count++] = fd;
+  SET_FLAG (tfd->flags, THREAD_FD_CHANGED);
+  return 0;
+}
+
+/* Push the noted changes to the kernel. */
+static void
+thread_epoll_flush (struct thread_master *m)
+{
+  struct thread_epoll_state *st = m->io_state;
+  int i;
+
+  for (i = 0; i < st->changes_count; i++)
+    {
+      int fd = st->changes[i];
+      struct thread_fd *tfd = &m->fds[fd];
+      struct epoll_event ev;
+      u_int32_t events;
+      int op, ret;
+
+      UNSET_FLAG (tfd->flags, THREAD_FD_CHANGED);
+      events = (tfd->read ? EPOLLIN : 0) | (tfd->write ? EPOLLOUT : 0);
+
+      if (CHECK_FLAG (tfd->flags, THREAD_FD_NOPOLL))
+        {
+          if (!events)
+            {
+              UNSET_FLAG (tfd->flags, THREAD_FD_NOPOLL);
+              st->nopoll--;
+            }
+          continue;
+        }
+
+      if (!events && !tfd->events)
+        continue;
+
+      /* Even if the events are unchanged, the fd may have been closed
+       * and reused since, which the kernel has noticed but we have not.
+       * MOD then fails, telling us to ADD instead.
+       */
+      memset (&ev, 0, sizeof (ev));
+      ev.events = events;
+      ev.data.fd = fd;
+      op = !events ? EPOLL_CTL_DEL
+                   : (tfd->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+
+      ret = epoll_ctl (st->epfd, op, fd, &ev);
+      if (ret < 0 && op == EPOLL_CTL_MOD && errno == ENOENT)
+        ret = epoll_ctl (st->epfd, EPOLL_CTL_ADD, fd, &ev);
+      else if (ret < 0 && op == EPOLL_CTL_ADD && errno == EEXIST)
+        ret = epoll_ctl (st->epfd, EPOLL_CTL_MOD, fd, &ev);
+      else if (ret < 0 && op == EPOLL_CTL_DEL)
+        ret = 0; /* already closed, the kernel dropped it for us */
+
+      if (ret < 0)
+        {
+          /* Regular files can't be polled, but select() always finds
+           * them ready, so do likewise. */
+          if (errno == EPERM)
+            {
+              SET_FLAG (tfd->flags, THREAD_FD_NOPOLL);
+              st->nopoll++;
+            }
+          else
+            zlog_warn ("epoll_ctl() on fd %d failed: %s",
+                       fd, safe_strerror (errno));
+          events = 0;
+        }
+      tfd->events = events;
+    }
+  st->changes_count = 0;
+}
+
+static int
+thread_epoll_wait (struct thread_master *m, struct timeval *timer_wait)
+{
+  struct thread_epoll_state *st = m->io_state;
+  int timeout = -1;
+
+  thread_epoll_flush (m);
+
+  if (st->nopoll)
+    timeout = 0;
+  else if (timer_wait)
+    {
+      /* Round up, so we don't wake early and spin until a timer pops. */
+      if (timer_wait->tv_sec >= INT_MAX / 1000 - 1)
+        timeout = INT_MAX;
+      else
+        timeout = timer_wait->tv_sec * 1000
+                  + (timer_wait->tv_usec + 999) / 1000;
+    }
+
+  st->nevents = epoll_wait (st->epfd, st->events, st->events_size, timeout);
+  if (st->nevents < 0)
+    {
+      st->nevents = 0;
+      return -1;
+    }
+  return st->nevents + st->nopoll;
+}
+
+static void
+thread_epoll_process (struct thread_master *m)
+{
+  struct thread_epoll_state *st = m->io_state;
+  int i;
+
+  for (i = 0; i < st->nevents; i++)
+    {
+      struct epoll_event *ev = &st->events[i];
+      struct thread_fd *tfd;
+
+      if (ev->data.fd >= m->fds_size)
+        continue;
+      tfd = &m->fds[ev->data.fd];
+
+      /* select() reports errors and hangups as both readable and
+       * writable. */
+      if (tfd->read && (ev->events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+        thread_fd_ready (m, tfd->read);
+      if (tfd->write && (ev->events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+        thread_fd_ready (m, tfd->write);
+    }
+
+  if (st->nopoll)
+    for (i = 0; i < m->fds_size; i++)
+      if (CHECK_FLAG (m->fds[i].flags, THREAD_FD_NOPOLL))
+        {
+          if (m->fds[i].read)
+            thread_fd_ready (m, m->fds[i].read);
+          if (m->fds[i].write)
+            thread_fd_ready (m, m->fds[i].write);
+        }
+
+  /* The buffer filled up, there may be more fds ready than we can see. */
+  if (st->nevents == st->events_size)
+    {
+      st->events_size *= 2;
+      st->events = XREALLOC (MTYPE_THREAD_IO, st->events,
+                             st->events_size * sizeof (struct epoll_event));
+    }
+  st->nevents = 0;
+}
+#endif /* HAVE_EPOLL */
+
+static const struct thread_io_ops thread_io_backends[] =
+{
+  {
+    .method = THREAD_IO_SELECT,
+    .name = "select",
+    .init = thread_select_init,
+    .finish = thread_select_finish,
+    .update = thread_select_update,
+    .wait = thread_select_wait,
+    .process = thread_select_process,
+  },
+#ifdef HAVE_EPOLL
+  {
+    .method = THREAD_IO_EPOLL,
+    .name = "epoll",
+    .init = thread_epoll_init,
+    .finish = thread_epoll_finish,
+    .update = thread_epoll_update,
+    .wait = thread_epoll_wait,
+    .process = thread_epoll_process,
+  },
+#endif /* HAVE_EPOLL */
+};
+
+/* Switch the I/O backend of a thread master, which must not have any
+ * read or write threads pending.  Returns -1 if the method is not
+ * available.
+ */
+int
+thread_master_set_io (struct thread_master *m, enum thread_io_method method)
+{
+  const struct thread_io_ops *io = NULL;
+  void *state;
+  unsigned int i;
+
+  for (i = 0; i < array_size (thread_io_backends); i++)
+    if (thread_io_backends[i].method == method)
+      io = &thread_io_backends[i];
+
+  if (io == NULL || m->read.count || m->write.count)
+    return -1;
+
+  if ((state = io->init (m)) == NULL)
+    return -1;
+
+  if (m->io)
+    m->io->finish (m);
+  m->io = io;
+  m->io_state = state;
+
+  /* Nothing is pending, so only stale backend state can be left. */
+  if (m->fds)
+    memset (m->fds, 0, m->fds_size * sizeof (struct thread_fd));
+
+  return 0;
+}
+
+const char *
+thread_master_io_name (struct thread_master *m)
+{
+  return m->io->name;
+}
+
 /* Return remain time in second. */
 unsigned long
 thread_timer_remain_second (struct thread *thread)
@@ -698,18 +1265,27 @@ funcname_thread_add_read (struct thread_master *m,
 		 debugargdef)
 {
   struct thread *thread;
+  struct thread_fd *tfd;
 
   assert (m != NULL);
 
-  if (FD_ISSET (fd, &m->readfd))
+  tfd = thread_fd_get (m, fd);
+  if (tfd->read)
     {
       zlog (NULL, LOG_WARNING, "There is already read fd [%d]", fd);
       return NULL;
     }
 
   thread = thread_get (m, THREAD_READ, func, arg, debugargpass);
-  FD_SET (fd, &m->readfd);
   thread->u.fd = fd;
+  tfd->read = thread;
+  if (m->io->update (m, fd) < 0)
+    {
+      tfd->read = NULL;
+      thread->type = THREAD_UNUSED;
+      thread_add_unuse (m, thread);
+      return NULL;
+    }
   thread_list_add (&m->read, thread);
 
   return thread;
@@ -722,18 +1298,27 @@ funcname_thread_add_write (struct thread_master *m,
 		 debugargdef)
 {
   struct thread *thread;
+  struct thread_fd *tfd;
 
   assert (m != NULL);
 
-  if (FD_ISSET (fd, &m->writefd))
+  tfd = thread_fd_get (m, fd);
+  if (tfd->write)
     {
       zlog (NULL, LOG_WARNING, "There is already write fd [%d]", fd);
       return NULL;
     }
 
   thread = thread_get (m, THREAD_WRITE, func, arg, debugargpass);
-  FD_SET (fd, &m->writefd);
   thread->u.fd = fd;
+  tfd->write = thread;
+  if (m->io->update (m, fd) < 0)
+    {
+      tfd->write = NULL;
+      thread->type = THREAD_UNUSED;
+      thread_add_unuse (m, thread);
+      return NULL;
+    }
   thread_list_add (&m->write, thread);
 
   return thread;
@@ -745,6 +1330,7 @@ funcname_thread_add_timer_timeval (struct thread_master *m,
                                   int type,
                                   void *arg, 
                                   struct timeval *time_relative,
+                                  int wheel,
 				  debugargdef)
 {
   struct thread *thread;
@@ -754,6 +1340,7 @@ funcname_thread_add_timer_timeval (struct thread_master *m,
   assert (m != NULL);
 
   assert (type == THREAD_TIMER || type == THREAD_BACKGROUND);
+  assert (!wheel || type == THREAD_TIMER);
   assert (time_relative);
   
   queue = ((type == THREAD_TIMER) ? m->timer : m->background);
@@ -765,7 +1352,10 @@ funcname_thread_add_timer_timeval (struct thread_master *m,
   alarm_time.tv_usec = relative_time.tv_usec + time_relative->tv_usec;
   thread->u.sands = timeval_adjust(alarm_time);
 
-  pqueue_enqueue(thread, queue);
+  if (wheel)
+    thread_wheel_add (m->wheel, thread);
+  else
+    pqueue_enqueue(thread, queue);
   return thread;
 }
 
@@ -785,7 +1375,7 @@ funcname_thread_add_timer (struct thread_master *m,
   trel.tv_usec = 0;
 
   return funcname_thread_add_timer_timeval (m, func, THREAD_TIMER, arg, 
-                                            &trel, debugargpass);
+                                            &trel, 1, debugargpass);
 }
 
 /* Add timer event thread with "millisecond" resolution */
@@ -803,7 +1393,7 @@ funcname_thread_add_timer_msec (struct thread_master *m,
   trel.tv_usec = 1000*(timer % 1000);
 
   return funcname_thread_add_timer_timeval (m, func, THREAD_TIMER, 
-                                            arg, &trel, debugargpass);
+                                            arg, &trel, 0, debugargpass);
 }
 
 /* Add a background thread, with an optional millisec delay */
@@ -829,7 +1419,7 @@ funcname_thread_add_background (struct thread_master *m,
     }
 
   return funcname_thread_add_timer_timeval (m, func, THREAD_BACKGROUND,
-                                            arg, &trel, debugargpass);
+                                            arg, &trel, 0, debugargpass);
 }
 
 /* Add simple event thread. */
@@ -859,16 +1449,25 @@ thread_cancel (struct thread *thread)
   switch (thread->type)
     {
     case THREAD_READ:
-      assert (FD_ISSET (thread->u.fd, &thread->master->readfd));
-      FD_CLR (thread->u.fd, &thread->master->readfd);
+      assert (thread->master->fds[thread->u.fd].read == thread);
+      thread->master->fds[thread->u.fd].read = NULL;
+      thread->master->io->update (thread->master, thread->u.fd);
       list = &thread->master->read;
       break;
     case THREAD_WRITE:
-      assert (FD_ISSET (thread->u.fd, &thread->master->writefd));
-      FD_CLR (thread->u.fd, &thread->master->writefd);
+      assert (thread->master->fds[thread->u.fd].write == thread);
+      thread->master->fds[thread->u.fd].write = NULL;
+      thread->master->io->update (thread->master, thread->u.fd);
       list = &thread->master->write;
       break;
     case THREAD_TIMER:
+      if (thread->index < 0)
+        {
+          thread_wheel_remove (thread->master->wheel, thread);
+          thread->type = THREAD_UNUSED;
+          thread_add_unuse (thread->master, thread);
+          return;
+        }
       queue = thread->master->timer;
       break;
     case THREAD_EVENT:
@@ -960,6 +1559,43 @@ thread_timer_wait (struct pqueue *queue, struct timeval *timer_val)
   return NULL;
 }
 
+/* Time until the first timer on the wheel pops.  The slots are searched
+ * at most one lap ahead, beyond that we just check back after a lap.
+ */
+static struct timeval *
+thread_wheel_wait (struct thread_wheel *wheel, struct timeval *timer_val)
+{
+  time_t sec;
+
+  if (!wheel->count)
+    return NULL;
+
+  for (sec = wheel->cursor;
+       !wheel->next_valid && sec < wheel->cursor + THREAD_WHEEL_SLOTS; sec++)
+    {
+      struct thread_list *list = &wheel->slots[THREAD_WHEEL_SLOT (sec)];
+      struct thread *thread;
+
+      for (thread = list->head; thread; thread = thread->next)
+        if (thread->u.sands.tv_sec <= sec
+            && (!wheel->next_valid
+                || timeval_cmp (thread->u.sands, wheel->next) < 0))
+          {
+            wheel->next = thread->u.sands;
+            wheel->next_valid = 1;
+          }
+    }
+
+  if (wheel->next_valid)
+    *timer_val = timeval_subtract (wheel->next, relative_time);
+  else
+    {
+      timer_val->tv_sec = THREAD_WHEEL_SLOTS;
+      timer_val->tv_usec = 0;
+    }
+  return timer_val;
+}
+
 static struct thread *
 thread_run (struct thread_master *m, struct thread *thread,
 	    struct thread *fetch)
@@ -970,32 +1606,6 @@ thread_run (struct thread_master *m, struct thread *thread,
   return fetch;
 }
 
-static int
-thread_process_fd (struct thread_list *list, fd_set *fdset, fd_set *mfdset)
-{
-  struct thread *thread;
-  struct thread *next;
-  int ready = 0;
-  
-  assert (list);
-  
-  for (thread = list->head; thread; thread = next)
-    {
-      next = thread->next;
-
-      if (FD_ISSET (THREAD_FD (thread), fdset))
-        {
-          assert (FD_ISSET (THREAD_FD (thread), mfdset));
-          FD_CLR(THREAD_FD (thread), mfdset);
-          thread_list_delete (list, thread);
-          thread_list_add (&thread->master->ready, thread);
-          thread->type = THREAD_READY;
-          ready++;
-        }
-    }
-  return ready;
-}
-
 /* Add all timers that have popped to the ready list. */
 static unsigned int
 thread_timer_process (struct pqueue *queue, struct timeval *timenow)
@@ -1016,6 +1626,44 @@ thread_timer_process (struct pqueue *queue, struct timeval *timenow)
   return ready;
 }
 
+/* Add all timers on the wheel that have popped to the ready list, in
+ * order of the second they expired in.
+ */
+static unsigned int
+thread_wheel_process (struct thread_wheel *wheel, struct timeval *timenow)
+{
+  time_t sec;
+  unsigned int ready = 0;
+
+  sec = wheel->cursor;
+  if (timenow->tv_sec - sec >= THREAD_WHEEL_SLOTS)
+    sec = timenow->tv_sec - THREAD_WHEEL_SLOTS + 1;
+
+  for (; wheel->count && sec <= timenow->tv_sec; sec++)
+    {
+      struct thread_list *list = &wheel->slots[THREAD_WHEEL_SLOT (sec)];
+      struct thread *thread;
+      struct thread *next;
+
+      for (thread = list->head; thread; thread = next)
+        {
+          next = thread->next;
+          if (timeval_cmp (*timenow, thread->u.sands) < 0)
+            continue;
+          thread_list_delete (list, thread);
+          wheel->count--;
+          thread->type = THREAD_READY;
+          thread_list_add (&thread->master->ready, thread);
+          ready++;
+        }
+    }
+
+  wheel->cursor = timenow->tv_sec;
+  if (ready)
+    wheel->next_valid = 0;
+  return ready;
+}
+
 /* process a list en masse, e.g. for event thread lists */
 static unsigned int
 thread_process (struct thread_list *list)
@@ -1041,22 +1689,16 @@ struct thread *
 thread_fetch (struct thread_master *m, struct thread *fetch)
 {
   struct thread *thread;
-  fd_set readfd;
-  fd_set writefd;
-  fd_set exceptfd;
   struct timeval timer_val = { .tv_sec = 0, .tv_usec = 0 };
+  struct timeval timer_val_wheel;
   struct timeval timer_val_bg;
   struct timeval *timer_wait = &timer_val;
+  struct timeval *timer_wait_wheel;
   struct timeval *timer_wait_bg;
 
   while (1)
     {
       int num = 0;
-#if defined HAVE_SNMP && defined SNMP_AGENTX
-      struct timeval snmp_timer_wait;
-      int snmpblock = 0;
-      int fdsetsize;
-#endif
       
       /* Signals pre-empt everything */
       quagga_sigevent_process ();
@@ -1075,82 +1717,43 @@ thread_fetch (struct thread_master *m, struct thread *fetch)
       /* Normal event are the next highest priority.  */
       thread_process (&m->event);
       
-      /* Structure copy.  */
-      readfd = m->readfd;
-      writefd = m->writefd;
-      exceptfd = m->exceptfd;
-      
       /* Calculate select wait timer if nothing else to do */
       if (m->ready.count == 0)
         {
           quagga_get_relative (NULL);
           timer_wait = thread_timer_wait (m->timer, &timer_val);
+          timer_wait_wheel = thread_wheel_wait (m->wheel, &timer_val_wheel);
           timer_wait_bg = thread_timer_wait (m->background, &timer_val_bg);
           
+          if (timer_wait_wheel &&
+              (!timer_wait || (timeval_cmp (*timer_wait, *timer_wait_wheel) > 0)))
+            timer_wait = timer_wait_wheel;
           if (timer_wait_bg &&
               (!timer_wait || (timeval_cmp (*timer_wait, *timer_wait_bg) > 0)))
             timer_wait = timer_wait_bg;
         }
       
-#if defined HAVE_SNMP && defined SNMP_AGENTX
-      /* When SNMP is enabled, we may have to select() on additional
-	 FD. snmp_select_info() will add them to `readfd'. The trick
-	 with this function is its last argument. We need to set it to
-	 0 if timer_wait is not NULL and we need to use the provided
-	 new timer only if it is still set to 0. */
-      if (agentx_enabled)
-        {
-          fdsetsize = FD_SETSIZE;
-          snmpblock = 1;
-          if (timer_wait)
-            {
-              snmpblock = 0;
-              memcpy(&snmp_timer_wait, timer_wait, sizeof(struct timeval));
-            }
-          snmp_select_info(&fdsetsize, &readfd, &snmp_timer_wait, &snmpblock);
-          if (snmpblock == 0)
-            timer_wait = &snmp_timer_wait;
-        }
-#endif
-      num = select (FD_SETSIZE, &readfd, &writefd, &exceptfd, timer_wait);
+      num = m->io->wait (m, timer_wait);
       
       /* Signals should get quick treatment */
       if (num < 0)
         {
           if (errno == EINTR)
             continue; /* signal received - process it */
-          zlog_warn ("select() error: %s", safe_strerror (errno));
+          zlog_warn ("%s() error: %s", m->io->name, safe_strerror (errno));
             return NULL;
         }
 
-#if defined HAVE_SNMP && defined SNMP_AGENTX
-      if (agentx_enabled)
-        {
-          if (num > 0)
-            snmp_read(&readfd);
-          else if (num == 0)
-            {
-              snmp_timeout();
-              run_alarms();
-            }
-          netsnmp_check_outstanding_agent_requests();
-        }
-#endif
-
       /* Check foreground timers.  Historically, they have had higher
          priority than I/O threads, so let's push them onto the ready
 	 list in front of the I/O threads. */
       quagga_get_relative (NULL);
       thread_timer_process (m->timer, &relative_time);
+      thread_wheel_process (m->wheel, &relative_time);
       
       /* Got IO, process it */
       if (num > 0)
-        {
-          /* Normal priority read thead. */
-          thread_process_fd (&m->read, &readfd, &m->readfd);
-          /* Write thead. */
-          thread_process_fd (&m->write, &writefd, &m->writefd);
-        }
+        m->io->process (m);
 
 #if 0
       /* If any threads were made ready above (I/O or foreground timer),
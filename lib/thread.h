@@ -45,6 +45,16 @@ struct thread_list
 };
 
 struct pqueue;
+struct thread_wheel;
+struct thread_fd;
+struct thread_io_ops;
+
+/* I/O readiness methods which thread_fetch() can wait with. */
+enum thread_io_method
+{
+  THREAD_IO_SELECT = 0,		/* select(2), limited to FD_SETSIZE */
+  THREAD_IO_EPOLL,		/* epoll(7), Linux only */
+};
 
 /* Master of the theads. */
 struct thread_master
@@ -52,6 +62,7 @@ struct thread_master
   struct thread_list read;
   struct thread_list write;
   struct pqueue *timer;
+  struct thread_wheel *wheel;	/* whole-second timers */
   struct thread_list event;
   struct thread_list ready;
   struct thread_list unuse;
@@ -59,6 +70,10 @@ struct thread_master
   fd_set readfd;
   fd_set writefd;
   fd_set exceptfd;
+  struct thread_fd *fds;	/* read/write threads, indexed by fd */
+  int fds_size;
+  const struct thread_io_ops *io; /* I/O backend */
+  void *io_state;		/* private to the I/O backend */
   unsigned long alloc;
 };
 
@@ -79,7 +94,8 @@ struct thread
     int fd;			/* file descriptor in case of read/write. */
     struct timeval sands;	/* rest of time sands value. */
   } u;
-  int index;			/* used for timers to store position in queue */
+  int index;			/* used for timers to store position in queue,
+				   -1 for timers on the wheel */
   struct timeval real;
   struct cpu_thread_history *hist; /* cache pointer to cpu_history */
   const char *funcname;
@@ -179,6 +195,9 @@ enum quagga_clkid {
 /* Prototypes. */
 extern struct thread_master *thread_master_create (void);
 extern void thread_master_free (struct thread_master *);
+extern int thread_master_set_io (struct thread_master *,
+                                 enum thread_io_method);
+extern const char *thread_master_io_name (struct thread_master *);
 
 extern struct thread *funcname_thread_add_read (struct thread_master *, 
 				                int (*)(struct thread *),
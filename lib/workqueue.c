@@ -38,23 +38,66 @@ static struct list *work_queues = &_work_queues;
 
 #define WORK_QUEUE_MIN_GRANULARITY 1
 
+/* Initial size of the item ring, and the size above which an emptied
+ * ring is given back rather than kept for the next load.
+ */
+#define WORK_QUEUE_RING_MIN  64
+#define WORK_QUEUE_RING_KEEP 4096
+
+/* How often per slice a run looks at the time. */
+#define WORK_QUEUE_CHECKS_PER_SLICE 4
+
+/* Upper bounds of the run duration buckets, in usec, the last one has
+ * none.
+ */
+static const unsigned long wq_hist_bound[WQ_HIST_BUCKETS - 1] =
+{
+  100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+};
+
 static struct work_queue_item *
-work_queue_item_new (struct work_queue *wq)
+work_queue_item_at (struct work_queue *wq, unsigned int n)
 {
-  struct work_queue_item *item;
-  assert (wq);
+  return &wq->items.ring[(wq->items.head + n) & (wq->items.size - 1)];
+}
 
-  item = XCALLOC (MTYPE_WORK_QUEUE_ITEM, 
-                  sizeof (struct work_queue_item));
-  
-  return item;
+/* Make room for one more item, unwrapping the ring into one twice the
+ * size if it is full.
+ */
+static void
+work_queue_ring_grow (struct work_queue *wq)
+{
+  struct work_queue_item *ring;
+  unsigned int size, i;
+
+  if (wq->items.count < wq->items.size)
+    return;
+
+  size = wq->items.size ? wq->items.size * 2 : WORK_QUEUE_RING_MIN;
+  ring = XMALLOC (MTYPE_WORK_QUEUE_ITEM, size * sizeof (*ring));
+  for (i = 0; i < wq->items.count; i++)
+    ring[i] = *work_queue_item_at (wq, i);
+
+  if (wq->items.ring)
+    XFREE (MTYPE_WORK_QUEUE_ITEM, wq->items.ring);
+  wq->items.ring = ring;
+  wq->items.size = size;
+  wq->items.head = 0;
 }
 
 static void
-work_queue_item_free (struct work_queue_item *item)
+work_queue_ring_push (struct work_queue *wq, struct work_queue_item *item)
 {
-  XFREE (MTYPE_WORK_QUEUE_ITEM, item);
-  return;
+  work_queue_ring_grow (wq);
+  *work_queue_item_at (wq, wq->items.count++) = *item;
+}
+
+static void
+work_queue_ring_pop (struct work_queue *wq)
+{
+  assert (wq->items.count);
+  wq->items.head = (wq->items.head + 1) & (wq->items.size - 1);
+  wq->items.count--;
 }
 
 /* create new work queue */
@@ -72,16 +115,6 @@ work_queue_new (struct thread_master *m, const char *queue_name)
   new->master = m;
   SET_FLAG (new->flags, WQ_UNPLUGGED);
   
-  if ( (new->items = list_new ()) == NULL)
-    {
-      XFREE (MTYPE_WORK_QUEUE_NAME, new->name);
-      XFREE (MTYPE_WORK_QUEUE, new);
-      
-      return NULL;
-    }
-  
-  new->items->del = (void (*)(void *)) work_queue_item_free;  
-  
   listnode_add (work_queues, new);
   
   new->cycles.granularity = WORK_QUEUE_MIN_GRANULARITY;
@@ -98,8 +131,8 @@ work_queue_free (struct work_queue *wq)
   if (wq->thread != NULL)
     thread_cancel(wq->thread);
   
-  /* list_delete frees items via callback */
-  list_delete (wq->items);
+  if (wq->items.ring)
+    XFREE (MTYPE_WORK_QUEUE_ITEM, wq->items.ring);
   listnode_delete (work_queues, wq);
   
   XFREE (MTYPE_WORK_QUEUE_NAME, wq->name);
@@ -113,7 +146,7 @@ work_queue_schedule (struct work_queue *wq, unsigned int delay)
   /* if appropriate, schedule work queue thread */
   if ( CHECK_FLAG (wq->flags, WQ_UNPLUGGED)
        && (wq->thread == NULL)
-       && (listcount (wq->items) > 0) )
+       && (wq->items.count > 0) )
     {
       wq->thread = thread_add_background (wq->master, work_queue_run, 
                                           wq, delay);
@@ -126,46 +159,53 @@ work_queue_schedule (struct work_queue *wq, unsigned int delay)
 void
 work_queue_add (struct work_queue *wq, void *data)
 {
-  struct work_queue_item *item;
+  struct work_queue_item item;
   
   assert (wq);
 
-  if (!(item = work_queue_item_new (wq)))
-    {
-      zlog_err ("%s: unable to get new queue item", __func__);
-      return;
-    }
-  
-  item->data = data;
-  listnode_add (wq->items, item);
+  item.data = data;
+  item.ran = 0;
+  work_queue_ring_push (wq, &item);
   
   work_queue_schedule (wq, wq->spec.hold);
   
   return;
 }
 
-static void
-work_queue_item_remove (struct work_queue *wq, struct listnode *ln)
+unsigned int
+work_queue_item_count (struct work_queue *wq)
 {
-  struct work_queue_item *item = listgetdata (ln);
+  return wq->items.count;
+}
+
+void *
+work_queue_item_peek (struct work_queue *wq, unsigned int n)
+{
+  if (n >= wq->items.count)
+    return NULL;
+  return work_queue_item_at (wq, n)->data;
+}
 
+/* Drop the item at the head, which was copied to ITEM before running. */
+static void
+work_queue_item_remove (struct work_queue *wq, struct work_queue_item *item)
+{
   assert (item && item->data);
 
+  work_queue_ring_pop (wq);
+
   /* call private data deletion callback if needed */  
   if (wq->spec.del_item_data)
     wq->spec.del_item_data (wq, item->data);
-
-  list_delete_node (wq->items, ln);
-  work_queue_item_free (item);
   
   return;
 }
 
 static void
-work_queue_item_requeue (struct work_queue *wq, struct listnode *ln)
+work_queue_item_requeue (struct work_queue *wq, struct work_queue_item *item)
 {
-  LISTNODE_DETACH (wq->items, ln);
-  LISTNODE_ATTACH (wq->items, ln); /* attach to end of list */
+  work_queue_ring_pop (wq);
+  work_queue_ring_push (wq, item); /* attach to end of queue */
 }
 
 DEFUN(show_work_queues,
@@ -174,8 +214,13 @@ DEFUN(show_work_queues,
       SHOW_STR
       "Work Queue information\n")
 {
+  static const char *hist_label[WQ_HIST_BUCKETS] =
+  {
+    "<0.1", "<0.25", "<0.5", "<1", "<2.5", "<5", "<10", "<25", "<50", ">=50",
+  };
   struct listnode *node;
   struct work_queue *wq;
+  int i;
   
   vty_out (vty, 
            "%c %8s %5s %8s %21s%s",
@@ -195,7 +240,7 @@ DEFUN(show_work_queues,
     {
       vty_out (vty,"%c %8d %5d %8ld %7d %6d %6u %s%s",
                (CHECK_FLAG (wq->flags, WQ_UNPLUGGED) ? ' ' : 'P'),
-               listcount (wq->items),
+               wq->items.count,
                wq->spec.hold,
                wq->runs,
                wq->cycles.best, wq->cycles.granularity,
@@ -204,6 +249,23 @@ DEFUN(show_work_queues,
                wq->name,
                VTY_NEWLINE);
     }
+
+  vty_out (vty, "%sRuns by duration (ms)%s", VTY_NEWLINE, VTY_NEWLINE);
+  vty_out (vty, "%6s", "Slice");
+  for (i = 0; i < WQ_HIST_BUCKETS; i++)
+    vty_out (vty, " %6s", hist_label[i]);
+  vty_out (vty, " %6s %s%s", "Max", "Name", VTY_NEWLINE);
+
+  for (ALL_LIST_ELEMENTS_RO (work_queues, node, wq))
+    {
+      vty_out (vty, "%6.1f",
+               (wq->spec.slice ? wq->spec.slice : THREAD_YIELD_TIME_SLOT)
+                 / 1000.0);
+      for (i = 0; i < WQ_HIST_BUCKETS; i++)
+        vty_out (vty, " %6lu", wq->time.hist[i]);
+      vty_out (vty, " %6.1f %s%s", wq->time.max / 1000.0, wq->name,
+               VTY_NEWLINE);
+    }
     
   return CMD_SUCCESS;
 }
@@ -234,6 +296,47 @@ work_queue_unplug (struct work_queue *wq)
   work_queue_schedule (wq, wq->spec.hold);
 }
 
+/* Account for a run of CYCLES items that took ELAPSED usec, and aim
+ * the granularity at looking at the time a few times per slice.
+ */
+static void
+work_queue_run_account (struct work_queue *wq, unsigned int cycles,
+                        unsigned long elapsed, unsigned long slice)
+{
+  unsigned long long target;
+  int i;
+
+  for (i = 0; i < WQ_HIST_BUCKETS - 1; i++)
+    if (elapsed < wq_hist_bound[i])
+      break;
+  wq->time.hist[i]++;
+  if (elapsed > wq->time.max)
+    wq->time.max = elapsed;
+
+  if (cycles > wq->cycles.best)
+    wq->cycles.best = cycles;
+
+  /* Items seen per check of the time, at the cost per item seen in
+   * this run.  Drop to it at once, but grow by no more than a factor
+   * of 4 per run, a few cheap items say little about the next ones.
+   */
+  if (cycles == 0)
+    return;
+  if (elapsed)
+    target = (unsigned long long) cycles * slice
+               / WORK_QUEUE_CHECKS_PER_SLICE / elapsed;
+  else
+    target = (unsigned long long) wq->cycles.granularity * 4;
+
+  if (target > (unsigned long long) wq->cycles.granularity * 4)
+    target = (unsigned long long) wq->cycles.granularity * 4;
+  if (target > UINT_MAX / 4)
+    target = UINT_MAX / 4;
+  if (target < WORK_QUEUE_MIN_GRANULARITY)
+    target = WORK_QUEUE_MIN_GRANULARITY;
+  wq->cycles.granularity = target;
+}
+
 /* timer thread to process a work queue
  * will reschedule itself if required,
  * otherwise work_queue_item_add 
@@ -242,59 +345,53 @@ int
 work_queue_run (struct thread *thread)
 {
   struct work_queue *wq;
-  struct work_queue_item *item;
+  struct work_queue_item item;
   wq_item_status ret;
   unsigned int cycles = 0;
-  struct listnode *node, *nnode;
-  char yielded = 0;
+  unsigned long slice, elapsed;
+  struct timeval start, now;
 
   wq = THREAD_ARG (thread);
   wq->thread = NULL;
 
-  assert (wq && wq->items);
-
-  /* calculate cycle granularity:
-   * list iteration == 1 cycle
-   * granularity == # cycles between checks whether we should yield.
-   *
-   * granularity should be > 0, and can increase slowly after each run to
-   * provide some hysteris, but not past cycles.best or 2*cycles.
-   *
-   * Best: starts low, can only increase
-   *
-   * Granularity: starts at WORK_QUEUE_MIN_GRANULARITY, can be decreased 
-   *              if we run to end of time slot, can increase otherwise 
-   *              by a small factor.
-   *
-   * We could use just the average and save some work, however we want to be
-   * able to adjust quickly to CPU pressure. Average wont shift much if
-   * daemon has been running a long time.
+  assert (wq);
+
+  /* A run goes on until the queue is empty or it has taken its slice
+   * of time.  To keep the cost of looking at the clock down, it only
+   * does so every granularity items, which work_queue_run_account()
+   * adjusts after each run to the cost of the items seen.
    */
-   if (wq->cycles.granularity == 0)
-     wq->cycles.granularity = WORK_QUEUE_MIN_GRANULARITY;
+  slice = wq->spec.slice ? wq->spec.slice : THREAD_YIELD_TIME_SLOT;
+  if (wq->cycles.granularity == 0)
+    wq->cycles.granularity = WORK_QUEUE_MIN_GRANULARITY;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
 
-  for (ALL_LIST_ELEMENTS (wq->items, node, nnode, item))
+  while (wq->items.count)
   {
-    assert (item && item->data);
+    /* The work function may add to the queue, which may move the ring,
+     * so work on a copy of the head.
+     */
+    item = *work_queue_item_at (wq, 0);
+    assert (item.data);
     
     /* dont run items which are past their allowed retries */
-    if (item->ran > wq->spec.max_retries)
+    if (item.ran > wq->spec.max_retries)
       {
         /* run error handler, if any */
 	if (wq->spec.errorfunc)
-	  wq->spec.errorfunc (wq, item->data);
-	work_queue_item_remove (wq, node);
+	  wq->spec.errorfunc (wq, &item);
+	work_queue_item_remove (wq, &item);
 	continue;
       }
 
     /* run and take care of items that want to be retried immediately */
     do
       {
-        ret = wq->spec.workfunc (wq, item->data);
-        item->ran++;
+        ret = wq->spec.workfunc (wq, item.data);
+        item.ran++;
       }
     while ((ret == WQ_RETRY_NOW) 
-           && (item->ran < wq->spec.max_retries));
+           && (item.ran < wq->spec.max_retries));
 
     switch (ret)
       {
@@ -303,16 +400,17 @@ work_queue_run (struct thread *thread)
           /* decrement item->ran again, cause this isn't an item
            * specific error, and fall through to WQ_RETRY_LATER
            */
-          item->ran--;
+          item.ran--;
         }
       case WQ_RETRY_LATER:
 	{
+	  work_queue_item_at (wq, 0)->ran = item.ran;
 	  goto stats;
 	}
       case WQ_REQUEUE:
 	{
-	  item->ran--;
-	  work_queue_item_requeue (wq, node);
+	  item.ran--;
+	  work_queue_item_requeue (wq, &item);
 	  break;
 	}
       case WQ_RETRY_NOW:
@@ -320,13 +418,13 @@ work_queue_run (struct thread *thread)
       case WQ_ERROR:
 	{
 	  if (wq->spec.errorfunc)
-	    wq->spec.errorfunc (wq, item);
+	    wq->spec.errorfunc (wq, &item);
 	}
 	/* fall through here is deliberate */
       case WQ_SUCCESS:
       default:
 	{
-	  work_queue_item_remove (wq, node);
+	  work_queue_item_remove (wq, &item);
 	  break;
 	}
       }
@@ -335,49 +433,33 @@ work_queue_run (struct thread *thread)
     cycles++;
 
     /* test if we should yield */
-    if ( !(cycles % wq->cycles.granularity) 
-        && thread_should_yield (thread))
+    if (!(cycles % wq->cycles.granularity))
       {
-        yielded = 1;
-        goto stats;
+        quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+        elapsed = timeval_elapsed (now, start);
+        if (elapsed >= slice)
+          goto stats;
       }
   }
 
 stats:
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  elapsed = timeval_elapsed (now, start);
+  work_queue_run_account (wq, cycles, elapsed, slice);
 
-#define WQ_HYSTERESIS_FACTOR 4
-
-  /* we yielded, check whether granularity should be reduced */
-  if (yielded && (cycles < wq->cycles.granularity))
-    {
-      wq->cycles.granularity = ((cycles > 0) ? cycles 
-                                             : WORK_QUEUE_MIN_GRANULARITY);
-    }
-  /* otherwise, should granularity increase? */
-  else if (cycles >= (wq->cycles.granularity))
-    {
-      if (cycles > wq->cycles.best)
-        wq->cycles.best = cycles;
-      
-      /* along with yielded check, provides hysteresis for granularity */
-      if (cycles > (wq->cycles.granularity * WQ_HYSTERESIS_FACTOR
-                                           * WQ_HYSTERESIS_FACTOR))
-        wq->cycles.granularity *= WQ_HYSTERESIS_FACTOR; /* quick ramp-up */
-      else if (cycles > (wq->cycles.granularity * WQ_HYSTERESIS_FACTOR))
-        wq->cycles.granularity += WQ_HYSTERESIS_FACTOR;
-    }
-#undef WQ_HYSTERIS_FACTOR
-  
   wq->runs++;
   wq->cycles.total += cycles;
 
-#if 0
-  printf ("%s: cycles %d, new: best %d, worst %d\n",
-            __func__, cycles, wq->cycles.best, wq->cycles.granularity);
-#endif
+  /* Give back the ring of a big load once it is done with. */
+  if (wq->items.count == 0 && wq->items.size > WORK_QUEUE_RING_KEEP)
+    {
+      XFREE (MTYPE_WORK_QUEUE_ITEM, wq->items.ring);
+      wq->items.size = 0;
+      wq->items.head = 0;
+    }
   
   /* Is the queue done yet? If it is, call the completion callback. */
-  if (listcount (wq->items) > 0)
+  if (wq->items.count > 0)
     work_queue_schedule (wq, 0);
   else if (wq->spec.completion_func)
     wq->spec.completion_func (wq);
@@ -49,6 +49,11 @@ struct work_queue_item
 
 #define WQ_UNPLUGGED	(1 << 0) /* available for draining */
 
+/* Run durations are counted in buckets of up to 100us, 250us, 500us,
+ * 1ms, 2.5ms, 5ms, 10ms, 25ms, 50ms and over.
+ */
+#define WQ_HIST_BUCKETS	10
+
 struct work_queue
 {
   /* Everything but the specification struct is private
@@ -84,17 +89,32 @@ struct work_queue
     unsigned int max_retries;	
 
     unsigned int hold;	/* hold time for first run, in ms */
+
+    /* how long a run may take before it yields, in usec,
+     * 0 for THREAD_YIELD_TIME_SLOT
+     */
+    unsigned long slice;
   } spec;
   
   /* remaining fields should be opaque to users */
-  struct list *items;                 /* queue item list */
+  struct {
+    struct work_queue_item *ring;     /* items, in order, no gaps */
+    unsigned int size;                /* slots in ring, a power of 2 */
+    unsigned int head;                /* slot of the next item to run */
+    unsigned int count;               /* items queued */
+  } items;
   unsigned long runs;                 /* runs count */
   
   struct {
     unsigned int best;
-    unsigned int granularity;
+    unsigned int granularity;         /* items between checks of the time */
     unsigned long total;
   } cycles;	/* cycle counts */
+
+  struct {
+    unsigned long max;                /* longest run, in usec */
+    unsigned long hist[WQ_HIST_BUCKETS]; /* runs, by duration */
+  } time;
   
   /* private state */
   u_int16_t flags;		/* user set flag */
@@ -114,6 +134,12 @@ extern void work_queue_free (struct work_queue *);
 /* Add the supplied data as an item onto the workqueue */
 extern void work_queue_add (struct work_queue *, void *);
 
+/* number of items queued, and the data of the Nth of them in the order
+ * they will be run
+ */
+extern unsigned int work_queue_item_count (struct work_queue *);
+extern void *work_queue_item_peek (struct work_queue *, unsigned int);
+
 /* plug the queue, ie prevent it from being drained / processed */
 extern void work_queue_plug (struct work_queue *wq);
 /* unplug the queue, allow it to be drained again */
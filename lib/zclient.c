@@ -32,6 +32,7 @@
 #include "zclient.h"
 #include "memory.h"
 #include "table.h"
+#include "zring.h"
 
 /* Zebra client events. */
 enum event {ZCLIENT_SCHEDULE, ZCLIENT_READ, ZCLIENT_CONNECT};
@@ -39,6 +40,11 @@ enum event {ZCLIENT_SCHEDULE, ZCLIENT_READ, ZCLIENT_CONNECT};
 /* Prototype for event manager. */
 static void zclient_event (enum event, struct zclient *);
 
+/* Ring messages handled before other threads get a turn. */
+#define ZCLIENT_RING_BUDGET 256
+
+static int zclient_ring_read (struct thread *);
+
 extern struct thread_master *master;
 
 char *zclient_serv_path = NULL;
@@ -55,8 +61,14 @@ zclient_new ()
 
   zclient->ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   zclient->obuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  zclient->batch = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  zclient->rbuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   zclient->wb = buffer_new(0);
 
+#ifndef HAVE_TCP_ZEBRA
+  zclient->ring_size = ZRING_SIZE_DEFAULT;
+#endif /* HAVE_TCP_ZEBRA */
+
   return zclient;
 }
 
@@ -72,6 +84,10 @@ zclient_free (struct zclient *zclient)
     stream_free(zclient->ibuf);
   if (zclient->obuf)
     stream_free(zclient->obuf);
+  if (zclient->batch)
+    stream_free(zclient->batch);
+  if (zclient->rbuf)
+    stream_free(zclient->rbuf);
   if (zclient->wb)
     buffer_free(zclient->wb);
 
@@ -121,10 +137,23 @@ zclient_stop (struct zclient *zclient)
   THREAD_OFF(zclient->t_read);
   THREAD_OFF(zclient->t_connect);
   THREAD_OFF(zclient->t_write);
+  THREAD_OFF(zclient->t_batch);
+  THREAD_OFF(zclient->t_ring);
 
   /* Reset streams. */
   stream_reset(zclient->ibuf);
   stream_reset(zclient->obuf);
+  stream_reset(zclient->batch);
+  zclient->batch_count = 0;
+
+  /* Whatever zebra offered is renegotiated on the next connection. */
+  zclient->capabilities = 0;
+  zclient->sock_sent = zclient->sock_read = 0;
+  if (zclient->ring)
+    {
+      zring_shm_free (zclient->ring);
+      zclient->ring = NULL;
+    }
 
   /* Empty the write buffer. */
   buffer_reset(zclient->wb);
@@ -268,13 +297,14 @@ zclient_flush_data(struct thread *thread)
   return 0;
 }
 
-int
-zclient_send_message(struct zclient *zclient)
+/* Write one message to the socket. */
+static int
+zclient_write (struct zclient *zclient, const u_char *data, size_t len)
 {
   if (zclient->sock < 0)
     return -1;
-  switch (buffer_write(zclient->wb, zclient->sock, STREAM_DATA(zclient->obuf),
-		       stream_get_endp(zclient->obuf)))
+  zclient->sock_sent++;
+  switch (buffer_write(zclient->wb, zclient->sock, data, len))
     {
     case BUFFER_ERROR:
       zlog_warn("%s: buffer_write failed to zclient fd %d, closing",
@@ -292,6 +322,88 @@ zclient_send_message(struct zclient *zclient)
   return 0;
 }
 
+static int
+zclient_ring_active (struct zclient *zclient)
+{
+  return zclient->ring
+	 && CHECK_FLAG (zclient->capabilities, ZAPI_CAPABILITY_RING);
+}
+
+/* Wake zebra up to read the ring.  Not made in obuf, which may hold a
+   message being made. */
+static int
+zclient_send_kick (struct zclient *zclient)
+{
+  u_char kick[ZEBRA_HEADER_SIZE];
+
+  kick[0] = 0;
+  kick[1] = ZEBRA_HEADER_SIZE;
+  kick[2] = ZEBRA_HEADER_MARKER;
+  kick[3] = ZSERV_VERSION;
+  kick[4] = 0;
+  kick[5] = ZEBRA_RING_KICK;
+  return zclient_write (zclient, kick, sizeof (kick));
+}
+
+/* Route messages take the ring once zebra has agreed to it, and the
+   socket until then, or when the ring is full. */
+static int
+zclient_send_route (struct zclient *zclient, struct stream *s)
+{
+  if (zclient_ring_active (zclient)
+      && zring_put (&zclient->ring->tx, s, zclient->sock_sent) == 0)
+    {
+      if (zring_wake (&zclient->ring->tx))
+	return zclient_send_kick (zclient);
+      return 0;
+    }
+  return zclient_write (zclient, STREAM_DATA (s), stream_get_endp (s));
+}
+
+int
+zclient_send_message(struct zclient *zclient)
+{
+  /* Keep messages in the order they were made. */
+  if (zclient->batch_count && zclient_batch_flush (zclient) < 0)
+    return -1;
+  return zclient_write (zclient, STREAM_DATA (zclient->obuf),
+			stream_get_endp (zclient->obuf));
+}
+
+/* Send the route message in obuf. */
+static int
+zclient_send_route_message (struct zclient *zclient)
+{
+  if (zclient->batch_count && zclient_batch_flush (zclient) < 0)
+    return -1;
+  return zclient_send_route (zclient, zclient->obuf);
+}
+
+int
+zclient_batch_flush (struct zclient *zclient)
+{
+  struct stream *s = zclient->batch;
+
+  THREAD_OFF (zclient->t_batch);
+  if (! zclient->batch_count)
+    return 0;
+
+  stream_putw_at (s, zclient->batch_countp, zclient->batch_count);
+  stream_putw_at (s, 0, stream_get_endp (s));
+  zclient->batch_count = 0;
+
+  return zclient_send_route (zclient, s);
+}
+
+static int
+zclient_batch_flush_event (struct thread *thread)
+{
+  struct zclient *zclient = THREAD_ARG (thread);
+
+  zclient->t_batch = NULL;
+  return zclient_batch_flush (zclient);
+}
+
 void
 zclient_create_header (struct stream *s, uint16_t command)
 {
@@ -318,23 +430,88 @@ zebra_message_send (struct zclient *zclient, int command)
   return zclient_send_message(zclient);
 }
 
+/* Send the message in obuf with a file descriptor attached.  It must
+   be the first thing written on the socket. */
+static int
+zclient_send_fd (struct zclient *zclient, int fd)
+{
+  struct stream *s = zclient->obuf;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (sizeof (int))];
+  } control;
+  ssize_t nbytes;
+
+  if (zclient->sock < 0 || ! buffer_empty (zclient->wb))
+    return -1;
+
+  iov.iov_base = STREAM_DATA (s);
+  iov.iov_len = stream_get_endp (s);
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+  memcpy (CMSG_DATA (cmsg), &fd, sizeof (int));
+
+  nbytes = sendmsg (zclient->sock, &msg, 0);
+  if (nbytes <= 0)
+    return -1;
+
+  /* The descriptor went with the first byte. */
+  zclient->sock_sent++;
+  if ((size_t) nbytes < iov.iov_len)
+    {
+      buffer_put (zclient->wb, STREAM_DATA (s) + nbytes, iov.iov_len - nbytes);
+      THREAD_WRITE_ON (master, zclient->t_write,
+		       zclient_flush_data, zclient, zclient->sock);
+    }
+  return 0;
+}
+
+/* Zebra ties the route type to the client, and answers with the
+   capabilities it shares with us.  Zebra that predates them reads the
+   route type only and does not answer.  The rings, if we offer them,
+   come with the hello, and zebra without them drops the fd. */
 static int
 zebra_hello_send (struct zclient *zclient)
 {
   struct stream *s;
+  u_int32_t capabilities = ZAPI_CAPABILITIES;
 
-  if (zclient->redist_default)
-    {
-      s = zclient->obuf;
-      stream_reset (s);
+  if (zclient->ring_size)
+    zclient->ring = zring_shm_new (zclient->ring_size);
+  if (! zclient->ring)
+    UNSET_FLAG (capabilities, ZAPI_CAPABILITY_RING);
 
-      zclient_create_header (s, ZEBRA_HELLO);
-      stream_putc (s, zclient->redist_default);
-      stream_putw_at (s, 0, stream_get_endp (s));
-      return zclient_send_message(zclient);
-    }
+  s = zclient->obuf;
+  stream_reset (s);
 
-  return 0;
+  zclient_create_header (s, ZEBRA_HELLO);
+  stream_putc (s, zclient->redist_default);
+  stream_putl (s, capabilities);
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  if (! zclient->ring)
+    return zclient_send_message(zclient);
+  if (zclient_send_fd (zclient, zclient->ring->fd) == 0)
+    return 0;
+
+  zlog_warn ("%s: could not pass the ring to zebra: %s", __func__,
+	     safe_strerror (errno));
+  zring_shm_free (zclient->ring);
+  zclient->ring = NULL;
+  stream_putl_at (s, ZEBRA_HEADER_SIZE + 1,
+		  capabilities & ~ZAPI_CAPABILITY_RING);
+  return zclient_send_message(zclient);
 }
 
 /* Make connection to zebra daemon. */
@@ -395,6 +572,9 @@ zclient_start (struct zclient *zclient)
   if (zclient->default_information)
     zebra_message_send (zclient, ZEBRA_REDISTRIBUTE_DEFAULT_ADD);
 
+  if (zclient->zebra_connected)
+    (*zclient->zebra_connected) (zclient);
+
   return 0;
 }
 
@@ -414,6 +594,104 @@ zclient_connect (struct thread *t)
   return zclient_start (zclient);
 }
 
+static void
+zapi_ipv4_route_nexthops (struct stream *s, struct zapi_ipv4 *api)
+{
+  int i;
+
+  if (CHECK_FLAG (api->flags, ZEBRA_FLAG_BLACKHOLE))
+    {
+      stream_putc (s, 1);
+      stream_putc (s, ZEBRA_NEXTHOP_BLACKHOLE);
+      /* XXX assert(api->nexthop_num == 0); */
+      /* XXX assert(api->ifindex_num == 0); */
+    }
+  else
+    stream_putc (s, api->nexthop_num + api->ifindex_num);
+
+  for (i = 0; i < api->nexthop_num; i++)
+    {
+      stream_putc (s, ZEBRA_NEXTHOP_IPV4);
+      stream_put_in_addr (s, api->nexthop[i]);
+    }
+  for (i = 0; i < api->ifindex_num; i++)
+    {
+      stream_putc (s, ZEBRA_NEXTHOP_IFINDEX);
+      stream_putl (s, api->ifindex[i]);
+    }
+}
+
+ /*
+  * Once zebra has ZAPI_CAPABILITY_ROUTE_BULK, zapi_ipv4_route() adds
+  * routes to a ZEBRA_IPV4_ROUTE_BULK_ADD or _DELETE message for as long
+  * as they share type, flags, SAFI, nexthops and distance.  The part
+  * they share comes once, laid out as in the single route message,
+  * followed by the prefixes:
+  *
+  * | Type | Flags | Message | SAFI (2) | Nexthops... | Distance |
+  * | Prefix count (2) |
+  *
+  * and per prefix, the metric only if ZAPI_MESSAGE_METRIC is set:
+  *
+  * | Prefix length | Prefix (0-4) | Metric (4) |
+  *
+  * The message goes out when a route differs from those before it,
+  * when it is full, before any other message to zebra, and at the
+  * latest once the thread that made the routes returns.
+  */
+static int
+zapi_ipv4_route_batch (u_char cmd, struct zclient *zclient,
+		       struct prefix_ipv4 *p, struct zapi_ipv4 *api)
+{
+  struct stream *s, *b;
+  size_t len;
+
+  /* The shared part, made in obuf to compare it with the batch's. */
+  s = zclient->obuf;
+  stream_reset (s);
+
+  zclient_create_header (s, cmd == ZEBRA_IPV4_ROUTE_ADD
+			 ? ZEBRA_IPV4_ROUTE_BULK_ADD
+			 : ZEBRA_IPV4_ROUTE_BULK_DELETE);
+  stream_putc (s, api->type);
+  stream_putc (s, api->flags);
+  stream_putc (s, api->message);
+  stream_putw (s, api->safi);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
+    zapi_ipv4_route_nexthops (s, api);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_DISTANCE))
+    stream_putc (s, api->distance);
+  len = stream_get_endp (s);
+
+  b = zclient->batch;
+  if (zclient->batch_count
+      && (len != zclient->batch_countp
+	  || memcmp (STREAM_DATA (s), STREAM_DATA (b), len)
+	  || STREAM_WRITEABLE (b) < 1 + sizeof (p->prefix) + 4
+	  || zclient->batch_count == UINT16_MAX))
+    if (zclient_batch_flush (zclient) < 0)
+      return -1;
+
+  if (! zclient->batch_count)
+    {
+      stream_reset (b);
+      stream_put (b, STREAM_DATA (s), len);
+      zclient->batch_countp = len;
+      stream_putw (b, 0);
+    }
+
+  stream_putc (b, p->prefixlen);
+  stream_put (b, &p->prefix, PSIZE (p->prefixlen));
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
+    stream_putl (b, api->metric);
+  zclient->batch_count++;
+
+  if (! zclient->t_batch)
+    zclient->t_batch = thread_add_event (master, zclient_batch_flush_event,
+					 zclient, 0);
+  return 0;
+}
+
  /* 
   * "xdr_encode"-like interface that allows daemon (client) to send
   * a message to zebra server for a route that needs to be
@@ -462,10 +740,13 @@ int
 zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
                  struct zapi_ipv4 *api)
 {
-  int i;
   int psize;
   struct stream *s;
 
+  if (CHECK_FLAG (zclient->capabilities, ZAPI_CAPABILITY_ROUTE_BULK)
+      && (cmd == ZEBRA_IPV4_ROUTE_ADD || cmd == ZEBRA_IPV4_ROUTE_DELETE))
+    return zapi_ipv4_route_batch (cmd, zclient, p, api);
+
   /* Reset stream. */
   s = zclient->obuf;
   stream_reset (s);
@@ -485,28 +766,7 @@ zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
 
   /* Nexthop, ifindex, distance and metric information. */
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
-    {
-      if (CHECK_FLAG (api->flags, ZEBRA_FLAG_BLACKHOLE))
-        {
-          stream_putc (s, 1);
-          stream_putc (s, ZEBRA_NEXTHOP_BLACKHOLE);
-          /* XXX assert(api->nexthop_num == 0); */
-          /* XXX assert(api->ifindex_num == 0); */
-        }
-      else
-        stream_putc (s, api->nexthop_num + api->ifindex_num);
-
-      for (i = 0; i < api->nexthop_num; i++)
-        {
-          stream_putc (s, ZEBRA_NEXTHOP_IPV4);
-          stream_put_in_addr (s, api->nexthop[i]);
-        }
-      for (i = 0; i < api->ifindex_num; i++)
-        {
-          stream_putc (s, ZEBRA_NEXTHOP_IFINDEX);
-          stream_putl (s, api->ifindex[i]);
-        }
-    }
+    zapi_ipv4_route_nexthops (s, api);
 
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_DISTANCE))
     stream_putc (s, api->distance);
@@ -516,7 +776,7 @@ zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
   /* Put length at the first point of the stream. */
   stream_putw_at (s, 0, stream_get_endp (s));
 
-  return zclient_send_message(zclient);
+  return zclient_send_route_message (zclient);
 }
 
 #ifdef HAVE_IPV6
@@ -570,7 +830,7 @@ zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
   /* Put length at the first point of the stream. */
   stream_putw_at (s, 0, stream_get_endp (s));
 
-  return zclient_send_message(zclient);
+  return zclient_send_route_message (zclient);
 }
 #endif /* HAVE_IPV6 */
 
@@ -827,6 +1087,147 @@ zebra_interface_address_read (int type, struct stream *s)
 }
 
 
+static void
+zclient_dispatch (struct zclient *zclient, uint16_t command, uint16_t length)
+{
+  switch (command)
+    {
+    case ZEBRA_ROUTER_ID_UPDATE:
+      if (zclient->router_id_update)
+	(*zclient->router_id_update) (command, zclient, length);
+      break;
+    case ZEBRA_INTERFACE_ADD:
+      if (zclient->interface_add)
+	(*zclient->interface_add) (command, zclient, length);
+      break;
+    case ZEBRA_INTERFACE_DELETE:
+      if (zclient->interface_delete)
+	(*zclient->interface_delete) (command, zclient, length);
+      break;
+    case ZEBRA_INTERFACE_ADDRESS_ADD:
+      if (zclient->interface_address_add)
+	(*zclient->interface_address_add) (command, zclient, length);
+      break;
+    case ZEBRA_INTERFACE_ADDRESS_DELETE:
+      if (zclient->interface_address_delete)
+	(*zclient->interface_address_delete) (command, zclient, length);
+      break;
+    case ZEBRA_INTERFACE_UP:
+      if (zclient->interface_up)
+	(*zclient->interface_up) (command, zclient, length);
+      break;
+    case ZEBRA_INTERFACE_DOWN:
+      if (zclient->interface_down)
+	(*zclient->interface_down) (command, zclient, length);
+      break;
+    case ZEBRA_IPV4_ROUTE_ADD:
+      if (zclient->ipv4_route_add)
+	(*zclient->ipv4_route_add) (command, zclient, length);
+      break;
+    case ZEBRA_IPV4_ROUTE_DELETE:
+      if (zclient->ipv4_route_delete)
+	(*zclient->ipv4_route_delete) (command, zclient, length);
+      break;
+    case ZEBRA_IPV6_ROUTE_ADD:
+      if (zclient->ipv6_route_add)
+	(*zclient->ipv6_route_add) (command, zclient, length);
+      break;
+    case ZEBRA_IPV6_ROUTE_DELETE:
+      if (zclient->ipv6_route_delete)
+	(*zclient->ipv6_route_delete) (command, zclient, length);
+      break;
+    case ZEBRA_NEXTHOP_UPDATE:
+      if (zclient->nexthop_update)
+	(*zclient->nexthop_update) (command, zclient, length);
+      break;
+    case ZEBRA_HELLO:
+      if (length >= 4)
+	zclient->capabilities = stream_getl (zclient->ibuf) & ZAPI_CAPABILITIES;
+      if (zclient_debug)
+	zlog_debug ("zebra capabilities 0x%x", zclient->capabilities);
+      if (zclient->ring && ! zclient_ring_active (zclient))
+	{
+	  zring_shm_free (zclient->ring);
+	  zclient->ring = NULL;
+	}
+      break;
+    case ZEBRA_RING_KICK:
+      /* The ring is read after every message. */
+      break;
+    default:
+      break;
+    }
+}
+
+/* Handle up to BUDGET messages from the ring, or all that can be
+   before the next socket message if BUDGET is 0.  Returns -1 if the
+   connection was closed. */
+static int
+zclient_ring_process (struct zclient *zclient, int budget)
+{
+  struct zring *ring = &zclient->ring->rx;
+  struct stream *s;
+  uint16_t length, command;
+  uint8_t marker, version;
+  int ret, n = 0;
+
+  /* Callbacks read from ibuf, which may hold part of a socket
+     message. */
+  s = zclient->ibuf;
+  zclient->ibuf = zclient->rbuf;
+
+  while ((ret = zring_get (ring, zclient->ibuf, zclient->sock_read))
+	 == ZRING_MSG)
+    {
+      length = stream_getw (zclient->ibuf);
+      marker = stream_getc (zclient->ibuf);
+      version = stream_getc (zclient->ibuf);
+      command = stream_getw (zclient->ibuf);
+      if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION
+	  || length != stream_get_endp (zclient->ibuf))
+	{
+	  ret = ZRING_ERROR;
+	  break;
+	}
+
+      zclient_dispatch (zclient, command, length - ZEBRA_HEADER_SIZE);
+      if (! zclient_ring_active (zclient) || ++n == budget)
+	break;
+    }
+
+  zclient->rbuf = zclient->ibuf;
+  zclient->ibuf = s;
+
+  if (ret == ZRING_ERROR)
+    {
+      zlog_err ("%s: bad message in ring from zebra", __func__);
+      return zclient_failed (zclient);
+    }
+  if (zclient->sock < 0)
+    return -1;
+  if (! budget || ! zclient_ring_active (zclient))
+    return 0;
+
+  /* Out of budget, or the ring ran dry and we are about to wait for
+     zebra to kick us, unless it put more in meanwhile. */
+  if (ret == ZRING_MSG || (ret == ZRING_EMPTY && zring_sleep (ring)))
+    if (! zclient->t_ring)
+      zclient->t_ring = thread_add_event (master, zclient_ring_read,
+					  zclient, 0);
+  return 0;
+}
+
+static int
+zclient_ring_read (struct thread *thread)
+{
+  struct zclient *zclient = THREAD_ARG (thread);
+
+  zclient->t_ring = NULL;
+  if (! zclient_ring_active (zclient))
+    return 0;
+  return zclient_ring_process (zclient, ZCLIENT_RING_BUDGET);
+}
+
 /* Zebra client message read function. */
 static int
 zclient_read (struct thread *thread)
@@ -921,55 +1322,12 @@ zclient_read (struct thread *thread)
   if (zclient_debug)
     zlog_debug("zclient 0x%p command 0x%x \n", zclient, command);
 
-  switch (command)
-    {
-    case ZEBRA_ROUTER_ID_UPDATE:
-      if (zclient->router_id_update)
-	(*zclient->router_id_update) (command, zclient, length);
-      break;
-    case ZEBRA_INTERFACE_ADD:
-      if (zclient->interface_add)
-	(*zclient->interface_add) (command, zclient, length);
-      break;
-    case ZEBRA_INTERFACE_DELETE:
-      if (zclient->interface_delete)
-	(*zclient->interface_delete) (command, zclient, length);
-      break;
-    case ZEBRA_INTERFACE_ADDRESS_ADD:
-      if (zclient->interface_address_add)
-	(*zclient->interface_address_add) (command, zclient, length);
-      break;
-    case ZEBRA_INTERFACE_ADDRESS_DELETE:
-      if (zclient->interface_address_delete)
-	(*zclient->interface_address_delete) (command, zclient, length);
-      break;
-    case ZEBRA_INTERFACE_UP:
-      if (zclient->interface_up)
-	(*zclient->interface_up) (command, zclient, length);
-      break;
-    case ZEBRA_INTERFACE_DOWN:
-      if (zclient->interface_down)
-	(*zclient->interface_down) (command, zclient, length);
-      break;
-    case ZEBRA_IPV4_ROUTE_ADD:
-      if (zclient->ipv4_route_add)
-	(*zclient->ipv4_route_add) (command, zclient, length);
-      break;
-    case ZEBRA_IPV4_ROUTE_DELETE:
-      if (zclient->ipv4_route_delete)
-	(*zclient->ipv4_route_delete) (command, zclient, length);
-      break;
-    case ZEBRA_IPV6_ROUTE_ADD:
-      if (zclient->ipv6_route_add)
-	(*zclient->ipv6_route_add) (command, zclient, length);
-      break;
-    case ZEBRA_IPV6_ROUTE_DELETE:
-      if (zclient->ipv6_route_delete)
-	(*zclient->ipv6_route_delete) (command, zclient, length);
-      break;
-    default:
-      break;
-    }
+  /* What zebra put in the ring before this message comes first. */
+  if (zclient_ring_active (zclient) && zclient_ring_process (zclient, 0) < 0)
+    return -1;
+
+  zclient_dispatch (zclient, command, length);
+  zclient->sock_read++;
 
   if (zclient->sock < 0)
     /* Connection was closed during packet processing. */
@@ -979,6 +1337,8 @@ zclient_read (struct thread *thread)
   stream_reset(zclient->ibuf);
   zclient_event (ZCLIENT_READ, zclient);
 
+  if (zclient_ring_active (zclient))
+    return zclient_ring_process (zclient, ZCLIENT_RING_BUDGET);
   return 0;
 }
 
@@ -34,6 +34,8 @@
 /* Zebra header size. */
 #define ZEBRA_HEADER_SIZE             6
 
+struct zring_shm;
+
 /* Structure for the zebra client. */
 struct zclient
 {
@@ -63,6 +65,29 @@ struct zclient
   /* Thread to write buffered data to zebra. */
   struct thread *t_write;
 
+  /* ZAPI_CAPABILITY_* zebra answered our hello with. */
+  u_int32_t capabilities;
+
+  /* IPv4 routes collected for one bulk message, and the thread that
+     sends it once the caller is done, see zapi_ipv4_route(). */
+  struct stream *batch;
+  size_t batch_countp;
+  u_int16_t batch_count;
+  struct thread *t_batch;
+
+  /* Messages written to and read from the socket, which order those
+     in the ring, see lib/zring.h. */
+  u_int32_t sock_sent;
+  u_int32_t sock_read;
+
+  /* Size of the shared-memory ring offered in the hello, or 0 not to
+     offer one.  The ring is used once zebra agrees to it; ring
+     messages are read into rbuf. */
+  u_int32_t ring_size;
+  struct zring_shm *ring;
+  struct stream *rbuf;
+  struct thread *t_ring;
+
   /* Redistribute information. */
   u_char redist_default;
   u_char redist[ZEBRA_ROUTE_MAX];
@@ -82,6 +107,11 @@ struct zclient
   int (*ipv4_route_delete) (int, struct zclient *, uint16_t);
   int (*ipv6_route_add) (int, struct zclient *, uint16_t);
   int (*ipv6_route_delete) (int, struct zclient *, uint16_t);
+  int (*nexthop_update) (int, struct zclient *, uint16_t);
+
+  /* Called once the connection to zebra is up, so the client can
+     replay state zebra keeps per connection. */
+  void (*zebra_connected) (struct zclient *);
 };
 
 /* Zebra API message flag. */
@@ -90,6 +120,12 @@ struct zclient
 #define ZAPI_MESSAGE_DISTANCE 0x04
 #define ZAPI_MESSAGE_METRIC   0x08
 
+/* Capabilities client and zebra offer each other in ZEBRA_HELLO. */
+#define ZAPI_CAPABILITY_ROUTE_BULK	0x00000001
+#define ZAPI_CAPABILITY_RING		0x00000002
+#define ZAPI_CAPABILITIES		(ZAPI_CAPABILITY_ROUTE_BULK \
+					 | ZAPI_CAPABILITY_RING)
+
 /* Zserv protocol message header */
 struct zserv_header
 {
@@ -151,6 +187,10 @@ extern int zclient_send_message(struct zclient *);
 /* create header for command, length to be filled in by user later */
 extern void zclient_create_header (struct stream *, uint16_t);
 
+/* Send the routes zapi_ipv4_route() batched so far.  Done before any
+   other message is sent, and once the current thread is done anyway. */
+extern int zclient_batch_flush (struct zclient *);
+
 extern struct interface *zebra_interface_add_read (struct stream *);
 extern struct interface *zebra_interface_state_read (struct stream *s);
 extern struct connected *zebra_interface_address_read (int, struct stream *);
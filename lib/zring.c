@@ -0,0 +1,336 @@
+/*
+ * Shared-memory rings between zebra and its clients.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+#include <sys/mman.h>
+
+#include "stream.h"
+#include "memory.h"
+#include "log.h"
+#include "zclient.h"
+#include "zring.h"
+
+#define ZRING_MAGIC		0x5a52494e	/* "ZRIN" */
+#define ZRING_CACHELINE		64
+
+/* Each entry starts with a word holding the length of the message that
+   follows, or 0 for a barrier, whose second word is the socket message
+   count.  Entries are padded to whole words, so that words never wrap
+   around the end of the ring. */
+#define ZRING_ALIGN(n)		(((n) + 3) & ~3U)
+#define ZRING_BARRIER_SIZE	8
+
+/* The part both sides write, with the producer's and the consumer's
+   fields on cache lines of their own. */
+struct zring_header
+{
+  u_int32_t magic;
+  u_int32_t size;
+  u_char pad0[ZRING_CACHELINE - 8];
+
+  /* Written by the producer. */
+  u_int32_t head;
+  u_char pad1[ZRING_CACHELINE - 4];
+
+  /* Written by the consumer, and waiting cleared by the producer. */
+  u_int32_t tail;
+  u_int32_t waiting;
+  u_char pad2[ZRING_CACHELINE - 8];
+};
+
+/* Client to zebra ring first, then zebra to client. */
+static size_t
+zring_shm_len (u_int32_t size)
+{
+  return 2 * (sizeof (struct zring_header) + (size_t) size);
+}
+
+static void
+zring_map (struct zring_shm *shm, int client)
+{
+  u_char *ring0 = shm->base;
+  u_char *ring1 = ring0 + shm->len / 2;
+  struct zring *up = client ? &shm->tx : &shm->rx;
+  struct zring *down = client ? &shm->rx : &shm->tx;
+
+  up->hdr = (struct zring_header *) ring0;
+  up->data = ring0 + sizeof (struct zring_header);
+  down->hdr = (struct zring_header *) ring1;
+  down->data = ring1 + sizeof (struct zring_header);
+  up->size = down->size = shm->len / 2 - sizeof (struct zring_header);
+}
+
+/* Make a pair of empty rings for a client to offer zebra. */
+struct zring_shm *
+zring_shm_new (u_int32_t size)
+{
+#ifdef HAVE_MEMFD_CREATE
+  struct zring_shm *shm;
+  struct zring_header *hdr;
+  size_t len;
+  int fd;
+
+  if (size < ZRING_SIZE_MIN || size > ZRING_SIZE_MAX || (size & (size - 1)))
+    return NULL;
+  len = zring_shm_len (size);
+
+  fd = memfd_create ("zserv-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0)
+    {
+      zlog_warn ("%s: memfd_create failed: %s", __func__,
+		 safe_strerror (errno));
+      return NULL;
+    }
+  if (ftruncate (fd, len) < 0)
+    {
+      zlog_warn ("%s: ftruncate failed: %s", __func__, safe_strerror (errno));
+      close (fd);
+      return NULL;
+    }
+  /* Zebra would fault on pages the client took away. */
+  if (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+    {
+      zlog_warn ("%s: sealing failed: %s", __func__, safe_strerror (errno));
+      close (fd);
+      return NULL;
+    }
+
+  shm = XCALLOC (MTYPE_ZRING, sizeof (struct zring_shm));
+  shm->fd = fd;
+  shm->len = len;
+  shm->base = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (shm->base == MAP_FAILED)
+    {
+      zlog_warn ("%s: mmap failed: %s", __func__, safe_strerror (errno));
+      close (fd);
+      XFREE (MTYPE_ZRING, shm);
+      return NULL;
+    }
+  zring_map (shm, 1);
+
+  hdr = shm->tx.hdr;
+  hdr->magic = ZRING_MAGIC;
+  hdr->size = size;
+  hdr = shm->rx.hdr;
+  hdr->magic = ZRING_MAGIC;
+  hdr->size = size;
+  return shm;
+#else
+  return NULL;
+#endif /* HAVE_MEMFD_CREATE */
+}
+
+/* Map the rings a client passed with its hello.  The fd is the pair's
+   from now on, or closed if it will not do. */
+struct zring_shm *
+zring_shm_attach (int fd)
+{
+  struct zring_shm *shm;
+  struct zring_header *hdr;
+  struct stat st;
+  u_int32_t size;
+
+#ifdef F_GET_SEALS
+  int seals = fcntl (fd, F_GET_SEALS);
+
+  if (seals < 0 || ! (seals & F_SEAL_SHRINK))
+    {
+      zlog_warn ("%s: ring fd %d can be shrunk, not using it", __func__, fd);
+      close (fd);
+      return NULL;
+    }
+#endif /* F_GET_SEALS */
+
+  if (fstat (fd, &st) < 0 || st.st_size < (off_t) zring_shm_len (0))
+    {
+      zlog_warn ("%s: ring fd %d is too small", __func__, fd);
+      close (fd);
+      return NULL;
+    }
+
+  shm = XCALLOC (MTYPE_ZRING, sizeof (struct zring_shm));
+  shm->fd = fd;
+  shm->len = st.st_size;
+  shm->base = mmap (NULL, shm->len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (shm->base == MAP_FAILED)
+    {
+      zlog_warn ("%s: mmap failed: %s", __func__, safe_strerror (errno));
+      close (fd);
+      XFREE (MTYPE_ZRING, shm);
+      return NULL;
+    }
+
+  /* The size in the first header must account for all of it. */
+  hdr = shm->base;
+  size = hdr->size;
+  if (hdr->magic != ZRING_MAGIC
+      || size < ZRING_SIZE_MIN || size > ZRING_SIZE_MAX || (size & (size - 1))
+      || zring_shm_len (size) != shm->len)
+    {
+      zlog_warn ("%s: ring fd %d has a bad header", __func__, fd);
+      zring_shm_free (shm);
+      return NULL;
+    }
+  zring_map (shm, 0);
+  return shm;
+}
+
+void
+zring_shm_free (struct zring_shm *shm)
+{
+  munmap (shm->base, shm->len);
+  close (shm->fd);
+  XFREE (MTYPE_ZRING, shm);
+}
+
+static inline void
+zring_put_word (struct zring *ring, u_int32_t pos, u_int32_t word)
+{
+  *(u_int32_t *) (ring->data + (pos & (ring->size - 1))) = word;
+}
+
+static inline u_int32_t
+zring_get_word (struct zring *ring, u_int32_t pos)
+{
+  return *(u_int32_t *) (ring->data + (pos & (ring->size - 1)));
+}
+
+/* Put a message in the ring, after a barrier if socket messages were
+   sent since the last one.  Returns -1 if it does not fit, and the
+   message must take the socket. */
+int
+zring_put (struct zring *ring, struct stream *s, u_int32_t sent)
+{
+  size_t len = stream_get_endp (s);
+  u_int32_t need, used, off, first;
+  u_int32_t head = ring->pos;
+
+  need = ZRING_ALIGN (4 + len);
+  if (ring->barrier != sent)
+    need += ZRING_BARRIER_SIZE;
+
+  used = head - __atomic_load_n (&ring->hdr->tail, __ATOMIC_ACQUIRE);
+  if (used > ring->size || need > ring->size - used)
+    {
+      ring->full++;
+      return -1;
+    }
+
+  if (ring->barrier != sent)
+    {
+      zring_put_word (ring, head, 0);
+      zring_put_word (ring, head + 4, sent);
+      head += ZRING_BARRIER_SIZE;
+      ring->barrier = sent;
+    }
+
+  zring_put_word (ring, head, len);
+  off = (head + 4) & (ring->size - 1);
+  first = MIN (len, ring->size - off);
+  memcpy (ring->data + off, STREAM_DATA (s), first);
+  memcpy (ring->data, STREAM_DATA (s) + first, len - first);
+  head += ZRING_ALIGN (4 + len);
+
+  ring->pos = head;
+  __atomic_store_n (&ring->hdr->head, head, __ATOMIC_RELEASE);
+  ring->msgs++;
+  return 0;
+}
+
+/* Get the next message into the stream, given the count of socket
+   messages read so far.  Returns ZRING_BARRIER when the socket must be
+   read first, and ZRING_ERROR when the producer wrote nonsense. */
+int
+zring_get (struct zring *ring, struct stream *s, u_int32_t sock_read)
+{
+  u_int32_t head, tail = ring->pos;
+  u_int32_t word, off, first;
+
+  head = __atomic_load_n (&ring->hdr->head, __ATOMIC_ACQUIRE);
+  if (head - tail > ring->size || (head & 3))
+    return ZRING_ERROR;
+
+  for (;;)
+    {
+      if (head == tail)
+	return ZRING_EMPTY;
+
+      word = zring_get_word (ring, tail);
+      if (word)
+	break;
+
+      /* A barrier. */
+      if (head - tail < ZRING_BARRIER_SIZE)
+	return ZRING_ERROR;
+      if ((int32_t) (sock_read - zring_get_word (ring, tail + 4)) < 0)
+	return ZRING_BARRIER;
+      tail += ZRING_BARRIER_SIZE;
+      ring->pos = tail;
+      __atomic_store_n (&ring->hdr->tail, tail, __ATOMIC_RELEASE);
+    }
+
+  if (word < ZEBRA_HEADER_SIZE || word > STREAM_SIZE (s)
+      || ZRING_ALIGN (4 + word) > head - tail)
+    return ZRING_ERROR;
+
+  stream_reset (s);
+  off = (tail + 4) & (ring->size - 1);
+  first = MIN (word, ring->size - off);
+  stream_put (s, ring->data + off, first);
+  stream_put (s, ring->data, word - first);
+  tail += ZRING_ALIGN (4 + word);
+
+  ring->pos = tail;
+  __atomic_store_n (&ring->hdr->tail, tail, __ATOMIC_RELEASE);
+  ring->msgs++;
+  return ZRING_MSG;
+}
+
+/* The consumer found the ring empty and is about to wait on the
+   socket.  Returns 1 if messages came in meanwhile, and it should get
+   them instead. */
+int
+zring_sleep (struct zring *ring)
+{
+  __atomic_store_n (&ring->hdr->waiting, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&ring->hdr->head, __ATOMIC_ACQUIRE) == ring->pos)
+    return 0;
+
+  /* Whether or not the producer saw it waiting, nothing is lost by
+     getting them now. */
+  __atomic_store_n (&ring->hdr->waiting, 0, __ATOMIC_RELAXED);
+  return 1;
+}
+
+/* After putting messages: returns 1 if the consumer is waiting on the
+   socket, and must be sent ZEBRA_RING_KICK. */
+int
+zring_wake (struct zring *ring)
+{
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  if (! __atomic_load_n (&ring->hdr->waiting, __ATOMIC_RELAXED)
+      || ! __atomic_exchange_n (&ring->hdr->waiting, 0, __ATOMIC_SEQ_CST))
+    return 0;
+
+  ring->wakeups++;
+  return 1;
+}
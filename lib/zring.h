@@ -0,0 +1,102 @@
+/*
+ * Shared-memory rings between zebra and its clients.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_ZRING_H
+#define _ZEBRA_ZRING_H
+
+#include "stream.h"
+
+/*
+ * A client that supports it makes a memfd holding two rings, one per
+ * direction, and passes it to zebra with its hello.  Once both agree on
+ * ZAPI_CAPABILITY_RING, route messages are copied into the ring whole,
+ * header and all, instead of being written to the socket.  Everything
+ * else, and route messages that do not fit, still take the socket.
+ *
+ * Messages must be handled in the order they were sent, whichever way
+ * they went.  Both sides count the messages sent and read on the
+ * socket.  A ring message is always preceded by everything put in the
+ * ring before it.  Before the first ring message that follows a socket
+ * message, the producer puts a barrier holding its count of socket
+ * messages sent, and the consumer does not read past the barrier until
+ * it has read that many from the socket.  The consumer in turn empties
+ * the ring, up to any barrier, before handling each socket message.
+ *
+ * A consumer that finds the ring empty says so in the ring before it
+ * goes back to polling the socket, and the producer that then puts a
+ * message sends ZEBRA_RING_KICK on the socket to wake it up.
+ */
+
+/* Bytes of messages each direction holds, a power of two. */
+#define ZRING_SIZE_DEFAULT	(1 << 20)
+#define ZRING_SIZE_MIN		(1 << 14)
+#define ZRING_SIZE_MAX		(1 << 28)
+
+/* What zring_get() found. */
+#define ZRING_ERROR		-1
+#define ZRING_EMPTY		0
+#define ZRING_MSG		1
+#define ZRING_BARRIER		2
+
+struct zring_header;
+
+/* One direction of the pair.  Positions count bytes ever put or got;
+   each side keeps its own rather than trust the shared copy. */
+struct zring
+{
+  struct zring_header *hdr;
+  u_char *data;
+  u_int32_t size;
+
+  /* Producer's head or consumer's tail. */
+  u_int32_t pos;
+
+  /* Producer: the socket message count the last barrier holds. */
+  u_int32_t barrier;
+
+  /* Messages through the ring, messages that did not fit, and times
+     the consumer had to be woken. */
+  u_long msgs;
+  u_long full;
+  u_long wakeups;
+};
+
+/* Both directions, in one mapping of the memfd. */
+struct zring_shm
+{
+  int fd;
+  void *base;
+  size_t len;
+
+  struct zring tx;
+  struct zring rx;
+};
+
+extern struct zring_shm *zring_shm_new (u_int32_t size);
+extern struct zring_shm *zring_shm_attach (int fd);
+extern void zring_shm_free (struct zring_shm *);
+
+extern int zring_put (struct zring *, struct stream *, u_int32_t sent);
+extern int zring_get (struct zring *, struct stream *, u_int32_t sock_read);
+extern int zring_sleep (struct zring *);
+extern int zring_wake (struct zring *);
+
+#endif /* _ZEBRA_ZRING_H */
@@ -628,14 +628,41 @@ ospf_ase_compare_tables (struct route_table *new_external_route,
   return 0;
 }
 
-static int
-ospf_ase_calculate_timer (struct thread *t)
+/* Calculate the external routes of every AS-external- and NSSA-LSA
+   into ospf->new_external_route. */
+static void
+ospf_ase_calculate_all (struct ospf *ospf)
 {
-  struct ospf *ospf;
   struct ospf_lsa *lsa;
   struct route_node *rn;
   struct listnode *node;
   struct ospf_area *area;
+
+  /* Calculate external route for each AS-external-LSA */
+  LSDB_LOOP (EXTERNAL_LSDB (ospf), rn, lsa)
+    ospf_ase_calculate_route (ospf, lsa);
+
+  /*  This version simple adds to the table all NSSA areas  */
+  if (ospf->anyNSSA)
+    for (ALL_LIST_ELEMENTS_RO (ospf->areas, node, area))
+      {
+	if (IS_DEBUG_OSPF_NSSA)
+	  zlog_debug ("ospf_ase_calculate_timer(): looking at area %s",
+		     inet_ntoa (area->area_id));
+
+	if (area->external_routing == OSPF_AREA_NSSA)
+	  LSDB_LOOP (NSSA_LSDB (area), rn, lsa)
+	    ospf_ase_calculate_route (ospf, lsa);
+      }
+  /* kevinm: And add the NSSA routes in ospf_top */
+  LSDB_LOOP (NSSA_LSDB (ospf),rn,lsa)
+  	    ospf_ase_calculate_route(ospf,lsa);
+}
+
+static int
+ospf_ase_calculate_timer (struct thread *t)
+{
+  struct ospf *ospf;
   struct timeval start_time, stop_time;
 
   ospf = THREAD_ARG (t);
@@ -644,28 +671,11 @@ ospf_ase_calculate_timer (struct thread *t)
   if (ospf->ase_calc)
     {
       ospf->ase_calc = 0;
+      ospf->ase_full_count++;
 
       quagga_gettime(QUAGGA_CLK_MONOTONIC, &start_time);
 
-      /* Calculate external route for each AS-external-LSA */
-      LSDB_LOOP (EXTERNAL_LSDB (ospf), rn, lsa)
-	ospf_ase_calculate_route (ospf, lsa);
-
-      /*  This version simple adds to the table all NSSA areas  */
-      if (ospf->anyNSSA)
-	for (ALL_LIST_ELEMENTS_RO (ospf->areas, node, area))
-	  {
-	    if (IS_DEBUG_OSPF_NSSA)
-	      zlog_debug ("ospf_ase_calculate_timer(): looking at area %s",
-			 inet_ntoa (area->area_id));
-
-	    if (area->external_routing == OSPF_AREA_NSSA)
-	      LSDB_LOOP (NSSA_LSDB (area), rn, lsa)
-		ospf_ase_calculate_route (ospf, lsa);
-	  }
-      /* kevinm: And add the NSSA routes in ospf_top */
-      LSDB_LOOP (NSSA_LSDB (ospf),rn,lsa)
-      		ospf_ase_calculate_route(ospf,lsa);
+      ospf_ase_calculate_all (ospf);
 
       /* Compare old and new external routing table and install the
 	 difference info zebra/kernel */
@@ -706,6 +716,21 @@ ospf_ase_calculate_timer_add (struct ospf *ospf)
 					 ospf, OSPF_ASE_CALC_INTERVAL);
 }
 
+/* Key for the forwarding address of an AS-external-LSA, 0 if none. */
+static int
+ospf_ase_fwd_prefix (struct ospf_lsa *lsa, struct prefix_ipv4 *p)
+{
+  struct as_external_lsa *al = (struct as_external_lsa *) lsa->data;
+
+  if (al->e[0].fwd_addr.s_addr == 0)
+    return 0;
+
+  p->family = AF_INET;
+  p->prefix = al->e[0].fwd_addr;
+  p->prefixlen = IPV4_MAX_BITLEN;
+  return 1;
+}
+
 void
 ospf_ase_register_external_lsa (struct ospf_lsa *lsa, struct ospf *top)
 {
@@ -727,6 +752,18 @@ ospf_ase_register_external_lsa (struct ospf_lsa *lsa, struct ospf *top)
   /* We assume that if LSA is deleted from DB
      is is also deleted from this RT */
   listnode_add (lst, ospf_lsa_lock (lsa)); /* external_lsas lst */
+
+  /* Also index it by forwarding address, so that a change of the
+     route to that address only recalculates the LSAs using it. */
+  if (ospf_ase_fwd_prefix (lsa, &p))
+    {
+      rn = route_node_get (top->external_fwd, (struct prefix *) &p);
+      if ((lst = rn->info) == NULL)
+	rn->info = lst = list_new ();
+      else
+	route_unlock_node (rn);
+      listnode_add (lst, ospf_lsa_lock (lsa)); /* external_fwd lst */
+    }
 }
 
 void
@@ -736,6 +773,25 @@ ospf_ase_unregister_external_lsa (struct ospf_lsa *lsa, struct ospf *top)
   struct prefix_ipv4 p;
   struct list *lst;
   struct as_external_lsa *al;
+  struct ospf_lsa *fwd_lsa;
+
+  if (ospf_ase_fwd_prefix (lsa, &p)
+      && (rn = route_node_lookup (top->external_fwd, (struct prefix *) &p)))
+    {
+      route_unlock_node (rn);
+      if ((lst = rn->info) != NULL && listnode_lookup (lst, lsa))
+	{
+	  listnode_delete (lst, lsa);
+	  fwd_lsa = lsa;
+	  ospf_lsa_unlock (&fwd_lsa); /* external_fwd lst */
+	  if (list_isempty (lst))
+	    {
+	      list_delete (lst);
+	      rn->info = NULL;
+	      route_unlock_node (rn);
+	    }
+	}
+    }
 
   al = (struct as_external_lsa *) lsa->data;
   p.family = AF_INET;
@@ -772,14 +828,135 @@ ospf_ase_external_lsas_finish (struct route_table *rt)
   route_table_finish (rt);
 }
 
-void
-ospf_ase_incremental_update (struct ospf *ospf, struct ospf_lsa *lsa)
+/* With "debug ospf spf verify", check the external routes kept up to
+   date by partial calculations against a full calculation, and have
+   the full one replace them if they differ. */
+static void
+ospf_ase_verify (struct ospf *ospf)
+{
+  struct route_table *tables[2], *saved;
+  struct route_node *rn, *other;
+  char buf[BUFSIZ];
+  int i, diffs = 0;
+
+  /* A full calculation pending will replace them anyway. */
+  if (ospf->ase_calc)
+    return;
+
+  saved = ospf->new_external_route;
+  ospf->new_external_route = route_table_init ();
+  ospf_ase_calculate_all (ospf);
+
+  tables[0] = ospf->old_external_route;
+  tables[1] = ospf->new_external_route;
+  for (i = 0; i < 2; i++)
+    for (rn = route_top (tables[i]); rn; rn = route_next (rn))
+      {
+	if (rn->info == NULL)
+	  continue;
+
+	/* Routes in both were compared in the first pass. */
+	if ((other = route_node_lookup (tables[1 - i], &rn->p)) != NULL)
+	  {
+	    route_unlock_node (other);
+	    if (i == 1
+		|| ospf_ase_route_match_same (tables[1], &rn->p, rn->info))
+	      continue;
+	  }
+
+	prefix2str (&rn->p, buf, sizeof (buf));
+	zlog_warn ("External verify: route to %s %s", buf,
+		   other ? "differs" : i ? "is missing" : "should be gone");
+	diffs++;
+      }
+
+  ospf_route_table_free (ospf->new_external_route);
+  ospf->new_external_route = saved;
+
+  if (diffs)
+    {
+      zlog_warn ("External verify: %d differences from a full calculation",
+		 diffs);
+      ospf->ase_verify_failed++;
+      ospf_ase_calculate_schedule (ospf);
+      ospf_ase_calculate_timer_add (ospf);
+    }
+}
+
+/* Recalculate the external route to a single destination from the
+   LSAs registered for it, and install the difference into zebra and
+   ospf->old_external_route. */
+static void
+ospf_ase_update_prefix (struct ospf *ospf, struct prefix_ipv4 *p)
 {
   struct list *lsas;
   struct listnode *node;
-  struct route_node *rn, *rn2;
+  struct ospf_lsa *lsa;
+  struct route_node *rn;
+  struct ospf_route *or = NULL, *oldor = NULL;
+
+  rn = route_node_lookup (ospf->external_lsas, (struct prefix *) p);
+  if (rn)
+    {
+      route_unlock_node (rn);
+      if ((lsas = rn->info) != NULL)
+	for (ALL_LIST_ELEMENTS_RO (lsas, node, lsa))
+	  ospf_ase_calculate_route (ospf, lsa);
+    }
+
+  /* Take the result out of ospf->new_external_route. */
+  rn = route_node_lookup (ospf->new_external_route, (struct prefix *) p);
+  if (rn)
+    {
+      if ((or = rn->info) != NULL)
+	{
+	  rn->info = NULL;
+	  route_unlock_node (rn);
+	}
+      route_unlock_node (rn);
+    }
+
+  /* install changes to zebra */
+  rn = route_node_lookup (ospf->old_external_route, (struct prefix *) p);
+  if (rn)
+    oldor = rn->info;
+
+  if (or)
+    {
+      if (! ospf_ase_route_match_same (ospf->old_external_route,
+				       (struct prefix *) p, or))
+	ospf_zebra_add (p, or);
+    }
+  else if (oldor)
+    ospf_zebra_delete (p, oldor);
+
+  /* update ospf->old_external_route table */
+  if (oldor)
+    ospf_route_free (oldor);
+
+  if (or)
+    {
+      if (!rn)
+	rn = route_node_get (ospf->old_external_route, (struct prefix *) p);
+      rn->info = or;
+    }
+  else if (rn)
+    {
+      /* remove route node from ospf->old_external_route */
+      if (oldor)
+	{
+	  rn->info = NULL;
+	  route_unlock_node (rn);
+	}
+      route_unlock_node (rn);
+    }
+}
+
+void
+ospf_ase_incremental_update (struct ospf *ospf, struct ospf_lsa *lsa)
+{
+  struct route_node *rn;
   struct prefix_ipv4 p;
-  struct route_table *tmp_old;
   struct as_external_lsa *al;
 
   al = (struct as_external_lsa *) lsa->data;
@@ -805,57 +982,175 @@ ospf_ase_incremental_update (struct ospf *ospf, struct ospf_lsa *lsa)
 	return;
     }
 
-  rn = route_node_lookup (ospf->external_lsas, (struct prefix *) &p);
-  assert (rn); 
-  assert (rn->info);
-  lsas = rn->info;
-  route_unlock_node (rn);
+  ospf->ase_partial_count++;
+  ospf_ase_update_prefix (ospf, &p);
 
-  for (ALL_LIST_ELEMENTS_RO (lsas, node, lsa))
-    ospf_ase_calculate_route (ospf, lsa);
+  if (IS_DEBUG_OSPF (spf, SPF_VERIFY))
+    ospf_ase_verify (ospf);
+}
 
-  /* prepare temporary old routing table for compare */
-  tmp_old = route_table_init ();
-  rn = route_node_lookup (ospf->old_external_route, (struct prefix *) &p);
-  if (rn && rn->info)
-    {
-      rn2 = route_node_get (tmp_old, (struct prefix *) &p);
-      rn2->info = rn->info;
-    }
+/* Compare the preferred routes to an ASBR before and after SPF, in
+   everything the external route calculation takes from them. */
+static int
+ospf_ase_asbr_route_same (struct ospf_route *or, struct ospf_route *newor)
+{
+  struct listnode *n1, *n2;
+  struct ospf_path *op, *newop;
 
-  /* install changes to zebra */
-  ospf_ase_compare_tables (ospf->new_external_route, tmp_old);
+  if (or == NULL || newor == NULL)
+    return or == newor;
 
-  /* update ospf->old_external_route table */
-  if (rn && rn->info)
-    ospf_route_free ((struct ospf_route *) rn->info);
+  if ((or->u.std.flags & ROUTER_LSA_EXTERNAL)
+      != (newor->u.std.flags & ROUTER_LSA_EXTERNAL))
+    return 0;
+  if (or->cost != newor->cost
+      || or->path_type != newor->path_type
+      || ! IPV4_ADDR_SAME (&or->u.std.area_id, &newor->u.std.area_id))
+    return 0;
+  if (or->paths->count != newor->paths->count)
+    return 0;
 
-  rn2 = route_node_lookup (ospf->new_external_route, (struct prefix *) &p);
-  /* if new route exists, install it to ospf->old_external_route */
-  if (rn2 && rn2->info)
+  for (n1 = listhead (or->paths), n2 = listhead (newor->paths);
+       n1 && n2; n1 = listnextnode (n1), n2 = listnextnode (n2))
     {
-      if (!rn)
-	rn = route_node_get (ospf->old_external_route, (struct prefix *) &p);
-      rn->info = rn2->info;
+      op = listgetdata (n1);
+      newop = listgetdata (n2);
+
+      if (! IPV4_ADDR_SAME (&op->nexthop, &newop->nexthop))
+	return 0;
+      if (op->ifindex != newop->ifindex)
+	return 0;
     }
-  else
-    {
-      /* remove route node from ospf->old_external_route */
-      if (rn)
+  return 1;
+}
+
+/* Has the route to any ASBR changed in the last SPF calculation? */
+static int
+ospf_ase_asbr_changed (struct ospf *ospf)
+{
+  struct route_table *tables[2] = { ospf->old_rtrs, ospf->new_rtrs };
+  struct route_node *rn;
+  struct ospf_route *or, *newor;
+  int i;
+
+  for (i = 0; i < 2; i++)
+    for (rn = route_top (tables[i]); rn; rn = route_next (rn))
+      if (rn->info)
 	{
-	  rn->info = NULL;
-	  route_unlock_node (rn);
-	  route_unlock_node (rn);
+	  or = ospf_find_asbr_route (ospf, ospf->old_rtrs,
+				     (struct prefix_ipv4 *) &rn->p);
+	  newor = ospf_find_asbr_route (ospf, ospf->new_rtrs,
+					(struct prefix_ipv4 *) &rn->p);
+
+	  /* Only routers flagged as ASBR are of any interest. */
+	  if (! (or && (or->u.std.flags & ROUTER_LSA_EXTERNAL))
+	      && ! (newor && (newor->u.std.flags & ROUTER_LSA_EXTERNAL)))
+	    continue;
+
+	  if (! ospf_ase_asbr_route_same (or, newor))
+	    {
+	      route_unlock_node (rn);
+	      return 1;
+	    }
 	}
+
+  return 0;
+}
+
+static void
+ospf_ase_target_add (struct route_table *targets, struct ospf_lsa *lsa)
+{
+  struct route_node *rn;
+  struct prefix_ipv4 p;
+  struct as_external_lsa *al;
+
+  al = (struct as_external_lsa *) lsa->data;
+  p.family = AF_INET;
+  p.prefix = lsa->data->id;
+  p.prefixlen = ip_masklen (al->mask);
+  apply_mask_ipv4 (&p);
+
+  rn = route_node_get (targets, (struct prefix *) &p);
+  if (rn->info)
+    route_unlock_node (rn);
+  else
+    rn->info = lsa;
+}
+
+/* Collect the destinations of external LSAs depending on the route
+   to a network which has changed: the ones to the network itself,
+   and the ones whose forwarding address falls inside it. */
+static void
+ospf_ase_targets_collect (struct ospf *ospf, struct route_table *targets,
+			  struct prefix *p)
+{
+  struct route_node *rn, *top;
+  struct ospf_lsa *lsa;
+  struct listnode *node;
+
+  rn = route_node_lookup (ospf->external_lsas, p);
+  if (rn)
+    {
+      route_unlock_node (rn);
+      if (rn->info && listhead ((struct list *) rn->info))
+	ospf_ase_target_add (targets,
+			     listgetdata (listhead ((struct list *) rn->info)));
     }
 
-  if (rn2)
+  top = route_node_get (ospf->external_fwd, p);
+  route_lock_node (top);
+  for (rn = top; rn; rn = route_next_until (rn, top))
+    if (rn->info)
+      for (ALL_LIST_ELEMENTS_RO ((struct list *) rn->info, node, lsa))
+	ospf_ase_target_add (targets, lsa);
+  route_unlock_node (top);
+}
+
+/* Bring the external routes up to date after an SPF calculation.
+
+   Only the destinations whose external routes depend on something
+   that changed are recalculated: those with a changed internal route
+   to the destination itself or to the forwarding address.  When the
+   route to any ASBR changed, or the caller asks for it, every LSA has
+   to be looked at again, and the full calculation is scheduled. */
+void
+ospf_ase_spf_update (struct ospf *ospf, int full)
+{
+  struct route_table *targets;
+  struct route_node *rn;
+  struct ospf_route *or;
+
+  if (full || ospf->old_rtrs == NULL || ospf->old_table == NULL
+      || ospf_ase_asbr_changed (ospf))
     {
-      /* rn2->info is stored in route node of ospf->old_external_route */
-      rn2->info = NULL;
-      route_unlock_node (rn2);
-      route_unlock_node (rn2);
+      ospf_ase_calculate_schedule (ospf);
+      ospf_ase_calculate_timer_add (ospf);
+      return;
     }
 
-  route_table_finish (tmp_old);
+  targets = route_table_init ();
+
+  for (rn = route_top (ospf->new_table); rn; rn = route_next (rn))
+    if ((or = rn->info) != NULL)
+      if (! ospf_route_match_same (ospf->old_table,
+				   (struct prefix_ipv4 *) &rn->p, or))
+	ospf_ase_targets_collect (ospf, targets, &rn->p);
+
+  for (rn = route_top (ospf->old_table); rn; rn = route_next (rn))
+    if ((or = rn->info) != NULL)
+      if (! ospf_route_match_same (ospf->new_table,
+				   (struct prefix_ipv4 *) &rn->p, or))
+	ospf_ase_targets_collect (ospf, targets, &rn->p);
+
+  if (targets->top)
+    ospf->ase_partial_count++;
+
+  for (rn = route_top (targets); rn; rn = route_next (rn))
+    if (rn->info)
+      ospf_ase_update_prefix (ospf, (struct prefix_ipv4 *) &rn->p);
+
+  route_table_finish (targets);
+
+  if (IS_DEBUG_OSPF (spf, SPF_VERIFY))
+    ospf_ase_verify (ospf);
 }
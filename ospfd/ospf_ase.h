@@ -43,5 +43,6 @@ extern void ospf_ase_incremental_update (struct ospf *, struct ospf_lsa *);
 extern void ospf_ase_register_external_lsa (struct ospf_lsa *, struct ospf *);
 extern void ospf_ase_unregister_external_lsa (struct ospf_lsa *,
 					      struct ospf *);
+extern void ospf_ase_spf_update (struct ospf *, int);
 
 #endif /* _ZEBRA_OSPF_ASE_H */
@@ -133,6 +133,7 @@ unsigned long conf_debug_ospf_nsm = 0;
 unsigned long conf_debug_ospf_lsa = 0;
 unsigned long conf_debug_ospf_zebra = 0;
 unsigned long conf_debug_ospf_nssa = 0;
+unsigned long conf_debug_ospf_spf = 0;
 
 /* Enable debug option variables -- valid only session. */
 unsigned long term_debug_ospf_packet[5] = {0, 0, 0, 0, 0};
@@ -142,6 +143,7 @@ unsigned long term_debug_ospf_nsm = 0;
 unsigned long term_debug_ospf_lsa = 0;
 unsigned long term_debug_ospf_zebra = 0;
 unsigned long term_debug_ospf_nssa = 0;
+unsigned long term_debug_ospf_spf = 0;
 
 
 
@@ -1428,6 +1430,35 @@ DEFUN (no_debug_ospf_nssa,
   return CMD_SUCCESS;
 }
 
+DEFUN (debug_ospf_spf_verify,
+       debug_ospf_spf_verify_cmd,
+       "debug ospf spf verify",
+       DEBUG_STR
+       OSPF_STR
+       "OSPF SPF calculation information\n"
+       "Check partial calculations against full ones\n")
+{
+  if (vty->node == CONFIG_NODE)
+    CONF_DEBUG_ON (spf, SPF_VERIFY);
+  TERM_DEBUG_ON (spf, SPF_VERIFY);
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_debug_ospf_spf_verify,
+       no_debug_ospf_spf_verify_cmd,
+       "no debug ospf spf verify",
+       NO_STR
+       DEBUG_STR
+       OSPF_STR
+       "OSPF SPF calculation information\n"
+       "Check partial calculations against full ones\n")
+{
+  if (vty->node == CONFIG_NODE)
+    CONF_DEBUG_OFF (spf, SPF_VERIFY);
+  TERM_DEBUG_OFF (spf, SPF_VERIFY);
+  return CMD_SUCCESS;
+}
+
 
 DEFUN (show_debugging_ospf,
        show_debugging_ospf_cmd,
@@ -1523,6 +1554,10 @@ DEFUN (show_debugging_ospf,
   if (IS_DEBUG_OSPF (nssa, NSSA) == OSPF_DEBUG_NSSA)
     vty_out (vty, "  OSPF NSSA debugging is on%s", VTY_NEWLINE);
 
+  /* Show debug status for SPF verification. */
+  if (IS_DEBUG_OSPF (spf, SPF_VERIFY))
+    vty_out (vty, "  OSPF SPF verify debugging is on%s", VTY_NEWLINE);
+
   return CMD_SUCCESS;
 }
 
@@ -1613,6 +1648,13 @@ config_write_debug (struct vty *vty)
       vty_out (vty, "debug ospf nssa%s", VTY_NEWLINE);
       write = 1;
     }
+
+  /* debug ospf spf verify. */
+  if (IS_CONF_DEBUG_OSPF (spf, SPF_VERIFY))
+    {
+      vty_out (vty, "debug ospf spf verify%s", VTY_NEWLINE);
+      write = 1;
+    }
   
   /* debug ospf packet all detail. */
   r = OSPF_DEBUG_SEND_RECV|OSPF_DEBUG_DETAIL;
@@ -1675,6 +1717,7 @@ debug_init ()
   install_element (ENABLE_NODE, &debug_ospf_zebra_cmd);
   install_element (ENABLE_NODE, &debug_ospf_event_cmd);
   install_element (ENABLE_NODE, &debug_ospf_nssa_cmd);
+  install_element (ENABLE_NODE, &debug_ospf_spf_verify_cmd);
   install_element (ENABLE_NODE, &no_debug_ospf_packet_send_recv_detail_cmd);
   install_element (ENABLE_NODE, &no_debug_ospf_packet_send_recv_cmd);
   install_element (ENABLE_NODE, &no_debug_ospf_packet_all_cmd);
@@ -1688,6 +1731,7 @@ debug_init ()
   install_element (ENABLE_NODE, &no_debug_ospf_zebra_cmd);
   install_element (ENABLE_NODE, &no_debug_ospf_event_cmd);
   install_element (ENABLE_NODE, &no_debug_ospf_nssa_cmd);
+  install_element (ENABLE_NODE, &no_debug_ospf_spf_verify_cmd);
 
   install_element (CONFIG_NODE, &debug_ospf_packet_send_recv_detail_cmd);
   install_element (CONFIG_NODE, &debug_ospf_packet_send_recv_cmd);
@@ -1702,6 +1746,7 @@ debug_init ()
   install_element (CONFIG_NODE, &debug_ospf_zebra_cmd);
   install_element (CONFIG_NODE, &debug_ospf_event_cmd);
   install_element (CONFIG_NODE, &debug_ospf_nssa_cmd);
+  install_element (CONFIG_NODE, &debug_ospf_spf_verify_cmd);
   install_element (CONFIG_NODE, &no_debug_ospf_packet_send_recv_detail_cmd);
   install_element (CONFIG_NODE, &no_debug_ospf_packet_send_recv_cmd);
   install_element (CONFIG_NODE, &no_debug_ospf_packet_all_cmd);
@@ -1715,4 +1760,5 @@ debug_init ()
   install_element (CONFIG_NODE, &no_debug_ospf_zebra_cmd);
   install_element (CONFIG_NODE, &no_debug_ospf_event_cmd);
   install_element (CONFIG_NODE, &no_debug_ospf_nssa_cmd);
+  install_element (CONFIG_NODE, &no_debug_ospf_spf_verify_cmd);
 }
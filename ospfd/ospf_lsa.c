@@ -2392,6 +2392,7 @@ ospf_router_lsa_install (struct ospf *ospf, struct ospf_lsa *new,
      the shortest path calculations for each area (not just the
      area whose link-state database has changed). 
   */
+  ospf_spf_lsa_changed (new);
 
   if (IS_LSA_SELF (new))
     {
@@ -2430,6 +2431,8 @@ ospf_network_lsa_install (struct ospf *ospf,
      the shortest path calculations for each area (not just the
      area whose link-state database has changed). 
   */
+  ospf_spf_lsa_changed (new);
+
   if (IS_LSA_SELF (new))
     {
       /* We supposed that when LSA is originated by us, we pass the int
@@ -2950,6 +2953,9 @@ ospf_lsa_maxage (struct ospf *ospf, struct ospf_lsa *lsa)
       return;
     }
 
+  /* A MaxAge router- or network-LSA no longer takes part in SPF. */
+  ospf_spf_lsa_changed (lsa);
+
   lsa_prefix.family = 0;
   lsa_prefix.prefixlen = sizeof(lsa_prefix.prefix) * CHAR_BIT;
   lsa_prefix.prefix = (uintptr_t) lsa;
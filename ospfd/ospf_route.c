@@ -808,6 +808,22 @@ ospf_path_lookup (struct list *plist, struct ospf_path *path)
   return NULL;
 }
 
+/* Whether two routes have the same paths, in whatever order. */
+int
+ospf_route_paths_same (struct ospf_route *or1, struct ospf_route *or2)
+{
+  struct listnode *node;
+  struct ospf_path *op;
+
+  if (listcount (or1->paths) != listcount (or2->paths))
+    return 0;
+
+  for (ALL_LIST_ELEMENTS_RO (or1->paths, node, op))
+    if (ospf_path_lookup (or2->paths, op) == NULL)
+      return 0;
+  return 1;
+}
+
 void
 ospf_route_copy_nexthops (struct ospf_route *to, struct list *from)
 {
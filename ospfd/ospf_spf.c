@@ -89,13 +89,6 @@ ospf_get_spf_reason_str (char *buf)
     }
 }
 
-static void ospf_vertex_free (void *);
-/* List of allocated vertices, to simplify cleanup of SPF.
- * Not thread-safe obviously. If it ever needs to be, it'd have to be
- * dynamically allocated at begin of ospf_spf_calculate
- */
-static struct list vertex_list = { .del = ospf_vertex_free };
-
 /* Heap related functions, for the managment of the candidates, to
  * be used with pqueue. */
 static int
@@ -146,40 +139,9 @@ vertex_nexthop_free (struct vertex_nexthop *nh)
   XFREE (MTYPE_OSPF_NEXTHOP, nh);
 }
 
-/* Free the canonical nexthop objects for an area, ie the nexthop objects
- * attached to the first-hop router vertices, and any intervening network
- * vertices.
- */
-static void
-ospf_canonical_nexthops_free (struct vertex *root)
-{
-  struct listnode *node, *nnode;
-  struct vertex *child;
-  
-  for (ALL_LIST_ELEMENTS (root->children, node, nnode, child))
-    {
-      struct listnode *n2, *nn2;
-      struct vertex_parent *vp;
-      
-      /* router vertices through an attached network each
-       * have a distinct (canonical / not inherited) nexthop
-       * which must be freed.
-       *
-       * A network vertex can only have router vertices as its
-       * children, so only one level of recursion is possible.
-       */
-      if (child->type == OSPF_VERTEX_NETWORK)
-        ospf_canonical_nexthops_free (child);
-      
-      /* Free child nexthops pointing back to this root vertex */
-      for (ALL_LIST_ELEMENTS (child->parents, n2, nn2, vp))
-        if (vp->parent == root && vp->nexthop)
-          vertex_nexthop_free (vp->nexthop);
-    }
-}      
-
-/* TODO: Parent list should be excised, in favour of maintaining only
- * vertex_nexthop, with refcounts.
+/* Nexthops are shared between the vertices inheriting them, see
+ * ospf_nexthop_calculation, and are freed along with the last
+ * vertex_parent referring to them.
  */
 static struct vertex_parent *
 vertex_parent_new (struct vertex *v, int backlink, struct vertex_nexthop *hop)
@@ -194,12 +156,17 @@ vertex_parent_new (struct vertex *v, int backlink, struct vertex_nexthop *hop)
   new->parent = v;
   new->backlink = backlink;
   new->nexthop = hop;
+  hop->lock++;
   return new;
 }
 
 static void
 vertex_parent_free (void *p)
 {
+  struct vertex_parent *vp = p;
+
+  if (--vp->nexthop->lock == 0)
+    vertex_nexthop_free (vp->nexthop);
   XFREE (MTYPE_OSPF_VERTEX_PARENT, p);
 }
 
@@ -215,12 +182,11 @@ ospf_vertex_new (struct ospf_lsa *lsa)
   new->type = lsa->data->type;
   new->id = lsa->data->id;
   new->lsa = lsa->data;
+  new->lsa_p = ospf_lsa_lock (lsa);
   new->children = list_new ();
   new->parents = list_new ();
   new->parents->del = vertex_parent_free;
   
-  listnode_add (&vertex_list, new);
-  
   if (IS_DEBUG_OSPF_EVENT)
     zlog_debug ("%s: Created %s vertex %s", __func__,
                 new->type == OSPF_VERTEX_ROUTER ? "Router" : "Network",
@@ -253,10 +219,84 @@ ospf_vertex_free (void *data)
   v->parents = NULL;
   
   v->lsa = NULL;
+  ospf_lsa_unlock (&v->lsa_p);
   
   XFREE (MTYPE_OSPF_VERTEX, v);
 }
 
+/* The vertices of the tree of an area are indexed by LSA type and ID,
+ * so that changed LSAs can be located on it.
+ */
+static void
+ospf_spf_vertex_prefix (struct prefix_ls *lp, u_char type, struct in_addr id)
+{
+  memset (lp, 0, sizeof (struct prefix_ls));
+  lp->family = 0;
+  lp->prefixlen = 64;
+  lp->id = id;
+  lp->adv_router.s_addr = type;
+}
+
+static struct vertex *
+ospf_spf_vertex_find (struct route_table *vertices, u_char type,
+                      struct in_addr id)
+{
+  struct prefix_ls lp;
+  struct route_node *rn;
+  struct vertex *v;
+
+  if (vertices == NULL)
+    return NULL;
+
+  ospf_spf_vertex_prefix (&lp, type, id);
+  rn = route_node_lookup (vertices, (struct prefix *) &lp);
+  if (rn == NULL)
+    return NULL;
+
+  v = rn->info;
+  route_unlock_node (rn);
+  return v;
+}
+
+static struct vertex *
+ospf_spf_vertex_lookup (struct ospf_area *area, u_char type,
+                        struct in_addr id)
+{
+  return ospf_spf_vertex_find (area->spf_vertices, type, id);
+}
+
+static void
+ospf_spf_vertex_index (struct ospf_area *area, struct vertex *v)
+{
+  struct prefix_ls lp;
+  struct route_node *rn;
+
+  ospf_spf_vertex_prefix (&lp, v->type, v->id);
+  rn = route_node_get (area->spf_vertices, (struct prefix *) &lp);
+  if (rn->info)
+    route_unlock_node (rn);
+  rn->info = v;
+}
+
+static void
+ospf_spf_vertex_unindex (struct ospf_area *area, struct vertex *v)
+{
+  struct prefix_ls lp;
+  struct route_node *rn;
+
+  ospf_spf_vertex_prefix (&lp, v->type, v->id);
+  rn = route_node_lookup (area->spf_vertices, (struct prefix *) &lp);
+  if (rn == NULL)
+    return;
+
+  if (rn->info == v)
+    {
+      rn->info = NULL;
+      route_unlock_node (rn);
+    }
+  route_unlock_node (rn);
+}
+
 static void
 ospf_vertex_dump(const char *msg, struct vertex *v,
 		 int print_parents, int print_children)
@@ -320,6 +360,18 @@ ospf_vertex_add_parent (struct vertex *v)
     }
 }
 
+static int
+ospf_vertex_has_parent (struct vertex *w, struct vertex *v)
+{
+  struct vertex_parent *vp;
+  struct listnode *node;
+
+  for (ALL_LIST_ELEMENTS_RO (w->parents, node, vp))
+    if (vp->parent == v)
+      return 1;
+  return 0;
+}
+
 static void
 ospf_spf_init (struct ospf_area *area)
 {
@@ -329,6 +381,8 @@ ospf_spf_init (struct ospf_area *area)
   v = ospf_vertex_new (area->router_lsa_self);
   
   area->spf = v;
+  area->spf_vertices = route_table_init ();
+  ospf_spf_vertex_index (area, v);
 
   /* Reset ABR and ASBR router counts. */
   area->abr_count = 0;
@@ -505,10 +559,13 @@ ospf_spf_add_parent (struct vertex *v, struct vertex *w,
    */  
   for (ALL_LIST_ELEMENTS_RO(w->parents, node, wp))
     {
-      if (memcmp(newhop, wp->nexthop, sizeof(*newhop)) == 0)
+      if (wp->nexthop->oi == newhop->oi
+          && IPV4_ADDR_SAME (&wp->nexthop->router, &newhop->router))
         {
           if (IS_DEBUG_OSPF_EVENT)
             zlog_debug ("%s: ... nexthop already on parent list, skipping add", __func__);
+          if (newhop->lock == 0)
+            vertex_nexthop_free (newhop);
           return;
         }
     }
@@ -786,10 +843,18 @@ ospf_nexthop_calculation (struct ospf_area *area, struct vertex *v,
  * v is on the SPF tree.  Examine the links in v's LSA.  Update the list
  * of candidates with any vertices not already on the list.  If a lower-cost
  * path is found to a vertex already on the candidate list, store the new cost.
+ *
+ * When only part of the tree is being recalculated, pull is given for
+ * a v settled in this run: vertices left on the tree to which v offers
+ * a path at least as short as their own are added to it, to be taken
+ * off the tree and reached again, see ospf_spf_detach.
+ *
+ * Returns -1 if the LSA status fields turn out not to match the tree,
+ * in which case it has to be rebuilt from scratch.
  */
-static void
+static int
 ospf_spf_next (struct vertex *v, struct ospf_area *area,
-	       struct pqueue * candidate)
+	       struct pqueue * candidate, struct list *pull)
 {
   struct ospf_lsa *w_lsa = NULL;
   u_char *p;
@@ -920,15 +985,6 @@ ospf_spf_next (struct vertex *v, struct ospf_area *area,
           continue;
         }
 
-      /* (c) If vertex W is already on the shortest-path tree, examine
-         the next link in the LSA. */
-      if (w_lsa->stat == LSA_SPF_IN_SPFTREE)
-	{
-	  if (IS_DEBUG_OSPF_EVENT)
-	    zlog_debug ("The LSA is already in SPF");
-	  continue;
-	}
-
       /* (d) Calculate the link state cost D of the resulting path
          from the root to vertex W.  D is equal to the sum of the link
          state cost of the (already calculated) shortest path to
@@ -941,6 +997,30 @@ ospf_spf_next (struct vertex *v, struct ospf_area *area,
       else /* v is not a Router-LSA */
 	distance = v->distance;
 
+      /* (c) If vertex W is already on the shortest-path tree, examine
+         the next link in the LSA. */
+      if (w_lsa->stat == LSA_SPF_IN_SPFTREE)
+	{
+	  if (IS_DEBUG_OSPF_EVENT)
+	    zlog_debug ("The LSA is already in SPF");
+
+	  if (pull == NULL)
+	    continue;
+
+	  w = ospf_spf_vertex_lookup (area, w_lsa->data->type,
+	                              w_lsa->data->id);
+	  if (w == NULL || w->lsa_p != w_lsa)
+	    return -1;
+
+	  if (w != area->spf
+	      && (distance < w->distance
+	          || (distance == w->distance
+	              && !ospf_vertex_has_parent (w, v)))
+	      && listnode_lookup (pull, w) == NULL)
+	    listnode_add (pull, w);
+	  continue;
+	}
+
       /* Is there already vertex W in candidate list? */
       if (w_lsa->stat == LSA_SPF_NOT_EXPLORED)
 	{
@@ -950,11 +1030,20 @@ ospf_spf_next (struct vertex *v, struct ospf_area *area,
           /* Calculate nexthop to W. */
           if (ospf_nexthop_calculation (area, v, w, l, distance, lsa_pos))
             pqueue_enqueue (w, candidate);
-          else if (IS_DEBUG_OSPF_EVENT)
-            zlog_debug ("Nexthop Calc failed");
+          else
+            {
+              if (IS_DEBUG_OSPF_EVENT)
+                zlog_debug ("Nexthop Calc failed");
+              ospf_vertex_free (w);
+            }
 	}
       else if (w_lsa->stat >= 0)
 	{
+	  if (w_lsa->stat >= candidate->size
+	      || ((struct vertex *) candidate->array[w_lsa->stat])->lsa_p
+	         != w_lsa)
+	    return -1;
+
 	  /* Get the vertex from candidates. */
 	  w = candidate->array[w_lsa->stat];
 
@@ -988,6 +1077,8 @@ ospf_spf_next (struct vertex *v, struct ospf_area *area,
             }
         } /* end W is already on the candidate list */
     } /* end loop over the links in V's LSA */
+
+  return 0;
 }
 
 static void
@@ -1181,13 +1272,515 @@ ospf_rtrs_print (struct route_table *rtrs)
 }
 #endif
 
-/* Calculating the shortest-path tree for an area. */
+/* Note a change to a router- or network-LSA, installed or aged out, for
+ * the next calculation to update the tree of its area from.
+ */
+void
+ospf_spf_lsa_changed (struct ospf_lsa *lsa)
+{
+  struct ospf_area *area = lsa->area;
+
+  if (area == NULL || area->spf == NULL)
+    return;
+
+  if (lsa->data->type != OSPF_ROUTER_LSA
+      && lsa->data->type != OSPF_NETWORK_LSA)
+    return;
+
+  if (area->spf_changed == NULL)
+    area->spf_changed = list_new ();
+  listnode_add (area->spf_changed, ospf_lsa_lock (lsa));
+}
+
+static void
+ospf_spf_changes_clear (struct ospf_area *area)
+{
+  struct listnode *node, *nnode;
+  struct ospf_lsa *lsa;
+
+  if (area->spf_changed == NULL)
+    return;
+
+  for (ALL_LIST_ELEMENTS (area->spf_changed, node, nnode, lsa))
+    ospf_lsa_unlock (&lsa);
+  list_delete_all_node (area->spf_changed);
+}
+
+static void
+ospf_spf_vertices_free (struct route_table *vertices)
+{
+  struct route_node *rn;
+
+  for (rn = route_top (vertices); rn; rn = route_next (rn))
+    if (rn->info)
+      {
+        ospf_vertex_free (rn->info);
+        rn->info = NULL;
+        route_unlock_node (rn);
+      }
+  route_table_finish (vertices);
+}
+
+/* Free the tree of an area, so that the next calculation builds it
+ * from scratch.
+ */
+void
+ospf_spf_tree_free (struct ospf_area *area)
+{
+  if (area->spf_vertices)
+    {
+      ospf_spf_vertices_free (area->spf_vertices);
+      area->spf_vertices = NULL;
+    }
+  area->spf = NULL;
+
+  if (area->spf_changed)
+    {
+      ospf_spf_changes_clear (area);
+      list_delete (area->spf_changed);
+      area->spf_changed = NULL;
+    }
+}
+
+/* The instance of an LSA the calculation would use, if any. */
+static struct ospf_lsa *
+ospf_spf_lsa_current (struct ospf_area *area, u_char type,
+                      struct in_addr id)
+{
+  struct ospf_lsa *lsa;
+
+  lsa = ospf_lsa_lookup_by_id (area, type, id);
+  if (lsa && IS_LSA_MAXAGE (lsa))
+    return NULL;
+  return lsa;
+}
+
+static struct router_lsa_link *
+ospf_spf_next_transit_link (u_char **p, u_char *lim)
+{
+  struct router_lsa_link *l;
+
+  while (*p < lim)
+    {
+      l = (struct router_lsa_link *) *p;
+      *p += (OSPF_ROUTER_LSA_LINK_SIZE +
+             (l->m[0].tos_count * OSPF_ROUTER_LSA_TOS_SIZE));
+
+      if (l->m[0].type != LSA_LINK_TYPE_STUB)
+        return l;
+    }
+  return NULL;
+}
+
+/* Whether two instances of a router- or network-LSA give the same tree,
+ * ie differ at most in stub links, router flags or network mask.
+ */
+static int
+ospf_spf_lsa_same (struct lsa_header *lsa1, struct lsa_header *lsa2)
+{
+  struct router_lsa_link *l1, *l2;
+  u_char *p1, *p2, *lim1, *lim2;
+
+  if (lsa1->type != lsa2->type)
+    return 0;
+
+  p1 = ((u_char *) lsa1) + OSPF_LSA_HEADER_SIZE + 4;
+  p2 = ((u_char *) lsa2) + OSPF_LSA_HEADER_SIZE + 4;
+  lim1 = ((u_char *) lsa1) + ntohs (lsa1->length);
+  lim2 = ((u_char *) lsa2) + ntohs (lsa2->length);
+
+  /* Attached routers of a network. */
+  if (lsa1->type == OSPF_NETWORK_LSA)
+    return (lim1 - p1) == (lim2 - p2) && memcmp (p1, p2, lim1 - p1) == 0;
+
+  for (;;)
+    {
+      l1 = ospf_spf_next_transit_link (&p1, lim1);
+      l2 = ospf_spf_next_transit_link (&p2, lim2);
+
+      if (l1 == NULL || l2 == NULL)
+        return l1 == l2;
+
+      if (l1->m[0].type != l2->m[0].type
+          || l1->m[0].metric != l2->m[0].metric
+          || !IPV4_ADDR_SAME (&l1->link_id, &l2->link_id)
+          || !IPV4_ADDR_SAME (&l1->link_data, &l2->link_data))
+        return 0;
+    }
+}
+
+/* Move a vertex over to a new instance of its LSA. */
+static void
+ospf_spf_vertex_rebind (struct vertex *v, struct ospf_lsa *lsa)
+{
+  ospf_lsa_unlock (&v->lsa_p);
+  v->lsa_p = ospf_lsa_lock (lsa);
+  v->lsa = lsa->data;
+  v->stat = &lsa->stat;
+  lsa->stat = LSA_SPF_IN_SPFTREE;
+}
+
+/* Add the vertices on the tree which the given LSA has links to. */
+static void
+ospf_spf_boundary_add (struct ospf_area *area, struct lsa_header *lsa,
+                       struct list *boundary)
+{
+  u_char *p, *lim;
+  struct router_lsa_link *l;
+  struct vertex *u;
+
+  p = ((u_char *) lsa) + OSPF_LSA_HEADER_SIZE + 4;
+  lim = ((u_char *) lsa) + ntohs (lsa->length);
+
+  while (p < lim)
+    {
+      if (lsa->type == OSPF_ROUTER_LSA)
+        {
+          l = (struct router_lsa_link *) p;
+          p += (OSPF_ROUTER_LSA_LINK_SIZE +
+                (l->m[0].tos_count * OSPF_ROUTER_LSA_TOS_SIZE));
+
+          switch (l->m[0].type)
+            {
+            case LSA_LINK_TYPE_POINTOPOINT:
+            case LSA_LINK_TYPE_VIRTUALLINK:
+              u = ospf_spf_vertex_lookup (area, OSPF_VERTEX_ROUTER,
+                                          l->link_id);
+              break;
+            case LSA_LINK_TYPE_TRANSIT:
+              u = ospf_spf_vertex_lookup (area, OSPF_VERTEX_NETWORK,
+                                          l->link_id);
+              break;
+            default:
+              continue;
+            }
+        }
+      else
+        {
+          u = ospf_spf_vertex_lookup (area, OSPF_VERTEX_ROUTER,
+                                      *(struct in_addr *) p);
+          p += sizeof (struct in_addr);
+        }
+
+      if (u && !CHECK_FLAG (u->flags,
+                            OSPF_VERTEX_REMOVE | OSPF_VERTEX_BOUNDARY))
+        {
+          SET_FLAG (u->flags, OSPF_VERTEX_BOUNDARY);
+          listnode_add (boundary, u);
+        }
+    }
+}
+
+/* Take the vertices on the roots list and everything below them off the
+ * tree of an area, to be reached again from what is left of it: the
+ * candidates lose them as parents, and the vertices on the tree next
+ * to them are examined again.  So are those next to the LSAs on the
+ * fresh list, which are not on the tree yet.
+ */
+static int
+ospf_spf_detach (struct ospf_area *area, struct list *roots,
+                 struct list *fresh, struct pqueue *candidate)
+{
+  struct list *removed, *orphans, *boundary;
+  struct listnode *node, *cnode, *nnode;
+  struct vertex *v, *w;
+  struct vertex_parent *vp;
+  struct ospf_lsa *lsa;
+  int i, ret = 0;
+
+  removed = list_new ();
+  orphans = list_new ();
+  boundary = list_new ();
+
+  for (ALL_LIST_ELEMENTS_RO (roots, node, v))
+    if (!CHECK_FLAG (v->flags, OSPF_VERTEX_REMOVE))
+      {
+        SET_FLAG (v->flags, OSPF_VERTEX_REMOVE);
+        listnode_add (removed, v);
+      }
+
+  /* Everything below them, the list growing as it is walked. */
+  for (node = listhead (removed); node; node = listnextnode (node))
+    {
+      v = listgetdata (node);
+      for (ALL_LIST_ELEMENTS_RO (v->children, cnode, w))
+        if (!CHECK_FLAG (w->flags, OSPF_VERTEX_REMOVE))
+          {
+            SET_FLAG (w->flags, OSPF_VERTEX_REMOVE);
+            listnode_add (removed, w);
+          }
+    }
+
+  for (ALL_LIST_ELEMENTS_RO (removed, node, v))
+    if ((lsa = ospf_spf_lsa_current (area, v->type, v->id)) != NULL)
+      {
+        lsa->stat = LSA_SPF_NOT_EXPLORED;
+        ospf_spf_boundary_add (area, lsa->data, boundary);
+      }
+
+  if (fresh)
+    for (ALL_LIST_ELEMENTS_RO (fresh, node, lsa))
+      {
+        lsa->stat = LSA_SPF_NOT_EXPLORED;
+        ospf_spf_boundary_add (area, lsa->data, boundary);
+      }
+
+  /* Candidates reached only through removed vertices are dropped too. */
+  for (i = 0; i < candidate->size; i++)
+    {
+      w = candidate->array[i];
+
+      for (ALL_LIST_ELEMENTS (w->parents, cnode, nnode, vp))
+        if (CHECK_FLAG (vp->parent->flags, OSPF_VERTEX_REMOVE))
+          {
+            list_delete_node (w->parents, cnode);
+            vertex_parent_free (vp);
+          }
+
+      if (listcount (w->parents) == 0)
+        listnode_add (orphans, w);
+    }
+
+  for (ALL_LIST_ELEMENTS_RO (orphans, node, w))
+    {
+      if (*w->stat == candidate->size - 1)
+        candidate->size--;
+      else
+        pqueue_remove_at (*w->stat, candidate);
+      *w->stat = LSA_SPF_NOT_EXPLORED;
+      ospf_spf_boundary_add (area, w->lsa, boundary);
+      ospf_vertex_free (w);
+    }
+
+  for (ALL_LIST_ELEMENTS_RO (removed, node, v))
+    {
+      for (ALL_LIST_ELEMENTS_RO (v->parents, cnode, vp))
+        if (!CHECK_FLAG (vp->parent->flags, OSPF_VERTEX_REMOVE))
+          listnode_delete (vp->parent->children, v);
+      ospf_spf_vertex_unindex (area, v);
+    }
+
+  for (ALL_LIST_ELEMENTS_RO (removed, node, v))
+    ospf_vertex_free (v);
+
+  for (ALL_LIST_ELEMENTS_RO (boundary, node, v))
+    {
+      UNSET_FLAG (v->flags, OSPF_VERTEX_BOUNDARY);
+      if (ret == 0 && ospf_spf_next (v, area, candidate, NULL) < 0)
+        ret = -1;
+    }
+
+  list_delete (removed);
+  list_delete (orphans);
+  list_delete (boundary);
+  return ret;
+}
+
+/* Bring the tree of an area up to date with the router- and network-LSAs
+ * changed since the last calculation, recalculating it only below the
+ * vertices whose transit links changed.  Returns -1 if the tree has to
+ * be built from scratch instead, otherwise whether it changed.
+ */
+static int
+ospf_spf_update (struct ospf_area *area)
+{
+  struct vertex *root = area->spf;
+  struct list *roots, *fresh, *pull;
+  struct pqueue *candidate;
+  struct listnode *node;
+  struct ospf_lsa *lsa, *cur;
+  struct vertex *v;
+  unsigned long limit, settled = 0;
+  int changed = 0, ret = 0;
+
+  /* The links of the root carry every nexthop, only its stub links may
+     change without starting over. */
+  if (root->lsa_p != area->router_lsa_self)
+    {
+      if (!IPV4_ADDR_SAME (&root->id, &area->router_lsa_self->data->id)
+          || !ospf_spf_lsa_same (root->lsa, area->router_lsa_self->data))
+        return -1;
+
+      ospf_spf_vertex_rebind (root, area->router_lsa_self);
+      changed = 1;
+    }
+
+  if (area->spf_changed == NULL || listcount (area->spf_changed) == 0)
+    return changed;
+
+  /* Past this many changes, starting over is cheaper. */
+  limit = ospf_lsdb_count (area->lsdb, OSPF_ROUTER_LSA)
+          + ospf_lsdb_count (area->lsdb, OSPF_NETWORK_LSA);
+  if (listcount (area->spf_changed) > limit / 2 + 1)
+    return -1;
+
+  roots = list_new ();
+  fresh = list_new ();
+  pull = list_new ();
+
+  candidate = pqueue_create ();
+  candidate->cmp = cmp;
+  candidate->update = update_stat;
+
+  for (ALL_LIST_ELEMENTS_RO (area->spf_changed, node, lsa))
+    {
+      cur = ospf_spf_lsa_current (area, lsa->data->type, lsa->data->id);
+      v = ospf_spf_vertex_lookup (area, lsa->data->type, lsa->data->id);
+
+      if (v == root || (v && v->lsa_p == cur))
+        continue;
+
+      if (v == NULL)
+        {
+          if (cur && listnode_lookup (fresh, cur) == NULL)
+            {
+              listnode_add (fresh, cur);
+              changed = 1;
+            }
+        }
+      else if (cur && ospf_spf_lsa_same (v->lsa, cur->data))
+        {
+          ospf_spf_vertex_rebind (v, cur);
+          changed = 1;
+        }
+      else if (listnode_lookup (roots, v) == NULL)
+        {
+          listnode_add (roots, v);
+          changed = 1;
+        }
+    }
+
+  if (ospf_spf_detach (area, roots, fresh, candidate) < 0)
+    ret = -1;
+
+  while (ret == 0)
+    {
+      if (listcount (pull))
+        {
+          if (ospf_spf_detach (area, pull, NULL, candidate) < 0)
+            {
+              ret = -1;
+              break;
+            }
+          list_delete_all_node (pull);
+        }
+
+      if (candidate->size == 0)
+        break;
+
+      v = (struct vertex *) pqueue_dequeue (candidate);
+
+      /* Inconsistent LSAs could keep the loop going, or settle a
+         vertex twice. */
+      if (++settled > 2 * limit
+          || ospf_spf_vertex_lookup (area, v->type, v->id))
+        {
+          ospf_vertex_free (v);
+          ret = -1;
+          break;
+        }
+
+      *(v->stat) = LSA_SPF_IN_SPFTREE;
+      ospf_vertex_add_parent (v);
+      ospf_spf_vertex_index (area, v);
+
+      if (ospf_spf_next (v, area, candidate, pull) < 0)
+        ret = -1;
+    }
+
+  while (candidate->size)
+    ospf_vertex_free (pqueue_dequeue (candidate));
+  pqueue_delete (candidate);
+
+  list_delete (roots);
+  list_delete (fresh);
+  list_delete (pull);
+
+  if (IS_DEBUG_OSPF_EVENT)
+    zlog_debug ("%s: area %s, %lu vertices recalculated%s", __func__,
+                inet_ntoa (area->area_id), settled,
+                ret < 0 ? ", giving up" : "");
+
+  return ret < 0 ? -1 : changed;
+}
+
+static int
+ospf_spf_vertex_cmp (const void *a, const void *b)
+{
+  struct vertex *v1 = *(struct vertex * const *) a;
+  struct vertex *v2 = *(struct vertex * const *) b;
+  int ret;
+
+  if ((ret = cmp (v1, v2)) != 0)
+    return ret;
+  return IPV4_ADDR_CMP (&v1->id, &v2->id);
+}
+
+/* Add the routes for the tree of an area, in the order the Dijkstra
+ * loop would have settled its vertices.
+ */
 static void
+ospf_spf_tree_routes (struct ospf_area *area, struct route_table *new_table,
+                      struct route_table *new_rtrs)
+{
+  struct route_node *rn;
+  struct vertex **vs, *v;
+  unsigned int i, count = 0;
+
+  for (rn = route_top (area->spf_vertices); rn; rn = route_next (rn))
+    if (rn->info)
+      count++;
+
+  vs = XMALLOC (MTYPE_TMP, count * sizeof (struct vertex *));
+  count = 0;
+  for (rn = route_top (area->spf_vertices); rn; rn = route_next (rn))
+    if (rn->info)
+      vs[count++] = rn->info;
+  qsort (vs, count, sizeof (struct vertex *), ospf_spf_vertex_cmp);
+
+  area->abr_count = 0;
+  area->asbr_count = 0;
+  area->transit = OSPF_TRANSIT_FALSE;
+  area->shortcut_capability = 1;
+
+  for (i = 0; i < count; i++)
+    {
+      v = vs[i];
+      UNSET_FLAG (v->flags, OSPF_VERTEX_PROCESSED);
+
+      if (v->type == OSPF_VERTEX_ROUTER
+          && IS_ROUTER_LSA_VIRTUAL ((struct router_lsa *) v->lsa))
+        area->transit = OSPF_TRANSIT_TRUE;
+
+      if (v == area->spf)
+        continue;
+
+      if (v->type == OSPF_VERTEX_ROUTER)
+        ospf_intra_add_router (new_rtrs, v, area);
+      else
+        ospf_intra_add_transit (new_table, v, area);
+    }
+  XFREE (MTYPE_TMP, vs);
+
+  ospf_spf_process_stubs (area, area->spf, new_table, 0);
+}
+
+/* How the tree of an area was brought up to date. */
+enum ospf_spf_run
+{
+  OSPF_SPF_RUN_NONE = 0,	/* Unchanged, only its routes added again. */
+  OSPF_SPF_RUN_INCREMENTAL,	/* Changed parts recalculated. */
+  OSPF_SPF_RUN_FULL,		/* Built from scratch. */
+};
+
+/* Calculating the shortest-path tree for an area. */
+static enum ospf_spf_run
 ospf_spf_calculate (struct ospf_area *area, struct route_table *new_table,
-                    struct route_table *new_rtrs)
+                    struct route_table *new_rtrs, int full)
 {
   struct pqueue *candidate;
   struct vertex *v;
+  int changed;
   
   if (IS_DEBUG_OSPF_EVENT)
     {
@@ -1204,9 +1797,34 @@ ospf_spf_calculate (struct ospf_area *area, struct route_table *new_table,
         zlog_debug ("ospf_spf_calculate: "
                    "Skip area %s's calculation due to empty router_lsa_self",
                    inet_ntoa (area->area_id));
-      return;
+      ospf_spf_tree_free (area);
+      return OSPF_SPF_RUN_NONE;
+    }
+
+  /* Try to update the tree kept from the last calculation first. */
+  if (!full && area->spf)
+    {
+      if ((changed = ospf_spf_update (area)) >= 0)
+        {
+          ospf_spf_changes_clear (area);
+          ospf_spf_tree_routes (area, new_table, new_rtrs);
+
+          if (changed)
+            area->spf_calculation++;
+
+          quagga_gettime (QUAGGA_CLK_MONOTONIC, &area->ospf->ts_spf);
+          area->ts_spf = area->ospf->ts_spf;
+
+          return changed ? OSPF_SPF_RUN_INCREMENTAL : OSPF_SPF_RUN_NONE;
+        }
+
+      if (IS_DEBUG_OSPF_EVENT)
+        zlog_debug ("ospf_spf_calculate: area %s needs a full calculation",
+                    inet_ntoa (area->area_id));
     }
 
+  ospf_spf_tree_free (area);
+
   /* RFC2328 16.1. (1). */
   /* Initialize the algorithm's data structures. */
   
@@ -1233,7 +1851,7 @@ ospf_spf_calculate (struct ospf_area *area, struct route_table *new_table,
   for (;;)
     {
       /* RFC2328 16.1. (2). */
-      ospf_spf_next (v, area, candidate);
+      ospf_spf_next (v, area, candidate, NULL);
 
       /* RFC2328 16.1. (3). */
       /* If at this step the candidate list is empty, the shortest-
@@ -1252,6 +1870,7 @@ ospf_spf_calculate (struct ospf_area *area, struct route_table *new_table,
       *(v->stat) = LSA_SPF_IN_SPFTREE;
 
       ospf_vertex_add_parent (v);
+      ospf_spf_vertex_index (area, v);
 
       /* RFC2328 16.1. (4). */
       if (v->type == OSPF_VERTEX_ROUTER)
@@ -1277,11 +1896,6 @@ ospf_spf_calculate (struct ospf_area *area, struct route_table *new_table,
   pqueue_delete (candidate);
 
   ospf_vertex_dump (__func__, area->spf, 0, 1);
-  /* Free nexthop information, canonical versions of which are attached
-   * the first level of router vertices attached to the root vertex, see
-   * ospf_nexthop_calculation.
-   */
-  ospf_canonical_nexthops_free (area->spf);
 
   /* Increment SPF Calculation Counter. */
   area->spf_calculation++;
@@ -1293,10 +1907,219 @@ ospf_spf_calculate (struct ospf_area *area, struct route_table *new_table,
     zlog_debug ("ospf_spf_calculate: Stop. %ld vertices",
                 mtype_stats_alloc(MTYPE_OSPF_VERTEX));
 
-  /* Free SPF vertices, but not the list. List has ospf_vertex_free
-   * as deconstructor.
-   */
-  list_delete_all_node (&vertex_list);
+  return OSPF_SPF_RUN_FULL;
+}
+
+/* Whether a vertex is reached over the given next hop. */
+static int
+ospf_spf_vertex_has_nexthop (struct vertex *v, struct vertex_nexthop *nh)
+{
+  struct listnode *node;
+  struct vertex_parent *vp;
+
+  for (ALL_LIST_ELEMENTS_RO (v->parents, node, vp))
+    if (vp->nexthop->oi == nh->oi
+        && IPV4_ADDR_SAME (&vp->nexthop->router, &nh->router))
+      return 1;
+  return 0;
+}
+
+/* Whether two vertices for the same LSA are at the same distance and
+ * reached over the same next hops.
+ */
+static int
+ospf_spf_vertex_same (struct vertex *v1, struct vertex *v2)
+{
+  struct listnode *node;
+  struct vertex_parent *vp;
+
+  if (v1->distance != v2->distance)
+    return 0;
+
+  for (ALL_LIST_ELEMENTS_RO (v1->parents, node, vp))
+    if (!ospf_spf_vertex_has_nexthop (v2, vp->nexthop))
+      return 0;
+  for (ALL_LIST_ELEMENTS_RO (v2->parents, node, vp))
+    if (!ospf_spf_vertex_has_nexthop (v1, vp->nexthop))
+      return 0;
+  return 1;
+}
+
+/* Count the differences between the tree of an area kept from before
+ * and the one it has now.
+ */
+static int
+ospf_spf_verify_tree (struct ospf_area *area, struct route_table *kept)
+{
+  struct route_table *trees[2] = { kept, area->spf_vertices };
+  struct route_node *rn;
+  struct vertex *v, *w;
+  char buf[INET_ADDRSTRLEN];
+  int i, diffs = 0;
+
+  for (i = 0; i < 2; i++)
+    {
+      if (trees[i] == NULL)
+        continue;
+
+      for (rn = route_top (trees[i]); rn; rn = route_next (rn))
+        {
+          if ((v = rn->info) == NULL)
+            continue;
+
+          w = ospf_spf_vertex_find (trees[1 - i], v->type, v->id);
+          if (w && (i == 1 || ospf_spf_vertex_same (v, w)))
+            continue;
+
+          inet_ntop (AF_INET, &area->area_id, buf, sizeof (buf));
+          zlog_warn ("SPF verify: area %s: %s vertex %s %s", buf,
+                     v->type == OSPF_VERTEX_ROUTER ? "router" : "network",
+                     inet_ntoa (v->id),
+                     w ? "differs" : i ? "is missing" : "should be gone");
+          diffs++;
+        }
+    }
+
+  return diffs;
+}
+
+/* Whether two routes from the SPF calculation are the same. */
+static int
+ospf_spf_route_same (struct ospf_route *or1, struct ospf_route *or2)
+{
+  return or1->type == or2->type
+         && or1->path_type == or2->path_type
+         && or1->cost == or2->cost
+         && IPV4_ADDR_SAME (&or1->u.std.area_id, &or2->u.std.area_id)
+         && or1->u.std.flags == or2->u.std.flags
+         && ospf_route_paths_same (or1, or2);
+}
+
+/* Whether two route table entries are the same.  Entries of the router
+ * table are lists of routes, one for each area.
+ */
+static int
+ospf_spf_entry_same (void *info1, void *info2, int routers)
+{
+  struct listnode *n1, *n2;
+  struct ospf_route *or1, *or2 = NULL;
+
+  if (info1 == NULL || info2 == NULL)
+    return info1 == info2;
+  if (!routers)
+    return ospf_spf_route_same (info1, info2);
+
+  if (listcount ((struct list *) info1) != listcount ((struct list *) info2))
+    return 0;
+  for (ALL_LIST_ELEMENTS_RO ((struct list *) info1, n1, or1))
+    {
+      for (ALL_LIST_ELEMENTS_RO ((struct list *) info2, n2, or2))
+        if (IPV4_ADDR_SAME (&or1->u.std.area_id, &or2->u.std.area_id))
+          break;
+      if (n2 == NULL || !ospf_spf_route_same (or1, or2))
+        return 0;
+    }
+  return 1;
+}
+
+/* Count the entries two route tables differ in. */
+static int
+ospf_spf_verify_table (struct route_table *have, struct route_table *want,
+                       int routers)
+{
+  struct route_table *tables[2] = { have, want };
+  struct route_node *rn, *other;
+  void *info;
+  char buf[BUFSIZ];
+  int i, diffs = 0;
+
+  for (i = 0; i < 2; i++)
+    for (rn = route_top (tables[i]); rn; rn = route_next (rn))
+      {
+        if (rn->info == NULL)
+          continue;
+
+        info = NULL;
+        if ((other = route_node_lookup (tables[1 - i], &rn->p)) != NULL)
+          {
+            info = other->info;
+            route_unlock_node (other);
+          }
+
+        /* Entries in both were compared in the first pass. */
+        if (info && (i == 1 || ospf_spf_entry_same (rn->info, info, routers)))
+          continue;
+
+        prefix2str (&rn->p, buf, sizeof (buf));
+        zlog_warn ("SPF verify: %s route to %s %s",
+                   routers ? "router" : "network", buf,
+                   info ? "differs" : i ? "is missing" : "should be gone");
+        diffs++;
+      }
+
+  return diffs;
+}
+
+/* Build the tree of an area from scratch, and count how it differs from
+ * the one kept and updated by the last calculation.
+ */
+static int
+ospf_spf_verify_area (struct ospf_area *area, struct route_table *new_table,
+                      struct route_table *new_rtrs)
+{
+  struct route_table *kept = area->spf_vertices;
+  u_int32_t calculation = area->spf_calculation;
+  int diffs;
+
+  area->spf_vertices = NULL;
+  area->spf = NULL;
+  ospf_spf_calculate (area, new_table, new_rtrs, 1);
+  area->spf_calculation = calculation;
+
+  diffs = ospf_spf_verify_tree (area, kept);
+  if (kept)
+    ospf_spf_vertices_free (kept);
+
+  return diffs;
+}
+
+/* With "debug ospf spf verify", check the trees updated by the last
+ * calculation and the routes taken from them against a full
+ * calculation.  What that calculates is kept either way, so a wrong
+ * update is only logged and counted.
+ */
+static void
+ospf_spf_verify (struct ospf *ospf, struct route_table **new_table,
+                 struct route_table **new_rtrs)
+{
+  struct route_table *table, *rtrs;
+  struct ospf_area *area;
+  struct listnode *node;
+  int diffs = 0;
+
+  table = route_table_init ();
+  rtrs = route_table_init ();
+
+  for (ALL_LIST_ELEMENTS_RO (ospf->areas, node, area))
+    if (area != ospf->backbone)
+      diffs += ospf_spf_verify_area (area, table, rtrs);
+  if (ospf->backbone)
+    diffs += ospf_spf_verify_area (ospf->backbone, table, rtrs);
+
+  diffs += ospf_spf_verify_table (*new_table, table, 0);
+  diffs += ospf_spf_verify_table (*new_rtrs, rtrs, 1);
+
+  if (diffs)
+    {
+      zlog_warn ("SPF verify: %d differences from a full calculation",
+                 diffs);
+      ospf->spf_verify_failed++;
+    }
+
+  ospf_route_table_free (*new_table);
+  ospf_rtrs_free (*new_rtrs);
+  *new_table = table;
+  *new_rtrs = rtrs;
 }
 
 /* Timer for SPF calculation. */
@@ -1309,6 +2132,8 @@ ospf_spf_calculate_timer (struct thread *thread)
   struct listnode *node, *nnode;
   struct timeval start_time, stop_time, spf_start_time;
   int areas_processed = 0;
+  enum ospf_spf_run run, area_run;
+  int full;
   unsigned long ia_time, prune_time, rt_time;
   unsigned long abr_time, total_spf_time, spf_time;
   char rbuf[32];		/* reason_buf */
@@ -1325,6 +2150,17 @@ ospf_spf_calculate_timer (struct thread *thread)
 
   ospf_vl_unapprove (ospf);
 
+  /* Trees kept from the last calculation are updated incrementally,
+   * unless what changed is not captured by the router- and network-LSAs
+   * installed since: ABR/ASBR status, configuration, or virtual link
+   * parameters set as a side effect of the calculation itself.
+   */
+  full = (spf_reason_flags & ((1 << SPF_FLAG_ABR_STATUS_CHANGE)
+                              | (1 << SPF_FLAG_ASBR_STATUS_CHANGE)
+                              | (1 << SPF_FLAG_CONFIG_CHANGE)))
+         || listcount (ospf->vlinks) > 0;
+  run = OSPF_SPF_RUN_NONE;
+
   /* Calculate SPF for each area. */
   for (ALL_LIST_ELEMENTS (ospf->areas, node, nnode, area))
     {
@@ -1334,17 +2170,36 @@ ospf_spf_calculate_timer (struct thread *thread)
       if (ospf->backbone && ospf->backbone == area)
         continue;
 
-      ospf_spf_calculate (area, new_table, new_rtrs);
+      area_run = ospf_spf_calculate (area, new_table, new_rtrs, full);
+      run = MAX (run, area_run);
       areas_processed++;
     }
 
   /* SPF for backbone, if required */
   if (ospf->backbone)
     {
-      ospf_spf_calculate (ospf->backbone, new_table, new_rtrs);
+      area_run = ospf_spf_calculate (ospf->backbone, new_table, new_rtrs,
+                                     full);
+      run = MAX (run, area_run);
       areas_processed++;
     }
 
+  if (IS_DEBUG_OSPF (spf, SPF_VERIFY) && !full)
+    ospf_spf_verify (ospf, &new_table, &new_rtrs);
+
+  switch (run)
+    {
+    case OSPF_SPF_RUN_FULL:
+      ospf->spf_full_count++;
+      break;
+    case OSPF_SPF_RUN_INCREMENTAL:
+      ospf->spf_incremental_count++;
+      break;
+    default:
+      ospf->spf_route_count++;
+      break;
+    }
+
   quagga_gettime (QUAGGA_CLK_MONOTONIC, &stop_time);
   spf_time = timeval_elapsed (stop_time, spf_start_time);
 
@@ -1365,13 +2220,6 @@ ospf_spf_calculate_timer (struct thread *thread)
   prune_time = timeval_elapsed (stop_time, start_time);
   /* AS-external-LSA calculation should not be performed here. */
 
-  /* If new Router Route is installed,
-     then schedule re-calculate External routes. */
-  if (1)
-    ospf_ase_calculate_schedule (ospf);
-
-  ospf_ase_calculate_timer_add (ospf);
-
   quagga_gettime (QUAGGA_CLK_MONOTONIC, &start_time);
 
   /* Update routing table. */
@@ -1390,6 +2238,10 @@ ospf_spf_calculate_timer (struct thread *thread)
   ospf->old_rtrs = ospf->new_rtrs;
   ospf->new_rtrs = new_rtrs;
 
+  /* Recalculate the external routes depending on what changed, all of
+     them if the routes to ASBRs did. */
+  ospf_ase_spf_update (ospf, full);
+
   quagga_gettime (QUAGGA_CLK_MONOTONIC, &start_time);
   if (IS_OSPF_ABR (ospf))
     ospf_abr_task (ospf);
@@ -1407,7 +2259,10 @@ ospf_spf_calculate_timer (struct thread *thread)
   if (IS_DEBUG_OSPF_EVENT)
     {
       zlog_info ("SPF Processing Time(usecs): %ld", total_spf_time);
-      zlog_info ("\t    SPF Time: %ld", spf_time);
+      zlog_info ("\t    SPF Time: %ld (%s)", spf_time,
+                 run == OSPF_SPF_RUN_FULL ? "full" :
+                 run == OSPF_SPF_RUN_INCREMENTAL ? "incremental" :
+                 "routes only");
       zlog_info ("\t   InterArea: %ld", ia_time);
       zlog_info ("\t       Prune: %ld", prune_time);
       zlog_info ("\tRouteInstall: %ld", rt_time);
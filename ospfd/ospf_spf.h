@@ -29,6 +29,8 @@
 
 /* values for vertex->flags */
 #define OSPF_VERTEX_PROCESSED      0x01
+#define OSPF_VERTEX_REMOVE         0x02  /* being taken off the tree */
+#define OSPF_VERTEX_BOUNDARY       0x04  /* next to a changed part of it */
 
 /* The "root" is the node running the SPF calculation */
 
@@ -39,6 +41,7 @@ struct vertex
   u_char type;		/* copied from LSA header */
   struct in_addr id;	/* copied from LSA header */
   struct lsa_header *lsa; /* Router or Network LSA */
+  struct ospf_lsa *lsa_p; /* Locked LSA instance holding lsa. */
   int *stat;		/* Link to LSA status. */
   u_int32_t distance;	/* from root to this vertex */  
   struct list *parents;		/* list of parents in SPF tree */
@@ -50,6 +53,7 @@ struct vertex_nexthop
 {
   struct ospf_interface *oi;	/* output intf on root node */
   struct in_addr router;	/* router address to send to */
+  unsigned int lock;		/* vertex_parents referring to it */
 };
 
 struct vertex_parent
@@ -73,6 +77,8 @@ typedef enum {
 
 extern void ospf_spf_calculate_schedule (struct ospf *, ospf_spf_reason_t);
 extern void ospf_rtrs_free (struct route_table *);
+extern void ospf_spf_lsa_changed (struct ospf_lsa *);
+extern void ospf_spf_tree_free (struct ospf_area *);
 
 /* void ospf_spf_calculate_timer_add (); */
 #endif /* _QUAGGA_OSPF_SPF_H */
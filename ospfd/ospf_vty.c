@@ -2752,6 +2752,16 @@ DEFUN (show_ip_ospf,
       vty_out (vty, " Last SPF duration %s%s",
 	       ospf_timeval_dump (&ospf->ts_spf_duration, timebuf, sizeof (timebuf)),
 	       VTY_NEWLINE);
+      vty_out (vty, " SPF runs: %u full, %u incremental, %u routes only%s",
+	       ospf->spf_full_count, ospf->spf_incremental_count,
+	       ospf->spf_route_count, VTY_NEWLINE);
+      vty_out (vty, " External route calculations: %u full, %u partial%s",
+	       ospf->ase_full_count, ospf->ase_partial_count, VTY_NEWLINE);
+      if (IS_DEBUG_OSPF (spf, SPF_VERIFY)
+	  || ospf->spf_verify_failed || ospf->ase_verify_failed)
+	vty_out (vty, " Failed verifications: %u SPF, %u external%s",
+		 ospf->spf_verify_failed, ospf->ase_verify_failed,
+		 VTY_NEWLINE);
     }
   else
     vty_out (vty, "has not been run%s", VTY_NEWLINE);
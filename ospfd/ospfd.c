@@ -179,6 +179,7 @@ ospf_new (void)
   new->new_external_route = route_table_init ();
   new->old_external_route = route_table_init ();
   new->external_lsas = route_table_init ();
+  new->external_fwd = route_table_init ();
   
   new->stub_router_startup_time = OSPF_STUB_ROUTER_UNCONFIGURED;
   new->stub_router_shutdown_time = OSPF_STUB_ROUTER_UNCONFIGURED;
@@ -540,6 +541,10 @@ ospf_finish_final (struct ospf *ospf)
     {
       ospf_ase_external_lsas_finish (ospf->external_lsas);
     }
+  if (ospf->external_fwd)
+    {
+      ospf_ase_external_lsas_finish (ospf->external_fwd);
+    }
 
   list_delete (ospf->areas);
   
@@ -625,6 +630,8 @@ ospf_area_free (struct ospf_area *area)
     ospf_discard_from_db (area->ospf, area->lsdb, lsa);
 #endif /* HAVE_OPAQUE_LSA */
 
+  ospf_spf_tree_free (area);
+
   ospf_lsdb_delete_all (area->lsdb);
   ospf_lsdb_free (area->lsdb);
 
@@ -193,11 +193,27 @@ struct ospf
   
   struct route_table *external_lsas;    /* Database of external LSAs,
 					   prefix is LSA's adv. network*/
+  struct route_table *external_fwd;     /* The same, prefix is LSA's
+					   forwarding address. */
 
   /* Time stamps */
   struct timeval ts_spf;		/* SPF calculation time stamp. */
   struct timeval ts_spf_duration;	/* Execution time of last SPF */
 
+  /* SPF calculations, by what they had to recalculate. */
+  u_int32_t spf_full_count;		/* Some tree rebuilt from scratch. */
+  u_int32_t spf_incremental_count;	/* Only changed parts of trees. */
+  u_int32_t spf_route_count;		/* Trees unchanged, routes only. */
+
+  /* External route calculations, all LSAs or only affected ones. */
+  u_int32_t ase_full_count;
+  u_int32_t ase_partial_count;
+
+  /* Incremental and partial calculations a full one disagreed with,
+     checked with "debug ospf spf verify". */
+  u_int32_t spf_verify_failed;
+  u_int32_t ase_verify_failed;
+
   struct route_table *maxage_lsa;       /* List of MaxAge LSA for deletion. */
   int redistribute;                     /* Num of redistributed protocols. */
 
@@ -382,8 +398,10 @@ struct ospf_area
 #define PREFIX_LIST_OUT(A)  (A)->plist_out.list
 #define PREFIX_NAME_OUT(A)  (A)->plist_out.name
 
-  /* Shortest Path Tree. */
+  /* Shortest Path Tree, kept between calculations. */
   struct vertex *spf;
+  struct route_table *spf_vertices;	/* Its vertices, by LSA type and ID. */
+  struct list *spf_changed;		/* Router/network-LSAs changed since. */
 
   /* Threads. */
   struct thread *t_stub_router;    /* Stub-router timer */
@@ -28,6 +28,7 @@
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_aspath.h"
 #include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_regex.h"
 
 #define VT100_RESET "\x1b[0m"
 #define VT100_RED "\x1b[31m"
@@ -915,6 +916,62 @@ printbytes (const u_char *bytes, int len)
   printf ("\n");
 }  
 
+/* as-path regexps, matched over the ASes must agree with regexec () */
+static const char *regex_patterns[] =
+{
+  "_8466_", "^8466_", "_3741$", "^8466$", "^$", ".*", "^8466_.*_3741$",
+  "_8466_3741_", "^8466 3741_", "_(8466|3741)_", "^(8466_)+$",
+  "^(8466_)*3741$", "_84[0-9][0-9]_", "_[0-9]+$", "^[0-9]*$",
+  "_65[0-9]?[0-9]?[0-9]?_", "_(_|8466)_", ".+_3741$", "_0[0-9]*_",
+  "^(_[0-9]+)?$", "_4294967295_",
+  /* left to regexec () */
+  "8466", "^84", "_84", "_[{]", "^8466[^0-9]", "_8466.3741_", "(8466)3741",
+  NULL
+};
+
+static const char *regex_paths[] =
+{
+  "", "8466", "8466 3741", "8466 8466 8466", "3741 8466 3741",
+  "8466 84661 3741", "65000 65535 6500", "0 00 4294967295", "846 6",
+  "8466 {3741,8466}", "(8466 3741) 8466", "{3741}",
+  NULL
+};
+
+static int
+regex_check (struct aspath *as)
+{
+  struct bgp_asregex *asre;
+  regex_t *re;
+  int fails = 0;
+  int i;
+
+  for (i = 0; regex_patterns[i]; i++)
+    {
+      asre = bgp_asregcomp (regex_patterns[i]);
+      re = bgp_regcomp (regex_patterns[i]);
+      if (!asre || !re)
+        {
+          printf ("regexp %s does not compile\n", regex_patterns[i]);
+          fails++;
+        }
+      else if ((bgp_asregexec (asre, as) == REG_NOMATCH)
+               != (bgp_regexec (re, as) == REG_NOMATCH))
+        {
+          printf ("regexp %s on \"%s\": %d, regexec %d\n",
+                  regex_patterns[i], as->str,
+                  bgp_asregexec (asre, as) != REG_NOMATCH,
+                  bgp_regexec (re, as) != REG_NOMATCH);
+          fails++;
+        }
+      if (asre)
+        bgp_asregex_free (asre);
+      if (re)
+        bgp_regex_free (re);
+    }
+  failed += fails;
+  return fails;
+}
+
 /* validate the given aspath */
 static int
 validate (struct aspath *as, const struct test_spec *sp)
@@ -1039,6 +1096,27 @@ validate (struct aspath *as, const struct test_spec *sp)
       printf ("private check: %d %d\n", sp->private_as,
               aspath_private_as_check (as));
     }
+    /* what interning keeps should agree with walking the segments */
+  if (asstr
+      && ((aspath_count_hops (as) != aspath_count_hops (asstr))
+          || (aspath_count_confeds (as) != aspath_count_confeds (asstr))
+          || (aspath_leftmost (as) != aspath_leftmost (asstr))
+          || (aspath_highest (as) != aspath_highest (asstr))
+          || (aspath_loop_check (as, sp->does_loop)
+              != aspath_loop_check (asstr, sp->does_loop))
+          || (aspath_loop_check (as, sp->doesnt_loop)
+              != aspath_loop_check (asstr, sp->doesnt_loop))))
+    {
+      failed++;
+      fails++;
+      printf ("interned: hops %d confeds %d leftmost %u highest %u\n",
+              aspath_count_hops (as), aspath_count_confeds (as),
+              aspath_leftmost (as), aspath_highest (as));
+      printf ("walked:   hops %d confeds %d leftmost %u highest %u\n",
+              aspath_count_hops (asstr), aspath_count_confeds (asstr),
+              aspath_leftmost (asstr), aspath_highest (asstr));
+    }
+  fails += regex_check (as);
   aspath_unintern (&asinout);
   aspath_unintern (&as4);
   
@@ -1066,6 +1144,22 @@ empty_get_test ()
   aspath_free (as);
 }
 
+static void
+regex_test (void)
+{
+  struct aspath *as;
+  int i, fails = 0;
+
+  printf ("regex test\n");
+  for (i = 0; regex_paths[i]; i++)
+    {
+      as = aspath_str2aspath (regex_paths[i]);
+      fails += regex_check (as);
+      aspath_free (as);
+    }
+  printf ("%s\n\n", fails ? FAILED "!" : OK);
+}
+
 /* basic parsing test */
 static void
 parse_test (struct test_segment *t)
@@ -1368,6 +1462,8 @@ main (void)
   
   empty_get_test();
   
+  regex_test ();
+  
   i = 0;
   
   while (aspath_tests[i].desc)
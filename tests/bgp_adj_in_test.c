@@ -0,0 +1,347 @@
+/*
+ * Adj-RIB-In tests, with soft-reconfiguration inbound: only routes
+ * inbound policy denied or changed keep an attribute of their own.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "vector.h"
+#include "buffer.h"
+#include "command.h"
+#include "prefix.h"
+#include "sockunion.h"
+#include "privs.h"
+#include "memory.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_advertise.h"
+
+#define VT100_RESET "\x1b[0m"
+#define VT100_RED "\x1b[31m"
+#define VT100_GREEN "\x1b[32m"
+
+/* need these to link in libbgp */
+struct zebra_privs_t bgpd_privs =
+{
+  .user = NULL,
+  .group = NULL,
+  .vty_group = NULL,
+};
+struct thread_master *master = NULL;
+
+static int failed = 0;
+static int tty = 0;
+static struct vty *vty;
+static struct bgp *bgp;
+static struct peer *peer;
+
+#define EXPECT(expr)							\
+  do {									\
+    if (! (expr))							\
+      {									\
+	printf ("%s line %u: %s\n", __FUNCTION__, __LINE__, #expr);	\
+	failed++;							\
+      }									\
+  } while (0)
+
+/* Configure as from the vty, in node. */
+static void
+run (int node, const char *line)
+{
+  vector vline;
+  int ret;
+
+  vline = cmd_make_strvec (line);
+  vty->node = node;
+  ret = cmd_execute_command (vline, vty, NULL, 0);
+  cmd_free_strvec (vline);
+  buffer_reset (vty->obuf);
+
+  if (ret != CMD_SUCCESS)
+    {
+      printf ("'%s' failed: %d\n", line, ret);
+      failed++;
+    }
+}
+
+#define config(line)	run (CONFIG_NODE, (line))
+#define router(line)	run (BGP_NODE, (line))
+#define enable(line)	run (ENABLE_NODE, (line))
+
+/* An UPDATE from the peer, with the attribute on the stack as the
+   parser leaves it. */
+static void
+update (const char *prefix, u_int32_t med)
+{
+  struct attr attr;
+  struct prefix p;
+
+  str2prefix (prefix, &p);
+  bgp_attr_default_set (&attr, BGP_ORIGIN_IGP);
+  attr.nexthop.s_addr = inet_addr ("10.0.0.2");
+  attr.med = med;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC);
+
+  bgp_update (peer, &p, &attr, AFI_IP, SAFI_UNICAST, ZEBRA_ROUTE_BGP,
+	      BGP_ROUTE_NORMAL, NULL, NULL, 0);
+
+  bgp_attr_unintern_sub (&attr);
+  bgp_attr_extra_free (&attr);
+}
+
+static void
+withdraw (const char *prefix)
+{
+  struct prefix p;
+
+  str2prefix (prefix, &p);
+  bgp_withdraw (peer, &p, NULL, AFI_IP, SAFI_UNICAST, ZEBRA_ROUTE_BGP,
+		BGP_ROUTE_NORMAL, NULL, NULL);
+}
+
+static struct bgp_node *
+node (const char *prefix)
+{
+  struct prefix p;
+  struct bgp_node *rn;
+
+  /* Not bgp_node_lookup, which misses nodes only adj_in holds. */
+  str2prefix (prefix, &p);
+  for (rn = bgp_table_top (bgp->rib[AFI_IP][SAFI_UNICAST]); rn;
+       rn = bgp_route_next (rn))
+    if (prefix_same (&rn->p, &p))
+      {
+	bgp_unlock_node (rn);
+	return rn;
+      }
+  return NULL;
+}
+
+/* The peer's route to prefix, unless withdrawn or filtered. */
+static struct bgp_info *
+route (const char *prefix)
+{
+  struct bgp_node *rn = node (prefix);
+  struct bgp_info *ri;
+
+  for (ri = rn ? rn->info : NULL; ri; ri = ri->next)
+    if (ri->peer == peer && ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+      return ri;
+  return NULL;
+}
+
+/* The peer's Adj-RIB-In entry of its own for prefix. */
+static struct bgp_adj_in *
+adj_in (const char *prefix)
+{
+  struct bgp_node *rn = node (prefix);
+  struct bgp_adj_in *adj;
+
+  for (adj = rn ? rn->adj_in : NULL; adj; adj = adj->next)
+    if (adj->peer == peer)
+      return adj;
+  return NULL;
+}
+
+/* What the peer sent for prefix, as soft reconfiguration sees it. */
+static struct attr *
+sent (const char *prefix)
+{
+  struct bgp_node *rn = node (prefix);
+
+  return rn ? bgp_adj_in_lookup (rn, peer) : NULL;
+}
+
+/* The route carries the attribute the peer sent, so needs no entry. */
+static int
+shared (const char *prefix, u_int32_t med)
+{
+  struct bgp_info *ri = route (prefix);
+
+  return ri && ri->attr->med == med && adj_in (prefix) == NULL
+	 && CHECK_FLAG (ri->flags, BGP_INFO_ADJ_IN)
+	 && sent (prefix) == ri->attr;
+}
+
+/* Policy changed the route, so what the peer sent is kept apart. */
+static int
+kept (const char *prefix, u_int32_t med, u_int32_t sent_med)
+{
+  struct bgp_info *ri = route (prefix);
+  struct bgp_adj_in *adj = adj_in (prefix);
+
+  return ri && ri->attr->med == med && adj && adj->attr->med == sent_med
+	 && ! CHECK_FLAG (ri->flags, BGP_INFO_ADJ_IN)
+	 && sent (prefix) == adj->attr;
+}
+
+static void
+soft_in (void)
+{
+  enable ("clear ip bgp 10.0.0.2 soft in");
+}
+
+static void
+test_unchanged (void)
+{
+  update ("10.1.0.0/16", 5);
+  EXPECT (shared ("10.1.0.0/16", 5));
+
+  soft_in ();
+  EXPECT (shared ("10.1.0.0/16", 5));
+
+  /* Policy now changes it: the route is rebuilt from what it held. */
+  config ("ip prefix-list MOD seq 10 permit 10.1.0.0/16");
+  soft_in ();
+  EXPECT (kept ("10.1.0.0/16", 15, 5));
+
+  config ("no ip prefix-list MOD seq 10 permit 10.1.0.0/16");
+  soft_in ();
+  EXPECT (shared ("10.1.0.0/16", 5));
+}
+
+static void
+test_changed (void)
+{
+  update ("10.2.0.0/16", 5);
+  EXPECT (kept ("10.2.0.0/16", 15, 5));
+
+  /* Policy is applied again to what was sent, not to its result. */
+  soft_in ();
+  EXPECT (kept ("10.2.0.0/16", 15, 5));
+  soft_in ();
+  EXPECT (kept ("10.2.0.0/16", 15, 5));
+
+  /* A new attribute replaces the one kept. */
+  update ("10.2.0.0/16", 7);
+  EXPECT (kept ("10.2.0.0/16", 17, 7));
+}
+
+static void
+test_equal (void)
+{
+  /* Policy no longer changes it: the entry goes. */
+  config ("no ip prefix-list MOD seq 20 permit 10.2.0.0/16");
+  soft_in ();
+  EXPECT (shared ("10.2.0.0/16", 7));
+
+  /* And back. */
+  config ("ip prefix-list MOD seq 20 permit 10.2.0.0/16");
+  soft_in ();
+  EXPECT (kept ("10.2.0.0/16", 17, 7));
+
+  /* A withdraw forgets either. */
+  withdraw ("10.1.0.0/16");
+  withdraw ("10.2.0.0/16");
+  EXPECT (sent ("10.1.0.0/16") == NULL);
+  EXPECT (sent ("10.2.0.0/16") == NULL);
+}
+
+static void
+test_denied (void)
+{
+  update ("10.3.0.0/16", 5);
+  EXPECT (route ("10.3.0.0/16") == NULL);
+  EXPECT (adj_in ("10.3.0.0/16") && sent ("10.3.0.0/16")->med == 5);
+
+  config ("no ip prefix-list DENY");
+  soft_in ();
+  EXPECT (shared ("10.3.0.0/16", 5));
+
+  config ("ip prefix-list DENY seq 5 permit 10.3.0.0/16");
+  soft_in ();
+  EXPECT (route ("10.3.0.0/16") == NULL);
+  EXPECT (adj_in ("10.3.0.0/16") && sent ("10.3.0.0/16")->med == 5);
+}
+
+static struct test
+{
+  const char *name;
+  const char *desc;
+  void (*func) (void);
+} tests[] =
+{
+  { "unchanged", "Route accepted as sent", test_unchanged },
+  { "changed", "Route changed by policy", test_changed },
+  { "equal", "Policy change makes them equal", test_equal },
+  { "denied", "Route denied by policy", test_denied },
+  { NULL, NULL, NULL },
+};
+
+int
+main (void)
+{
+  struct test *t;
+  union sockunion su;
+  int oldfailed;
+
+  master = thread_master_create ();
+  cmd_init (1);
+  vty = vty_new ();
+  bgp_master_init ();
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_option_set (BGP_OPT_NO_FIB);
+  bgp_init ();
+
+  /* Routes in MOD get their metric raised, those in DENY are dropped. */
+  config ("ip prefix-list MOD seq 20 permit 10.2.0.0/16");
+  config ("ip prefix-list DENY seq 5 permit 10.3.0.0/16");
+  config ("route-map IN deny 5");
+  run (RMAP_NODE, "match ip address prefix-list DENY");
+  config ("route-map IN permit 10");
+  run (RMAP_NODE, "match ip address prefix-list MOD");
+  run (RMAP_NODE, "set metric +10");
+  config ("route-map IN permit 20");
+
+  config ("router bgp 65000");
+  bgp = vty->index;
+  router ("neighbor 10.0.0.2 remote-as 65000");
+  router ("neighbor 10.0.0.2 soft-reconfiguration inbound");
+  router ("neighbor 10.0.0.2 route-map IN in");
+
+  str2sockunion ("10.0.0.2", &su);
+  peer = peer_lookup (bgp, &su);
+  peer->status = Established;
+
+  if (fileno (stdout) >= 0)
+    tty = isatty (fileno (stdout));
+
+  for (t = tests; t->name; t++)
+    {
+      printf ("%s: %s\n", t->name, t->desc);
+      oldfailed = failed;
+      t->func ();
+
+      if (tty)
+	printf ("%s", (failed > oldfailed) ? VT100_RED "failed!" VT100_RESET
+					   : VT100_GREEN "OK" VT100_RESET);
+      else
+	printf ("%s", (failed > oldfailed) ? "failed!" : "OK");
+      printf ("\n\n");
+    }
+
+  printf ("failures: %d\n", failed);
+  return failed;
+}
@@ -0,0 +1,402 @@
+/*
+ * Nexthop tracking tests: paths are linked to a cache entry per
+ * nexthop, registered with zebra, and re-evaluated on
+ * ZEBRA_NEXTHOP_UPDATE.  Zebra is a socketpair here.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "command.h"
+#include "prefix.h"
+#include "sockunion.h"
+#include "stream.h"
+#include "network.h"
+#include "zclient.h"
+#include "workqueue.h"
+#include "if.h"
+#include "privs.h"
+#include "memory.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_nexthop.h"
+
+#define VT100_RESET "\x1b[0m"
+#define VT100_RED "\x1b[31m"
+#define VT100_GREEN "\x1b[32m"
+
+/* need these to link in libbgp */
+struct zebra_privs_t bgpd_privs =
+{
+  .user = NULL,
+  .group = NULL,
+  .vty_group = NULL,
+};
+struct thread_master *master = NULL;
+
+extern struct zclient *zclient;
+extern struct zclient *zlookup;
+
+static int failed = 0;
+static int tty = 0;
+static struct bgp *bgp;
+static struct peer *ibgp;
+static struct peer *ebgp;
+static struct connected *ifc;
+static int zebra = -1;
+
+#define EXPECT(expr)							\
+  do {									\
+    if (! (expr))							\
+      {									\
+	printf ("%s line %u: %s\n", __FUNCTION__, __LINE__, #expr);	\
+	failed++;							\
+      }									\
+  } while (0)
+
+static struct peer *
+add_peer (const char *addr, as_t as, bgp_peer_sort_t sort)
+{
+  struct peer *peer;
+
+  peer = peer_create_accept (bgp);
+  peer->host = XSTRDUP (MTYPE_BGP_PEER_HOST, addr);
+  peer->as = as;
+  peer->sort = sort;
+  peer->ttl = (sort == BGP_PEER_IBGP ? 255 : 1);
+  peer->su_remote = sockunion_str2su (addr);
+  return peer;
+}
+
+static void
+update (struct peer *peer, const char *prefix, const char *nexthop)
+{
+  struct attr attr;
+  struct prefix p;
+
+  str2prefix (prefix, &p);
+  bgp_attr_default_set (&attr, BGP_ORIGIN_IGP);
+  attr.nexthop.s_addr = inet_addr (nexthop);
+
+  bgp_update (peer, &p, &attr, AFI_IP, SAFI_UNICAST, ZEBRA_ROUTE_BGP,
+	      BGP_ROUTE_NORMAL, NULL, NULL, 0);
+
+  bgp_attr_unintern_sub (&attr);
+  bgp_attr_extra_free (&attr);
+}
+
+static void
+withdraw (struct peer *peer, const char *prefix)
+{
+  struct prefix p;
+
+  str2prefix (prefix, &p);
+  bgp_withdraw (peer, &p, NULL, AFI_IP, SAFI_UNICAST, ZEBRA_ROUTE_BGP,
+		BGP_ROUTE_NORMAL, NULL, NULL);
+}
+
+/* Run the process queue dry, reaping withdrawn paths. */
+static void
+drain (void)
+{
+  struct work_queue *wq = bm->process_main_queue;
+  struct thread thread;
+
+  if (! wq)
+    return;
+
+  wq->spec.hold = 0;
+  while (work_queue_item_count (wq))
+    if (thread_fetch (master, &thread))
+      thread_call (&thread);
+}
+
+/* The peer's path to prefix, unless withdrawn or filtered. */
+static struct bgp_info *
+route (struct peer *peer, const char *prefix)
+{
+  struct prefix p;
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+
+  str2prefix (prefix, &p);
+  rn = bgp_node_lookup (bgp->rib[AFI_IP][SAFI_UNICAST], &p);
+  if (! rn)
+    return NULL;
+  bgp_unlock_node (rn);
+
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->peer == peer && ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+      return ri;
+  return NULL;
+}
+
+static int
+valid (struct bgp_info *ri)
+{
+  return ri && CHECK_FLAG (ri->flags, BGP_INFO_VALID);
+}
+
+static int
+selected (struct bgp_info *ri)
+{
+  return ri && CHECK_FLAG (ri->flags, BGP_INFO_SELECTED);
+}
+
+/* How many of the messages sent to zebra since last asked were
+   command about addr.  Others, such as routes, are skipped. */
+static int
+sent (int command, const char *addr)
+{
+  u_char buf[ZEBRA_MAX_PACKET_SIZ];
+  struct in_addr in;
+  ssize_t len;
+  ssize_t i;
+  int count = 0;
+
+  in.s_addr = inet_addr (addr);
+  len = read (zebra, buf, sizeof (buf));
+
+  for (i = 0; i + ZEBRA_HEADER_SIZE <= len; i += (buf[i] << 8) | buf[i + 1])
+    {
+      u_char *msg = buf + i;
+
+      if (((msg[4] << 8) | msg[5]) == command
+	  && msg[ZEBRA_HEADER_SIZE] == AF_INET
+	  && ! memcmp (msg + ZEBRA_HEADER_SIZE + 1, &in, sizeof (in)))
+	count++;
+    }
+  return count;
+}
+
+/* Zebra's ZEBRA_NEXTHOP_UPDATE for addr: reachable through gate, or
+   not at all without one. */
+static void
+nexthop_update (const char *addr, const char *gate, u_int32_t metric)
+{
+  struct stream *s = zclient->ibuf;
+  struct in_addr in;
+
+  in.s_addr = inet_addr (addr);
+  stream_reset (s);
+  stream_putc (s, AF_INET);
+  stream_put_in_addr (s, &in);
+  stream_putl (s, metric);
+  if (gate)
+    {
+      stream_putc (s, 1);
+      stream_putc (s, ZEBRA_NEXTHOP_IPV4_IFINDEX);
+      stream_put_ipv4 (s, inet_addr (gate));
+      stream_putl (s, 2);
+    }
+  else
+    stream_putc (s, 0);
+
+  bgp_nexthop_update (ZEBRA_NEXTHOP_UPDATE, zclient, stream_get_endp (s));
+}
+
+static void
+test_register (void)
+{
+  struct bgp_info *ri1, *ri2;
+
+  /* Zebra is asked once, and nothing is trusted until it answers. */
+  update (ibgp, "10.1.0.0/16", "10.0.0.2");
+  update (ibgp, "10.2.0.0/16", "10.0.0.2");
+  EXPECT (sent (ZEBRA_NEXTHOP_REGISTER, "10.0.0.2") == 1);
+
+  ri1 = route (ibgp, "10.1.0.0/16");
+  ri2 = route (ibgp, "10.2.0.0/16");
+  EXPECT (ri1 && ri2 && ri1->nexthop && ri1->nexthop == ri2->nexthop);
+  EXPECT (ri1 && ri1->nexthop && ri1->nexthop->path_count == 2);
+  EXPECT (! valid (ri1) && ! valid (ri2));
+}
+
+static void
+test_reachable (void)
+{
+  struct bgp_info *ri1 = route (ibgp, "10.1.0.0/16");
+  struct bgp_info *ri2 = route (ibgp, "10.2.0.0/16");
+
+  nexthop_update ("10.0.0.2", "192.168.0.1", 10);
+  drain ();
+  EXPECT (valid (ri1) && valid (ri2));
+  EXPECT (selected (ri1) && selected (ri2));
+  EXPECT (ri1->extra && ri1->extra->igpmetric == 10);
+
+  /* Down, and both paths go. */
+  nexthop_update ("10.0.0.2", NULL, 0);
+  drain ();
+  EXPECT (! valid (ri1) && ! valid (ri2));
+  EXPECT (! selected (ri1) && ! selected (ri2));
+
+  /* And back. */
+  nexthop_update ("10.0.0.2", "192.168.0.1", 20);
+  drain ();
+  EXPECT (valid (ri1) && valid (ri2));
+  EXPECT (selected (ri1) && selected (ri2));
+  EXPECT (ri1->extra && ri1->extra->igpmetric == 20);
+
+  /* Resolved another way: the IGP change is flagged. */
+  UNSET_FLAG (ri1->flags, BGP_INFO_IGP_CHANGED);
+  nexthop_update ("10.0.0.2", "192.168.0.2", 20);
+  EXPECT (CHECK_FLAG (ri1->flags, BGP_INFO_IGP_CHANGED));
+  drain ();
+  EXPECT (valid (ri1) && selected (ri1));
+
+  /* Updates do not register the address again. */
+  EXPECT (sent (ZEBRA_NEXTHOP_REGISTER, "10.0.0.2") == 0);
+}
+
+static void
+test_onlink (void)
+{
+  struct bgp_info *ri;
+
+  /* A single-hop EBGP nexthop off the connected networks is not
+     accepted at all. */
+  update (ebgp, "10.4.0.0/16", "192.0.2.1");
+  EXPECT (route (ebgp, "10.4.0.0/16") == NULL);
+
+  /* One on them is, whatever zebra says of the address. */
+  update (ebgp, "10.3.0.0/16", "10.0.0.3");
+  EXPECT (sent (ZEBRA_NEXTHOP_REGISTER, "10.0.0.3") == 1);
+  ri = route (ebgp, "10.3.0.0/16");
+  EXPECT (valid (ri));
+
+  nexthop_update ("10.0.0.3", NULL, 0);
+  EXPECT (valid (ri));
+
+  /* Until the network goes, and zebra tells. */
+  bgp_connected_delete (ifc);
+  nexthop_update ("10.0.0.3", "192.168.0.1", 0);
+  drain ();
+  EXPECT (! valid (ri) && ! selected (ri));
+
+  bgp_connected_add (ifc);
+  nexthop_update ("10.0.0.3", NULL, 0);
+  drain ();
+  EXPECT (valid (ri) && selected (ri));
+}
+
+static void
+test_free (void)
+{
+  struct bgp_info *ri;
+
+  /* A freed path leaves the entry to the others. */
+  withdraw (ibgp, "10.1.0.0/16");
+  drain ();
+  ri = route (ibgp, "10.2.0.0/16");
+  EXPECT (ri && ri->nexthop && ri->nexthop->path_count == 1);
+  EXPECT (ri && ri->nexthop && ri->nexthop->paths == ri);
+  EXPECT (sent (ZEBRA_NEXTHOP_UNREGISTER, "10.0.0.2") == 0);
+
+  /* The last one frees it, and zebra is told. */
+  withdraw (ibgp, "10.2.0.0/16");
+  drain ();
+  EXPECT (sent (ZEBRA_NEXTHOP_UNREGISTER, "10.0.0.2") == 1);
+
+  /* An update crossing the unregistration is ignored. */
+  nexthop_update ("10.0.0.2", "192.168.0.1", 10);
+
+  /* A new path starts afresh. */
+  update (ibgp, "10.1.0.0/16", "10.0.0.2");
+  EXPECT (sent (ZEBRA_NEXTHOP_REGISTER, "10.0.0.2") == 1);
+  ri = route (ibgp, "10.1.0.0/16");
+  EXPECT (ri && ri->nexthop && ri->nexthop->path_count == 1);
+  EXPECT (! valid (ri));
+}
+
+static struct test
+{
+  const char *name;
+  const char *desc;
+  void (*func) (void);
+} tests[] =
+{
+  { "register", "Paths share a registered nexthop", test_register },
+  { "reachable", "Nexthop unreachable and back", test_reachable },
+  { "onlink", "Single-hop EBGP nexthop on a connected network",
+    test_onlink },
+  { "free", "Freed paths unlink from the nexthop", test_free },
+  { NULL, NULL, NULL },
+};
+
+int
+main (void)
+{
+  struct test *t;
+  struct interface *ifp;
+  int sv[2];
+  as_t as = 65000;
+  int oldfailed;
+
+  bgp_master_init ();
+  master = bm->master;
+  cmd_init (1);
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_option_set (BGP_OPT_NO_FIB);
+  bgp_init ();
+
+  /* Zebra is connected: one end of the pair is the client's. */
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    return 1;
+  set_nonblocking (sv[1]);
+  zclient->sock = sv[0];
+  zlookup->sock = sv[0];
+  zebra = sv[1];
+
+  if (bgp_get (&bgp, &as, NULL))
+    return 1;
+  ibgp = add_peer ("10.0.0.2", 65000, BGP_PEER_IBGP);
+  ebgp = add_peer ("10.0.0.3", 65001, BGP_PEER_EBGP);
+
+  /* 10.0.0.0/24 is connected. */
+  ifp = if_create ("eth0", strlen ("eth0"));
+  ifc = connected_new ();
+  ifc->ifp = ifp;
+  ifc->address = prefix_new ();
+  str2prefix ("10.0.0.1/24", ifc->address);
+  bgp_connected_add (ifc);
+
+  if (fileno (stdout) >= 0)
+    tty = isatty (fileno (stdout));
+
+  for (t = tests; t->name; t++)
+    {
+      printf ("%s: %s\n", t->name, t->desc);
+      oldfailed = failed;
+      t->func ();
+
+      if (tty)
+	printf ("%s", (failed > oldfailed) ? VT100_RED "failed!" VT100_RESET
+					   : VT100_GREEN "OK" VT100_RESET);
+      else
+	printf ("%s", (failed > oldfailed) ? "failed!" : "OK");
+      printf ("\n\n");
+    }
+
+  printf ("failures: %d\n", failed);
+  return failed;
+}
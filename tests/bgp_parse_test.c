@@ -0,0 +1,345 @@
+/*
+ * Tests for the UPDATE pre-parser.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "stream.h"
+#include "privs.h"
+#include "memory.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_community.h"
+#include "bgpd/bgp_debug.h"
+#include "bgpd/bgp_parse.h"
+
+#define VT100_RESET "\x1b[0m"
+#define VT100_RED "\x1b[31m"
+#define VT100_GREEN "\x1b[32m"
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+static int failed = 0;
+static int tty = 0;
+
+/* UPDATE bodies, after the header, and what should come of them. */
+static struct test_segment {
+  const char *name;
+  const char *desc;
+  const u_char data[1024];
+  int len;
+  int as4;
+#define SHOULD_PARSE	0
+#define SHOULD_ERR	-1
+  int parses;
+  /* Prefixes in withdrawn, NLRI, MP_REACH and MP_UNREACH. */
+  int count[BGP_PARSED_NLRI_MAX];
+} test_segments [] =
+{
+  { "eor",
+    "End-of-RIB marker",
+    { 0x0, 0x0, 0x0, 0x0 },
+    4, 0, SHOULD_PARSE, { 0, 0, 0, 0 },
+  },
+  { "withdraw",
+    "Withdrawn routes only",
+    { 0x0, 0x6,
+        24, 10, 0, 1,
+        8, 11,
+      0x0, 0x0 },
+    10, 0, SHOULD_PARSE, { 2, 0, 0, 0 },
+  },
+  { "update",
+    "ORIGIN, AS_PATH, NEXT_HOP, COMMUNITIES and 3 NLRI",
+    { 0x0, 0x0,
+      0x0, 39,
+        0x40, BGP_ATTR_ORIGIN, 1, BGP_ORIGIN_IGP,
+        0x40, BGP_ATTR_AS_PATH, 10,
+          AS_SEQUENCE, 2, 0x0, 0x1, 0x0, 0x2,
+          AS_SET, 1, 0x0, 0x3,
+        0x40, BGP_ATTR_NEXT_HOP, 4, 192, 168, 0, 1,
+        0xc0, BGP_ATTR_COMMUNITIES, 12,
+          0x0, 0x2, 0x0, 0x1,
+          0x0, 0x1, 0x0, 0x2,
+          0x0, 0x2, 0x0, 0x1,
+      24, 10, 1, 1,
+      16, 10, 2,
+      0 },
+    51, 0, SHOULD_PARSE, { 0, 3, 0, 0 },
+  },
+  { "as4",
+    "4-octet AS_PATH from an AS4 speaker",
+    { 0x0, 0x0,
+      0x0, 17,
+        0x40, BGP_ATTR_ORIGIN, 1, BGP_ORIGIN_IGP,
+        0x40, BGP_ATTR_AS_PATH, 10,
+          AS_SEQUENCE, 2, 0x0, 0x1, 0x0, 0x1, 0x0, 0x0, 0xfa, 0x56,
+      32, 10, 0, 0, 1 },
+    26, 1, SHOULD_PARSE, { 0, 1, 0, 0 },
+  },
+  { "mp",
+    "IPv6 MP_REACH and MP_UNREACH",
+    { 0x0, 0x0,
+      0x0, 50,
+        0x40, BGP_ATTR_ORIGIN, 1, BGP_ORIGIN_IGP,
+        0x40, BGP_ATTR_AS_PATH, 0,
+        0x80, BGP_ATTR_MP_REACH_NLRI, 27,
+          0x0, AFI_IP6, SAFI_UNICAST, 16,
+          0xff, 0xfe, 0x1, 0x2, 0xaa, 0xbb, 0xcc, 0xdd,
+          0x3,  0x4,  0x5, 0x6, 0xa1, 0xa2, 0xa3, 0xa4,
+          0x0,
+          32, 0xff, 0xfe, 0x1, 0x2,
+          0,
+        0x80, BGP_ATTR_MP_UNREACH_NLRI, 10,
+          0x0, AFI_IP6, SAFI_UNICAST,
+          48, 0x20, 0x01, 0x0d, 0xb8, 0x0, 0x1 },
+    54, 0, SHOULD_PARSE, { 0, 0, 2, 1 },
+  },
+  { "vpn",
+    "MPLS-labeled VPN NLRI is left alone",
+    { 0x0, 0x0,
+      0x0, 35,
+        0x80, BGP_ATTR_MP_REACH_NLRI, 32,
+          0x0, AFI_IP, SAFI_MPLS_LABELED_VPN, 12,
+          0, 0, 0, 0, 0, 0, 0, 0, 192, 168, 0, 1,
+          0x0,
+          112, 0x0, 0x0, 0x11, 0x0, 0x0, 0x0, 0x64, 0x0, 0x0, 0x0, 0x1,
+          10, 1, 0 },
+    39, 0, SHOULD_PARSE, { 0, 0, 0, 0 },
+  },
+  { "withdraw-len",
+    "Withdrawn routes length overflow",
+    { 0x0, 0x8,
+        24, 10, 0, 1,
+      0x0, 0x0 },
+    8, 0, SHOULD_ERR, { 0 },
+  },
+  { "nlri-bitlen",
+    "NLRI prefix length over 32",
+    { 0x0, 0x0,
+      0x0, 0x0,
+      33, 10, 0, 0, 1, 0 },
+    10, 0, SHOULD_ERR, { 0 },
+  },
+  { "attr-dup",
+    "Attribute present twice",
+    { 0x0, 0x0,
+      0x0, 8,
+        0x40, BGP_ATTR_ORIGIN, 1, BGP_ORIGIN_IGP,
+        0x40, BGP_ATTR_ORIGIN, 1, BGP_ORIGIN_IGP,
+      8, 10 },
+    14, 0, SHOULD_ERR, { 0 },
+  },
+  { "attr-len",
+    "Attribute length past the attributes",
+    { 0x0, 0x0,
+      0x0, 4,
+        0x40, BGP_ATTR_ORIGIN, 2, BGP_ORIGIN_IGP,
+      8, 10 },
+    10, 0, SHOULD_ERR, { 0 },
+  },
+  { "aspath-seg",
+    "AS_PATH segment of length 0",
+    { 0x0, 0x0,
+      0x0, 7,
+        0x40, BGP_ATTR_AS_PATH, 4,
+          AS_SEQUENCE, 0, 0x0, 0x1,
+      8, 10 },
+    13, 0, SHOULD_ERR, { 0 },
+  },
+  { "community-len",
+    "COMMUNITIES not a multiple of 4",
+    { 0x0, 0x0,
+      0x0, 6,
+        0xc0, BGP_ATTR_COMMUNITIES, 3, 0x0, 0x1, 0x0,
+      8, 10 },
+    12, 0, SHOULD_ERR, { 0 },
+  },
+  { "mp-nhlen",
+    "MP_REACH with an invalid nexthop length",
+    { 0x0, 0x0,
+      0x0, 13,
+        0x80, BGP_ATTR_MP_REACH_NLRI, 10,
+          0x0, AFI_IP, SAFI_UNICAST, 5,
+          192, 168, 0, 1, 1,
+          0x0 },
+    17, 0, SHOULD_ERR, { 0 },
+  },
+  { NULL, NULL, {0}, 0, 0, 0, { 0 } }
+};
+
+/* Parse the attributes of the message in peer's input, with or without
+   help from the pre-parser, and return the AS path and communities. */
+static int
+attr_test (struct peer *peer, size_t len, struct bgp_update_parsed *up,
+	   struct aspath **aspath, struct community **community)
+{
+  struct attr attr;
+  struct bgp_nlri mp_update, mp_withdraw;
+  size_t withdraw_len, attr_len;
+  int ret;
+
+  memset (&attr, 0, sizeof (attr));
+  memset (&mp_update, 0, sizeof (mp_update));
+  memset (&mp_withdraw, 0, sizeof (mp_withdraw));
+
+  withdraw_len = stream_getw_from (peer->ibuf, BGP_HEADER_SIZE);
+  attr_len = stream_getw_from (peer->ibuf, BGP_HEADER_SIZE + 2 + withdraw_len);
+  stream_set_getp (peer->ibuf, BGP_HEADER_SIZE + 4 + withdraw_len);
+
+  peer->parsed = up;
+  ret = bgp_attr_parse (peer, &attr, attr_len, &mp_update, &mp_withdraw);
+  peer->parsed = NULL;
+
+  *aspath = attr.aspath;
+  *community = attr.community;
+  if (attr.aspath)
+    attr.aspath->refcnt++;
+  if (attr.community)
+    attr.community->refcnt++;
+  bgp_attr_unintern_sub (&attr);
+  return ret;
+}
+
+static void
+parse_test (struct peer *peer, struct test_segment *t)
+{
+  struct bgp_update_parsed *up;
+  struct aspath *as1, *as2;
+  struct community *com1, *com2;
+  int oldfailed = failed;
+  size_t len = BGP_HEADER_SIZE + t->len;
+  int i;
+
+  stream_reset (peer->ibuf);
+  for (i = 0; i < BGP_MARKER_SIZE; i++)
+    stream_putc (peer->ibuf, 0xff);
+  stream_putw (peer->ibuf, 0);
+  stream_putc (peer->ibuf, BGP_MSG_UPDATE);
+  stream_write (peer->ibuf, t->data, t->len);
+  stream_putw_at (peer->ibuf, BGP_MARKER_SIZE, len);
+
+  printf ("%s: %s\n", t->name, t->desc);
+
+  if (t->as4)
+    SET_FLAG (peer->cap, PEER_CAP_AS4_RCV);
+  else
+    UNSET_FLAG (peer->cap, PEER_CAP_AS4_RCV);
+
+  up = bgp_update_preparse (STREAM_DATA (peer->ibuf), len, t->as4);
+  printf ("parsed?: %s\n", up ? "yes" : "no");
+
+  if ((up != NULL) != (t->parses == SHOULD_PARSE))
+    failed++;
+
+  if (up)
+    {
+      for (i = 0; i < BGP_PARSED_NLRI_MAX; i++)
+	if (up->nlri[i].count != t->count[i])
+	  {
+	    printf ("NLRI field %d: %d prefixes, expected %d\n",
+		    i, up->nlri[i].count, t->count[i]);
+	    failed++;
+	  }
+
+      /* The main thread must come to the same interned result. */
+      if (attr_test (peer, len, NULL, &as1, &com1)
+	  != attr_test (peer, len, up, &as2, &com2))
+	failed++;
+      if (as1 != as2 || com1 != com2)
+	{
+	  printf ("AS path %s / %s, communities %s / %s\n",
+		  as1 ? aspath_print (as1) : "-",
+		  as2 ? aspath_print (as2) : "-",
+		  com1 ? community_str (com1) : "-",
+		  com2 ? community_str (com2) : "-");
+	  failed++;
+	}
+      if (as1)
+	printf ("AS path: %s\n", aspath_print (as1));
+      if (com1)
+	printf ("communities: %s\n", community_str (com1));
+
+      if (as1)
+	aspath_unintern (&as1);
+      if (as2)
+	aspath_unintern (&as2);
+      if (com1)
+	community_unintern (&com1);
+      if (com2)
+	community_unintern (&com2);
+      bgp_update_parsed_free (up);
+    }
+
+  if (tty)
+    printf ("%s", (failed > oldfailed) ? VT100_RED "failed!" VT100_RESET
+                                         : VT100_GREEN "OK" VT100_RESET);
+  else
+    printf ("%s", (failed > oldfailed) ? "failed!" : "OK" );
+
+  if (failed)
+    printf (" (%u)", failed);
+
+  printf ("\n\n");
+}
+
+static struct bgp *bgp;
+static as_t asn = 100;
+
+int
+main (void)
+{
+  struct peer *peer;
+  int i, j;
+
+  master = thread_master_create ();
+  bgp_master_init ();
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_attr_init ();
+
+  if (fileno (stdout) >= 0)
+    tty = isatty (fileno (stdout));
+
+  if (bgp_get (&bgp, &asn, NULL))
+    return -1;
+
+  peer = peer_create_accept (bgp);
+  peer->host = (char *) "foo";
+  peer->status = Established;
+
+  for (i = AFI_IP; i < AFI_MAX; i++)
+    for (j = SAFI_UNICAST; j < SAFI_MAX; j++)
+      {
+        peer->afc[i][j] = 1;
+        peer->afc_adv[i][j] = 1;
+      }
+
+  i = 0;
+  while (test_segments[i].name)
+    parse_test (peer, &test_segments[i++]);
+
+  printf ("failures: %d\n", failed);
+  return failed;
+}
@@ -0,0 +1,402 @@
+/*
+ * Route-map result cache tests.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "vector.h"
+#include "buffer.h"
+#include "command.h"
+#include "prefix.h"
+#include "privs.h"
+#include "memory.h"
+#include "routemap.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_community.h"
+#include "bgpd/bgp_route.h"
+
+#define VT100_RESET "\x1b[0m"
+#define VT100_RED "\x1b[31m"
+#define VT100_GREEN "\x1b[32m"
+
+/* need these to link in libbgp */
+struct zebra_privs_t bgpd_privs =
+{
+  .user = NULL,
+  .group = NULL,
+  .vty_group = NULL,
+};
+struct thread_master *master = NULL;
+
+static int failed = 0;
+static int tty = 0;
+static struct vty *vty;
+
+#define EXPECT(expr)							\
+  do {									\
+    if (! (expr))							\
+      {									\
+	printf ("%s line %u: %s\n", __FUNCTION__, __LINE__, #expr);	\
+	failed++;							\
+      }									\
+  } while (0)
+
+/* Configure as from the vty, in node. */
+static void
+run (int node, const char *line)
+{
+  vector vline;
+  int ret;
+
+  vline = cmd_make_strvec (line);
+  vty->node = node;
+  ret = cmd_execute_command (vline, vty, NULL, 0);
+  cmd_free_strvec (vline);
+  buffer_reset (vty->obuf);
+
+  if (ret != CMD_SUCCESS)
+    {
+      printf ("'%s' failed: %d\n", line, ret);
+      failed++;
+    }
+}
+
+#define config(line)	run (CONFIG_NODE, (line))
+#define rmap(line)	run (RMAP_NODE, (line))
+
+/* An interned attribute, as an UPDATE's attributes are keyed.  Its
+   parts are interned first, as the parser does. */
+static struct attr *
+make_attr (const char *com, u_int32_t med)
+{
+  struct attr attr;
+  struct attr *new;
+
+  memset (&attr, 0, sizeof (attr));
+  attr.origin = BGP_ORIGIN_IGP;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_ORIGIN);
+  attr.aspath = aspath_empty ();
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_AS_PATH);
+  attr.nexthop.s_addr = inet_addr ("10.0.0.1");
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_NEXT_HOP);
+  attr.med = med;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC);
+  if (com)
+    {
+      attr.community = community_intern (community_str2com (com));
+      attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_COMMUNITIES);
+    }
+
+  new = bgp_attr_intern (&attr);
+  bgp_attr_unintern_sub (&attr);
+  return new;
+}
+
+/* Whether the route-map permits a copy of key for prefix, with the
+   results remembered for key.  It must come out as it does uncached. */
+static int
+permits (const char *name, const char *prefix, struct attr *key)
+{
+  struct route_map *map;
+  struct prefix p;
+  struct bgp_info info;
+  struct attr attr, ref;
+  struct attr_extra extra, ref_extra;
+  route_map_result_t ret, ref_ret;
+
+  map = route_map_lookup_by_name (name);
+  str2prefix (prefix, &p);
+  memset (&info, 0, sizeof (info));
+
+  attr.extra = &extra;
+  bgp_attr_dup (&attr, key);
+  info.attr = &attr;
+  ret = route_map_apply_cached (map, &p, RMAP_BGP, &info, key);
+
+  ref.extra = &ref_extra;
+  bgp_attr_dup (&ref, key);
+  info.attr = &ref;
+  ref_ret = route_map_apply (map, &p, RMAP_BGP, &info);
+
+  if (ret != ref_ret || attr.med != ref.med
+      || ! community_cmp (attr.community, ref.community))
+    {
+      printf ("%s %s: %d, med %u, communities %s, but uncached "
+	      "%d, med %u, communities %s\n", name, prefix,
+	      ret, attr.med, community_str (attr.community),
+	      ref_ret, ref.med, community_str (ref.community));
+      failed++;
+    }
+
+  bgp_attr_flush (&attr);
+  bgp_attr_flush (&ref);
+  return ret != RMAP_DENYMATCH;
+}
+
+static struct route_map_index *
+first_index (const char *name)
+{
+  return route_map_lookup_by_name (name)->head;
+}
+
+static void
+test_hit (void)
+{
+  struct attr *attr;
+  struct route_map_index *index;
+
+  config ("ip community-list 1 permit 100:1");
+  config ("route-map HIT permit 10");
+  rmap ("match community 1");
+  index = first_index ("HIT");
+  attr = make_attr ("100:1", 0);
+
+  EXPECT (permits ("HIT", "10.1.0.0/16", attr));
+  EXPECT (index->cache_miss == 1 && index->cache_hit == 0);
+  EXPECT (permits ("HIT", "10.2.0.0/16", attr));
+  EXPECT (permits ("HIT", "10.3.0.0/16", attr));
+  EXPECT (index->cache_miss == 1 && index->cache_hit == 2);
+
+  bgp_attr_unintern (&attr);
+  config ("no route-map HIT");
+  config ("no ip community-list 1");
+}
+
+static void
+test_route_map (void)
+{
+  struct attr *attr;
+
+  config ("route-map RM permit 10");
+  rmap ("match metric 5");
+  attr = make_attr (NULL, 5);
+  EXPECT (permits ("RM", "10.1.0.0/16", attr));
+
+  /* A changed match. */
+  config ("route-map RM permit 10");
+  rmap ("match metric 6");
+  EXPECT (! permits ("RM", "10.1.0.0/16", attr));
+
+  config ("route-map RM permit 10");
+  rmap ("no match metric");
+  EXPECT (permits ("RM", "10.1.0.0/16", attr));
+
+  /* An entry in front. */
+  config ("route-map RM deny 5");
+  rmap ("match metric 5");
+  EXPECT (! permits ("RM", "10.1.0.0/16", attr));
+
+  config ("no route-map RM deny 5");
+  EXPECT (permits ("RM", "10.1.0.0/16", attr));
+
+  bgp_attr_unintern (&attr);
+  config ("no route-map RM");
+}
+
+static void
+test_access_list (void)
+{
+  struct attr *attr;
+
+  config ("access-list 1 permit 10.0.0.1");
+  config ("route-map AL permit 10");
+  rmap ("match ip next-hop 1");
+  attr = make_attr (NULL, 0);
+  EXPECT (permits ("AL", "10.1.0.0/16", attr));
+
+  config ("no access-list 1 permit 10.0.0.1");
+  EXPECT (! permits ("AL", "10.1.0.0/16", attr));
+
+  config ("access-list 1 permit 10.0.0.1");
+  EXPECT (permits ("AL", "10.1.0.0/16", attr));
+
+  bgp_attr_unintern (&attr);
+  config ("no route-map AL");
+  config ("no access-list 1");
+}
+
+static void
+test_prefix_list (void)
+{
+  struct attr *attr;
+
+  config ("ip prefix-list PL seq 10 permit 10.0.0.1/32");
+  config ("route-map PL permit 10");
+  rmap ("match ip next-hop prefix-list PL");
+  attr = make_attr (NULL, 0);
+  EXPECT (permits ("PL", "10.1.0.0/16", attr));
+
+  config ("ip prefix-list PL seq 5 deny 10.0.0.0/8 le 32");
+  EXPECT (! permits ("PL", "10.1.0.0/16", attr));
+
+  config ("no ip prefix-list PL seq 5 deny 10.0.0.0/8 le 32");
+  EXPECT (permits ("PL", "10.1.0.0/16", attr));
+
+  bgp_attr_unintern (&attr);
+  config ("no route-map PL");
+  config ("no ip prefix-list PL");
+}
+
+static void
+test_community_list (void)
+{
+  struct attr *attr;
+
+  config ("ip community-list 1 permit 100:1");
+  config ("route-map CL permit 10");
+  rmap ("match community 1");
+  attr = make_attr ("100:1", 0);
+  EXPECT (permits ("CL", "10.1.0.0/16", attr));
+
+  config ("ip community-list 1 permit 200:1");
+  config ("no ip community-list 1 permit 100:1");
+  EXPECT (! permits ("CL", "10.1.0.0/16", attr));
+
+  config ("ip community-list 1 permit 100:1");
+  EXPECT (permits ("CL", "10.1.0.0/16", attr));
+
+  bgp_attr_unintern (&attr);
+  config ("no route-map CL");
+  config ("no ip community-list 1");
+}
+
+/* An attr freed by bgp_attr_unintern and another allocated in its
+   place must not get the results of the first. */
+static void
+test_forget (void)
+{
+  struct attr *attr, *old;
+  struct route_map_index *index;
+
+  config ("ip community-list 1 permit 100:1");
+  config ("route-map FG permit 10");
+  rmap ("match community 1");
+  index = first_index ("FG");
+
+  attr = make_attr ("100:1", 0);
+  EXPECT (permits ("FG", "10.1.0.0/16", attr));
+  EXPECT (index->cache_miss == 1);
+
+  old = attr;
+  bgp_attr_unintern (&attr);
+  attr = make_attr ("200:1", 0);
+  printf ("attr reused: %s\n", attr == old ? "yes" : "no");
+
+  EXPECT (! permits ("FG", "10.1.0.0/16", attr));
+  EXPECT (index->cache_miss == 2 && index->cache_hit == 0);
+
+  bgp_attr_unintern (&attr);
+  config ("no route-map FG");
+  config ("no ip community-list 1");
+}
+
+/* Once an entry's set clauses change the attr, what was remembered for
+   the key no longer holds for the rest of the route-map. */
+static void
+test_set (void)
+{
+  struct attr *attr;
+  struct route_map_index *index;
+
+  config ("ip prefix-list TAG seq 5 permit 10.1.0.0/16");
+  config ("ip community-list 1 permit 100:1");
+  config ("ip community-list 2 permit 200:1");
+
+  /* Tags routes in TAG with 200:1, then denies what is tagged, so a
+     key first seen untagged must still be denied once tagged. */
+  config ("route-map SET permit 10");
+  rmap ("match ip address prefix-list TAG");
+  rmap ("set community 200:1 additive");
+  rmap ("on-match next");
+  config ("route-map SET deny 20");
+  rmap ("match community 2");
+  config ("route-map SET permit 30");
+  rmap ("match community 1");
+  rmap ("set metric 7");
+  index = first_index ("SET")->next;
+
+  attr = make_attr ("100:1", 0);
+  EXPECT (permits ("SET", "10.2.0.0/16", attr));
+  EXPECT (! permits ("SET", "10.1.0.0/16", attr));
+  EXPECT (permits ("SET", "10.2.0.0/16", attr));
+  EXPECT (! permits ("SET", "10.1.0.0/16", attr));
+  EXPECT (index->cache_miss == 1 && index->cache_hit == 1);
+
+  bgp_attr_unintern (&attr);
+  config ("no route-map SET");
+  config ("no ip community-list 1");
+  config ("no ip community-list 2");
+  config ("no ip prefix-list TAG");
+}
+
+static struct test
+{
+  const char *name;
+  const char *desc;
+  void (*func) (void);
+} tests[] =
+{
+  { "hit", "Repeated apply takes the remembered matches", test_hit },
+  { "route-map", "Route-map change", test_route_map },
+  { "access-list", "Access-list change", test_access_list },
+  { "prefix-list", "Prefix-list change", test_prefix_list },
+  { "community-list", "Community-list change", test_community_list },
+  { "forget", "Freed attr is forgotten", test_forget },
+  { "set", "Set clauses change the attr", test_set },
+  { NULL, NULL, NULL },
+};
+
+int
+main (void)
+{
+  struct test *t;
+  int oldfailed;
+
+  master = thread_master_create ();
+  cmd_init (1);
+  vty = vty_new ();
+  bgp_master_init ();
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_init ();
+
+  if (fileno (stdout) >= 0)
+    tty = isatty (fileno (stdout));
+
+  for (t = tests; t->name; t++)
+    {
+      printf ("%s: %s\n", t->name, t->desc);
+      oldfailed = failed;
+      t->func ();
+
+      if (tty)
+	printf ("%s", (failed > oldfailed) ? VT100_RED "failed!" VT100_RESET
+					   : VT100_GREEN "OK" VT100_RESET);
+      else
+	printf ("%s", (failed > oldfailed) ? "failed!" : "OK");
+      printf ("\n\n");
+    }
+
+  printf ("failures: %d\n", failed);
+  return failed;
+}
@@ -25,6 +25,7 @@
 
 #include "prefix.h"
 #include "table.h"
+#include "memory.h"
 
 /*
  * test_node_t
@@ -534,6 +535,165 @@ test_iter_pause (void)
   route_table_finish (table);
 }
 
+/*
+ * Delegates for tables that never and always use the index.
+ */
+static struct route_node *
+test_node_create (route_table_delegate_t *delegate, struct route_table *table)
+{
+  return XCALLOC (MTYPE_ROUTE_NODE, sizeof (struct route_node));
+}
+
+static void
+test_node_destroy (route_table_delegate_t *delegate,
+		   struct route_table *table, struct route_node *node)
+{
+  XFREE (MTYPE_ROUTE_NODE, node);
+}
+
+static route_table_delegate_t plain_delegate = {
+  .create_node = test_node_create,
+  .destroy_node = test_node_destroy,
+  .index_threshold = 0
+};
+
+static route_table_delegate_t indexed_delegate = {
+  .create_node = test_node_create,
+  .destroy_node = test_node_destroy,
+  .index_threshold = 1
+};
+
+/*
+ * random_prefix
+ *
+ * Prefixes of all lengths below a few /14s, so that they nest and
+ * straddle the indexed bits.
+ */
+static void
+random_prefix (struct prefix_ipv4 *p, int maxlen)
+{
+  memset (p, 0, sizeof (*p));
+  p->family = AF_INET;
+  p->prefixlen = random () % (maxlen + 1);
+  p->prefix.s_addr = htonl ((10 << 24) | ((random () % 4) << 18)
+			    | (random () & 0x3ffff));
+  apply_mask_ipv4 (p);
+}
+
+/*
+ * same_node
+ *
+ * Whether two nodes of different tables are for the same prefix.
+ */
+static int
+same_node (struct route_node *rn1, struct route_node *rn2)
+{
+  if (rn1)
+    route_unlock_node (rn1);
+  if (rn2)
+    route_unlock_node (rn2);
+  if (! rn1 || ! rn2)
+    return rn1 == rn2;
+  return prefix_same (&rn1->p, &rn2->p);
+}
+
+/*
+ * verify_index
+ *
+ * Checks lookups and iteration on an indexed table against a plain one
+ * holding the same prefixes.
+ */
+static void
+verify_index (struct route_table *plain, struct route_table *indexed)
+{
+  struct route_node *rn1, *rn2;
+  struct prefix_ipv4 p;
+  int i;
+
+  assert (indexed->index);
+  assert (route_table_count (plain) == route_table_count (indexed));
+
+  for (i = 0; i < 20000; i++)
+    {
+      random_prefix (&p, 32);
+      assert (same_node (route_node_match (plain, (struct prefix *) &p),
+			 route_node_match (indexed, (struct prefix *) &p)));
+      assert (same_node (route_node_lookup (plain, (struct prefix *) &p),
+			 route_node_lookup (indexed, (struct prefix *) &p)));
+    }
+
+  for (rn1 = route_top (plain), rn2 = route_top (indexed); rn1 && rn2;
+       rn1 = route_next (rn1), rn2 = route_next (rn2))
+    assert (prefix_same (&rn1->p, &rn2->p) && ! rn1->info == ! rn2->info);
+  assert (! rn1 && ! rn2);
+}
+
+/*
+ * test_index
+ */
+static void
+test_index (void)
+{
+  struct route_table *plain, *indexed;
+  struct route_node *rn;
+  struct prefix_ipv4 p;
+  char buf[BUFSIZ];
+  int i;
+
+  printf ("\n\nTesting lookups through the index of a table\n");
+  srandom (1);
+  plain = route_table_init_with_delegate (&plain_delegate);
+  indexed = route_table_init_with_delegate (&indexed_delegate);
+
+  for (i = 0; i < 5000; i++)
+    {
+      random_prefix (&p, 28);
+      rn = route_node_lookup (plain, (struct prefix *) &p);
+      if (rn)
+	{
+	  route_unlock_node (rn);
+	  continue;
+	}
+      prefix2str ((struct prefix *) &p, buf, sizeof (buf));
+      add_node (plain, buf);
+      add_node (indexed, buf);
+    }
+  verify_index (plain, indexed);
+
+  /* Take out about half, which takes internal nodes with them. */
+  for (i = 0; i < 20000; i++)
+    {
+      random_prefix (&p, 28);
+      if (random () % 2)
+	continue;
+      rn = route_node_lookup (plain, (struct prefix *) &p);
+      if (! rn)
+	continue;
+      route_unlock_node (rn);
+
+      rn = route_node_lookup (indexed, (struct prefix *) &p);
+      free (((test_node_t *) rn->info)->prefix_str);
+      free (rn->info);
+      rn->info = NULL;
+      route_unlock_node (rn);
+      route_unlock_node (rn);
+
+      rn = route_node_lookup (plain, (struct prefix *) &p);
+      free (((test_node_t *) rn->info)->prefix_str);
+      free (rn->info);
+      rn->info = NULL;
+      route_unlock_node (rn);
+      route_unlock_node (rn);
+    }
+  verify_index (plain, indexed);
+
+  clear_table (plain);
+  clear_table (indexed);
+  route_table_finish (plain);
+  route_table_finish (indexed);
+  printf ("Verified lookups through the index\n");
+}
+
 /*
  * run_tests
  */
@@ -543,6 +703,7 @@ run_tests (void)
   test_prefix_iter_cmp ();
   test_get_next ();
   test_iter_pause ();
+  test_index ();
 }
 
 /*
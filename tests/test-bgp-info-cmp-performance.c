@@ -0,0 +1,172 @@
+/*
+ * Test program which measures how long the BGP decision process takes
+ * to compare two candidate paths, over paths and attributes spread
+ * through more memory than the caches hold.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "thread.h"
+#include "memory.h"
+#include "prefix.h"
+#include "sockunion.h"
+#include "privs.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_route.h"
+
+#define PEERS		16
+#define ATTRS		100000
+#define PATHS		1000000
+#define COMPARISONS	10000000
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+static struct bgp *bgp;
+static as_t asn = 65000;
+static struct peer *peers[PEERS];
+static struct attr *attrs[ATTRS];
+static struct bgp_info *paths[PATHS];
+
+/* Half the peers internal, the others each of their own AS. */
+static void
+add_peer (int i)
+{
+  struct peer *peer;
+  char buf[32];
+
+  peer = peers[i] = peer_create_accept (bgp);
+  peer->host = (char *) "bench";
+  peer->as = (i < PEERS / 2) ? asn : 65001 + i;
+  peer->sort = (i < PEERS / 2) ? BGP_PEER_IBGP : BGP_PEER_EBGP;
+  peer->remote_id.s_addr = htonl (0x0a000001 + i);
+  snprintf (buf, sizeof (buf), "10.0.0.%d", i + 1);
+  peer->su_remote = sockunion_str2su (buf);
+}
+
+/* Attributes which mostly tie on weight and local preference, so the
+   comparisons go on to the AS path, origin and MED, and some which
+   were reflected, with an originator. */
+static struct attr *
+make_attr (int i)
+{
+  struct attr attr;
+  struct attr_extra *ae;
+  struct attr *new;
+  char buf[128];
+  int len, j;
+
+  bgp_attr_default_set (&attr, i % 3 ? BGP_ORIGIN_IGP : BGP_ORIGIN_EGP);
+  aspath_unintern (&attr.aspath);
+  len = snprintf (buf, sizeof (buf), "%d", 64512 + i % 8);
+  for (j = 0; j < i % 5; j++)
+    len += snprintf (buf + len, sizeof (buf) - len, " %d",
+		     1 + (i * 7 + j) % 60000);
+  attr.aspath = aspath_intern (aspath_str2aspath (buf));
+
+  attr.med = (i / 5) % 4;
+  attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC);
+  if (i % 16 == 0)
+    {
+      attr.local_pref = 200;
+      attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_LOCAL_PREF);
+    }
+  attr.nexthop.s_addr = htonl (0xc0000200 + i % 250);
+
+  ae = attr.extra;
+  ae->weight = (i % 64 == 0) ? 100 : 0;
+  if (i % 4 == 0)
+    {
+      ae->originator_id.s_addr = htonl (0x0a010000 + i % 1000);
+      attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID);
+    }
+
+  new = bgp_attr_intern (&attr);
+  aspath_unintern (&attr.aspath);
+  bgp_attr_extra_free (&attr);
+  return new;
+}
+
+static unsigned int
+prng (unsigned int *state)
+{
+  *state = *state * 1103515245 + 12345;
+  return *state >> 8;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct timeval start, stop;
+  unsigned int seed = 1;
+  unsigned long comparisons = COMPARISONS;
+  unsigned long i, won = 0;
+  unsigned long us;
+  int paths_eq;
+
+  if (argc > 1)
+    comparisons = atol (argv[1]);
+
+  bgp_master_init ();
+  master = bm->master;
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_option_set (BGP_OPT_NO_FIB);
+  bgp_attr_init ();
+
+  if (bgp_get (&bgp, &asn, NULL))
+    return 1;
+  bgp_flag_set (bgp, BGP_FLAG_MED_CONFED);
+  for (i = 0; i < PEERS; i++)
+    add_peer (i);
+
+  for (i = 0; i < ATTRS; i++)
+    attrs[i] = make_attr (i);
+
+  for (i = 0; i < PATHS; i++)
+    {
+      struct bgp_info *ri = XCALLOC (MTYPE_BGP_ROUTE, sizeof (struct bgp_info));
+
+      ri->type = ZEBRA_ROUTE_BGP;
+      ri->sub_type = BGP_ROUTE_NORMAL;
+      ri->peer = peers[prng (&seed) % PEERS];
+      ri->attr = bgp_attr_intern (attrs[prng (&seed) % ATTRS]);
+      paths[i] = ri;
+    }
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  for (i = 0; i < comparisons; i++)
+    won += bgp_info_cmp (bgp, paths[prng (&seed) % PATHS],
+			 paths[prng (&seed) % PATHS], &paths_eq);
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &stop);
+  us = timeval_elapsed (stop, start);
+
+  printf ("%lu comparisons of %d paths with %d attributes\n",
+	  comparisons, PATHS, ATTRS);
+  printf ("%lu won, %lu us, %lu ns per comparison\n",
+	  won, us, us * 1000 / (comparisons ? comparisons : 1));
+
+  return 0;
+}
@@ -0,0 +1,240 @@
+/*
+ * Test program which measures the time the BGP process queue takes to
+ * select the best paths of a full table, for several numbers of best
+ * path threads, and checks that they all select the same.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "thread.h"
+#include "memory.h"
+#include "prefix.h"
+#include "sockunion.h"
+#include "workqueue.h"
+#include "privs.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_select.h"
+
+#define PREFIXES	100000
+#define PEERS		8
+#define VARIANTS	20
+
+/* need these to link in libbgp */
+struct zebra_privs_t *bgpd_privs = NULL;
+struct thread_master *master = NULL;
+
+static struct bgp *bgp;
+static as_t asn = 65000;
+static struct peer *peers[PEERS];
+static struct attr *attrs[PEERS][VARIANTS];
+
+/* A peer of its own AS, with attributes that differ in AS path length
+   and MED, so the comparisons go some way down the decision process. */
+static void
+add_peer (int i)
+{
+  struct peer *peer;
+  struct attr attr;
+  char buf[128];
+  int v, j;
+
+  peer = peers[i] = peer_create_accept (bgp);
+  peer->host = (char *) "bench";
+  peer->as = 65001 + i;
+  peer->sort = BGP_PEER_EBGP;
+  peer->remote_id.s_addr = htonl (0x0a000001 + i);
+  snprintf (buf, sizeof (buf), "10.0.0.%d", i + 1);
+  peer->su_remote = sockunion_str2su (buf);
+
+  for (v = 0; v < VARIANTS; v++)
+    {
+      int len = snprintf (buf, sizeof (buf), "%u", peer->as);
+
+      for (j = 0; j < v % 4; j++)
+	len += snprintf (buf + len, sizeof (buf) - len, " %d", 100 + j);
+
+      bgp_attr_default_set (&attr, BGP_ORIGIN_IGP);
+      aspath_unintern (&attr.aspath);
+      attr.aspath = aspath_intern (aspath_str2aspath (buf));
+      attr.med = v / 4;
+      attr.flag |= ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC);
+      attr.nexthop.s_addr = peer->remote_id.s_addr;
+      attrs[i][v] = bgp_attr_intern (&attr);
+      aspath_unintern (&attr.aspath);
+      bgp_attr_extra_free (&attr);
+    }
+}
+
+/* Each peer sends every prefix, as the table is learned first. */
+static void
+add_routes (int prefixes)
+{
+  struct bgp_table *table = bgp->rib[AFI_IP][SAFI_UNICAST];
+  struct prefix p;
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  int i, j;
+
+  for (i = 0; i < prefixes; i++)
+    {
+      memset (&p, 0, sizeof (p));
+      p.family = AF_INET;
+      p.prefixlen = 24;
+      p.u.prefix4.s_addr = htonl (0x01000000 + (i << 8));
+
+      rn = bgp_node_get (table, &p);
+      for (j = 0; j < PEERS; j++)
+	{
+	  ri = XCALLOC (MTYPE_BGP_ROUTE, sizeof (struct bgp_info));
+	  ri->type = ZEBRA_ROUTE_BGP;
+	  ri->sub_type = BGP_ROUTE_NORMAL;
+	  ri->peer = peer_lock (peers[j]);
+	  ri->attr = bgp_attr_intern (attrs[j][(i * 7 + j * 3) % VARIANTS]);
+	  ri->uptime = bgp_clock ();
+	  bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
+	  bgp_info_add (rn, ri);
+	}
+      bgp_process (bgp, rn, AFI_IP, SAFI_UNICAST);
+      bgp_unlock_node (rn);
+    }
+}
+
+/* Run the process queue dry, in milliseconds. */
+static unsigned long
+drain (void)
+{
+  struct work_queue *wq = bm->process_main_queue;
+  struct timeval start, stop;
+  struct thread thread;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  while (work_queue_item_count (wq))
+    if (thread_fetch (master, &thread))
+      thread_call (&thread);
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &stop);
+
+  return (stop.tv_sec - start.tv_sec) * 1000
+    + (stop.tv_usec - start.tv_usec) / 1000;
+}
+
+/* Which peer each prefix selected, in table order. */
+static void
+record (u_char *selected)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  int i = 0, j;
+
+  for (rn = bgp_table_top (bgp->rib[AFI_IP][SAFI_UNICAST]); rn;
+       rn = bgp_route_next (rn))
+    {
+      if (rn->info == NULL)
+	continue;
+      selected[i] = PEERS;
+      for (ri = rn->info; ri; ri = ri->next)
+	if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
+	  for (j = 0; j < PEERS; j++)
+	    if (ri->peer == peers[j])
+	      selected[i] = j;
+      i++;
+    }
+}
+
+/* Forget the selection and have every prefix selected anew, as when
+   the table was just learned. */
+static void
+reprocess (void)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+
+  for (rn = bgp_table_top (bgp->rib[AFI_IP][SAFI_UNICAST]); rn;
+       rn = bgp_route_next (rn))
+    if (rn->info)
+      {
+	for (ri = rn->info; ri; ri = ri->next)
+	  bgp_info_unset_flag (rn, ri, BGP_INFO_SELECTED);
+	bgp_process (bgp, rn, AFI_IP, SAFI_UNICAST);
+      }
+}
+
+int
+main (int argc, char **argv)
+{
+  static const int threads[] = { 0, 1, 2, 3, 4, 7, 15 };
+  int prefixes = PREFIXES;
+  u_char *serial, *parallel;
+  unsigned long ms;
+  int failed = 0;
+  unsigned int i;
+
+  if (argc > 1)
+    prefixes = atoi (argv[1]);
+
+  bgp_master_init ();
+  master = bm->master;
+  bgp_option_set (BGP_OPT_NO_LISTEN);
+  bgp_option_set (BGP_OPT_NO_FIB);
+  bgp_attr_init ();
+
+  if (bgp_get (&bgp, &asn, NULL))
+    return 1;
+  for (i = 0; i < PEERS; i++)
+    add_peer (i);
+
+  serial = XCALLOC (MTYPE_TMP, prefixes);
+  parallel = XCALLOC (MTYPE_TMP, prefixes);
+
+  /* Time the work, not the hold before it. */
+  bgp_select_threads_set (0);
+  add_routes (prefixes);
+  bm->process_main_queue->spec.hold = 0;
+  ms = drain ();
+  record (serial);
+  printf ("%d prefixes from %d peers, learned in %lu ms\n\n",
+	  prefixes, PEERS, ms);
+
+  printf ("threads  converged (ms)\n");
+  for (i = 0; i < sizeof (threads) / sizeof (threads[0]); i++)
+    {
+      bgp_select_threads_set (threads[i]);
+      reprocess ();
+      ms = drain ();
+      printf ("%7d  %14lu\n", bgp_select_threads (), ms);
+
+      record (parallel);
+      if (memcmp (serial, parallel, prefixes))
+	{
+	  printf ("selection differs from the serial one!\n");
+	  failed++;
+	}
+    }
+
+  bgp_select_finish ();
+  XFREE (MTYPE_TMP, serial);
+  XFREE (MTYPE_TMP, parallel);
+  return failed;
+}
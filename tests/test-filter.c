@@ -0,0 +1,385 @@
+/*
+ * Access-list tests.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "prefix.h"
+#include "memory.h"
+#include "vector.h"
+#include "buffer.h"
+#include "vty.h"
+#include "command.h"
+#include "filter.h"
+
+#include "prng.h"
+
+/* Filters are set up with the access-list commands, and apply is
+   checked against a walk over them in list order. */
+struct ref_filter
+{
+  int permit;
+  int cisco;
+
+  /* Zebra filters */
+  struct prefix_ipv4 p;
+  int exact;
+
+  /* Cisco filters, with the addresses cleared under their wildcards
+     as the commands store them */
+  int extended;
+  struct in_addr addr;
+  struct in_addr wild;
+  struct in_addr mask;
+  struct in_addr mask_wild;
+};
+
+/* Kinds of list, as the commands only take one kind of filter for a
+   name: named with zebra filters, numbered with standard or extended
+   cisco filters. */
+enum list_kind
+{
+  LIST_ZEBRA,
+  LIST_STANDARD,
+  LIST_EXTENDED,
+};
+
+struct ref_list
+{
+  char name[32];
+  enum list_kind kind;
+  struct ref_filter *filters;
+  int count;
+};
+
+struct thread_master *master;
+
+static struct prng *prng;
+static struct vty *vty;
+
+static int
+ref_match (struct ref_filter *f, struct prefix_ipv4 *p)
+{
+  struct in_addr mask;
+
+  if (! f->cisco)
+    {
+      if (f->exact && f->p.prefixlen != p->prefixlen)
+	return 0;
+      return prefix_match ((struct prefix *) &f->p, (struct prefix *) p);
+    }
+
+  if ((p->prefix.s_addr & ~f->wild.s_addr) != f->addr.s_addr)
+    return 0;
+  if (! f->extended)
+    return 1;
+  masklen2ip (p->prefixlen, &mask);
+  return (mask.s_addr & ~f->mask_wild.s_addr) == f->mask.s_addr;
+}
+
+static enum filter_type
+ref_apply (struct ref_list *list, struct prefix_ipv4 *p)
+{
+  int i;
+
+  for (i = 0; i < list->count; i++)
+    if (ref_match (&list->filters[i], p))
+      return list->filters[i].permit ? FILTER_PERMIT : FILTER_DENY;
+  return FILTER_DENY;
+}
+
+static int
+ref_same (struct ref_filter *a, struct ref_filter *b)
+{
+  if (a->permit != b->permit || a->cisco != b->cisco)
+    return 0;
+  if (! a->cisco)
+    return a->exact == b->exact
+	   && prefix_same ((struct prefix *) &a->p, (struct prefix *) &b->p);
+  return a->addr.s_addr == b->addr.s_addr
+	 && a->wild.s_addr == b->wild.s_addr
+	 && (! a->extended
+	     || (a->mask.s_addr == b->mask.s_addr
+		 && a->mask_wild.s_addr == b->mask_wild.s_addr));
+}
+
+static int
+ref_find (struct ref_list *list, struct ref_filter *f)
+{
+  int i;
+
+  for (i = 0; i < list->count; i++)
+    if (ref_same (&list->filters[i], f))
+      return i;
+  return -1;
+}
+
+static int
+run (const char *line)
+{
+  vector vline;
+  int ret;
+
+  vline = cmd_make_strvec (line);
+  vty->node = CONFIG_NODE;
+  ret = cmd_execute_command (vline, vty, NULL, 0);
+  cmd_free_strvec (vline);
+  buffer_reset (vty->obuf);
+
+  if (ret != CMD_SUCCESS)
+    printf ("'%s' failed: %d\n", line, ret);
+  return ret;
+}
+
+/* Give the command that sets or, with no, deletes the filter. */
+static int
+run_filter (struct ref_list *list, struct ref_filter *f, int no)
+{
+  char line[256];
+  char a[4][INET_ADDRSTRLEN];
+  const char *type = f->permit ? "permit" : "deny";
+
+  if (! f->cisco)
+    snprintf (line, sizeof (line), "%saccess-list %s %s %s/%d%s",
+	      no ? "no " : "", list->name, type,
+	      inet_ntop (AF_INET, &f->p.prefix, a[0], sizeof (a[0])),
+	      f->p.prefixlen, f->exact ? " exact-match" : "");
+  else if (! f->extended)
+    snprintf (line, sizeof (line), "%saccess-list %s %s %s %s",
+	      no ? "no " : "", list->name, type,
+	      inet_ntop (AF_INET, &f->addr, a[0], sizeof (a[0])),
+	      inet_ntop (AF_INET, &f->wild, a[1], sizeof (a[1])));
+  else
+    snprintf (line, sizeof (line), "%saccess-list %s %s ip %s %s %s %s",
+	      no ? "no " : "", list->name, type,
+	      inet_ntop (AF_INET, &f->addr, a[0], sizeof (a[0])),
+	      inet_ntop (AF_INET, &f->wild, a[1], sizeof (a[1])),
+	      inet_ntop (AF_INET, &f->mask, a[2], sizeof (a[2])),
+	      inet_ntop (AF_INET, &f->mask_wild, a[3], sizeof (a[3])));
+
+  return run (line);
+}
+
+/* Addresses below a few /8s, so that the filters overlap a lot. */
+static void
+random_prefix (struct prefix_ipv4 *p)
+{
+  memset (p, 0, sizeof (*p));
+  p->family = AF_INET;
+  p->prefixlen = prng_rand (prng) % 33;
+  p->prefix.s_addr = htonl (((10 + prng_rand (prng) % 3) << 24)
+			    | (prng_rand (prng) & 0x00ffffff));
+  apply_mask_ipv4 (p);
+}
+
+/* Host bits, sometimes with holes further up. */
+static u_int32_t
+random_wildcard (void)
+{
+  u_int32_t wild;
+
+  wild = 0xffffffff >> (8 + prng_rand (prng) % 25);
+  if (prng_rand (prng) % 3 == 0)
+    wild |= prng_rand (prng) & 0x00ff00ff;
+  return wild;
+}
+
+static void
+random_filter (struct ref_list *list, struct ref_filter *f)
+{
+  struct in_addr mask;
+  u_int32_t wild;
+  int len;
+
+  memset (f, 0, sizeof (*f));
+  f->permit = prng_rand (prng) % 2;
+
+  if (list->kind == LIST_ZEBRA)
+    {
+      random_prefix (&f->p);
+      f->exact = prng_rand (prng) % 3 == 0;
+      return;
+    }
+
+  f->cisco = 1;
+  wild = random_wildcard ();
+  f->wild.s_addr = htonl (wild);
+  f->addr.s_addr = htonl (((10 + prng_rand (prng) % 3) << 24)
+			  | (prng_rand (prng) & 0x00ffffff)) & ~f->wild.s_addr;
+  if (list->kind == LIST_STANDARD)
+    return;
+
+  /* An exact length, a range of them or scattered bits. */
+  f->extended = 1;
+  len = prng_rand (prng) % 33;
+  masklen2ip (len, &f->mask);
+  switch (prng_rand (prng) % 3)
+    {
+    case 1:
+      masklen2ip (len + prng_rand (prng) % (33 - len), &mask);
+      f->mask_wild.s_addr = f->mask.s_addr ^ mask.s_addr;
+      break;
+    case 2:
+      f->mask_wild.s_addr = htonl (prng_rand (prng) & 0x00ff00ff);
+      break;
+    }
+  f->mask.s_addr &= ~f->mask_wild.s_addr;
+}
+
+/* Mostly prefixes that some filter is about, some anywhere. */
+static void
+random_query (struct ref_list *list, struct prefix_ipv4 *p)
+{
+  struct ref_filter *f;
+
+  if (! list->count || prng_rand (prng) % 4 == 0)
+    {
+      random_prefix (p);
+      return;
+    }
+
+  f = &list->filters[prng_rand (prng) % list->count];
+  if (! f->cisco)
+    {
+      *p = f->p;
+      p->prefixlen += prng_rand (prng) % (33 - p->prefixlen);
+      p->prefix.s_addr |= htonl (prng_rand (prng)) & ~p->prefix.s_addr;
+      apply_mask_ipv4 (p);
+      return;
+    }
+
+  memset (p, 0, sizeof (*p));
+  p->family = AF_INET;
+  p->prefix.s_addr = f->addr.s_addr | (htonl (prng_rand (prng))
+				       & f->wild.s_addr);
+  if (f->extended && prng_rand (prng) % 2)
+    p->prefixlen = ip_masklen (f->mask);
+  else
+    p->prefixlen = prng_rand (prng) % 33;
+}
+
+static void
+add_filters (struct ref_list *list, int n)
+{
+  struct ref_filter f;
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      random_filter (list, &f);
+      if (ref_find (list, &f) >= 0)
+	continue;
+      if (run_filter (list, &f, 0) == CMD_SUCCESS)
+	list->filters[list->count++] = f;
+    }
+}
+
+static void
+delete_filter (struct ref_list *list, int i)
+{
+  if (run_filter (list, &list->filters[i], 1) != CMD_SUCCESS)
+    return;
+  list->count--;
+  memmove (&list->filters[i], &list->filters[i + 1],
+	   (list->count - i) * sizeof (struct ref_filter));
+}
+
+static int
+compare (struct ref_list *list, int queries)
+{
+  struct access_list *access;
+  struct prefix_ipv4 p;
+  char buf[INET_ADDRSTRLEN];
+  int i;
+
+  access = access_list_lookup (AFI_IP, list->name);
+  for (i = 0; i < queries; i++)
+    {
+      random_query (list, &p);
+      if (access_list_apply (access, &p) != ref_apply (list, &p))
+	{
+	  printf ("%s: %s/%d differs\n", list->name,
+		  inet_ntop (AF_INET, &p.prefix, buf, sizeof (buf)),
+		  p.prefixlen);
+	  return 1;
+	}
+    }
+  return 0;
+}
+
+static int
+test_compare (enum list_kind kind, const char *name, int n)
+{
+  struct ref_list list;
+  char line[64];
+  int i, failed = 0;
+
+  memset (&list, 0, sizeof (list));
+  snprintf (list.name, sizeof (list.name), "%s", name);
+  list.kind = kind;
+  list.filters = calloc (2 * n, sizeof (struct ref_filter));
+
+  add_filters (&list, n);
+  failed += compare (&list, 20000);
+
+  /* Change the list once it is indexed: take some filters out, then
+     put more on the end. */
+  for (i = list.count - 1; i >= 0; i -= 3)
+    delete_filter (&list, i);
+  failed += compare (&list, 20000);
+
+  add_filters (&list, n / 2);
+  failed += compare (&list, 20000);
+
+  snprintf (line, sizeof (line), "no access-list %s", name);
+  run (line);
+  free (list.filters);
+  return failed;
+}
+
+int
+main (int argc, char **argv)
+{
+  int failed = 0;
+
+  prng = prng_new (0);
+
+  cmd_init (1);
+  vty = vty_new ();
+  access_list_init ();
+
+  /* Below and above the size lists are indexed from. */
+  if (test_compare (LIST_ZEBRA, "zebra-5", 5)
+      || test_compare (LIST_ZEBRA, "zebra-60", 60)
+      || test_compare (LIST_ZEBRA, "zebra-3000", 3000)
+      || test_compare (LIST_STANDARD, "5", 5)
+      || test_compare (LIST_STANDARD, "60", 60)
+      || test_compare (LIST_STANDARD, "30", 3000)
+      || test_compare (LIST_EXTENDED, "105", 5)
+      || test_compare (LIST_EXTENDED, "160", 60)
+      || test_compare (LIST_EXTENDED, "130", 3000))
+    failed++;
+  else
+    printf ("Compare test passed.\n");
+
+  prng_free (prng);
+  return failed;
+}
@@ -0,0 +1,344 @@
+/*
+ * A Forwarding Plane Manager that takes what zebra sends it and
+ * measures how fast routes come in.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/*
+ * Usage: test-fpm-sink [-n | -v] [PORT]
+ *
+ * Listens on the loopback address at PORT, by default the FPM port, and
+ * asks zebra for batches of routes in the compact encoding, or with -n
+ * leaves it sending netlink.  Every batch is taken apart with the
+ * reference decoder in fpm/fpm.h, and with -v the routes are printed.
+ * A netlink message counts as one route, as zebra sends one route per
+ * message.
+ *
+ * Once routes stop coming for a second, what came since the last pause
+ * is reported, so that the full table zebra sends on connecting shows
+ * up on its own.  Zebra reconnects when the sink is restarted.
+ */
+
+#include <zebra.h>
+#include <poll.h>
+
+#include "fpm/fpm.h"
+
+#define SINK_BUF_SIZE	(4 * FPM_MAX_ROUTES_MSG_LEN)
+#define SINK_IDLE_MSECS	1000
+
+struct thread_master *master;
+
+static int verbose;
+
+static struct
+{
+  unsigned long msgs;
+  unsigned long bytes;
+  unsigned long adds;
+  unsigned long dels;
+  unsigned long nhs;
+  struct timeval first;
+  struct timeval last;
+} burst;
+
+static double
+tv_diff (struct timeval *a, struct timeval *b)
+{
+  return (a->tv_sec - b->tv_sec) + (a->tv_usec - b->tv_usec) / 1e6;
+}
+
+static int
+sink_listen (int port)
+{
+  struct sockaddr_in sin;
+  int sock, on = 1;
+
+  sock = socket (AF_INET, SOCK_STREAM, 0);
+  if (sock < 0)
+    {
+      perror ("socket");
+      return -1;
+    }
+  setsockopt (sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+
+  memset (&sin, 0, sizeof (sin));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons (port);
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (bind (sock, (struct sockaddr *) &sin, sizeof (sin)) < 0
+      || listen (sock, 1) < 0)
+    {
+      perror ("bind");
+      close (sock);
+      return -1;
+    }
+  return sock;
+}
+
+static int
+sink_send_caps (int sock)
+{
+  struct
+  {
+    fpm_msg_hdr_t hdr;
+    fpm_caps_t caps;
+  } msg;
+
+  memset (&msg, 0, sizeof (msg));
+  msg.hdr.version = FPM_PROTO_VERSION;
+  msg.hdr.msg_type = FPM_MSG_TYPE_CAPS;
+  msg.hdr.msg_len = htons (fpm_data_len_to_msg_len (sizeof (msg.caps)));
+  msg.caps.flags = htonl (FPM_CAP_ROUTES);
+  msg.caps.max_msg_len = htons (FPM_MAX_ROUTES_MSG_LEN);
+
+  if (write (sock, &msg, fpm_msg_len (&msg.hdr))
+      != (ssize_t) fpm_msg_len (&msg.hdr))
+    {
+      perror ("write");
+      return -1;
+    }
+  return 0;
+}
+
+static void
+sink_print_route (fpm_route_info_t *info)
+{
+  char buf[INET6_ADDRSTRLEN];
+  u_char addr[16];
+  const uint8_t *gateway;
+  uint32_t if_index;
+  int af, i;
+
+  af = info->family == FPM_ROUTE_AF_INET ? AF_INET : AF_INET6;
+  memset (addr, 0, sizeof (addr));
+  memcpy (addr, info->prefix, (info->prefixlen + 7) / 8);
+
+  printf ("%s %s/%d", info->op == FPM_ROUTE_OP_ADD ? "add" : "del",
+	  inet_ntop (af, addr, buf, sizeof (buf)), info->prefixlen);
+  if (info->op == FPM_ROUTE_OP_ADD)
+    printf (" type %d proto %d metric %u", info->type, info->protocol,
+	    info->metric);
+  if (info->src)
+    printf (" src %s", inet_ntop (af, info->src, buf, sizeof (buf)));
+
+  for (i = 0; i < info->num_nhs; i++)
+    {
+      fpm_route_nh (info, i, &if_index, &gateway);
+      printf (" nh");
+      if (gateway)
+	printf (" via %s", inet_ntop (af, gateway, buf, sizeof (buf)));
+      if (if_index)
+	printf (" ifindex %u", if_index);
+    }
+  printf ("\n");
+}
+
+static int
+sink_decode_routes (fpm_msg_hdr_t *hdr)
+{
+  const fpm_routes_hdr_t *rh;
+  const uint8_t *pos, *end;
+  fpm_route_info_t info;
+  int i, num_routes;
+
+  if (fpm_msg_data_len (hdr) < sizeof (*rh))
+    return -1;
+
+  rh = fpm_msg_data (hdr);
+  pos = (const uint8_t *) (rh + 1);
+  end = (const uint8_t *) rh + fpm_msg_data_len (hdr);
+  num_routes = ntohs (rh->num_routes);
+
+  for (i = 0; i < num_routes; i++)
+    {
+      if (!fpm_route_decode (&pos, end, &info))
+	{
+	  fprintf (stderr, "bad route %d of %d in message\n", i, num_routes);
+	  return -1;
+	}
+      if (info.op == FPM_ROUTE_OP_ADD)
+	burst.adds++;
+      else
+	burst.dels++;
+      burst.nhs += info.num_nhs;
+      if (verbose)
+	sink_print_route (&info);
+    }
+
+  /* Only padding may follow. */
+  if (end - pos >= FPM_MSG_ALIGNTO)
+    {
+      fprintf (stderr, "%d bytes left over in message\n", (int) (end - pos));
+      return -1;
+    }
+  return 0;
+}
+
+static void
+sink_report (void)
+{
+  unsigned long routes = burst.adds + burst.dels;
+  double t = tv_diff (&burst.last, &burst.first);
+
+  if (!burst.msgs)
+    return;
+
+  printf ("%lu routes (%lu adds, %lu deletes, %lu nexthops) "
+	  "in %lu messages, %lu bytes", routes, burst.adds, burst.dels,
+	  burst.nhs, burst.msgs, burst.bytes);
+  if (t > 0)
+    printf (", %.0f routes/s over %.3fs", routes / t, t);
+  printf ("\n");
+  fflush (stdout);
+  memset (&burst, 0, sizeof (burst));
+}
+
+/* Handle the messages in buf, returning how many bytes were used up,
+   or -1 if zebra sent something malformed. */
+static ssize_t
+sink_process (u_char *buf, size_t len)
+{
+  fpm_msg_hdr_t *hdr;
+  size_t used = 0;
+
+  while (len - used >= FPM_MSG_HDR_LEN)
+    {
+      hdr = (fpm_msg_hdr_t *) (buf + used);
+      if (!fpm_msg_hdr_ok (hdr))
+	{
+	  fprintf (stderr, "bad message header\n");
+	  return -1;
+	}
+      if (!fpm_msg_ok (hdr, len - used))
+	break;
+
+      switch (hdr->msg_type)
+	{
+	case FPM_MSG_TYPE_NETLINK:
+	  burst.adds++;
+	  break;
+	case FPM_MSG_TYPE_ROUTES:
+	  if (sink_decode_routes (hdr) < 0)
+	    return -1;
+	  break;
+	default:
+	  fprintf (stderr, "unexpected message type %d\n", hdr->msg_type);
+	  return -1;
+	}
+
+      if (!burst.msgs)
+	gettimeofday (&burst.first, NULL);
+      burst.msgs++;
+      burst.bytes += fpm_msg_len (hdr);
+      used += fpm_msg_len (hdr);
+    }
+
+  gettimeofday (&burst.last, NULL);
+  return used;
+}
+
+static int
+sink_run (int sock)
+{
+  u_char *buf;
+  size_t len = 0;
+  ssize_t n, used;
+  struct pollfd pfd;
+
+  buf = malloc (SINK_BUF_SIZE);
+  pfd.fd = sock;
+  pfd.events = POLLIN;
+
+  for (;;)
+    {
+      if (poll (&pfd, 1, SINK_IDLE_MSECS) == 0)
+	{
+	  sink_report ();
+	  continue;
+	}
+
+      n = read (sock, buf + len, SINK_BUF_SIZE - len);
+      if (n <= 0)
+	break;
+      len += n;
+
+      used = sink_process (buf, len);
+      if (used < 0)
+	{
+	  free (buf);
+	  return -1;
+	}
+      memmove (buf, buf + used, len - used);
+      len -= used;
+    }
+
+  sink_report ();
+  free (buf);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  int lsock, sock, port = FPM_DEFAULT_PORT, netlink = 0;
+
+  if (argc > 1 && ! strcmp (argv[1], "-n"))
+    {
+      netlink = 1;
+      argc--;
+      argv++;
+    }
+  else if (argc > 1 && ! strcmp (argv[1], "-v"))
+    {
+      verbose = 1;
+      argc--;
+      argv++;
+    }
+  if (argc > 1)
+    port = atoi (argv[1]);
+
+  lsock = sink_listen (port);
+  if (lsock < 0)
+    return 1;
+
+  printf ("waiting for zebra on port %d, %s routes\n", port,
+	  netlink ? "netlink" : "compact");
+  fflush (stdout);
+
+  while ((sock = accept (lsock, NULL, NULL)) >= 0)
+    {
+      printf ("zebra connected\n");
+      fflush (stdout);
+      if (! netlink && sink_send_caps (sock) < 0)
+	{
+	  close (sock);
+	  continue;
+	}
+      if (sink_run (sock) < 0)
+	printf ("dropping zebra\n");
+      else
+	printf ("zebra went away\n");
+      fflush (stdout);
+      close (sock);
+    }
+
+  perror ("accept");
+  return 1;
+}
@@ -0,0 +1,147 @@
+/*
+ * Test program which measures the cost of a thread_fetch() wakeup for
+ * a single active socket while many idle sockets have read threads
+ * pending, for each thread I/O backend.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <zebra.h>
+#include <sys/resource.h>
+
+#include "thread.h"
+
+#define IDLE_SOCKETS 5000
+#define ITERATIONS   20000
+
+struct thread_master *master;
+
+static int active[2];
+static unsigned long reads;
+
+static int
+idle_read (struct thread *thread)
+{
+  return 0;
+}
+
+static int
+active_read (struct thread *thread)
+{
+  char c;
+
+  if (read (THREAD_FD (thread), &c, 1) == 1)
+    reads++;
+  thread_add_read (master, active_read, NULL, THREAD_FD (thread));
+  return 0;
+}
+
+static void
+run (enum thread_io_method method, int (*idle)[2], int nidle)
+{
+  struct thread thread;
+  struct timeval tv_start, tv_stop;
+  unsigned long usec;
+  int i, registered = 0;
+
+  master = thread_master_create ();
+  if (thread_master_set_io (master, method) < 0)
+    {
+      printf ("%-7s backend not available\n", method == THREAD_IO_EPOLL
+                                              ? "epoll" : "select");
+      thread_master_free (master);
+      return;
+    }
+
+  /* Descriptors past FD_SETSIZE are refused by the select backend. */
+  for (i = 0; i < nidle; i++)
+    {
+      if (method == THREAD_IO_SELECT && idle[i][0] >= FD_SETSIZE)
+        continue;
+      if (thread_add_read (master, idle_read, NULL, idle[i][0]))
+        registered++;
+    }
+  thread_add_read (master, active_read, NULL, active[0]);
+
+  reads = 0;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &tv_start);
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      if (write (active[1], "x", 1) != 1)
+        break;
+      if (thread_fetch (master, &thread) == NULL)
+        break;
+      thread_call (&thread);
+    }
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &tv_stop);
+  usec = timeval_elapsed (tv_stop, tv_start);
+
+  printf ("%-7s %5d idle fds: %d wakeups in %lu.%03lu s, %.2f usec each\n",
+          thread_master_io_name (master), registered, (int) reads,
+          usec / 1000000, (usec % 1000000) / 1000,
+          reads ? (double) usec / reads : 0.0);
+  fflush (stdout);
+
+  thread_master_free (master);
+}
+
+int
+main (int argc, char **argv)
+{
+  int (*idle)[2];
+  struct rlimit rl;
+  int nidle = IDLE_SOCKETS;
+  int i;
+
+  /* Two fds per socket pair, plus some slack. */
+  if (getrlimit (RLIMIT_NOFILE, &rl) == 0
+      && rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < 2 * IDLE_SOCKETS + 64)
+    {
+      rl.rlim_cur = rl.rlim_max;
+      setrlimit (RLIMIT_NOFILE, &rl);
+      getrlimit (RLIMIT_NOFILE, &rl);
+      if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < 2 * IDLE_SOCKETS + 64)
+        nidle = (rl.rlim_cur - 64) / 2;
+    }
+
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, active) < 0)
+    {
+      perror ("socketpair");
+      return 1;
+    }
+
+  idle = calloc (nidle, sizeof (*idle));
+  for (i = 0; i < nidle; i++)
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, idle[i]) < 0)
+      {
+        perror ("socketpair");
+        return 1;
+      }
+
+  run (THREAD_IO_SELECT, idle, nidle);
+  run (THREAD_IO_EPOLL, idle, nidle);
+
+  for (i = 0; i < nidle; i++)
+    {
+      close (idle[i][0]);
+      close (idle[i][1]);
+    }
+  free (idle);
+  return 0;
+}
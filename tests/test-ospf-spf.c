@@ -0,0 +1,516 @@
+/*
+ * OSPF incremental SPF and partial external route calculation tests,
+ * checked against full calculations with "debug ospf spf verify".
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "prefix.h"
+#include "memory.h"
+#include "linklist.h"
+#include "table.h"
+#include "if.h"
+#include "log.h"
+#include "privs.h"
+#include "zclient.h"
+
+#include "ospfd/ospfd.h"
+#include "ospfd/ospf_interface.h"
+#include "ospfd/ospf_asbr.h"
+#include "ospfd/ospf_lsa.h"
+#include "ospfd/ospf_lsdb.h"
+#include "ospfd/ospf_route.h"
+#include "ospfd/ospf_ase.h"
+#include "ospfd/ospf_dump.h"
+
+#define VT100_RESET "\x1b[0m"
+#define VT100_RED "\x1b[31m"
+#define VT100_GREEN "\x1b[32m"
+
+/* Expected by libospf, normally from ospf_main.c. */
+struct thread_master *master;
+struct zebra_privs_t ospfd_privs;
+
+extern struct zclient *zclient;
+
+static int failed = 0;
+static int tty = 0;
+
+#define EXPECT(expr)							\
+  do {									\
+    if (! (expr))							\
+      {									\
+	printf ("%s line %u: %s\n", __FUNCTION__, __LINE__, #expr);	\
+	failed++;							\
+      }									\
+  } while (0)
+
+/* The calculating router is 1.1.1.1, in the backbone only, with one
+   broadcast interface on 10.0.1.0/24, where 2.2.2.2 is the DR:
+
+      1.1.1.1 --- 10.0.1.0/24 --- 2.2.2.2 --5-- 4.4.4.4 (ASBR)
+                       |                          |
+                       +--------- 3.3.3.3 --20----+
+                                     |
+                                10.0.35.0/24 (stub)
+ */
+static struct ospf *ospf;
+static struct ospf_area *area;
+static struct ospf_interface *oi;
+static u_int32_t seqnum = OSPF_INITIAL_SEQUENCE_NUMBER;
+
+struct link
+{
+  u_char type;
+  const char *id;
+  const char *data;
+  u_int16_t metric;
+};
+
+static struct in_addr
+addr (const char *s)
+{
+  struct in_addr a;
+
+  inet_aton (s, &a);
+  return a;
+}
+
+static void
+lsa_header (struct lsa_header *lsah, u_char type, const char *id,
+	    const char *adv_router, size_t length)
+{
+  lsah->ls_age = 0;
+  lsah->options = OSPF_OPTION_E;
+  lsah->type = type;
+  lsah->id = addr (id);
+  lsah->adv_router = addr (adv_router);
+  lsah->ls_seqnum = htonl (seqnum++);
+  lsah->length = htons (length);
+}
+
+static void
+lsa_install (struct lsa_header *lsah, struct ospf_area *lsa_area)
+{
+  struct ospf_lsa *lsa;
+
+  lsa = ospf_lsa_new ();
+  lsa->data = lsah;
+  lsa->area = lsa_area;
+  if (IPV4_ADDR_SAME (&lsah->adv_router, &ospf->router_id))
+    SET_FLAG (lsa->flags, OSPF_LSA_SELF);
+
+  /* The database takes over the reference. */
+  ospf_lsa_install (ospf, oi, lsa);
+}
+
+/* Install a router-LSA with links up to one of type 0. */
+static void
+router_lsa (const char *rid, u_char flags, const struct link *links)
+{
+  struct router_lsa *rl;
+  size_t length;
+  int i, n;
+
+  for (n = 0; links[n].type; n++)
+    ;
+  length = OSPF_LSA_HEADER_SIZE + OSPF_ROUTER_LSA_MIN_SIZE
+	   + n * OSPF_ROUTER_LSA_LINK_SIZE;
+
+  rl = (struct router_lsa *) ospf_lsa_data_new (length);
+  lsa_header (&rl->header, OSPF_ROUTER_LSA, rid, rid, length);
+  rl->flags = flags;
+  rl->links = htons (n);
+  for (i = 0; i < n; i++)
+    {
+      rl->link[i].type = links[i].type;
+      rl->link[i].link_id = addr (links[i].id);
+      rl->link[i].link_data = addr (links[i].data);
+      rl->link[i].metric = htons (links[i].metric);
+    }
+
+  lsa_install (&rl->header, area);
+}
+
+/* Install a network-LSA for a /24, with attached routers up to NULL. */
+static void
+network_lsa (const char *id, const char *dr, const char **routers)
+{
+  struct network_lsa *nl;
+  size_t length;
+  int i, n;
+
+  for (n = 0; routers[n]; n++)
+    ;
+  length = OSPF_LSA_HEADER_SIZE + 4 + n * sizeof (struct in_addr);
+
+  nl = (struct network_lsa *) ospf_lsa_data_new (length);
+  lsa_header (&nl->header, OSPF_NETWORK_LSA, id, dr, length);
+  nl->mask = addr ("255.255.255.0");
+  for (i = 0; i < n; i++)
+    nl->routers[i] = addr (routers[i]);
+
+  lsa_install (&nl->header, area);
+}
+
+/* Install an AS-external-LSA of metric type 1 or 2 for a /24. */
+static void
+external_lsa (const char *id, const char *asbr, int type, u_int32_t metric,
+	      const char *fwd)
+{
+  struct as_external_lsa *al;
+  size_t length = OSPF_LSA_HEADER_SIZE + OSPF_AS_EXTERNAL_LSA_MIN_SIZE;
+
+  al = (struct as_external_lsa *) ospf_lsa_data_new (length);
+  lsa_header (&al->header, OSPF_AS_EXTERNAL_LSA, id, asbr, length);
+  al->mask = addr ("255.255.255.0");
+  al->e[0].tos = (type == 2) ? 0x80 : 0;
+  al->e[0].metric[0] = (metric >> 16) & 0xff;
+  al->e[0].metric[1] = (metric >> 8) & 0xff;
+  al->e[0].metric[2] = metric & 0xff;
+  al->e[0].fwd_addr = addr (fwd);
+
+  lsa_install (&al->header, NULL);
+}
+
+/* Run the calculations scheduled so far. */
+static void
+run (void)
+{
+  struct thread thread;
+
+  while ((ospf->t_spf_calc || ospf->t_ase_calc)
+	 && thread_fetch (master, &thread))
+    thread_call (&thread);
+}
+
+static struct ospf_route *
+route (struct route_table *table, const char *prefix)
+{
+  struct prefix p;
+  struct route_node *rn;
+
+  str2prefix (prefix, &p);
+  if ((rn = route_node_lookup (table, &p)) == NULL)
+    return NULL;
+  route_unlock_node (rn);
+  return rn->info;
+}
+
+/* Whether the route to a prefix has the given cost and paths. */
+static int
+route_is (struct route_table *table, const char *prefix, u_int32_t cost,
+	  int paths)
+{
+  struct ospf_route *or = route (table, prefix);
+
+  return or && or->cost == cost && listcount (or->paths) == paths;
+}
+
+#define NETWORK(p, cost, paths)	route_is (ospf->new_table, p, cost, paths)
+#define EXTERNAL(p, cost, paths) \
+  route_is (ospf->old_external_route, p, cost, paths)
+
+static const char *n1_routers[] = { "2.2.2.2", "1.1.1.1", "3.3.3.3", NULL };
+
+static void
+r2_lsa (u_int16_t r4_metric)
+{
+  struct link with_r4[] =
+  {
+    { LSA_LINK_TYPE_TRANSIT, "10.0.1.2", "10.0.1.2", 10 },
+    { LSA_LINK_TYPE_POINTOPOINT, "4.4.4.4", "10.0.24.2", r4_metric },
+    { LSA_LINK_TYPE_STUB, "10.0.24.0", "255.255.255.0", r4_metric },
+    { LSA_LINK_TYPE_STUB, "2.2.2.0", "255.255.255.0", 1 },
+    { 0 },
+  };
+  struct link without_r4[] =
+  {
+    { LSA_LINK_TYPE_TRANSIT, "10.0.1.2", "10.0.1.2", 10 },
+    { LSA_LINK_TYPE_STUB, "2.2.2.0", "255.255.255.0", 1 },
+    { 0 },
+  };
+
+  router_lsa ("2.2.2.2", 0, r4_metric ? with_r4 : without_r4);
+}
+
+static void
+r3_lsa (u_int16_t r4_metric, u_int16_t stub_metric, int transit)
+{
+  struct link links[] =
+  {
+    { LSA_LINK_TYPE_TRANSIT, "10.0.1.2", "10.0.1.3", 10 },
+    { LSA_LINK_TYPE_POINTOPOINT, "4.4.4.4", "10.0.34.3", r4_metric },
+    { LSA_LINK_TYPE_STUB, "10.0.34.0", "255.255.255.0", r4_metric },
+    { LSA_LINK_TYPE_STUB, "3.3.3.0", "255.255.255.0", stub_metric },
+    { LSA_LINK_TYPE_STUB, "10.0.35.0", "255.255.255.0", 1 },
+    { 0 },
+  };
+
+  if (transit)
+    {
+      links[4].type = LSA_LINK_TYPE_TRANSIT;
+      links[4].id = "10.0.35.3";
+      links[4].data = "10.0.35.3";
+    }
+  router_lsa ("3.3.3.3", 0, links);
+}
+
+static void
+topology (void)
+{
+  struct link r1[] =
+  {
+    { LSA_LINK_TYPE_TRANSIT, "10.0.1.2", "10.0.1.1", 10 },
+    { 0 },
+  };
+  struct link r4[] =
+  {
+    { LSA_LINK_TYPE_POINTOPOINT, "2.2.2.2", "10.0.24.4", 5 },
+    { LSA_LINK_TYPE_POINTOPOINT, "3.3.3.3", "10.0.34.4", 20 },
+    { LSA_LINK_TYPE_STUB, "4.4.4.0", "255.255.255.0", 1 },
+    { 0 },
+  };
+
+  router_lsa ("1.1.1.1", 0, r1);
+  network_lsa ("10.0.1.2", "2.2.2.2", n1_routers);
+  r2_lsa (5);
+  r3_lsa (20, 1, 0);
+  router_lsa ("4.4.4.4", ROUTER_LSA_EXTERNAL, r4);
+  external_lsa ("100.0.0.0", "4.4.4.4", 1, 20, "0.0.0.0");
+  external_lsa ("101.0.0.0", "4.4.4.4", 2, 5, "3.3.3.9");
+  run ();
+}
+
+/* Check the verify mode saw no differences, and note the counters. */
+static u_int32_t spf_incremental, ase_partial, ase_full;
+
+static void
+verified (void)
+{
+  EXPECT (ospf->spf_verify_failed == 0);
+  EXPECT (ospf->ase_verify_failed == 0);
+
+  spf_incremental = ospf->spf_incremental_count;
+  ase_partial = ospf->ase_partial_count;
+  ase_full = ospf->ase_full_count;
+}
+
+static void
+test_metric (void)
+{
+  verified ();
+  EXPECT (NETWORK ("4.4.4.0/24", 16, 1));
+  EXPECT (EXTERNAL ("100.0.0.0/24", 35, 1));
+  EXPECT (EXTERNAL ("101.0.0.0/24", 11, 1));
+
+  /* 4.4.4.4 is now as close through 3.3.3.3. */
+  r3_lsa (5, 1, 0);
+  run ();
+
+  EXPECT (ospf->spf_incremental_count > spf_incremental);
+  EXPECT (ospf->ase_full_count > ase_full);
+  EXPECT (NETWORK ("4.4.4.0/24", 16, 2));
+  EXPECT (EXTERNAL ("100.0.0.0/24", 35, 2));
+  verified ();
+}
+
+static void
+test_removal (void)
+{
+  /* 2.2.2.2 loses its link to 4.4.4.4. */
+  r2_lsa (0);
+  run ();
+
+  EXPECT (ospf->spf_incremental_count > spf_incremental);
+  EXPECT (NETWORK ("4.4.4.0/24", 16, 1));
+  EXPECT (route (ospf->new_table, "10.0.24.0/24") == NULL);
+  EXPECT (EXTERNAL ("100.0.0.0/24", 35, 1));
+  verified ();
+}
+
+static void
+test_transit (void)
+{
+  const char *n2_routers[] = { "3.3.3.3", "5.5.5.5", NULL };
+  struct link r5[] =
+  {
+    { LSA_LINK_TYPE_TRANSIT, "10.0.35.3", "10.0.35.5", 1 },
+    { LSA_LINK_TYPE_STUB, "5.5.5.0", "255.255.255.0", 1 },
+    { 0 },
+  };
+
+  /* 10.0.35.0/24 gets a second router, and 3.3.3.3 becomes the DR. */
+  r3_lsa (5, 1, 1);
+  network_lsa ("10.0.35.3", "3.3.3.3", n2_routers);
+  router_lsa ("5.5.5.5", 0, r5);
+  run ();
+
+  EXPECT (ospf->spf_incremental_count > spf_incremental);
+  EXPECT (NETWORK ("10.0.35.0/24", 11, 1));
+  EXPECT (NETWORK ("5.5.5.0/24", 12, 1));
+  verified ();
+}
+
+static void
+test_external (void)
+{
+  /* A new external, and a changed one. */
+  external_lsa ("102.0.0.0", "4.4.4.4", 1, 7, "0.0.0.0");
+  external_lsa ("100.0.0.0", "4.4.4.4", 1, 30, "0.0.0.0");
+  run ();
+
+  EXPECT (ospf->ase_partial_count >= ase_partial + 2);
+  EXPECT (ospf->ase_full_count == ase_full);
+  EXPECT (EXTERNAL ("102.0.0.0/24", 22, 1));
+  EXPECT (EXTERNAL ("100.0.0.0/24", 45, 1));
+  verified ();
+}
+
+static void
+test_forward (void)
+{
+  /* Only the route to the forwarding address of 101.0.0.0/24 changes. */
+  r3_lsa (5, 7, 1);
+  run ();
+
+  EXPECT (ospf->spf_incremental_count > spf_incremental);
+  EXPECT (ospf->ase_partial_count > ase_partial);
+  EXPECT (ospf->ase_full_count == ase_full);
+  EXPECT (NETWORK ("3.3.3.0/24", 17, 1));
+  EXPECT (EXTERNAL ("101.0.0.0/24", 17, 1));
+  verified ();
+}
+
+static struct test
+{
+  const char *name;
+  const char *desc;
+  void (*func) (void);
+} tests[] =
+{
+  { "metric", "a link metric changes", test_metric },
+  { "removal", "a link is removed", test_removal },
+  { "transit", "a stub network becomes a transit network", test_transit },
+  { "external", "AS-external-LSAs change", test_external },
+  { "forward", "the route to a forwarding address changes", test_forward },
+  { NULL, NULL, NULL },
+};
+
+/* What ospf_new() would set up, short of the socket and its threads. */
+static void
+ospf_setup (void)
+{
+  struct interface *ifp;
+  struct prefix *p;
+  int i;
+
+  ospf = XCALLOC (MTYPE_OSPF_TOP, sizeof (struct ospf));
+  ospf->router_id = addr ("1.1.1.1");
+  ospf->abr_type = OSPF_ABR_DEFAULT;
+  ospf->oiflist = list_new ();
+  ospf->vlinks = list_new ();
+  ospf->areas = list_new ();
+  ospf->networks = route_table_init ();
+  ospf->nbr_nbma = route_table_init ();
+  ospf->lsdb = ospf_lsdb_new ();
+  ospf->default_originate = DEFAULT_ORIGINATE_NONE;
+  ospf->new_external_route = route_table_init ();
+  ospf->old_external_route = route_table_init ();
+  ospf->external_lsas = route_table_init ();
+  ospf->external_fwd = route_table_init ();
+  for (i = 0; i <= ZEBRA_ROUTE_MAX; i++)
+    {
+      ospf->dmetric[i].type = -1;
+      ospf->dmetric[i].value = -1;
+    }
+  ospf->default_metric = -1;
+  ospf->ref_bandwidth = OSPF_DEFAULT_REF_BANDWIDTH;
+  ospf->maxage_lsa = route_table_init ();
+  ospf->distance_table = route_table_init ();
+  ospf->lsa_refresh_interval = OSPF_LSA_REFRESH_INTERVAL_DEFAULT;
+  ospf->lsa_refresher_started = quagga_time (NULL);
+  ospf->oi_write_q = list_new ();
+  listnode_add (om->ospf, ospf);
+
+  /* Calculate as soon as asked. */
+  ospf->spf_delay = 0;
+  ospf->spf_holdtime = 0;
+  ospf->spf_max_holdtime = 0;
+  ospf->spf_hold_multiplier = 1;
+
+  area = ospf_area_get (ospf, addr ("0.0.0.0"), OSPF_AREA_ID_FORMAT_ADDRESS);
+
+  ifp = if_get_by_name ("eth0");
+  ifp->ifindex = 1;
+  ifp->flags = IFF_UP | IFF_RUNNING;
+  p = prefix_new ();
+  str2prefix ("10.0.1.1/24", p);
+
+  oi = ospf_if_new (ospf, ifp, p);
+  oi->area = area;
+  oi->type = OSPF_IFTYPE_BROADCAST;
+  oi->lsa_pos_beg = 0;
+  oi->lsa_pos_end = 1;
+  listnode_add (area->oiflist, oi);
+}
+
+int
+main (void)
+{
+  struct test *t;
+  int oldfailed;
+
+  zlog_default = openzlog ("testospfspf", ZLOG_OSPF,
+			   LOG_CONS|LOG_NDELAY|LOG_PID, LOG_DAEMON);
+  zlog_set_level (NULL, ZLOG_DEST_SYSLOG, ZLOG_DISABLED);
+  zlog_set_level (NULL, ZLOG_DEST_STDOUT, LOG_WARNING);
+  zlog_set_level (NULL, ZLOG_DEST_MONITOR, ZLOG_DISABLED);
+
+  ospf_master_init ();
+  master = om->master;
+  ospf_if_init ();
+  zclient = zclient_new ();
+  TERM_DEBUG_ON (spf, SPF_VERIFY);
+
+  ospf_setup ();
+  topology ();
+
+  if (fileno (stdout) >= 0)
+    tty = isatty (fileno (stdout));
+
+  for (t = tests; t->name; t++)
+    {
+      printf ("%s: %s\n", t->name, t->desc);
+      oldfailed = failed;
+      t->func ();
+
+      if (tty)
+	printf ("%s", (failed > oldfailed) ? VT100_RED "failed!" VT100_RESET
+					   : VT100_GREEN "OK" VT100_RESET);
+      else
+	printf ("%s", (failed > oldfailed) ? "failed!" : "OK");
+      printf ("\n\n");
+    }
+
+  printf ("failures: %d\n", failed);
+  return failed;
+}
@@ -0,0 +1,312 @@
+/*
+ * Prefix-list tests.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "prefix.h"
+#include "memory.h"
+#include "command.h"
+#include "plist.h"
+
+#include "prng.h"
+
+/* Entries are added with the ORF interface, which takes the sequence
+   number, ge and le of each, and checked against a walk over them in
+   sequence order. */
+struct ref_entry
+{
+  int set;
+  int permit;
+  struct orf_prefix orf;
+};
+
+#define BENCH_ENTRIES	50000
+#define BENCH_APPLIES	200000
+#define BENCH_WALKS	2000
+
+struct thread_master *master;
+
+static struct prng *prng;
+static int verbose;
+
+static int
+ref_match (struct ref_entry *e, struct prefix *p)
+{
+  if (! prefix_match (&e->orf.p, p))
+    return 0;
+  if (! e->orf.ge && ! e->orf.le)
+    return e->orf.p.prefixlen == p->prefixlen;
+  if (e->orf.le && p->prefixlen > e->orf.le)
+    return 0;
+  if (e->orf.ge && p->prefixlen < e->orf.ge)
+    return 0;
+  return 1;
+}
+
+static enum prefix_list_type
+ref_apply (struct ref_entry *ref, int n, struct prefix *p)
+{
+  int i, count = 0;
+
+  for (i = 0; i < n; i++)
+    if (ref[i].set)
+      {
+	count++;
+	if (ref_match (&ref[i], p))
+	  return ref[i].permit ? PREFIX_PERMIT : PREFIX_DENY;
+      }
+  return count ? PREFIX_DENY : PREFIX_PERMIT;
+}
+
+/* Prefixes below a few /8s, so that the entries overlap a lot. */
+static void
+random_prefix (struct prefix *p)
+{
+  memset (p, 0, sizeof (*p));
+  p->family = AF_INET;
+  p->prefixlen = prng_rand (prng) % 33;
+  p->u.prefix4.s_addr = htonl (((10 + prng_rand (prng) % 3) << 24)
+			       | (prng_rand (prng) & 0x00ffffff));
+  apply_mask (p);
+}
+
+static void
+random_entry (struct ref_entry *e, int seq)
+{
+  int len;
+
+  memset (e, 0, sizeof (*e));
+  random_prefix (&e->orf.p);
+  len = e->orf.p.prefixlen;
+  e->orf.seq = seq;
+  e->permit = prng_rand (prng) % 2;
+
+  if (len < 32)
+    switch (prng_rand (prng) % 4)
+      {
+      case 1:
+	e->orf.ge = len + 1 + prng_rand (prng) % (32 - len);
+	break;
+      case 2:
+	e->orf.le = len + 1 + prng_rand (prng) % (32 - len);
+	break;
+      case 3:
+	e->orf.ge = len + 1 + prng_rand (prng) % (32 - len);
+	e->orf.le = e->orf.ge + prng_rand (prng) % (33 - e->orf.ge);
+	break;
+      }
+}
+
+/* Mostly prefixes below or at entries, some anywhere. */
+static void
+random_query (struct ref_entry *ref, int n, struct prefix *p)
+{
+  struct ref_entry *e = &ref[prng_rand (prng) % n];
+  int len;
+
+  if (prng_rand (prng) % 4 == 0 || ! e->set)
+    {
+      random_prefix (p);
+      return;
+    }
+
+  *p = e->orf.p;
+  len = p->prefixlen + prng_rand (prng) % (33 - p->prefixlen);
+  p->u.prefix4.s_addr |= htonl (prng_rand (prng) & 0x0fffffff)
+			 & ~p->u.prefix4.s_addr;
+  p->prefixlen = len;
+  apply_mask (p);
+}
+
+static int
+add_entries (const char *name, struct ref_entry *ref, int n)
+{
+  int i, j, added = 0;
+  int *order;
+
+  /* Add them out of sequence order. */
+  order = malloc (n * sizeof (int));
+  for (i = 0; i < n; i++)
+    order[i] = i;
+  for (i = n - 1; i > 0; i--)
+    {
+      j = prng_rand (prng) % (i + 1);
+      added = order[i];
+      order[i] = order[j];
+      order[j] = added;
+    }
+
+  for (i = 0, added = 0; i < n; i++)
+    {
+      struct ref_entry *e = &ref[order[i]];
+
+      /* Short prefixes run out, so retry duplicates a few times. */
+      for (j = 0; j < 10 && ! e->set; j++)
+	{
+	  random_entry (e, (order[i] + 1) * 5);
+	  if (prefix_bgp_orf_set ((char *) name, AFI_IP, &e->orf,
+				  e->permit, 1) == CMD_SUCCESS)
+	    {
+	      e->set = 1;
+	      added++;
+	    }
+	}
+    }
+  free (order);
+  return added;
+}
+
+static int
+compare (const char *name, struct ref_entry *ref, int n, int queries)
+{
+  struct prefix_list *plist;
+  struct prefix p;
+  char buf[INET_ADDRSTRLEN];
+  int i;
+
+  plist = prefix_list_lookup (AFI_ORF_PREFIX, name);
+  for (i = 0; i < queries; i++)
+    {
+      random_query (ref, n, &p);
+      if (prefix_list_apply (plist, &p) != ref_apply (ref, n, &p))
+	{
+	  printf ("%s: %s/%d differs\n", name,
+		  inet_ntop (AF_INET, &p.u.prefix4, buf, sizeof (buf)),
+		  p.prefixlen);
+	  return 1;
+	}
+    }
+  return 0;
+}
+
+static int
+test_compare (int n)
+{
+  struct ref_entry *ref;
+  char name[32];
+  int i, failed = 0;
+
+  snprintf (name, sizeof (name), "compare-%d", n);
+  ref = calloc (n, sizeof (struct ref_entry));
+
+  add_entries (name, ref, n);
+  failed += compare (name, ref, n, 20000);
+
+  /* Take some out again, and replace some by sequence number. */
+  for (i = 0; i < n; i += 3)
+    if (ref[i].set
+	&& prefix_bgp_orf_set (name, AFI_IP, &ref[i].orf,
+			       ref[i].permit, 0) == CMD_SUCCESS)
+      ref[i].set = 0;
+  failed += compare (name, ref, n, 20000);
+
+  for (i = 1; i < n; i += 7)
+    {
+      struct ref_entry e;
+
+      random_entry (&e, (i + 1) * 5);
+      if (prefix_bgp_orf_set (name, AFI_IP, &e.orf, e.permit, 1)
+	  == CMD_SUCCESS)
+	{
+	  ref[i] = e;
+	  ref[i].set = 1;
+	}
+    }
+  failed += compare (name, ref, n, 20000);
+
+  prefix_bgp_orf_remove_all (name);
+  free (ref);
+  return failed;
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
+}
+
+static void
+bench (void)
+{
+  struct ref_entry *ref;
+  struct prefix_list *plist;
+  struct prefix *queries;
+  struct timeval start;
+  double t;
+  int i, added;
+
+  ref = calloc (BENCH_ENTRIES, sizeof (struct ref_entry));
+  queries = calloc (BENCH_APPLIES, sizeof (struct prefix));
+
+  gettimeofday (&start, NULL);
+  added = add_entries ("bench", ref, BENCH_ENTRIES);
+  printf ("%d entries added in %.3fs\n", added, elapsed (&start));
+
+  for (i = 0; i < BENCH_APPLIES; i++)
+    random_query (ref, BENCH_ENTRIES, &queries[i]);
+  plist = prefix_list_lookup (AFI_ORF_PREFIX, "bench");
+
+  /* The first apply builds the trie. */
+  gettimeofday (&start, NULL);
+  prefix_list_apply (plist, &queries[0]);
+  printf ("index built in %.3fs\n", elapsed (&start));
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < BENCH_APPLIES; i++)
+    prefix_list_apply (plist, &queries[i]);
+  t = elapsed (&start);
+  printf ("prefix_list_apply: %.0f prefixes/s\n", BENCH_APPLIES / t);
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < BENCH_WALKS; i++)
+    ref_apply (ref, BENCH_ENTRIES, &queries[i]);
+  t = elapsed (&start);
+  printf ("linear walk: %.0f prefixes/s\n", BENCH_WALKS / t);
+
+  prefix_bgp_orf_remove_all ("bench");
+  free (queries);
+  free (ref);
+}
+
+int
+main (int argc, char **argv)
+{
+  int failed = 0;
+
+  verbose = (argc > 1);
+  prng = prng_new (0);
+
+  /* Below and above the size lists are indexed from. */
+  if (test_compare (5) || test_compare (60) || test_compare (5000))
+    failed++;
+  else
+    printf ("Compare test passed.\n");
+
+  if (verbose)
+    bench ();
+
+  prng_free (prng);
+  return failed;
+}
@@ -0,0 +1,236 @@
+/*
+ * Route table insert and lookup performance.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/*
+ * Usage: test-table-performance [FILE]
+ *
+ * FILE holds one IPv4 prefix per line, such as a full table dumped
+ * with "show ip bgp" and cut down to its prefixes.  Without it, a
+ * table with the prefix length mix of the IPv4 default-free zone is
+ * made up.
+ */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "memory.h"
+
+#include "prng.h"
+
+#define TABLE_SIZE	900000
+#define LOOKUPS		2000000
+
+struct thread_master *master;
+
+static struct prefix_ipv4 *prefixes;
+static int nprefixes;
+static struct in_addr *addrs;
+
+/* Share of the table in per mille by prefix length, roughly as in the
+   default-free zone. */
+static const struct
+{
+  int len;
+  int share;
+} mix[] =
+{
+  { 8, 1 }, { 12, 1 }, { 13, 2 }, { 14, 4 }, { 15, 6 }, { 16, 14 },
+  { 17, 9 }, { 18, 16 }, { 19, 28 }, { 20, 44 }, { 21, 50 },
+  { 22, 120 }, { 23, 100 }, { 24, 605 },
+};
+
+static struct route_node *
+bench_node_create (route_table_delegate_t *delegate,
+		   struct route_table *table)
+{
+  return XCALLOC (MTYPE_ROUTE_NODE, sizeof (struct route_node));
+}
+
+static void
+bench_node_destroy (route_table_delegate_t *delegate,
+		    struct route_table *table, struct route_node *node)
+{
+  XFREE (MTYPE_ROUTE_NODE, node);
+}
+
+static route_table_delegate_t plain_delegate = {
+  .create_node = bench_node_create,
+  .destroy_node = bench_node_destroy,
+  .index_threshold = 0
+};
+
+static route_table_delegate_t indexed_delegate = {
+  .create_node = bench_node_create,
+  .destroy_node = bench_node_destroy,
+  .index_threshold = ROUTE_TABLE_INDEX_THRESHOLD
+};
+
+static void
+make_prefixes (struct prng *prng)
+{
+  unsigned int r;
+  int i, j;
+
+  prefixes = calloc (TABLE_SIZE, sizeof (struct prefix_ipv4));
+  for (i = 0; i < TABLE_SIZE; i++)
+    {
+      r = prng_rand (prng) % 1000;
+      for (j = 0; r >= (unsigned) mix[j].share; j++)
+	r -= mix[j].share;
+
+      prefixes[i].family = AF_INET;
+      prefixes[i].prefixlen = mix[j].len;
+      prefixes[i].prefix.s_addr = htonl (((1 + prng_rand (prng) % 223) << 24)
+					 | (prng_rand (prng) & 0xffffff));
+      apply_mask_ipv4 (&prefixes[i]);
+    }
+  nprefixes = TABLE_SIZE;
+}
+
+static int
+read_prefixes (const char *name)
+{
+  FILE *fp;
+  char line[128];
+  int size = 0;
+
+  fp = fopen (name, "r");
+  if (! fp)
+    {
+      perror (name);
+      return -1;
+    }
+
+  while (fgets (line, sizeof (line), fp))
+    {
+      line[strcspn (line, " \t\r\n")] = '\0';
+      if (nprefixes == size)
+	{
+	  size = size ? size * 2 : 65536;
+	  prefixes = realloc (prefixes, size * sizeof (struct prefix_ipv4));
+	}
+      if (str2prefix_ipv4 (line, &prefixes[nprefixes]) > 0)
+	apply_mask_ipv4 (&prefixes[nprefixes++]);
+    }
+  fclose (fp);
+  return 0;
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
+}
+
+static void
+bench (const char *name, route_table_delegate_t *delegate)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct timeval start;
+  unsigned long found = 0;
+  double t;
+  int i;
+
+  table = route_table_init_with_delegate (delegate);
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < nprefixes; i++)
+    {
+      rn = route_node_get (table, (struct prefix *) &prefixes[i]);
+      if (rn->info)
+	route_unlock_node (rn);
+      else
+	rn->info = rn;
+    }
+  t = elapsed (&start);
+  printf ("%s: %lu routes inserted at %.0f/s\n", name,
+	  route_table_count (table), nprefixes / t);
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < LOOKUPS; i++)
+    {
+      rn = route_node_match_ipv4 (table, &addrs[i]);
+      if (rn)
+	{
+	  found++;
+	  route_unlock_node (rn);
+	}
+    }
+  t = elapsed (&start);
+  printf ("%s: %lu of %d addresses matched at %.0f lookups/s\n", name,
+	  found, LOOKUPS, LOOKUPS / t);
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < nprefixes; i++)
+    {
+      rn = route_node_lookup (table, (struct prefix *) &prefixes[i]);
+      if (rn)
+	{
+	  rn->info = NULL;
+	  route_unlock_node (rn);
+	  route_unlock_node (rn);
+	}
+    }
+  t = elapsed (&start);
+  printf ("%s: routes removed at %.0f/s\n", name, nprefixes / t);
+
+  route_table_finish (table);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct prng *prng;
+  int i;
+
+  prng = prng_new (0);
+
+  if (argc > 1)
+    {
+      if (read_prefixes (argv[1]) < 0)
+	return 1;
+    }
+  else
+    make_prefixes (prng);
+
+  if (! nprefixes)
+    {
+      fprintf (stderr, "no prefixes\n");
+      return 1;
+    }
+
+  /* Addresses below routes of the table, as traffic would be. */
+  addrs = calloc (LOOKUPS, sizeof (struct in_addr));
+  for (i = 0; i < LOOKUPS; i++)
+    addrs[i].s_addr = prefixes[prng_rand (prng) % nprefixes].prefix.s_addr
+		      | htonl (prng_rand (prng) & 0xff);
+
+  bench ("plain", &plain_delegate);
+  bench ("indexed", &indexed_delegate);
+
+  prng_free (prng);
+  return 0;
+}
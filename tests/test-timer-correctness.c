@@ -36,6 +36,19 @@
 #define SCHEDULE_TIMERS 800
 #define REMOVE_TIMERS   200
 
+/* Whole-second timers go on the timing wheel.  Half are added before
+ * the run, some of those removed again, and half in batches during the
+ * first second, so that they expire at times well apart.  Then msec
+ * timers add more and every other one cancels the earliest left, which
+ * the wheel has cached as the time to wait for.  A stale cached time
+ * shows as timers run late, or as the loop spinning until the next. */
+#define WHEEL_TIMERS    400
+#define WHEEL_REMOVE    50
+#define WHEEL_BATCHES   10
+#define WHEEL_CHURN     40
+#define WHEEL_LATE_MSEC 100
+#define WHEEL_CPU_MSEC  100
+
 #define TIMESTR_LEN strlen("4294967296.999999")
 
 struct thread_master *master;
@@ -54,30 +67,42 @@ static struct thread **timers;
 
 static int timers_pending;
 
-static void terminate_test(void)
+struct wheel_timer
+{
+  struct thread *thread;
+  struct timeval sands;
+  int order;
+  int cancelled;
+};
+
+static struct wheel_timer *wheel;
+static int wheel_count;
+static int wheel_late;
+static int churn_count;
+
+static int check_output(const char *match)
 {
-  int exit_code;
-
   if (strcmp(log_buf, expected_buf))
     {
       fprintf(stderr, "Expected output and received output differ.\n");
       fprintf(stderr, "---Expected output: ---\n%s", expected_buf);
       fprintf(stderr, "---Actual output: ---\n%s", log_buf);
-      exit_code = 1;
-    }
-  else
-    {
-      printf("Expected output and actual output match.\n");
-      exit_code = 0;
+      return 1;
     }
 
-  thread_master_free(master);
-  XFREE(MTYPE_TMP, log_buf);
-  XFREE(MTYPE_TMP, expected_buf);
-  prng_free(prng);
-  XFREE(MTYPE_TMP, timers);
+  printf("%s\n", match);
+  return 0;
+}
 
-  exit(exit_code);
+static void log_sands(struct timeval *sands)
+{
+  int rv;
+
+  rv = snprintf(log_buf + log_buf_pos, log_buf_len - log_buf_pos,
+                "%ld.%06ld\n", sands->tv_sec, sands->tv_usec);
+  assert(rv >= 0);
+  log_buf_pos += rv;
+  assert(log_buf_pos < log_buf_len);
 }
 
 static int timer_func(struct thread *thread)
@@ -92,12 +117,77 @@ static int timer_func(struct thread *thread)
   XFREE(MTYPE_TMP, thread->arg);
 
   timers_pending--;
-  if (!timers_pending)
-    terminate_test();
 
   return 0;
 }
 
+static int wheel_func(struct thread *thread)
+{
+  struct wheel_timer *timer = thread->arg;
+  struct timeval now = recent_relative_time();
+
+  if (timercmp(&now, &timer->sands, <)
+      || timeval_elapsed(now, timer->sands) > WHEEL_LATE_MSEC * 1000)
+    wheel_late++;
+
+  log_sands(&timer->sands);
+  timer->thread = NULL;
+  timers_pending--;
+
+  return 0;
+}
+
+static void wheel_add(long interval_sec)
+{
+  struct wheel_timer *timer = &wheel[wheel_count];
+
+  timer->order = wheel_count++;
+  assert(wheel_count <= WHEEL_TIMERS + WHEEL_CHURN);
+  timer->thread = thread_add_timer(master, wheel_func, timer, interval_sec);
+  timer->sands = timer->thread->u.sands;
+  timers_pending++;
+}
+
+static void wheel_cancel(struct wheel_timer *timer)
+{
+  thread_cancel(timer->thread);
+  timer->thread = NULL;
+  timer->cancelled = 1;
+  timers_pending--;
+}
+
+static int batch_func(struct thread *thread)
+{
+  int i;
+
+  for (i = 0; i < WHEEL_TIMERS / 2 / WHEEL_BATCHES; i++)
+    wheel_add(prng_rand(prng) % 5);
+
+  timers_pending--;
+  return 0;
+}
+
+static int churn_func(struct thread *thread)
+{
+  struct wheel_timer *first = NULL;
+  int i;
+
+  if (churn_count++ % 2)
+    {
+      for (i = 0; i < wheel_count; i++)
+        if (wheel[i].thread
+            && (!first || timercmp(&wheel[i].sands, &first->sands, <)))
+          first = &wheel[i];
+      if (first)
+        wheel_cancel(first);
+    }
+
+  wheel_add(prng_rand(prng) % 3);
+
+  timers_pending--;
+  return 0;
+}
+
 static int cmp_timeval(const void* a, const void *b)
 {
   const struct timeval *ta = *(struct timeval * const *)a;
@@ -110,9 +200,98 @@ static int cmp_timeval(const void* a, const void *b)
   return 0;
 }
 
+static int cmp_wheel_timer(const void* a, const void *b)
+{
+  const struct wheel_timer *ta = a;
+  const struct wheel_timer *tb = b;
+
+  if (timercmp(&ta->sands, &tb->sands, <))
+    return -1;
+  if (timercmp(&ta->sands, &tb->sands, >))
+    return 1;
+  return ta->order - tb->order;
+}
+
+static unsigned long cpu_msec(void)
+{
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000
+         + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000;
+}
+
+static int test_wheel(void)
+{
+  struct thread t;
+  unsigned long cpu;
+  int i;
+
+  log_buf_pos = 0;
+  log_buf[0] = '\0';
+  expected_buf_pos = 0;
+  wheel = XCALLOC(MTYPE_TMP, (WHEEL_TIMERS + WHEEL_CHURN) * sizeof(*wheel));
+  wheel_count = 0;
+
+  /* Schedule timers to expire in 0..4 seconds */
+  for (i = 0; i < WHEEL_TIMERS / 2; i++)
+    wheel_add(prng_rand(prng) % 5);
+
+  for (i = 0; i < WHEEL_REMOVE; i++)
+    {
+      struct wheel_timer *timer = &wheel[prng_rand(prng) % (WHEEL_TIMERS / 2)];
+
+      if (timer->thread)
+        wheel_cancel(timer);
+    }
+
+  for (i = 0; i < WHEEL_BATCHES; i++)
+    thread_add_timer_msec(master, batch_func, NULL, prng_rand(prng) % 1000);
+  for (i = 0; i < WHEEL_CHURN; i++)
+    thread_add_timer_msec(master, churn_func, NULL, prng_rand(prng) % 4000);
+  timers_pending += WHEEL_BATCHES + WHEEL_CHURN;
+
+  cpu = cpu_msec();
+  while (timers_pending && thread_fetch(master, &t))
+    thread_call(&t);
+  cpu = cpu_msec() - cpu;
+
+  /* Timers were added in order of their expiry within each second, so
+   * sorting them keeps the order they were added in for equal times. */
+  qsort(wheel, wheel_count, sizeof(*wheel), cmp_wheel_timer);
+  for (i = 0; i < wheel_count; i++)
+    {
+      int ret;
+
+      if (wheel[i].cancelled)
+        continue;
+      ret = snprintf(expected_buf + expected_buf_pos,
+                     expected_buf_len - expected_buf_pos,
+                     "%ld.%06ld\n", wheel[i].sands.tv_sec,
+                     wheel[i].sands.tv_usec);
+      assert(ret > 0);
+      expected_buf_pos += ret;
+      assert(expected_buf_pos < expected_buf_len);
+    }
+  XFREE(MTYPE_TMP, wheel);
+
+  if (wheel_late)
+    {
+      fprintf(stderr, "%d wheel timers ran at the wrong time.\n", wheel_late);
+      return 1;
+    }
+  if (cpu > WHEEL_CPU_MSEC)
+    {
+      fprintf(stderr, "Waiting for wheel timers took %lu msec of CPU.\n", cpu);
+      return 1;
+    }
+  return check_output("Wheel timers ran in order.");
+}
+
 int main(int argc, char **argv)
 {
   int i, j;
+  int exit_code;
   struct thread t;
   struct timeval **alarms;
 
@@ -187,8 +366,18 @@ int main(int argc, char **argv)
     }
   XFREE(MTYPE_TMP, alarms);
 
-  while (thread_fetch(master, &t))
+  while (timers_pending && thread_fetch(master, &t))
     thread_call(&t);
 
-  return 0;
+  exit_code = check_output("Expected output and actual output match.");
+  if (!exit_code)
+    exit_code = test_wheel();
+
+  thread_master_free(master);
+  XFREE(MTYPE_TMP, log_buf);
+  XFREE(MTYPE_TMP, expected_buf);
+  prng_free(prng);
+  XFREE(MTYPE_TMP, timers);
+
+  return exit_code;
 }
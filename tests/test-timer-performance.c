@@ -41,34 +41,27 @@ static int dummy_func(struct thread *thread)
   return 0;
 }
 
-int main(int argc, char **argv)
+/* Schedule timers with random delays of whole seconds, once through the
+ * msec interface, which puts them on the pqueue, and once as plain
+ * second timers, which go on the timing wheel. */
+static void run(struct prng *prng, struct thread **timers, int wheel)
 {
-  struct prng *prng;
   int i;
-  struct thread **timers;
   struct timeval tv_start, tv_lap, tv_stop;
   unsigned long t_schedule, t_remove;
 
-  master = thread_master_create();
-  prng = prng_new(0);
-  timers = calloc(SCHEDULE_TIMERS, sizeof(*timers));
-
-  /* create thread structures so they won't be allocated during the
-   * time measurement */
-  for (i = 0; i < SCHEDULE_TIMERS; i++)
-    timers[i] = thread_add_timer_msec(master, dummy_func, NULL, 0);
-  for (i = 0; i < SCHEDULE_TIMERS; i++)
-    thread_cancel(timers[i]);
-
   quagga_gettime(QUAGGA_CLK_MONOTONIC, &tv_start);
 
   for (i = 0; i < SCHEDULE_TIMERS; i++)
     {
-      long interval_msec;
-
-      interval_msec = prng_rand(prng) % (100 * SCHEDULE_TIMERS);
-      timers[i] = thread_add_timer_msec(master, dummy_func,
-                                        NULL, interval_msec);
+      long interval_sec;
+
+      interval_sec = prng_rand(prng) % 3600;
+      if (wheel)
+        timers[i] = thread_add_timer(master, dummy_func, NULL, interval_sec);
+      else
+        timers[i] = thread_add_timer_msec(master, dummy_func,
+                                          NULL, 1000 * interval_sec);
     }
 
   quagga_gettime(QUAGGA_CLK_MONOTONIC, &tv_lap);
@@ -85,17 +78,44 @@ int main(int argc, char **argv)
 
   quagga_gettime(QUAGGA_CLK_MONOTONIC, &tv_stop);
 
+  for (i = 0; i < SCHEDULE_TIMERS; i++)
+    if (timers[i])
+      thread_cancel(timers[i]);
+
   t_schedule = 1000 * (tv_lap.tv_sec - tv_start.tv_sec);
   t_schedule += (tv_lap.tv_usec - tv_start.tv_usec) / 1000;
 
   t_remove = 1000 * (tv_stop.tv_sec - tv_lap.tv_sec);
   t_remove += (tv_stop.tv_usec - tv_lap.tv_usec) / 1000;
 
-  printf("Scheduling %d random timers took %ld.%03ld seconds.\n",
-         SCHEDULE_TIMERS, t_schedule/1000, t_schedule%1000);
-  printf("Removing %d random timers took %ld.%03ld seconds.\n",
-         REMOVE_TIMERS, t_remove/1000, t_remove%1000);
+  printf("%s: Scheduling %d random timers took %ld.%03ld seconds.\n",
+         wheel ? "wheel " : "pqueue", SCHEDULE_TIMERS,
+         t_schedule/1000, t_schedule%1000);
+  printf("%s: Removing %d random timers took %ld.%03ld seconds.\n",
+         wheel ? "wheel " : "pqueue", REMOVE_TIMERS,
+         t_remove/1000, t_remove%1000);
   fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+  struct prng *prng;
+  int i;
+  struct thread **timers;
+
+  master = thread_master_create();
+  prng = prng_new(0);
+  timers = calloc(SCHEDULE_TIMERS, sizeof(*timers));
+
+  /* create thread structures so they won't be allocated during the
+   * time measurement */
+  for (i = 0; i < SCHEDULE_TIMERS; i++)
+    timers[i] = thread_add_timer_msec(master, dummy_func, NULL, 0);
+  for (i = 0; i < SCHEDULE_TIMERS; i++)
+    thread_cancel(timers[i]);
+
+  run(prng, timers, 0);
+  run(prng, timers, 1);
 
   free(timers);
   thread_master_free(master);
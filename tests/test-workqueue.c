@@ -0,0 +1,240 @@
+/*
+ * Work queue tests.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "memory.h"
+#include "workqueue.h"
+
+#define ITEMS	10000
+#define ADDED	500
+
+struct thread_master *master;
+
+static int verbose;
+
+/* What happened to the items, indexed by item. */
+static int runs[ITEMS + ADDED];
+static int deleted[ITEMS + ADDED];
+static int order[ITEMS + ADDED];
+static int done;
+static int completed;
+static int blocked;
+
+static long
+item_of (void *data)
+{
+  return (long) data - 1;
+}
+
+/* Every 7th of the first items wants to go to the back of the queue
+   once, item 100 holds the queue up once and item 5000 queues more
+   items, by which time the ring has wrapped around. */
+static wq_item_status
+order_func (struct work_queue *wq, void *data)
+{
+  long i = item_of (data);
+  long j;
+
+  if (i < ITEMS && i % 7 == 0 && runs[i]++ == 0)
+    return WQ_REQUEUE;
+  if (i == 100 && ! blocked++)
+    return WQ_QUEUE_BLOCKED;
+  if (i == 5000)
+    for (j = ITEMS; j < ITEMS + ADDED; j++)
+      work_queue_add (wq, (void *) (j + 1));
+
+  order[done++] = i;
+  return WQ_SUCCESS;
+}
+
+static void
+order_del (struct work_queue *wq, void *data)
+{
+  deleted[item_of (data)]++;
+}
+
+static void
+order_completion (struct work_queue *wq)
+{
+  completed++;
+}
+
+static void
+drain (struct work_queue *wq)
+{
+  struct thread thread;
+
+  while (work_queue_item_count (wq))
+    if (thread_fetch (master, &thread))
+      thread_call (&thread);
+}
+
+static int
+test_order (void)
+{
+  struct work_queue *wq;
+  long i, j;
+  int n, failed = 0;
+
+  wq = work_queue_new (master, "order");
+  wq->spec.workfunc = order_func;
+  wq->spec.del_item_data = order_del;
+  wq->spec.completion_func = order_completion;
+  wq->spec.hold = 0;
+
+  for (i = 0; i < ITEMS; i++)
+    work_queue_add (wq, (void *) (i + 1));
+  if (work_queue_item_count (wq) != ITEMS
+      || item_of (work_queue_item_peek (wq, 0)) != 0
+      || item_of (work_queue_item_peek (wq, ITEMS - 1)) != ITEMS - 1
+      || work_queue_item_peek (wq, ITEMS) != NULL)
+    {
+      printf ("peek failed\n");
+      failed++;
+    }
+
+  drain (wq);
+
+  /* Items in order, except that the requeued ones follow the rest,
+     and the added ones come after those requeued up to then. */
+  if (done != ITEMS + ADDED)
+    {
+      printf ("%d items done\n", done);
+      failed++;
+    }
+  for (i = 0, n = 0; i < ITEMS; i++)
+    if (i % 7 && order[n++] != i)
+      {
+	printf ("item %ld out of order\n", i);
+	failed++;
+	break;
+      }
+  for (i = 0; i < ITEMS; i += 7)
+    {
+      if (i > 5000 && i - 7 < 5000)
+	for (j = ITEMS; j < ITEMS + ADDED; j++)
+	  if (order[n++] != j)
+	    {
+	      printf ("added item %ld out of order\n", j);
+	      failed++;
+	      break;
+	    }
+      if (order[n++] != i)
+	{
+	  printf ("requeued item %ld out of order\n", i);
+	  failed++;
+	  break;
+	}
+    }
+
+  for (i = 0; i < ITEMS + ADDED; i++)
+    if (deleted[i] != 1)
+      {
+	printf ("item %ld deleted %d times\n", i, deleted[i]);
+	failed++;
+	break;
+      }
+  if (completed != 1)
+    {
+      printf ("completed %d times\n", completed);
+      failed++;
+    }
+
+  work_queue_free (wq);
+  return failed;
+}
+
+/* Items of about 100us, in runs of about 1ms. */
+static wq_item_status
+slow_func (struct work_queue *wq, void *data)
+{
+  struct timeval start, now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  do
+    quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  while (timeval_elapsed (now, start) < 100);
+
+  return WQ_SUCCESS;
+}
+
+static int
+test_slice (void)
+{
+  struct work_queue *wq;
+  unsigned long total = 0;
+  long i;
+  int failed = 0;
+
+  wq = work_queue_new (master, "slice");
+  wq->spec.workfunc = slow_func;
+  wq->spec.hold = 0;
+  wq->spec.slice = 1000;
+
+  for (i = 0; i < 200; i++)
+    work_queue_add (wq, (void *) (i + 1));
+  drain (wq);
+
+  for (i = 0; i < WQ_HIST_BUCKETS; i++)
+    total += wq->time.hist[i];
+  if (total != wq->runs)
+    {
+      printf ("%lu runs counted, %lu made\n", total, wq->runs);
+      failed++;
+    }
+
+  /* 20ms of work cannot be done in 1ms slices in fewer than 20 runs,
+     and with the granularity adapting it should not take many more. */
+  if (wq->runs < 20 || wq->runs > 100)
+    {
+      printf ("%lu runs\n", wq->runs);
+      failed++;
+    }
+  if (verbose)
+    printf ("%lu runs, granularity %u, longest %luus\n",
+	    wq->runs, wq->cycles.granularity, wq->time.max);
+
+  work_queue_free (wq);
+  return failed;
+}
+
+int
+main (int argc, char **argv)
+{
+  int failed = 0;
+
+  verbose = (argc > 1);
+  master = thread_master_create ();
+
+  if (test_order ())
+    failed++;
+  else
+    printf ("Order test passed.\n");
+
+  if (test_slice ())
+    failed++;
+  else
+    printf ("Slice test passed.\n");
+
+  return failed;
+}
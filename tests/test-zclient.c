@@ -0,0 +1,590 @@
+/*
+ * Zclient route message batching and ring tests.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+#include <sys/wait.h>
+
+#include "thread.h"
+#include "prefix.h"
+#include "stream.h"
+#include "memory.h"
+#include "network.h"
+#include "zclient.h"
+#include "zring.h"
+
+#include "prng.h"
+
+/* Routes are sent through a socket pair as a routing daemon would,
+   and what comes out the other end is decoded as zebra would. */
+#define ROUTES		5000
+#define NEXTHOPS	4
+
+/* Messages a producer process sends through a ring, some of them
+   through the socket instead. */
+#define RING_MSGS	200000
+
+struct ref_route
+{
+  int add;
+  struct prefix_ipv4 p;
+  struct in_addr nexthop;
+  u_int32_t metric;
+};
+
+struct thread_master *master;
+
+static struct prng *prng;
+static int verbose;
+static struct zclient *zclient;
+static int sock;
+
+static u_char *rxbuf;
+static size_t rxlen, rxsize;
+
+/* Take in whatever the zclient wrote, so its socket never fills. */
+static void
+drain (void)
+{
+  ssize_t n;
+
+  for (;;)
+    {
+      if (rxsize - rxlen < 65536)
+	{
+	  rxsize = rxsize ? rxsize * 2 : 1 << 20;
+	  rxbuf = realloc (rxbuf, rxsize);
+	}
+      n = read (sock, rxbuf + rxlen, rxsize - rxlen);
+      if (n <= 0)
+	break;
+      rxlen += n;
+    }
+}
+
+/* Run the events the zclient scheduled, as its daemon would on
+   returning to the thread loop. */
+static void
+run_events (void)
+{
+  struct thread thread;
+
+  /* Only the flush event is pending, so this does not block. */
+  while (zclient->t_batch && thread_fetch (master, &thread))
+    thread_call (&thread);
+}
+
+static void
+make_routes (struct ref_route *ref, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      memset (&ref[i], 0, sizeof (ref[i]));
+      ref[i].p.family = AF_INET;
+      ref[i].p.prefixlen = 8 + prng_rand (prng) % 25;
+      ref[i].p.prefix.s_addr = htonl (0x0a000000 | (i << 8)
+				      | (prng_rand (prng) & 0xff));
+      apply_mask_ipv4 (&ref[i].p);
+      /* Runs of adds or deletes through the same nexthop, as a
+         protocol that walks its table would send. */
+      if (i && prng_rand (prng) % 16)
+	{
+	  ref[i].add = ref[i - 1].add;
+	  ref[i].nexthop = ref[i - 1].nexthop;
+	}
+      else
+	{
+	  ref[i].add = (prng_rand (prng) % 4 != 0);
+	  ref[i].nexthop.s_addr = htonl (0xc0000201
+					 + prng_rand (prng) % NEXTHOPS);
+	}
+      ref[i].metric = prng_rand (prng) % 3;
+    }
+}
+
+static void
+send_route (struct ref_route *r)
+{
+  struct zapi_ipv4 api;
+  struct in_addr *nexthop = &r->nexthop;
+
+  memset (&api, 0, sizeof (api));
+  api.type = ZEBRA_ROUTE_OSPF;
+  api.safi = SAFI_UNICAST;
+  SET_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP);
+  api.nexthop_num = 1;
+  api.nexthop = &nexthop;
+  SET_FLAG (api.message, ZAPI_MESSAGE_METRIC);
+  api.metric = r->metric;
+
+  zapi_ipv4_route (r->add ? ZEBRA_IPV4_ROUTE_ADD : ZEBRA_IPV4_ROUTE_DELETE,
+		   zclient, &r->p, &api);
+}
+
+/* Read the part of a route message before the prefix, and in bulk
+   messages the nexthop after it; returns 0 if it is not as this test
+   sends it. */
+static int
+decode_shared (struct stream *s, int bulk, struct in_addr *nexthop,
+	       u_char *message)
+{
+  if (stream_getc (s) != ZEBRA_ROUTE_OSPF)
+    return 0;
+  stream_getc (s);
+  *message = stream_getc (s);
+  if (stream_getw (s) != SAFI_UNICAST)
+    return 0;
+  if (! bulk)
+    return 1;
+  if (stream_getc (s) != 1 || stream_getc (s) != ZEBRA_NEXTHOP_IPV4)
+    return 0;
+  nexthop->s_addr = stream_get_ipv4 (s);
+  return 1;
+}
+
+static int
+decode_prefix (struct stream *s, struct prefix_ipv4 *p)
+{
+  memset (p, 0, sizeof (*p));
+  p->family = AF_INET;
+  p->prefixlen = stream_getc (s);
+  if (p->prefixlen > IPV4_MAX_BITLEN)
+    return 0;
+  stream_get (&p->prefix, s, PSIZE (p->prefixlen));
+  return 1;
+}
+
+/* Decode all received messages and check them against the routes
+   sent.  A redistribute message is expected after route MARK. */
+static int
+check (struct ref_route *ref, int n, int mark, int *msgs)
+{
+  struct stream *s;
+  struct prefix_ipv4 p;
+  struct in_addr nexthop;
+  u_int16_t length, command, count;
+  u_char message;
+  u_int32_t metric;
+  size_t off;
+  int i = 0, seen_mark = 0;
+
+  s = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  *msgs = 0;
+
+  for (off = 0; off + ZEBRA_HEADER_SIZE <= rxlen; off += length)
+    {
+      length = (rxbuf[off] << 8) | rxbuf[off + 1];
+      if (length < ZEBRA_HEADER_SIZE || length > ZEBRA_MAX_PACKET_SIZ
+	  || off + length > rxlen)
+	{
+	  printf ("bad message length %u at %zu\n", length, off);
+	  goto fail;
+	}
+      stream_reset (s);
+      stream_put (s, rxbuf + off, length);
+      stream_getw (s);
+      if (stream_getc (s) != ZEBRA_HEADER_MARKER
+	  || stream_getc (s) != ZSERV_VERSION)
+	{
+	  printf ("bad header at %zu\n", off);
+	  goto fail;
+	}
+      command = stream_getw (s);
+      (*msgs)++;
+
+      if (command == ZEBRA_REDISTRIBUTE_ADD)
+	{
+	  if (i != mark)
+	    {
+	      printf ("redistribute message after route %d, not %d\n",
+		      i, mark);
+	      goto fail;
+	    }
+	  seen_mark = 1;
+	  continue;
+	}
+
+      if (command == ZEBRA_IPV4_ROUTE_BULK_ADD
+	  || command == ZEBRA_IPV4_ROUTE_BULK_DELETE)
+	{
+	  if (! decode_shared (s, 1, &nexthop, &message)
+	      || ! CHECK_FLAG (message, ZAPI_MESSAGE_METRIC))
+	    {
+	      printf ("bad bulk message at %zu\n", off);
+	      goto fail;
+	    }
+	  count = stream_getw (s);
+	  if (! count)
+	    {
+	      printf ("empty bulk message at %zu\n", off);
+	      goto fail;
+	    }
+	  while (count--)
+	    {
+	      if (! decode_prefix (s, &p))
+		goto fail;
+	      metric = stream_getl (s);
+	      if (i >= n
+		  || ref[i].add != (command == ZEBRA_IPV4_ROUTE_BULK_ADD)
+		  || ! prefix_same ((struct prefix *) &p,
+				    (struct prefix *) &ref[i].p)
+		  || nexthop.s_addr != ref[i].nexthop.s_addr
+		  || metric != ref[i].metric)
+		{
+		  printf ("route %d differs\n", i);
+		  goto fail;
+		}
+	      i++;
+	    }
+	}
+      else if (command == ZEBRA_IPV4_ROUTE_ADD
+	       || command == ZEBRA_IPV4_ROUTE_DELETE)
+	{
+	  if (! decode_shared (s, 0, &nexthop, &message)
+	      || ! decode_prefix (s, &p)
+	      || stream_getc (s) != 1 || stream_getc (s) != ZEBRA_NEXTHOP_IPV4)
+	    {
+	      printf ("bad route message at %zu\n", off);
+	      goto fail;
+	    }
+	  nexthop.s_addr = stream_get_ipv4 (s);
+	  metric = stream_getl (s);
+	  if (i >= n
+	      || ref[i].add != (command == ZEBRA_IPV4_ROUTE_ADD)
+	      || ! prefix_same ((struct prefix *) &p,
+				(struct prefix *) &ref[i].p)
+	      || nexthop.s_addr != ref[i].nexthop.s_addr
+	      || metric != ref[i].metric)
+	    {
+	      printf ("route %d differs\n", i);
+	      goto fail;
+	    }
+	  i++;
+	}
+      else
+	{
+	  printf ("unexpected command %u\n", command);
+	  goto fail;
+	}
+
+      if (stream_get_getp (s) != length)
+	{
+	  printf ("%zu bytes left over in message at %zu\n",
+		  length - stream_get_getp (s), off);
+	  goto fail;
+	}
+    }
+
+  stream_free (s);
+  if (off != rxlen || i != n || (mark >= 0 && ! seen_mark))
+    {
+      printf ("%d of %d routes received\n", i, n);
+      return 1;
+    }
+  return 0;
+
+fail:
+  stream_free (s);
+  return 1;
+}
+
+static int
+test_send (u_int32_t capabilities, int *msgs)
+{
+  struct ref_route *ref;
+  int i, mark = ROUTES / 2, failed;
+
+  ref = calloc (ROUTES, sizeof (struct ref_route));
+  make_routes (ref, ROUTES);
+  rxlen = 0;
+  zclient->capabilities = capabilities;
+
+  for (i = 0; i < ROUTES; i++)
+    {
+      send_route (&ref[i]);
+      if (i == mark - 1)
+	zebra_redistribute_send (ZEBRA_REDISTRIBUTE_ADD, zclient,
+				 ZEBRA_ROUTE_RIP);
+      /* Now and then return to the thread loop, and flush by hand. */
+      if (prng_rand (prng) % 500 == 0)
+	run_events ();
+      else if (prng_rand (prng) % 500 == 0)
+	zclient_batch_flush (zclient);
+      drain ();
+    }
+  run_events ();
+  drain ();
+
+  failed = check (ref, ROUTES, mark, msgs);
+  free (ref);
+  return failed;
+}
+
+/* A message numbered N, of a length that varies with N. */
+static void
+ring_msg_make (struct stream *s, u_int32_t n)
+{
+  size_t len, i;
+
+  len = ZEBRA_HEADER_SIZE + 4 + (n * 2654435761U) % 600;
+  stream_reset (s);
+  stream_putw (s, len);
+  stream_putc (s, ZEBRA_HEADER_MARKER);
+  stream_putc (s, ZSERV_VERSION);
+  stream_putw (s, ZEBRA_IPV4_ROUTE_ADD);
+  stream_putl (s, n);
+  for (i = ZEBRA_HEADER_SIZE + 4; i < len; i++)
+    stream_putc (s, n + i);
+}
+
+static int
+ring_msg_check (struct stream *s, u_int32_t n)
+{
+  struct stream *ref = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  int ok;
+
+  ring_msg_make (ref, n);
+  ok = (stream_get_endp (s) == stream_get_endp (ref)
+	&& ! memcmp (STREAM_DATA (s), STREAM_DATA (ref),
+		     stream_get_endp (ref)));
+  stream_free (ref);
+  if (! ok)
+    printf ("ring message %u differs\n", n);
+  return ok;
+}
+
+static int
+write_all (int fd, const u_char *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len)
+    {
+      if ((n = write (fd, buf, len)) <= 0)
+	return -1;
+      buf += n;
+      len -= n;
+    }
+  return 0;
+}
+
+static int
+read_all (int fd, u_char *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len)
+    {
+      if ((n = read (fd, buf, len)) <= 0)
+	return -1;
+      buf += n;
+      len -= n;
+    }
+  return 0;
+}
+
+/* Send as a client would: through the ring, or through the socket now
+   and then and whenever the ring is full, kicking the consumer when it
+   sleeps. */
+static void
+ring_producer (struct zring *ring, int fd)
+{
+  struct stream *s = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  u_char kick[ZEBRA_HEADER_SIZE] = { 0, ZEBRA_HEADER_SIZE,
+				     ZEBRA_HEADER_MARKER, ZSERV_VERSION,
+				     0, ZEBRA_RING_KICK };
+  u_int32_t n, sent = 0;
+
+  for (n = 0; n < RING_MSGS; n++)
+    {
+      ring_msg_make (s, n);
+      if (prng_rand (prng) % 64 == 0 || zring_put (ring, s, sent) < 0)
+	{
+	  if (write_all (fd, STREAM_DATA (s), stream_get_endp (s)) < 0)
+	    _exit (1);
+	  sent++;
+	}
+      else if (zring_wake (ring))
+	{
+	  if (write_all (fd, kick, sizeof (kick)) < 0)
+	    _exit (1);
+	  sent++;
+	}
+    }
+  _exit (0);
+}
+
+/* Get what the ring allows before the next socket message. */
+static int
+ring_consume (struct zring *ring, struct stream *s, u_int32_t nread,
+	      u_int32_t *next)
+{
+  int ret;
+
+  while ((ret = zring_get (ring, s, nread)) == ZRING_MSG)
+    {
+      stream_set_getp (s, ZEBRA_HEADER_SIZE);
+      if (! ring_msg_check (s, *next))
+	return ZRING_ERROR;
+      (*next)++;
+    }
+  return ret;
+}
+
+/* Receive as zebra would, and check all messages come in order. */
+static int
+test_ring (void)
+{
+  struct zring_shm *shm, *peer;
+  struct stream *s;
+  u_int32_t next = 0, nread = 0;
+  u_int16_t length, command;
+  int sv[2], ret, status;
+  pid_t pid;
+
+  shm = zring_shm_new (ZRING_SIZE_MIN);
+  if (! shm)
+    {
+      printf ("could not make a ring\n");
+      return 1;
+    }
+  peer = zring_shm_attach (dup (shm->fd));
+  if (! peer || socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+      printf ("could not attach to the ring\n");
+      return 1;
+    }
+
+  if ((pid = fork ()) == 0)
+    {
+      close (sv[1]);
+      ring_producer (&shm->tx, sv[0]);
+    }
+  close (sv[0]);
+
+  s = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  while (next < RING_MSGS)
+    {
+      ret = ring_consume (&peer->rx, s, nread, &next);
+      if (ret == ZRING_ERROR)
+	break;
+      if (next == RING_MSGS)
+	break;
+      if (ret == ZRING_EMPTY && zring_sleep (&peer->rx))
+	continue;
+
+      stream_reset (s);
+      if (read_all (sv[1], STREAM_DATA (s), ZEBRA_HEADER_SIZE) < 0)
+	break;
+      stream_set_endp (s, ZEBRA_HEADER_SIZE);
+      length = stream_getw (s);
+      stream_getc (s);
+      stream_getc (s);
+      command = stream_getw (s);
+      if (length < ZEBRA_HEADER_SIZE || length > ZEBRA_MAX_PACKET_SIZ
+	  || read_all (sv[1], STREAM_DATA (s) + ZEBRA_HEADER_SIZE,
+		       length - ZEBRA_HEADER_SIZE) < 0)
+	break;
+      stream_set_endp (s, length);
+
+      /* What was put in the ring before this message comes first. */
+      if (command != ZEBRA_RING_KICK)
+	{
+	  struct stream *m = stream_dup (s);
+
+	  ret = ring_consume (&peer->rx, s, nread, &next);
+	  if (ret == ZRING_ERROR || ! ring_msg_check (m, next))
+	    {
+	      stream_free (m);
+	      break;
+	    }
+	  stream_free (m);
+	  next++;
+	}
+      nread++;
+    }
+
+  close (sv[1]);
+  waitpid (pid, &status, 0);
+  stream_free (s);
+  if (verbose)
+    printf ("%u of %d ring messages in order, %lu through the ring\n",
+	    next, RING_MSGS, peer->rx.msgs);
+  zring_shm_free (peer);
+  zring_shm_free (shm);
+  return next != RING_MSGS || ! WIFEXITED (status)
+	 || WEXITSTATUS (status) != 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  int sv[2], msgs, failed = 0;
+
+  verbose = (argc > 1);
+  prng = prng_new (0);
+  master = thread_master_create ();
+
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+      perror ("socketpair");
+      return 1;
+    }
+  set_nonblocking (sv[1]);
+  sock = sv[1];
+
+  zclient = zclient_new ();
+  zclient->sock = sv[0];
+
+  if (test_send (ZAPI_CAPABILITY_ROUTE_BULK, &msgs))
+    failed++;
+  else if (msgs >= ROUTES / 4)
+    {
+      printf ("%d messages for %d routes\n", msgs, ROUTES);
+      failed++;
+    }
+  else
+    printf ("Bulk test passed.\n");
+
+  if (test_send (0, &msgs))
+    failed++;
+  else if (msgs != ROUTES + 1)
+    {
+      printf ("%d messages for %d routes without bulk\n", msgs, ROUTES);
+      failed++;
+    }
+  else
+    printf ("Fallback test passed.\n");
+
+  if (test_ring ())
+    failed++;
+  else
+    printf ("Ring test passed.\n");
+
+  zclient->sock = -1;
+  close (sv[0]);
+  close (sv[1]);
+  zclient_free (zclient);
+  thread_master_free (master);
+  prng_free (prng);
+  return failed;
+}
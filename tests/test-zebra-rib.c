@@ -0,0 +1,394 @@
+/*
+ * Zebra RIB tests, against a kernel that keeps the routes it is given.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "prefix.h"
+#include "memory.h"
+#include "table.h"
+#include "if.h"
+#include "log.h"
+
+#include "zebra/rib.h"
+#include "zebra/rt.h"
+#include "zebra/zserv.h"
+#include "zebra/connected.h"
+#include "zebra/rtadv.h"
+#include "zebra/irdp.h"
+#include "zebra/zebra_fpm.h"
+#include "zebra/zebra_rnh.h"
+
+#define VT100_RESET "\x1b[0m"
+#define VT100_RED "\x1b[31m"
+#define VT100_GREEN "\x1b[32m"
+
+struct zebra_t zebrad =
+{
+  .rtm_table_default = 0,
+};
+
+/* Pacify zclient.o in libzebra, which expects this variable. */
+struct thread_master *master;
+
+static int failed = 0;
+static int tty = 0;
+
+#define EXPECT(expr)							\
+  do {									\
+    if (! (expr))							\
+      {									\
+	printf ("%s line %u: %s\n", __FUNCTION__, __LINE__, #expr);	\
+	failed++;							\
+      }									\
+  } while (0)
+
+/* The kernel's routes, with the gateways netlink would have sent. */
+#define KERNEL_MAX	16
+#define KERNEL_GATES	4
+
+static struct kernel_route
+{
+  struct prefix p;
+  struct in_addr gate[KERNEL_GATES];
+  int count;
+} kernel[KERNEL_MAX];
+static int kernel_count;
+
+/* Deletes that matched no route, and adds next to a route already
+   there, which the kernel keeps both of. */
+static int kernel_errors;
+
+/* Routes whose nexthop tracking was triggered since the kernel was
+   last given a route. */
+static int rnh_after_add;
+
+/* The gateways of the nexthops netlink would send: active ones for an
+   add, those in the FIB for a delete, which it also marks so. */
+static int
+kernel_gates (struct rib *rib, int add, struct in_addr *gate)
+{
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+  int count = 0;
+
+  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+    {
+      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+	continue;
+      if (! CHECK_FLAG (nexthop->flags,
+			add ? NEXTHOP_FLAG_ACTIVE : NEXTHOP_FLAG_FIB))
+	continue;
+      if (count < KERNEL_GATES)
+	gate[count++] = nexthop->gate.ipv4;
+      if (add)
+	SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+    }
+  return count;
+}
+
+int
+kernel_add_ipv4 (struct prefix *p, struct rib *rib)
+{
+  struct kernel_route *kr;
+  int i;
+
+  kr = &kernel[kernel_count];
+  kr->count = kernel_gates (rib, 1, kr->gate);
+  if (! kr->count)
+    return 0;
+
+  for (i = 0; i < kernel_count; i++)
+    if (prefix_same (&kernel[i].p, p))
+      kernel_errors++;
+
+  prefix_copy (&kr->p, p);
+  kernel_count++;
+  rnh_after_add = 0;
+  return 0;
+}
+
+int
+kernel_delete_ipv4 (struct prefix *p, struct rib *rib)
+{
+  struct in_addr gate[KERNEL_GATES];
+  int count, i;
+
+  /* "No useful nexthop", nothing is sent. */
+  count = kernel_gates (rib, 0, gate);
+  if (! count)
+    return 0;
+
+  for (i = 0; i < kernel_count; i++)
+    if (prefix_same (&kernel[i].p, p) && kernel[i].count == count
+	&& ! memcmp (kernel[i].gate, gate, count * sizeof (gate[0])))
+      {
+	kernel[i] = kernel[--kernel_count];
+	return 0;
+      }
+
+  kernel_errors++;
+  return 0;
+}
+
+int kernel_add_ipv6 (struct prefix *a, struct rib *b) { return 0; }
+int kernel_delete_ipv6 (struct prefix *a, struct rib *b) { return 0; }
+int kernel_delete_ipv6_old (struct prefix_ipv6 *dest, struct in6_addr *gate,
+                            unsigned int index, int flags, int table)
+{ return 0; }
+void kernel_route_flush (void) { }
+void kernel_route_forget (struct rib *a) { }
+int kernel_add_route (struct prefix_ipv4 *a, struct in_addr *b, int c, int d)
+{ return 0; }
+int kernel_address_add_ipv4 (struct interface *a, struct connected *b)
+{ return 0; }
+int kernel_address_delete_ipv4 (struct interface *a, struct connected *b)
+{ return 0; }
+void kernel_init (void) { }
+void route_read (void) { }
+
+void rtadv_config_write (struct vty *vty, struct interface *ifp) { }
+void irdp_config_write (struct vty *vty, struct interface *ifp) { }
+
+void
+zfpm_trigger_update (struct route_node *rn, const char *reason)
+{
+}
+
+void
+zebra_rnh_trigger (struct route_node *rn)
+{
+  rnh_after_add++;
+}
+
+/* The routes the kernel has for prefix: how many, and whether one of
+   them goes through exactly the gateways given. */
+static int
+kernel_has (const char *prefix, int *found, const char *gate1,
+	    const char *gate2)
+{
+  struct prefix p;
+  struct in_addr gate[2];
+  int count = 0, i, n;
+
+  str2prefix (prefix, &p);
+  n = 0;
+  if (gate1)
+    inet_aton (gate1, &gate[n++]);
+  if (gate2)
+    inet_aton (gate2, &gate[n++]);
+
+  *found = 0;
+  for (i = 0; i < kernel_count; i++)
+    if (prefix_same (&kernel[i].p, &p))
+      {
+	count++;
+	if (kernel[i].count == n
+	    && ! memcmp (kernel[i].gate, gate, n * sizeof (gate[0])))
+	  *found = 1;
+      }
+  return count;
+}
+
+static int
+run_stop (struct thread *t)
+{
+  int *done = THREAD_ARG (t);
+
+  *done = 1;
+  return 0;
+}
+
+/* Let the RIB queue and the FIB flush run. */
+static void
+run (long msec)
+{
+  struct thread thread;
+  int done = 0;
+
+  thread_add_timer_msec (zebrad.master, run_stop, &done, msec);
+  while (! done && thread_fetch (zebrad.master, &thread))
+    thread_call (&thread);
+}
+
+static void
+route_add (int type, int flags, const char *prefix, const char *gate1,
+	   const char *gate2, u_char distance)
+{
+  struct prefix_ipv4 p;
+  struct in_addr gate;
+  struct rib *rib;
+
+  str2prefix_ipv4 (prefix, &p);
+  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
+  rib->type = type;
+  rib->flags = flags;
+  rib->distance = distance;
+  rib->table = zebrad.rtm_table_default;
+  rib->uptime = time (NULL);
+  inet_aton (gate1, &gate);
+  nexthop_ipv4_add (rib, &gate, NULL);
+  if (gate2)
+    {
+      inet_aton (gate2, &gate);
+      nexthop_ipv4_add (rib, &gate, NULL);
+    }
+  rib_add_ipv4_multipath (&p, rib, SAFI_UNICAST);
+}
+
+static void
+route_delete (int type, const char *prefix, const char *gate1)
+{
+  struct prefix_ipv4 p;
+  struct in_addr gate;
+
+  str2prefix_ipv4 (prefix, &p);
+  inet_aton (gate1, &gate);
+  rib_delete_ipv4 (type, 0, &p, &gate, 0, 0, SAFI_UNICAST);
+}
+
+#define igp_add(p, g)		route_add (ZEBRA_ROUTE_OSPF, 0, (p), (g), NULL, 110)
+#define igp_delete(p, g)	route_delete (ZEBRA_ROUTE_OSPF, (p), (g))
+#define ibgp_add(p, g1, g2)	route_add (ZEBRA_ROUTE_BGP, ZEBRA_FLAG_INTERNAL, \
+					   (p), (g1), (g2), 200)
+#define ibgp_delete(p, g)	route_delete (ZEBRA_ROUTE_BGP, (p), (g))
+
+/* One of the gateways of an iBGP route goes away.  The kernel must be
+   left with the route through the other, rather than keep the old
+   route next to it. */
+static void
+test_recursive (void)
+{
+  int found;
+
+  igp_add ("10.0.0.0/24", "192.168.1.2");
+  igp_add ("10.1.0.0/24", "192.168.1.3");
+  ibgp_add ("20.0.0.0/24", "10.0.0.5", "10.1.0.5");
+  run (100);
+  EXPECT (kernel_has ("20.0.0.0/24", &found, "192.168.1.2", "192.168.1.3")
+	  == 1 && found);
+
+  igp_delete ("10.1.0.0/24", "192.168.1.3");
+  run (100);
+  rib_update ();
+  run (100);
+  EXPECT (kernel_has ("20.0.0.0/24", &found, "192.168.1.2", NULL) == 1
+	  && found);
+
+  igp_add ("10.1.0.0/24", "192.168.1.4");
+  run (100);
+  rib_update ();
+  run (100);
+  EXPECT (kernel_has ("20.0.0.0/24", &found, "192.168.1.2", "192.168.1.4")
+	  == 1 && found);
+
+  ibgp_delete ("20.0.0.0/24", "10.0.0.5");
+  igp_delete ("10.0.0.0/24", "192.168.1.2");
+  igp_delete ("10.1.0.0/24", "192.168.1.4");
+  run (100);
+  EXPECT (kernel_has ("20.0.0.0/24", &found, NULL, NULL) == 0);
+  EXPECT (kernel_has ("10.0.0.0/24", &found, NULL, NULL) == 0);
+  EXPECT (kernel_errors == 0);
+}
+
+/* With a coalescing window, an iBGP route that comes in before the IGP
+   route it resolves through has been flushed must still resolve, and
+   nexthop tracking must hear of the IGP route once the kernel has it. */
+static void
+test_window (void)
+{
+  int found;
+
+  rib_fib_coalesce_window = 50;
+
+  igp_add ("10.2.0.0/24", "192.168.1.2");
+  run (5);
+  ibgp_add ("30.0.0.0/24", "10.2.0.5", NULL);
+  run (200);
+  EXPECT (kernel_has ("10.2.0.0/24", &found, "192.168.1.2", NULL) == 1
+	  && found);
+  EXPECT (kernel_has ("30.0.0.0/24", &found, "192.168.1.2", NULL) == 1
+	  && found);
+  EXPECT (rnh_after_add > 0);
+
+  ibgp_delete ("30.0.0.0/24", "10.2.0.5");
+  igp_delete ("10.2.0.0/24", "192.168.1.2");
+  run (200);
+  EXPECT (kernel_has ("30.0.0.0/24", &found, NULL, NULL) == 0);
+  EXPECT (kernel_errors == 0);
+
+  rib_fib_coalesce_window = 0;
+}
+
+static struct test
+{
+  const char *name;
+  const char *desc;
+  void (*func) (void);
+} tests[] =
+{
+  { "recursive", "iBGP route loses a gateway's IGP route", test_recursive },
+  { "window", "iBGP route resolves in the coalescing window", test_window },
+  { NULL, NULL, NULL },
+};
+
+int
+main (void)
+{
+  struct test *t;
+  struct interface *ifp;
+  struct prefix_ipv4 p;
+  int oldfailed;
+
+  zebrad.master = thread_master_create ();
+  master = zebrad.master;
+  if_init ();
+  rib_init ();
+
+  /* The gateways are on a connected network. */
+  ifp = if_get_by_name ("eth0");
+  ifp->ifindex = 1;
+  ifp->flags = IFF_UP | IFF_RUNNING;
+  str2prefix_ipv4 ("192.168.1.0/24", &p);
+  rib_add_ipv4 (ZEBRA_ROUTE_CONNECT, 0, &p, NULL, NULL, ifp->ifindex, 0, 0, 0,
+		SAFI_UNICAST);
+  run (100);
+
+  if (fileno (stdout) >= 0)
+    tty = isatty (fileno (stdout));
+
+  for (t = tests; t->name; t++)
+    {
+      printf ("%s: %s\n", t->name, t->desc);
+      oldfailed = failed;
+      t->func ();
+
+      if (tty)
+	printf ("%s", (failed > oldfailed) ? VT100_RED "failed!" VT100_RESET
+					   : VT100_GREEN "OK" VT100_RESET);
+      else
+	printf ("%s", (failed > oldfailed) ? "failed!" : "OK");
+      printf ("\n\n");
+    }
+
+  printf ("failures: %d\n", failed);
+  return failed;
+}
@@ -0,0 +1,203 @@
+/*
+ * Route message throughput between a client and a running zebra, over
+ * the socket alone and with the shared-memory ring.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/*
+ * Usage: test-zserv-performance [PATH [ROUTES]]
+ *
+ * Connects to the zebra listening on PATH, by default its usual socket,
+ * asks for the redistribution of OSPF routes, then adds ROUTES blackhole
+ * /32 OSPF routes out of 198.18.0.0/15 and deletes them again.  A phase
+ * ends when zebra has redistributed every route back, so the rate
+ * counts both directions and zebra's work in between.  This is done
+ * once with the socket alone and once with the ring.  Zebra is best
+ * run with the null kernel interface, as testzebra is.
+ */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "prefix.h"
+#include "stream.h"
+#include "memory.h"
+#include "zclient.h"
+#include "zring.h"
+
+#define ROUTES		100000
+#define ROUTES_PER_EVENT 1000
+#define TIMEOUT		120
+
+struct thread_master *master;
+
+static struct zclient *zclient;
+static int nroutes = ROUTES;
+static int sent, added, deleted, done;
+static int deleting;
+static struct timeval start;
+
+static double
+elapsed (struct timeval *since)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - since->tv_sec) + (now.tv_usec - since->tv_usec) / 1e6;
+}
+
+static void
+route_n (struct prefix_ipv4 *p, int n)
+{
+  p->family = AF_INET;
+  p->prefixlen = IPV4_MAX_BITLEN;
+  p->prefix.s_addr = htonl (0xc6120000 + n);
+}
+
+static int
+send_routes (struct thread *thread)
+{
+  struct prefix_ipv4 p;
+  struct zapi_ipv4 api;
+  int i;
+
+  memset (&api, 0, sizeof (api));
+  api.type = ZEBRA_ROUTE_OSPF;
+  api.flags = ZEBRA_FLAG_BLACKHOLE;
+  api.safi = SAFI_UNICAST;
+  SET_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP);
+  SET_FLAG (api.message, ZAPI_MESSAGE_METRIC);
+  api.metric = 20;
+
+  for (i = 0; i < ROUTES_PER_EVENT && sent < nroutes; i++, sent++)
+    {
+      route_n (&p, sent);
+      zapi_ipv4_route (deleting ? ZEBRA_IPV4_ROUTE_DELETE
+		       : ZEBRA_IPV4_ROUTE_ADD, zclient, &p, &api);
+    }
+  if (sent < nroutes)
+    thread_add_event (master, send_routes, NULL, 0);
+  return 0;
+}
+
+/* The router-id comes after zebra's hello, once the transport is
+   settled. */
+static int
+bench_router_id (int command, struct zclient *zclient, zebra_size_t length)
+{
+  if (sent || done)
+    return 0;
+  gettimeofday (&start, NULL);
+  thread_add_event (master, send_routes, NULL, 0);
+  return 0;
+}
+
+static int
+bench_route_add (int command, struct zclient *zclient, zebra_size_t length)
+{
+  double t;
+
+  if (++added < nroutes)
+    return 0;
+
+  t = elapsed (&start);
+  printf ("  %d routes added at %.0f/s\n", nroutes, nroutes / t);
+  gettimeofday (&start, NULL);
+  deleting = 1;
+  sent = 0;
+  thread_add_event (master, send_routes, NULL, 0);
+  return 0;
+}
+
+static int
+bench_route_delete (int command, struct zclient *zclient, zebra_size_t length)
+{
+  double t;
+
+  if (++deleted < nroutes)
+    return 0;
+
+  t = elapsed (&start);
+  printf ("  %d routes deleted at %.0f/s\n", nroutes, nroutes / t);
+  done = 1;
+  return 0;
+}
+
+static int
+bench_timeout (struct thread *thread)
+{
+  printf ("  timed out with %d routes added and %d deleted\n",
+	  added, deleted);
+  done = -1;
+  return 0;
+}
+
+static int
+bench (const char *name, u_int32_t ring_size)
+{
+  struct thread thread;
+  struct thread *t_timeout;
+
+  sent = added = deleted = done = deleting = 0;
+
+  zclient = zclient_new ();
+  zclient->ring_size = ring_size;
+  zclient->router_id_update = bench_router_id;
+  zclient->ipv4_route_add = bench_route_add;
+  zclient->ipv4_route_delete = bench_route_delete;
+  zclient_init (zclient, ZEBRA_ROUTE_STATIC);
+  zclient->redist[ZEBRA_ROUTE_OSPF] = 1;
+
+  printf ("%s:\n", name);
+  t_timeout = thread_add_timer (master, bench_timeout, NULL, TIMEOUT);
+  while (! done && thread_fetch (master, &thread))
+    thread_call (&thread);
+  THREAD_TIMER_OFF (t_timeout);
+
+  if (done > 0)
+    printf ("  capabilities 0x%x, %s\n", zclient->capabilities,
+	    zclient->ring ? "through the ring" : "through the socket");
+
+  zclient_stop (zclient);
+  zclient_free (zclient);
+  zclient = NULL;
+  return done < 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  int failed = 0;
+
+  if (argc > 1)
+    zclient_serv_path_set (argv[1]);
+  if (argc > 2)
+    nroutes = atoi (argv[2]);
+  if (nroutes <= 0 || nroutes > 1 << 17)
+    {
+      fprintf (stderr, "ROUTES must be between 1 and %d\n", 1 << 17);
+      return 1;
+    }
+
+  master = thread_master_create ();
+
+  failed += bench ("socket", 0);
+  failed += bench ("ring", ZRING_SIZE_DEFAULT);
+  return failed;
+}
@@ -40,6 +40,7 @@
 #include "zebra/irdp.h"
 #include "zebra/rtadv.h"
 #include "zebra/zebra_fpm.h"
+#include "zebra/zebra_rnh.h"
 
 /* Zebra instance */
 struct zebra_t zebrad =
@@ -322,6 +323,7 @@ main (int argc, char **argv)
   /* Zebra related initialize. */
   zebra_init ();
   rib_init ();
+  zebra_rnh_init ();
   zebra_if_init ();
   zebra_debug_init ();
   router_id_init();
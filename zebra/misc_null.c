@@ -26,6 +26,7 @@
 #include "zebra/irdp.h"
 #include "zebra/interface.h"
 #include "zebra/zebra_fpm.h"
+#include "zebra/zebra_rnh.h"
 
 void ifstat_update_proc (void) { return; }
 #ifdef HAVE_SYS_WEAK_ALIAS_PRAGMA
@@ -43,3 +44,9 @@ zfpm_trigger_update (struct route_node *rn, const char *reason)
 {
   return;
 }
+
+void
+zebra_rnh_trigger (struct route_node *rn)
+{
+  return;
+}
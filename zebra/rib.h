@@ -117,11 +117,41 @@ typedef struct rib_dest_t_
    */
   u_int32_t flags;
 
+  /*
+   * The route last handed to the kernel for this prefix, if any.  It
+   * stays on the list of routes, even once removed, until the kernel
+   * has been told otherwise.
+   */
+  struct rib *kernel;
+
+  /*
+   * The nexthops the kernel was given for that route, kept when its
+   * recursive nexthops are resolved again before the next flush.
+   */
+  struct nexthop *kernel_nexthop;
+
+  /*
+   * Kernel operations best-path selection asked for since the prefix
+   * was last flushed to the kernel.
+   */
+  u_int32_t fib_ops;
+
+  /*
+   * Linkage to put dest on the list of prefixes to flush.
+   */
+  TAILQ_ENTRY(rib_dest_t_) fib_q_entries;
+
   /*
    * Linkage to put dest on the FPM processing queue.
    */
   TAILQ_ENTRY(rib_dest_t_) fpm_q_entries;
 
+  /*
+   * Generation of the FPM's copy of the tables in which the FPM was
+   * last told about this prefix.
+   */
+  u_int32_t fpm_gen;
+
 } rib_dest_t;
 
 #define RIB_ROUTE_QUEUED(x)	(1 << (x))
@@ -143,6 +173,17 @@ typedef struct rib_dest_t_
  */
 #define RIB_DEST_UPDATE_FPM    (1 << (ZEBRA_MAX_QINDEX + 2))
 
+/*
+ * The dest is waiting for its route to be flushed to the kernel.
+ */
+#define RIB_DEST_FIB_QUEUED    (1 << (ZEBRA_MAX_QINDEX + 3))
+
+/*
+ * The nexthops of the route in the kernel changed, so it has to be
+ * installed again even if it stays selected.
+ */
+#define RIB_DEST_FIB_CHANGED   (1 << (ZEBRA_MAX_QINDEX + 4))
+
 /*
  * Macro to iterate over each route for a destination (prefix).
  */
@@ -414,6 +455,9 @@ extern int rib_add_ipv4 (int type, int flags, struct prefix_ipv4 *p,
 
 extern int rib_add_ipv4_multipath (struct prefix_ipv4 *, struct rib *, safi_t);
 
+extern int rib_add_ipv4_bulk (struct prefix_ipv4 *, u_int32_t *, int,
+			      struct rib *, safi_t);
+
 extern int rib_delete_ipv4 (int type, int flags, struct prefix_ipv4 *p,
 		            struct in_addr *gate, unsigned int ifindex, 
 		            u_int32_t, safi_t safi);
@@ -465,6 +509,21 @@ static_delete_ipv6 (struct prefix *p, u_char type, struct in6_addr *gate,
 #endif /* HAVE_IPV6 */
 
 extern int rib_gc_dest (struct route_node *rn);
+
+/* Kernel updates are held back this many milliseconds, so that a
+   prefix changing repeatedly is only installed once.  0 disables it. */
+extern u_int32_t rib_fib_coalesce_window;
+
+struct rib_fib_stats
+{
+  unsigned long requested;	/* Operations best-path selection made. */
+  unsigned long emitted;	/* Operations handed to the kernel. */
+  unsigned long suppressed;	/* Operations that cancelled out. */
+  unsigned long flushes;	/* Prefixes flushed. */
+  unsigned long max_flush;	/* Most prefixes flushed at once. */
+  unsigned long pending;	/* Prefixes waiting to be flushed. */
+};
+extern struct rib_fib_stats rib_fib_stats;
 extern struct route_table *rib_tables_iter_next (rib_tables_iter_t *iter);
 
 /*
@@ -526,3 +526,14 @@ kernel_delete_ipv6_old (struct prefix_ipv6 *dest, struct in6_addr *gate,
   return kernel_ioctl_ipv6 (SIOCDELRT, dest, gate, index, flags);
 }
 #endif /* HAVE_IPV6 */
+
+/* Routes are installed by ioctl() synchronously, nothing is queued. */
+void
+kernel_route_flush (void)
+{
+}
+
+void
+kernel_route_forget (struct rib *rib)
+{
+}
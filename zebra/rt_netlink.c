@@ -36,12 +36,14 @@
 #include "rib.h"
 #include "thread.h"
 #include "privs.h"
+#include "command.h"
 
 #include "zebra/zserv.h"
 #include "zebra/rt.h"
 #include "zebra/redistribute.h"
 #include "zebra/interface.h"
 #include "zebra/debug.h"
+#include "zebra/zebra_rnh.h"
 
 #include "rt_netlink.h"
 
@@ -1314,6 +1316,394 @@ netlink_talk_filter (struct sockaddr_nl *snl, struct nlmsghdr *h)
   return 0;
 }
 
+/*
+ * Route updates are not sent to the kernel one message at a time.
+ * They are appended to a batch buffer which is written to netlink_cmd
+ * with a single sendmsg() once it fills up, once the RIB work queue
+ * runs dry, or at the latest NL_BATCH_HOLD_MSEC after the first message
+ * was queued.  The ACKs and errors are
+ * read back from the event loop and matched against the pending list
+ * by sequence number, so a failed install is reflected on the rib it
+ * was sent for instead of blocking zebra until the kernel answers.
+ */
+
+/* Size of the batch buffer.  The message limit keeps the ACKs for one
+   batch well within the default receive buffer of netlink_cmd. */
+#define NL_BATCH_BUF_SIZE	(8 * NL_PKT_BUF_SIZE)
+#define NL_BATCH_MAX_MSGS	128
+
+/* Longest time a route update may wait in the batch buffer. */
+#define NL_BATCH_HOLD_MSEC	10
+
+/* Route messages queued or sent but not yet acknowledged. */
+#define NL_PENDING_MAX		(2 * NL_BATCH_MAX_MSGS)
+
+struct nl_pending
+{
+  u_int32_t seq;
+  int cmd;
+  struct prefix p;
+  struct rib *rib;
+};
+
+static struct
+{
+  /* Messages not yet handed to the kernel. */
+  char buf[NL_BATCH_BUF_SIZE];
+  size_t len;
+  unsigned int count;
+
+  /* Ring of pending messages in sequence order; the last 'count'
+     entries are the ones still sitting in buf. */
+  struct nl_pending pending[NL_PENDING_MAX];
+  unsigned int head;
+  unsigned int pending_count;
+
+  struct thread *t_flush;
+  struct thread *t_read;
+
+  struct
+  {
+    unsigned long batches;
+    unsigned long msgs;
+    unsigned long max_batch;
+    unsigned long full_flushes;
+    unsigned long acks;
+    unsigned long errors;
+    unsigned long lost;
+    unsigned long send_errors;
+    unsigned long max_inflight;
+  } stats;
+} nl_batch;
+
+#define NL_BATCH_INFLIGHT() (nl_batch.pending_count - nl_batch.count)
+
+static struct nl_pending *
+netlink_batch_pending (unsigned int i)
+{
+  return &nl_batch.pending[(nl_batch.head + i) % NL_PENDING_MAX];
+}
+
+/* The kernel refused a route message. */
+static void
+netlink_batch_error (struct nl_pending *pe, int errnum)
+{
+  char buf[INET6_ADDRSTRLEN + 4];
+  struct route_table *table;
+  struct route_node *rn;
+  struct rib *rib;
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+
+  prefix2str (&pe->p, buf, sizeof buf);
+
+  /* Races in link handling, ignored as the synchronous path does. */
+  if ((pe->cmd == RTM_DELROUTE && (errnum == ENODEV || errnum == ESRCH))
+      || (pe->cmd == RTM_NEWROUTE && errnum == EEXIST))
+    {
+      if (IS_ZEBRA_DEBUG_KERNEL)
+	zlog_debug ("%s: error: %s type=%s, seq=%u, %s", netlink_cmd.name,
+		    safe_strerror (errnum), lookup (nlmsg_str, pe->cmd),
+		    pe->seq, buf);
+      nl_batch.stats.acks++;
+      return;
+    }
+
+  nl_batch.stats.errors++;
+  zlog_err ("%s error: %s, type=%s, seq=%u, %s", netlink_cmd.name,
+	    safe_strerror (errnum), lookup (nlmsg_str, pe->cmd), pe->seq,
+	    buf);
+
+  if (pe->cmd != RTM_NEWROUTE)
+    return;
+
+  /* The route is not in the FIB after all.  The rib may have been
+     replaced in the meantime, so only touch it if it is still there. */
+  if (! pe->rib)
+    return;
+  table = vrf_table (family2afi (pe->p.family), SAFI_UNICAST, 0);
+  if (! table)
+    return;
+  rn = route_node_lookup (table, &pe->p);
+  if (! rn)
+    return;
+
+  RNODE_FOREACH_RIB (rn, rib)
+    if (rib == pe->rib && CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED))
+      {
+	for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+	  UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	zebra_rnh_trigger (rn);
+	break;
+      }
+
+  route_unlock_node (rn);
+}
+
+/* Retire the pending message acknowledged by the kernel with the given
+   sequence number.  Every message carries NLM_F_ACK, so anything older
+   still on the list had its answer dropped. */
+static void
+netlink_batch_ack (u_int32_t seq, int errnum)
+{
+  struct nl_pending *pe;
+
+  while (NL_BATCH_INFLIGHT ())
+    {
+      pe = netlink_batch_pending (0);
+      if ((int32_t) (pe->seq - seq) > 0)
+	return;
+
+      nl_batch.head = (nl_batch.head + 1) % NL_PENDING_MAX;
+      nl_batch.pending_count--;
+
+      if (pe->seq != seq)
+	{
+	  nl_batch.stats.lost++;
+	  continue;
+	}
+
+      if (errnum)
+	netlink_batch_error (pe, errnum);
+      else
+	nl_batch.stats.acks++;
+      return;
+    }
+}
+
+/* Collect ACKs for messages already sent.  Without 'block' this stops
+   as soon as the socket has nothing more to read. */
+static void
+netlink_batch_read (int block)
+{
+  int status;
+  struct nlmsghdr *h;
+
+  while (NL_BATCH_INFLIGHT ())
+    {
+      char buf[NL_PKT_BUF_SIZE];
+      struct iovec iov = {
+        .iov_base = buf,
+        .iov_len = sizeof buf
+      };
+      struct sockaddr_nl snl;
+      struct msghdr msg = {
+        .msg_name = (void *) &snl,
+        .msg_namelen = sizeof snl,
+        .msg_iov = &iov,
+        .msg_iovlen = 1
+      };
+
+      status = recvmsg (netlink_cmd.sock, &msg, block ? 0 : MSG_DONTWAIT);
+      if (status < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          if (errno == EWOULDBLOCK || errno == EAGAIN)
+            return;
+          if (errno == ENOBUFS)
+            {
+              /* ACKs were dropped; nothing sent so far can be matched
+                 any more. */
+              zlog_err ("%s recvmsg overrun, %u ACKs lost", netlink_cmd.name,
+                        NL_BATCH_INFLIGHT ());
+              nl_batch.stats.lost += NL_BATCH_INFLIGHT ();
+              nl_batch.head = (nl_batch.head + NL_BATCH_INFLIGHT ())
+                              % NL_PENDING_MAX;
+              nl_batch.pending_count = nl_batch.count;
+              return;
+            }
+          zlog_err ("%s recvmsg error: %s", netlink_cmd.name,
+                    safe_strerror (errno));
+          return;
+        }
+      if (status == 0)
+        return;
+
+      for (h = (struct nlmsghdr *) buf; NLMSG_OK (h, (unsigned int) status);
+           h = NLMSG_NEXT (h, status))
+        {
+          struct nlmsgerr *err;
+
+          if (h->nlmsg_type != NLMSG_ERROR
+              || h->nlmsg_len < NLMSG_LENGTH (sizeof (struct nlmsgerr)))
+            {
+              netlink_talk_filter (&snl, h);
+              continue;
+            }
+
+          err = (struct nlmsgerr *) NLMSG_DATA (h);
+          if (IS_ZEBRA_DEBUG_KERNEL && err->error == 0)
+            zlog_debug ("%s: %s ACK: type=%s(%u), seq=%u, pid=%u",
+                        __func__, netlink_cmd.name,
+                        lookup (nlmsg_str, err->msg.nlmsg_type),
+                        err->msg.nlmsg_type, err->msg.nlmsg_seq,
+                        err->msg.nlmsg_pid);
+          netlink_batch_ack (err->msg.nlmsg_seq, -err->error);
+        }
+    }
+}
+
+static int
+netlink_batch_read_thread (struct thread *thread)
+{
+  nl_batch.t_read = NULL;
+
+  netlink_batch_read (0);
+
+  if (NL_BATCH_INFLIGHT ())
+    nl_batch.t_read = thread_add_read (zebrad.master,
+                                       netlink_batch_read_thread, NULL,
+                                       netlink_cmd.sock);
+  return 0;
+}
+
+/* Hand the batch to the kernel. */
+static void
+netlink_batch_flush (void)
+{
+  int status;
+  int save_errno;
+  unsigned int i;
+  struct sockaddr_nl snl;
+  struct iovec iov = {
+    .iov_base = (void *) nl_batch.buf,
+    .iov_len = nl_batch.len
+  };
+  struct msghdr msg = {
+    .msg_name = (void *) &snl,
+    .msg_namelen = sizeof snl,
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+  };
+
+  THREAD_OFF (nl_batch.t_flush);
+
+  if (nl_batch.count == 0)
+    return;
+
+  /* Make room in the receive buffer for the ACKs of this batch. */
+  netlink_batch_read (0);
+
+  memset (&snl, 0, sizeof snl);
+  snl.nl_family = AF_NETLINK;
+
+  if (IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("%s: %s %u messages, %zu bytes", __func__, netlink_cmd.name,
+                nl_batch.count, nl_batch.len);
+
+  if (zserv_privs.change (ZPRIVS_RAISE))
+    zlog (NULL, LOG_ERR, "Can't raise privileges");
+  status = sendmsg (netlink_cmd.sock, &msg, 0);
+  save_errno = errno;
+  if (zserv_privs.change (ZPRIVS_LOWER))
+    zlog (NULL, LOG_ERR, "Can't lower privileges");
+
+  if (status < 0)
+    {
+      zlog (NULL, LOG_ERR, "netlink batch sendmsg() error: %s",
+            safe_strerror (save_errno));
+      nl_batch.stats.send_errors++;
+      for (i = NL_BATCH_INFLIGHT (); i < nl_batch.pending_count; i++)
+        netlink_batch_error (netlink_batch_pending (i), save_errno);
+      nl_batch.pending_count -= nl_batch.count;
+    }
+  else
+    {
+      nl_batch.stats.batches++;
+      nl_batch.stats.msgs += nl_batch.count;
+      if (nl_batch.count > nl_batch.stats.max_batch)
+        nl_batch.stats.max_batch = nl_batch.count;
+      if (nl_batch.pending_count > nl_batch.stats.max_inflight)
+        nl_batch.stats.max_inflight = nl_batch.pending_count;
+    }
+
+  nl_batch.len = 0;
+  nl_batch.count = 0;
+
+  if (NL_BATCH_INFLIGHT () && ! nl_batch.t_read)
+    nl_batch.t_read = thread_add_read (zebrad.master,
+                                       netlink_batch_read_thread, NULL,
+                                       netlink_cmd.sock);
+}
+
+static int
+netlink_batch_flush_timer (struct thread *thread)
+{
+  nl_batch.t_flush = NULL;
+  netlink_batch_flush ();
+  return 0;
+}
+
+/* Send everything queued and wait until the kernel has answered it,
+   so that netlink_cmd can be used synchronously again. */
+static void
+netlink_batch_sync (void)
+{
+  netlink_batch_flush ();
+  while (NL_BATCH_INFLIGHT ())
+    netlink_batch_read (1);
+}
+
+/* Queue a route message for the kernel. */
+static int
+netlink_batch_add (struct nlmsghdr *n, struct prefix *p, struct rib *rib)
+{
+  struct nl_pending *pe;
+
+  if (nl_batch.count >= NL_BATCH_MAX_MSGS
+      || nl_batch.len + NLMSG_ALIGN (n->nlmsg_len) > NL_BATCH_BUF_SIZE)
+    {
+      nl_batch.stats.full_flushes++;
+      netlink_batch_flush ();
+    }
+  if (nl_batch.pending_count == NL_PENDING_MAX)
+    netlink_batch_sync ();
+
+  n->nlmsg_seq = ++netlink_cmd.seq;
+  n->nlmsg_flags |= NLM_F_ACK;
+
+  if (IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("%s: %s type %s(%u), seq=%u", __func__, netlink_cmd.name,
+                lookup (nlmsg_str, n->nlmsg_type), n->nlmsg_type,
+                n->nlmsg_seq);
+
+  memcpy (nl_batch.buf + nl_batch.len, n, n->nlmsg_len);
+  nl_batch.len += NLMSG_ALIGN (n->nlmsg_len);
+  nl_batch.count++;
+
+  pe = netlink_batch_pending (nl_batch.pending_count++);
+  pe->seq = n->nlmsg_seq;
+  pe->cmd = n->nlmsg_type;
+  prefix_copy (&pe->p, p);
+  pe->rib = rib;
+
+  if (! nl_batch.t_flush)
+    nl_batch.t_flush = thread_add_timer_msec (zebrad.master,
+                                              netlink_batch_flush_timer, NULL,
+                                              NL_BATCH_HOLD_MSEC);
+  return 0;
+}
+
+/* Push queued route updates to the kernel now. */
+void
+kernel_route_flush (void)
+{
+  netlink_batch_flush ();
+}
+
+/* The rib is about to be freed, so an error for a message sent on its
+   behalf must not be put down to whatever rib takes its address. */
+void
+kernel_route_forget (struct rib *rib)
+{
+  unsigned int i;
+
+  for (i = 0; i < nl_batch.pending_count; i++)
+    if (netlink_batch_pending (i)->rib == rib)
+      netlink_batch_pending (i)->rib = NULL;
+}
+
 /* sendmsg() to netlink socket then recvmsg(). */
 static int
 netlink_talk (struct nlmsghdr *n, struct nlsock *nl)
@@ -1335,6 +1725,10 @@ netlink_talk (struct nlmsghdr *n, struct nlsock *nl)
   memset (&snl, 0, sizeof snl);
   snl.nl_family = AF_NETLINK;
 
+  /* Route updates still in flight would be read back as the reply. */
+  if (nl == &netlink_cmd)
+    netlink_batch_sync ();
+
   n->nlmsg_seq = ++nl->seq;
 
   /* Request an acknowledgement by setting NLM_F_ACK */
@@ -1827,8 +2221,8 @@ skip:
   memset (&snl, 0, sizeof snl);
   snl.nl_family = AF_NETLINK;
 
-  /* Talk to netlink socket. */
-  return netlink_talk (&req.n, &netlink_cmd);
+  /* Queue for the netlink socket. */
+  return netlink_batch_add (&req.n, p, rib);
 }
 
 int
@@ -1972,6 +2366,48 @@ static void netlink_install_filter (int sock, __u32 pid)
     zlog_warn ("Can't install socket filter: %s\n", safe_strerror(errno));
 }
 
+DEFUN (show_zebra_netlink_stats,
+       show_zebra_netlink_stats_cmd,
+       "show zebra netlink stats",
+       SHOW_STR
+       "Zebra information\n"
+       "Kernel netlink interface\n"
+       "Route update batching statistics\n")
+{
+#define NL_SHOW_STAT(name, value) \
+  vty_out (vty, "%-40s %10lu%s", name, (unsigned long) (value), VTY_NEWLINE)
+
+  NL_SHOW_STAT ("Batches sent", nl_batch.stats.batches);
+  NL_SHOW_STAT ("Route messages sent", nl_batch.stats.msgs);
+  NL_SHOW_STAT ("Average batch size",
+                nl_batch.stats.batches
+                ? nl_batch.stats.msgs / nl_batch.stats.batches : 0);
+  NL_SHOW_STAT ("Largest batch", nl_batch.stats.max_batch);
+  NL_SHOW_STAT ("Batches flushed when full", nl_batch.stats.full_flushes);
+  NL_SHOW_STAT ("Messages queued", nl_batch.count);
+  NL_SHOW_STAT ("Messages in flight", NL_BATCH_INFLIGHT ());
+  NL_SHOW_STAT ("Most messages in flight", nl_batch.stats.max_inflight);
+  NL_SHOW_STAT ("ACKs", nl_batch.stats.acks);
+  NL_SHOW_STAT ("Errors", nl_batch.stats.errors);
+  NL_SHOW_STAT ("ACKs lost", nl_batch.stats.lost);
+  NL_SHOW_STAT ("Send errors", nl_batch.stats.send_errors);
+
+#undef NL_SHOW_STAT
+  return CMD_SUCCESS;
+}
+
+DEFUN (clear_zebra_netlink_stats,
+       clear_zebra_netlink_stats_cmd,
+       "clear zebra netlink stats",
+       CLEAR_STR
+       "Zebra information\n"
+       "Kernel netlink interface\n"
+       "Route update batching statistics\n")
+{
+  memset (&nl_batch.stats, 0, sizeof nl_batch.stats);
+  return CMD_SUCCESS;
+}
+
 /* Exported interface function.  This function simply calls
    netlink_socket (). */
 void
@@ -2001,6 +2437,10 @@ kernel_init (void)
       netlink_install_filter (netlink.sock, netlink_cmd.snl.nl_pid);
       thread_add_read (zebrad.master, kernel_read, NULL, netlink.sock);
     }
+
+  install_element (VIEW_NODE, &show_zebra_netlink_stats_cmd);
+  install_element (ENABLE_NODE, &show_zebra_netlink_stats_cmd);
+  install_element (ENABLE_NODE, &clear_zebra_netlink_stats_cmd);
 }
 
 /*
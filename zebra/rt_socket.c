@@ -496,3 +496,14 @@ kernel_delete_ipv6_old (struct prefix_ipv6 *dest, struct in6_addr *gate,
   return route;
 }
 #endif /* HAVE_IPV6 */
+
+/* Routing socket messages are sent synchronously, nothing is queued. */
+void
+kernel_route_flush (void)
+{
+}
+
+void
+kernel_route_forget (struct rib *rib)
+{
+}
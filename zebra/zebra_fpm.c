@@ -45,7 +45,7 @@
  * Sizes of outgoing and incoming stream buffers for writing/reading
  * FPM messages.
  */
-#define ZFPM_OBUF_SIZE (2 * FPM_MAX_MSG_LEN)
+#define ZFPM_OBUF_SIZE (2 * FPM_MAX_ROUTES_MSG_LEN)
 #define ZFPM_IBUF_SIZE (FPM_MAX_MSG_LEN)
 
 /*
@@ -54,6 +54,18 @@
  */
 #define ZFPM_MAX_WRITES_PER_RUN 10
 
+/*
+ * Time the FPM is given to send its capabilities once the connection
+ * is up, before the full table goes out.
+ */
+#define ZFPM_CAPS_WAIT_MSECS 200
+
+/*
+ * Number of prefixes taken from the snapshot at a time, once the
+ * queue of live updates is empty.
+ */
+#define ZFPM_SNAPSHOT_BATCH 512
+
 /*
  * Interval over which we collect statistics.
  */
@@ -77,6 +89,7 @@ typedef struct zfpm_stats_t_ {
   unsigned long connect_no_sock;
 
   unsigned long read_cb_calls;
+  unsigned long caps_msgs;
 
   unsigned long write_cb_calls;
   unsigned long write_calls;
@@ -87,6 +100,7 @@ typedef struct zfpm_stats_t_ {
   unsigned long nop_deletes_skipped;
   unsigned long route_adds;
   unsigned long route_dels;
+  unsigned long route_msgs;
 
   unsigned long updates_triggered;
   unsigned long redundant_triggers;
@@ -99,11 +113,11 @@ typedef struct zfpm_stats_t_ {
   unsigned long t_conn_down_yields;
   unsigned long t_conn_down_finishes;
 
-  unsigned long t_conn_up_starts;
-  unsigned long t_conn_up_dests_processed;
-  unsigned long t_conn_up_yields;
-  unsigned long t_conn_up_aborts;
-  unsigned long t_conn_up_finishes;
+  unsigned long snapshot_starts;
+  unsigned long snapshot_dests_queued;
+  unsigned long snapshot_dests_current;
+  unsigned long snapshot_aborts;
+  unsigned long snapshot_finishes;
 
 } zfpm_stats_t;
 
@@ -174,6 +188,13 @@ typedef struct zfpm_glob_t_
   struct stream *obuf;
   struct stream *ibuf;
 
+  /*
+   * TRUE if the FPM asked for FPM_MSG_TYPE_ROUTES messages, and the
+   * largest message it takes.
+   */
+  int compact;
+  size_t max_msg_len;
+
   /*
    * Threads for I/O.
    */
@@ -192,14 +213,30 @@ typedef struct zfpm_glob_t_
   } t_conn_down_state;
 
   /*
-   * Thread to take actions once the TCP conn to the FPM comes up, and
-   * the state that belongs to it.
+   * Generation of the copy of the tables the FPM has. It goes up
+   * every time the connection comes up, so that a prefix whose
+   * fpm_gen matches has been sent since.
+   */
+  u_int32_t generation;
+
+  /*
+   * Snapshot of the tables being sent to the FPM once the connection
+   * is up. It starts when the FPM's capabilities arrive, or when
+   * t_caps_wait runs out, and is taken a batch at a time whenever
+   * there are no live updates to send, so that those go out first.
    */
-  struct thread *t_conn_up;
+  struct thread *t_caps_wait;
 
   struct {
+    int active;
+    u_int32_t generation;
     zfpm_rnodes_iter_t iter;
-  } t_conn_up_state;
+    unsigned long nodes_total;
+    unsigned long nodes_walked;
+    unsigned long dests_queued;
+    time_t start_time;
+    time_t end_time;
+  } snapshot;
 
   unsigned long connect_calls;
   time_t last_connect_call_time;
@@ -242,6 +279,7 @@ static int zfpm_write_cb (struct thread *thread);
 static void zfpm_set_state (zfpm_state_t state, const char *reason);
 static void zfpm_start_connect_timer (const char *reason);
 static void zfpm_start_stats_timer (void);
+static struct rib *zfpm_route_for_update (rib_dest_t *dest);
 
 /*
  * zfpm_thread_should_yield
@@ -516,58 +554,120 @@ zfpm_write_off (void)
 }
 
 /*
- * zfpm_conn_up_thread_cb
+ * zfpm_snapshot_start
  *
- * Callback for actions to be taken when the connection to the FPM
- * comes up.
+ * Start sending the FPM the routes it does not know about yet.
  */
-static int
-zfpm_conn_up_thread_cb (struct thread *thread)
+static void
+zfpm_snapshot_start (void)
+{
+  rib_tables_iter_t tables_iter;
+  struct route_table *table;
+
+  THREAD_TIMER_OFF (zfpm_g->t_caps_wait);
+  assert (!zfpm_g->snapshot.active);
+
+  memset (&zfpm_g->snapshot, 0, sizeof (zfpm_g->snapshot));
+  zfpm_rnodes_iter_init (&zfpm_g->snapshot.iter);
+
+  /*
+   * For reporting progress only, the tables may change as we go.
+   */
+  rib_tables_iter_init (&tables_iter);
+  while ((table = rib_tables_iter_next (&tables_iter)))
+    if (zfpm_is_table_for_fpm (table))
+      zfpm_g->snapshot.nodes_total += table->count;
+  rib_tables_iter_cleanup (&tables_iter);
+
+  zfpm_debug ("Starting snapshot %u", zfpm_g->generation);
+  zfpm_g->snapshot.active = 1;
+  zfpm_g->snapshot.generation = zfpm_g->generation;
+  zfpm_g->snapshot.start_time = zfpm_get_time ();
+  zfpm_g->stats.snapshot_starts++;
+
+  if (!zfpm_g->t_write)
+    zfpm_write_on ();
+}
+
+/*
+ * zfpm_snapshot_stop
+ */
+static void
+zfpm_snapshot_stop (void)
+{
+  zfpm_rnodes_iter_cleanup (&zfpm_g->snapshot.iter);
+  zfpm_g->snapshot.active = 0;
+}
+
+/*
+ * zfpm_snapshot_fill
+ *
+ * Put the next batch of prefixes from the snapshot on the outgoing
+ * queue, skipping those the FPM has already been told about.
+ */
+static void
+zfpm_snapshot_fill (void)
 {
   struct route_node *rnode;
-  zfpm_rnodes_iter_t *iter;
   rib_dest_t *dest;
+  int count;
 
-  assert (zfpm_g->t_conn_up);
-  zfpm_g->t_conn_up = NULL;
-
-  iter = &zfpm_g->t_conn_up_state.iter;
+  if (!zfpm_g->snapshot.active)
+    return;
 
-  if (zfpm_g->state != ZFPM_STATE_ESTABLISHED)
+  count = 0;
+  while (count < ZFPM_SNAPSHOT_BATCH
+	 && (rnode = zfpm_rnodes_iter_next (&zfpm_g->snapshot.iter)))
     {
-      zfpm_debug ("Connection not up anymore, conn_up thread aborting");
-      zfpm_g->stats.t_conn_up_aborts++;
-      goto done;
-    }
+      zfpm_g->snapshot.nodes_walked++;
 
-  while ((rnode = zfpm_rnodes_iter_next (iter)))
-    {
       dest = rib_dest_from_rnode (rnode);
+      if (!dest)
+	continue;
 
-      if (dest)
+      if (CHECK_FLAG (dest->flags, RIB_DEST_UPDATE_FPM)
+	  || dest->fpm_gen == zfpm_g->generation)
 	{
-	  zfpm_g->stats.t_conn_up_dests_processed++;
-	  zfpm_trigger_update (rnode, NULL);
+	  zfpm_g->stats.snapshot_dests_current++;
+	  continue;
 	}
 
       /*
-       * Yield if need be.
+       * The FPM starts out empty, so there is nothing to delete.
        */
-      if (!zfpm_thread_should_yield (thread))
+      if (!zfpm_route_for_update (dest))
 	continue;
 
-      zfpm_g->stats.t_conn_up_yields++;
-      zfpm_rnodes_iter_pause (iter);
-      zfpm_g->t_conn_up = thread_add_background (zfpm_g->master,
-						 zfpm_conn_up_thread_cb,
-						 0, 0);
-      return 0;
+      SET_FLAG (dest->flags, RIB_DEST_UPDATE_FPM);
+      TAILQ_INSERT_TAIL (&zfpm_g->dest_q, dest, fpm_q_entries);
+      zfpm_g->snapshot.dests_queued++;
+      zfpm_g->stats.snapshot_dests_queued++;
+      count++;
     }
 
-  zfpm_g->stats.t_conn_up_finishes++;
+  if (count)
+    {
+      zfpm_rnodes_iter_pause (&zfpm_g->snapshot.iter);
+      return;
+    }
 
- done:
-  zfpm_rnodes_iter_cleanup (iter);
+  zfpm_debug ("Snapshot %u complete, %lu routes", zfpm_g->generation,
+	      zfpm_g->snapshot.dests_queued);
+  zfpm_g->snapshot.end_time = zfpm_get_time ();
+  zfpm_g->stats.snapshot_finishes++;
+  zfpm_snapshot_stop ();
+}
+
+/*
+ * zfpm_caps_wait_cb
+ *
+ * The FPM sent no capabilities in time, the routes go out as netlink.
+ */
+static int
+zfpm_caps_wait_cb (struct thread *thread)
+{
+  zfpm_g->t_caps_wait = NULL;
+  zfpm_snapshot_start ();
   return 0;
 }
 
@@ -585,16 +685,19 @@ zfpm_connection_up (const char *detail)
   zfpm_set_state (ZFPM_STATE_ESTABLISHED, detail);
 
   /*
-   * Start thread to push existing routes to the FPM.
+   * Everything the FPM had is gone, skipping 0 as new prefixes have
+   * that.
    */
-  assert (!zfpm_g->t_conn_up);
+  if (++zfpm_g->generation == 0)
+    zfpm_g->generation = 1;
 
-  zfpm_rnodes_iter_init (&zfpm_g->t_conn_up_state.iter);
-
-  zfpm_debug ("Starting conn_up thread");
-  zfpm_g->t_conn_up = thread_add_background (zfpm_g->master,
-					     zfpm_conn_up_thread_cb, 0, 0);
-  zfpm_g->stats.t_conn_up_starts++;
+  /*
+   * Give the FPM a chance to ask for another encoding before the full
+   * table is sent.
+   */
+  assert (!zfpm_g->t_caps_wait);
+  THREAD_TIMER_MSEC_ON (zfpm_g->master, zfpm_g->t_caps_wait,
+			zfpm_caps_wait_cb, 0, ZFPM_CAPS_WAIT_MSECS);
 }
 
 /*
@@ -715,10 +818,21 @@ zfpm_connection_down (const char *detail)
 
   zfpm_read_off ();
   zfpm_write_off ();
+  THREAD_TIMER_OFF (zfpm_g->t_caps_wait);
+
+  if (zfpm_g->snapshot.active)
+    {
+      zfpm_debug ("Connection went down, abandoning snapshot");
+      zfpm_g->stats.snapshot_aborts++;
+      zfpm_snapshot_stop ();
+    }
 
   stream_reset (zfpm_g->ibuf);
   stream_reset (zfpm_g->obuf);
 
+  zfpm_g->compact = 0;
+  zfpm_g->max_msg_len = FPM_MAX_MSG_LEN;
+
   if (zfpm_g->sock >= 0) {
     close (zfpm_g->sock);
     zfpm_g->sock = -1;
@@ -737,6 +851,54 @@ zfpm_connection_down (const char *detail)
   zfpm_set_state (ZFPM_STATE_IDLE, detail);
 }
 
+/*
+ * zfpm_process_caps
+ *
+ * Act on the capabilities the FPM sent. Routes already in the
+ * outbound buffer still go out as they are.
+ */
+static void
+zfpm_process_caps (fpm_msg_hdr_t *hdr)
+{
+  fpm_caps_t caps;
+  size_t max_len;
+
+  zfpm_g->stats.caps_msgs++;
+
+  /*
+   * Whatever the FPM takes, the full table can go out now.
+   */
+  if (zfpm_g->t_caps_wait)
+    zfpm_snapshot_start ();
+
+  if (fpm_msg_data_len (hdr) < sizeof (caps))
+    {
+      zfpm_debug ("Ignoring short capabilities message");
+      return;
+    }
+
+  memcpy (&caps, fpm_msg_data (hdr), sizeof (caps));
+
+  if (!(ntohl (caps.flags) & FPM_CAP_ROUTES))
+    {
+      zfpm_g->compact = 0;
+      zfpm_g->max_msg_len = FPM_MAX_MSG_LEN;
+      return;
+    }
+
+  max_len = ntohs (caps.max_msg_len);
+  if (max_len < FPM_MAX_MSG_LEN)
+    max_len = FPM_MAX_MSG_LEN;
+  if (max_len > FPM_MAX_ROUTES_MSG_LEN)
+    max_len = FPM_MAX_ROUTES_MSG_LEN;
+
+  zfpm_g->compact = 1;
+  zfpm_g->max_msg_len = max_len & ~(FPM_MSG_ALIGNTO - 1);
+
+  zfpm_debug ("FPM takes route batches of up to %lu bytes",
+	      (unsigned long) zfpm_g->max_msg_len);
+}
+
 /*
  * zfpm_read_cb
  */
@@ -818,8 +980,11 @@ zfpm_read_cb (struct thread *thread)
   zfpm_debug ("Read out a full fpm message");
 
   /*
-   * Just throw it away for now.
+   * Capabilities are all we understand, the rest is thrown away.
    */
+  if (hdr->msg_type == FPM_MSG_TYPE_CAPS)
+    zfpm_process_caps (hdr);
+
   stream_reset (ibuf);
 
  done:
@@ -849,6 +1014,9 @@ zfpm_writes_pending (void)
   if (!TAILQ_EMPTY (&zfpm_g->dest_q))
     return 1;
 
+  if (zfpm_g->snapshot.active)
+    return 1;
+
   return 0;
 }
 
@@ -901,6 +1069,136 @@ zfpm_route_for_update (rib_dest_t *dest)
   return NULL;
 }
 
+/*
+ * zfpm_next_dest
+ *
+ * Returns the dest at the head of the outgoing queue, topping the
+ * queue up from the snapshot if it has run dry.
+ */
+static rib_dest_t *
+zfpm_next_dest (void)
+{
+  if (TAILQ_EMPTY (&zfpm_g->dest_q))
+    zfpm_snapshot_fill ();
+
+  return TAILQ_FIRST (&zfpm_g->dest_q);
+}
+
+/*
+ * zfpm_dest_sent
+ *
+ * Take a dest off the outgoing queue once an update for it has been
+ * written out, or found unnecessary.
+ */
+static void
+zfpm_dest_sent (rib_dest_t *dest, int is_add)
+{
+  /*
+   * Remove the dest from the queue, and reset the flag.
+   */
+  UNSET_FLAG (dest->flags, RIB_DEST_UPDATE_FPM);
+  TAILQ_REMOVE (&zfpm_g->dest_q, dest, fpm_q_entries);
+  dest->fpm_gen = zfpm_g->generation;
+
+  if (is_add)
+    {
+      SET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
+    }
+  else
+    {
+      UNSET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
+    }
+
+  /*
+   * Delete the destination if necessary.
+   */
+  if (rib_gc_dest (dest->rnode))
+    zfpm_g->stats.dests_del_after_update++;
+}
+
+/*
+ * zfpm_build_route_msgs
+ *
+ * Process the outgoing queue into FPM_MSG_TYPE_ROUTES messages in the
+ * outbound buffer, as many routes to a message as fit.
+ */
+static void
+zfpm_build_route_msgs (void)
+{
+  struct stream *s;
+  rib_dest_t *dest;
+  fpm_msg_hdr_t *hdr;
+  fpm_routes_hdr_t *routes;
+  unsigned char *data, *msg_end;
+  struct rib *rib;
+  int num_routes, len;
+
+  s = zfpm_g->obuf;
+
+  while (STREAM_WRITEABLE (s) >= zfpm_g->max_msg_len && zfpm_next_dest ())
+    {
+      hdr = (fpm_msg_hdr_t *) (STREAM_DATA (s) + stream_get_endp (s));
+      hdr->version = FPM_PROTO_VERSION;
+      hdr->msg_type = FPM_MSG_TYPE_ROUTES;
+
+      routes = fpm_msg_data (hdr);
+      data = (unsigned char *) (routes + 1);
+      msg_end = (unsigned char *) hdr + zfpm_g->max_msg_len;
+      num_routes = 0;
+
+      while ((dest = zfpm_next_dest ()) && num_routes < UINT16_MAX)
+	{
+	  assert (CHECK_FLAG (dest->flags, RIB_DEST_UPDATE_FPM));
+
+	  rib = zfpm_route_for_update (dest);
+
+	  /*
+	   * If this is a route deletion, and we have not sent the route
+	   * to the FPM previously, skip it.
+	   */
+	  if (!rib && !CHECK_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM))
+	    {
+	      zfpm_g->stats.nop_deletes_skipped++;
+	      zfpm_dest_sent (dest, 0);
+	      continue;
+	    }
+
+	  len = zfpm_compact_encode_route (dest, rib, (char *) data,
+					   msg_end - data);
+	  if (!len)
+	    break;
+
+	  data += len;
+	  num_routes++;
+
+	  if (rib)
+	    zfpm_g->stats.route_adds++;
+	  else
+	    zfpm_g->stats.route_dels++;
+
+	  zfpm_dest_sent (dest, rib != NULL);
+	}
+
+      /*
+       * Any route fits in an empty message, so this is only when the
+       * rest of the queue was deletes to skip.
+       */
+      if (!num_routes)
+	{
+	  assert (!dest);
+	  break;
+	}
+
+      routes->num_routes = htons (num_routes);
+      routes->reserved = 0;
+
+      len = fpm_data_len_to_msg_len (data - (unsigned char *) routes);
+      hdr->msg_len = htons (len);
+      stream_forward_endp (s, len);
+      zfpm_g->stats.route_msgs++;
+    }
+}
+
 /*
  * zfpm_build_updates
  *
@@ -923,6 +1221,12 @@ zfpm_build_updates (void)
 
   assert (stream_empty (s));
 
+  if (zfpm_g->compact)
+    {
+      zfpm_build_route_msgs ();
+      return;
+    }
+
   do {
 
     /*
@@ -934,7 +1238,7 @@ zfpm_build_updates (void)
     buf = STREAM_DATA (s) + stream_get_endp (s);
     buf_end = buf + STREAM_WRITEABLE (s);
 
-    dest = TAILQ_FIRST (&zfpm_g->dest_q);
+    dest = zfpm_next_dest ();
     if (!dest)
       break;
 
@@ -978,26 +1282,7 @@ zfpm_build_updates (void)
 	}
     }
 
-    /*
-     * Remove the dest from the queue, and reset the flag.
-     */
-    UNSET_FLAG (dest->flags, RIB_DEST_UPDATE_FPM);
-    TAILQ_REMOVE (&zfpm_g->dest_q, dest, fpm_q_entries);
-
-    if (is_add)
-      {
-	SET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
-      }
-    else
-      {
-	UNSET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
-      }
-
-    /*
-     * Delete the destination if necessary.
-     */
-    if (rib_gc_dest (dest->rnode))
-      zfpm_g->stats.dests_del_after_update++;
+    zfpm_dest_sent (dest, is_add);
 
   } while (1);
 
@@ -1412,6 +1697,43 @@ zfpm_start_stats_timer (void)
 	     zfpm_g->last_ivl_stats.counter, VTY_NEWLINE);		\
   } while (0)
 
+/*
+ * zfpm_show_snapshot
+ *
+ * Say how far the last snapshot sent to the FPM got.
+ */
+static void
+zfpm_show_snapshot (struct vty *vty)
+{
+  unsigned long pct;
+
+  if (!zfpm_g->snapshot.start_time)
+    return;
+
+  vty_out (vty, "Snapshot %u: ", zfpm_g->snapshot.generation);
+
+  if (zfpm_g->snapshot.active)
+    {
+      pct = 0;
+      if (zfpm_g->snapshot.nodes_total)
+	pct = zfpm_g->snapshot.nodes_walked * 100
+	      / zfpm_g->snapshot.nodes_total;
+      vty_out (vty, "%lu%% walked, %lu routes queued in %lu secs%s",
+	       pct > 99 ? 99 : pct, zfpm_g->snapshot.dests_queued,
+	       (unsigned long)
+	       zfpm_get_elapsed_time (zfpm_g->snapshot.start_time),
+	       VTY_NEWLINE);
+    }
+  else if (zfpm_g->snapshot.end_time)
+    vty_out (vty, "complete, %lu routes in %lu secs%s",
+	     zfpm_g->snapshot.dests_queued,
+	     (unsigned long) (zfpm_g->snapshot.end_time
+			      - zfpm_g->snapshot.start_time), VTY_NEWLINE);
+  else
+    vty_out (vty, "abandoned after %lu routes%s",
+	     zfpm_g->snapshot.dests_queued, VTY_NEWLINE);
+}
+
 /*
  * zfpm_show_stats
  */
@@ -1421,6 +1743,12 @@ zfpm_show_stats (struct vty *vty)
   zfpm_stats_t total_stats;
   time_t elapsed;
 
+  vty_out (vty, "Route encoding: %s, largest message %lu bytes%s",
+	   zfpm_g->compact ? "compact batches" : "netlink",
+	   (unsigned long) zfpm_g->max_msg_len, VTY_NEWLINE);
+
+  zfpm_show_snapshot (vty);
+
   vty_out (vty, "%s%-40s %10s     Last %2d secs%s%s", VTY_NEWLINE, "Counter",
 	   "Total", ZFPM_STATS_IVL_SECS, VTY_NEWLINE, VTY_NEWLINE);
 
@@ -1433,6 +1761,7 @@ zfpm_show_stats (struct vty *vty)
   ZFPM_SHOW_STAT (connect_calls);
   ZFPM_SHOW_STAT (connect_no_sock);
   ZFPM_SHOW_STAT (read_cb_calls);
+  ZFPM_SHOW_STAT (caps_msgs);
   ZFPM_SHOW_STAT (write_cb_calls);
   ZFPM_SHOW_STAT (write_calls);
   ZFPM_SHOW_STAT (partial_writes);
@@ -1441,6 +1770,7 @@ zfpm_show_stats (struct vty *vty)
   ZFPM_SHOW_STAT (nop_deletes_skipped);
   ZFPM_SHOW_STAT (route_adds);
   ZFPM_SHOW_STAT (route_dels);
+  ZFPM_SHOW_STAT (route_msgs);
   ZFPM_SHOW_STAT (updates_triggered);
   ZFPM_SHOW_STAT (non_fpm_table_triggers);
   ZFPM_SHOW_STAT (redundant_triggers);
@@ -1449,11 +1779,11 @@ zfpm_show_stats (struct vty *vty)
   ZFPM_SHOW_STAT (t_conn_down_dests_processed);
   ZFPM_SHOW_STAT (t_conn_down_yields);
   ZFPM_SHOW_STAT (t_conn_down_finishes);
-  ZFPM_SHOW_STAT (t_conn_up_starts);
-  ZFPM_SHOW_STAT (t_conn_up_dests_processed);
-  ZFPM_SHOW_STAT (t_conn_up_yields);
-  ZFPM_SHOW_STAT (t_conn_up_aborts);
-  ZFPM_SHOW_STAT (t_conn_up_finishes);
+  ZFPM_SHOW_STAT (snapshot_starts);
+  ZFPM_SHOW_STAT (snapshot_dests_queued);
+  ZFPM_SHOW_STAT (snapshot_dests_current);
+  ZFPM_SHOW_STAT (snapshot_aborts);
+  ZFPM_SHOW_STAT (snapshot_finishes);
 
   if (!zfpm_g->last_stats_clear_time)
     return;
@@ -1544,6 +1874,7 @@ zfpm_init (struct thread_master *master, int enable, uint16_t port)
   TAILQ_INIT(&zfpm_g->dest_q);
   zfpm_g->sock = -1;
   zfpm_g->state = ZFPM_STATE_IDLE;
+  zfpm_g->max_msg_len = FPM_MAX_MSG_LEN;
 
   /*
    * Netlink must currently be available for the Zebra-FPM interface
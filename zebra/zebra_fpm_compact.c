@@ -0,0 +1,239 @@
+/*
+ * Code for encoding routes in the compact FPM format, many to an FPM
+ * message.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "log.h"
+#include "rib.h"
+
+#include "fpm/fpm.h"
+#include "zebra_fpm_private.h"
+
+/*
+ * Most nexthops sent for a route, as for netlink.
+ */
+#define ZFPM_COMPACT_MAX_NHS (MULTIPATH_NUM ? MIN (MULTIPATH_NUM, 64) : 64)
+
+/*
+ * compact_family
+ */
+static uint8_t
+compact_family (u_char af)
+{
+  switch (af)
+    {
+    case AF_INET:
+      return FPM_ROUTE_AF_INET;
+
+#ifdef HAVE_IPV6
+    case AF_INET6:
+      return FPM_ROUTE_AF_INET6;
+#endif
+
+    default:
+      return 0;
+    }
+}
+
+/*
+ * compact_put_nh
+ *
+ * Put the given nexthop after the others at 'p', if it is of any use.
+ *
+ * Returns the number of bytes written, 0 if the nexthop was skipped
+ * and -1 if it did not fit.
+ */
+static int
+compact_put_nh (struct nexthop *nexthop, size_t alen, uint8_t *p,
+		uint8_t *end, union g_addr **src)
+{
+  uint32_t if_index;
+  union g_addr *gateway;
+
+  gateway = NULL;
+
+  switch (nexthop->type)
+    {
+    case NEXTHOP_TYPE_IPV4:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+      gateway = &nexthop->gate;
+      if (nexthop->src.ipv4.s_addr && !*src)
+	*src = &nexthop->src;
+      break;
+
+#ifdef HAVE_IPV6
+    case NEXTHOP_TYPE_IPV6:
+    case NEXTHOP_TYPE_IPV6_IFNAME:
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+      gateway = &nexthop->gate;
+      break;
+#endif /* HAVE_IPV6 */
+
+    case NEXTHOP_TYPE_IFINDEX:
+    case NEXTHOP_TYPE_IFNAME:
+      if (nexthop->src.ipv4.s_addr && !*src)
+	*src = &nexthop->src;
+      break;
+
+    default:
+      break;
+    }
+
+  if (!gateway && nexthop->ifindex == 0)
+    return 0;
+
+  if ((size_t) (end - p) < 4 + alen)
+    return -1;
+
+  if_index = htonl (nexthop->ifindex);
+  memcpy (p, &if_index, 4);
+  if (gateway)
+    memcpy (p + 4, gateway, alen);
+  else
+    memset (p + 4, 0, alen);
+
+  return 4 + alen;
+}
+
+/*
+ * zfpm_compact_encode_route
+ *
+ * Encode the given route in the compact format in the given buffer
+ * space. A NULL rib, or one without a usable nexthop, makes a delete.
+ *
+ * Returns the number of bytes written to the buffer, 0 if the route
+ * does not fit.
+ */
+int
+zfpm_compact_encode_route (rib_dest_t *dest, struct rib *rib,
+			   char *in_buf, size_t in_buf_len)
+{
+  fpm_route_t *route;
+  struct prefix *prefix;
+  struct nexthop *nexthop, *tnexthop;
+  union g_addr *src;
+  uint8_t *p, *end, *nhs;
+  size_t alen, plen;
+  int recursing, num_nhs, len;
+
+  route = (fpm_route_t *) in_buf;
+  p = (uint8_t *) in_buf;
+  end = p + in_buf_len;
+
+  prefix = rib_dest_prefix (dest);
+  alen = fpm_route_addr_len (compact_family (prefix->family));
+  plen = fpm_route_prefix_len (prefix->prefixlen);
+  assert (alen);
+
+  /*
+   * Room for the route itself, and a source address it may need.
+   */
+  if (in_buf_len < sizeof (*route) + plen + alen)
+    return 0;
+
+  memset (route, 0, sizeof (*route));
+  route->op = FPM_ROUTE_OP_DEL;
+  route->family = compact_family (prefix->family);
+  route->prefixlen = prefix->prefixlen;
+  route->table_id = htonl (rib_dest_vrf (dest)->id);
+
+  p += sizeof (*route);
+  memset (p, 0, plen);
+  memcpy (p, &prefix->u.prefix, (prefix->prefixlen + 7) / 8);
+  p += plen;
+
+  if (!rib)
+    goto done;
+
+  route->protocol = rib->type;
+  route->metric = htonl (rib->metric);
+
+  if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_BLACKHOLE))
+    route->type = FPM_ROUTE_TYPE_BLACKHOLE;
+  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_REJECT))
+    route->type = FPM_ROUTE_TYPE_UNREACHABLE;
+  else
+    route->type = FPM_ROUTE_TYPE_UNICAST;
+
+  if (route->type != FPM_ROUTE_TYPE_UNICAST)
+    {
+      route->op = FPM_ROUTE_OP_ADD;
+      goto done;
+    }
+
+  /*
+   * The nexthops go after a gap left for the source address, which is
+   * closed up if there turns out to be none.
+   */
+  nhs = p + alen;
+  src = NULL;
+  num_nhs = 0;
+
+  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+    {
+      if (num_nhs >= ZFPM_COMPACT_MAX_NHS)
+	break;
+
+      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+	continue;
+
+      if (!CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+	continue;
+
+      len = compact_put_nh (nexthop, alen, nhs + num_nhs * (4 + alen), end,
+			    &src);
+      if (len < 0)
+	return 0;
+      if (len)
+	num_nhs++;
+    }
+
+  /*
+   * Without a usable nexthop the prefix goes away.
+   */
+  if (num_nhs == 0)
+    {
+      zfpm_debug ("%s: No useful nexthop, sending a delete", __func__);
+      route->protocol = 0;
+      route->type = 0;
+      route->metric = 0;
+      goto done;
+    }
+
+  route->op = FPM_ROUTE_OP_ADD;
+  route->num_nhs = num_nhs;
+
+  if (src)
+    {
+      route->flags |= FPM_ROUTE_F_SRC;
+      memcpy (p, src, alen);
+      p = nhs;
+    }
+  else
+    memmove (p, nhs, num_nhs * (4 + alen));
+
+  p += num_nhs * (4 + alen);
+
+ done:
+  route->len = htons (p - (uint8_t *) in_buf);
+  return p - (uint8_t *) in_buf;
+}
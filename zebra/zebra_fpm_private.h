@@ -53,4 +53,8 @@ extern int
 zfpm_netlink_encode_route (int cmd, rib_dest_t *dest, struct rib *rib,
 			   char *in_buf, size_t in_buf_len);
 
+extern int
+zfpm_compact_encode_route (rib_dest_t *dest, struct rib *rib,
+			   char *in_buf, size_t in_buf_len);
+
 #endif /* _ZEBRA_FPM_PRIVATE_H */
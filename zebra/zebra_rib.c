@@ -41,6 +41,7 @@
 #include "zebra/redistribute.h"
 #include "zebra/debug.h"
 #include "zebra/zebra_fpm.h"
+#include "zebra/zebra_rnh.h"
 
 /* Default rtm_table for all clients */
 extern struct zebra_t zebrad;
@@ -51,6 +52,16 @@ extern struct zebra_t zebrad;
  */
 int rib_process_hold_time = 10;
 
+/* Kernel updates are coalesced per prefix over this many milliseconds,
+   see rib_fib_update(). */
+u_int32_t rib_fib_coalesce_window = 0;
+struct rib_fib_stats rib_fib_stats;
+
+/* Prefixes waiting for the coalescing window to close. */
+static TAILQ_HEAD (rib_fib_q, rib_dest_t_) rib_fib_queue =
+  TAILQ_HEAD_INITIALIZER (rib_fib_queue);
+static struct thread *rib_fib_timer;
+
 /* Each route type's string and default distance value. */
 static const struct
 {  
@@ -406,6 +417,21 @@ nexthop_has_fib_child(struct nexthop *nexthop)
   return 0;
 }
 
+/* Can a route resolve through this nexthop of the route selected for
+   rn?  Through those in the kernel, or, while rn waits to be flushed,
+   through those the kernel is about to be given. */
+static int
+nexthop_resolves (struct route_node *rn, struct nexthop *newhop)
+{
+  rib_dest_t *dest = rib_dest_from_rnode (rn);
+
+  if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
+    return 0;
+  if (dest && CHECK_FLAG (dest->flags, RIB_DEST_FIB_QUEUED))
+    return CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_ACTIVE);
+  return CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB);
+}
+
 /* If force flag is not set, do not modify falgs at all for uninstall
    the route from FIB. */
 static int
@@ -491,8 +517,7 @@ nexthop_active_ipv4 (struct rib *rib, struct nexthop *nexthop, int set,
 	    {
 	      resolved = 0;
 	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
-		    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
+		if (nexthop_resolves (rn, newhop))
 		  {
 		    if (set)
 		      {
@@ -634,8 +659,7 @@ nexthop_active_ipv6 (struct rib *rib, struct nexthop *nexthop, int set,
 	    {
 	      resolved = 0;
 	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
-		    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
+		if (nexthop_resolves (rn, newhop))
 		  {
 		    if (set)
 		      {
@@ -1156,6 +1180,86 @@ rib_uninstall_kernel (struct route_node *rn, struct rib *rib)
   return ret;
 }
 
+/* The recursive nexthops of the route the kernel has are about to be
+   resolved again, which frees the resolved nexthops it was given.  Keep
+   a copy of those to take the route out with at the flush. */
+static void
+rib_fib_keep (struct route_node *rn, struct rib *rib)
+{
+  rib_dest_t *dest = rib_dest_from_rnode (rn);
+  struct nexthop *nexthop, *tnexthop, *copy;
+  int recursing;
+
+  if (rib != dest->kernel || dest->kernel_nexthop)
+    return;
+
+  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+      break;
+  if (! nexthop)
+    return;
+
+  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+    if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE)
+	&& CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+      {
+	copy = XCALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+	copy->type = nexthop->type;
+	copy->flags = nexthop->flags;
+	copy->ifindex = nexthop->ifindex;
+	if (nexthop->ifname)
+	  copy->ifname = XSTRDUP (0, nexthop->ifname);
+	copy->gate = nexthop->gate;
+	copy->src = nexthop->src;
+	_nexthop_add (&dest->kernel_nexthop, copy);
+      }
+}
+
+/* The route the kernel has for the prefix, with the nexthops it was
+   given: those kept by rib_fib_keep() in a copy filled in at kept. */
+static struct rib *
+rib_fib_kernel (rib_dest_t *dest, struct rib *kept)
+{
+  if (! dest->kernel || ! dest->kernel_nexthop)
+    return dest->kernel;
+
+  *kept = *dest->kernel;
+  kept->nexthop = dest->kernel_nexthop;
+  return kept;
+}
+
+/* The kernel was told about the prefix, drop what was kept for it. */
+static void
+rib_fib_forget (rib_dest_t *dest, struct rib *kept)
+{
+  if (! dest->kernel_nexthop)
+    return;
+
+  kernel_route_forget (kept);
+  nexthops_free (dest->kernel_nexthop);
+  dest->kernel_nexthop = NULL;
+}
+
+/* Take the prefix out of the kernel right away, rather than at the
+   next flush.  A removed route the kernel had is unlinked by the next
+   rib_process(). */
+static void
+rib_fib_withdraw (struct route_node *rn)
+{
+  rib_dest_t *dest = rib_dest_from_rnode (rn);
+  struct rib kept;
+
+  if (! dest || ! dest->kernel)
+    return;
+
+  rib_uninstall_kernel (rn, rib_fib_kernel (dest, &kept));
+  rib_fib_forget (dest, &kept);
+  dest->kernel = NULL;
+  UNSET_FLAG (dest->flags, RIB_DEST_FIB_CHANGED);
+  rib_fib_stats.requested++;
+  rib_fib_stats.emitted++;
+}
+
 /* Uninstall the route from kernel. */
 static void
 rib_uninstall (struct route_node *rn, struct rib *rib)
@@ -1166,7 +1270,7 @@ rib_uninstall (struct route_node *rn, struct rib *rib)
 
       redistribute_delete (&rn->p, rib);
       if (! RIB_SYSTEM_ROUTE (rib))
-	rib_uninstall_kernel (rn, rib);
+	rib_fib_withdraw (rn);
       UNSET_FLAG (rib->flags, ZEBRA_FLAG_SELECTED);
     }
 }
@@ -1194,6 +1298,12 @@ rib_can_delete_dest (rib_dest_t *dest)
       CHECK_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM))
     return 0;
 
+  /*
+   * Nor while it waits to be flushed to the kernel.
+   */
+  if (CHECK_FLAG (dest->flags, RIB_DEST_FIB_QUEUED))
+    return 0;
+
   return 1;
 }
 
@@ -1236,6 +1346,193 @@ rib_gc_dest (struct route_node *rn)
   return 1;
 }
 
+/* The n-th nexthop of a route the kernel would be given, that is a
+   resolved one carrying the given flag. */
+static struct nexthop *
+rib_fib_nexthop (struct rib *rib, u_char flag, int n)
+{
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+
+  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+    if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE)
+	&& CHECK_FLAG (nexthop->flags, flag) && n-- == 0)
+      return nexthop;
+  return NULL;
+}
+
+/* Would installing 'want' leave the kernel with the route it has for
+   'have' already?  That is the case when a route is withdrawn and
+   announced again, or its nexthops flap back, within the window. */
+static int
+rib_fib_same (struct rib *have, struct rib *want)
+{
+  struct nexthop *a, *b;
+  int i;
+
+  if (have->table != want->table || have->metric != want->metric
+      || ((have->flags ^ want->flags)
+	  & (ZEBRA_FLAG_BLACKHOLE | ZEBRA_FLAG_REJECT)))
+    return 0;
+
+  for (i = 0; ; i++)
+    {
+      a = rib_fib_nexthop (have, NEXTHOP_FLAG_FIB, i);
+      b = rib_fib_nexthop (want, NEXTHOP_FLAG_ACTIVE, i);
+      if (! a || ! b)
+	return a == b;
+      if (a->type != b->type || a->ifindex != b->ifindex
+	  || memcmp (&a->gate, &b->gate, sizeof (a->gate))
+	  || memcmp (&a->src, &b->src, sizeof (a->src)))
+	return 0;
+    }
+}
+
+/* Bring the kernel's route for a prefix in line with the selected
+   one.  Whatever happened to the prefix since the last flush, this is
+   at most one route out and one in. */
+static void
+rib_fib_flush (struct route_node *rn)
+{
+  rib_dest_t *dest = rib_dest_from_rnode (rn);
+  struct rib *rib, *want = NULL, *have, *old;
+  struct rib kept;
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+  u_int32_t ops = 0;
+
+  RNODE_FOREACH_RIB (rn, rib)
+    if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED))
+      {
+	if (! RIB_SYSTEM_ROUTE (rib))
+	  want = rib;
+	break;
+      }
+  old = dest->kernel;
+  have = rib_fib_kernel (dest, &kept);
+
+  if (want && want == have
+      && ! CHECK_FLAG (dest->flags, RIB_DEST_FIB_CHANGED))
+    {
+      /* Housekeeping code to deal with race conditions in kernel with
+         linux netlink reporting interface up before IPv4 or IPv6
+         protocol is ready to add routes.  This makes sure the routes
+         are IN the kernel. */
+      for (ALL_NEXTHOPS_RO(want->nexthop, nexthop, tnexthop, recursing))
+	if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+	  break;
+      if (! nexthop)
+	{
+	  rib_install_kernel (rn, want);
+	  dest->fib_ops++;
+	  ops++;
+	}
+    }
+  else if (want && have && rib_fib_same (have, want))
+    {
+      /* Nothing to tell the kernel, just move the FIB flags over. */
+      for (ALL_NEXTHOPS_RO(have->nexthop, nexthop, tnexthop, recursing))
+	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+      for (ALL_NEXTHOPS_RO(want->nexthop, nexthop, tnexthop, recursing))
+	if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE)
+	    && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+	  SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+    }
+  else
+    {
+      if (have)
+	{
+	  rib_uninstall_kernel (rn, have);
+	  ops++;
+	}
+      if (want)
+	{
+	  rib_install_kernel (rn, want);
+	  ops++;
+	}
+    }
+
+  rib_fib_forget (dest, &kept);
+  dest->kernel = want;
+  UNSET_FLAG (dest->flags, RIB_DEST_FIB_CHANGED);
+
+  rib_fib_stats.requested += dest->fib_ops;
+  rib_fib_stats.emitted += ops;
+  if (dest->fib_ops > ops)
+    rib_fib_stats.suppressed += dest->fib_ops - ops;
+  dest->fib_ops = 0;
+  rib_fib_stats.flushes++;
+
+  if (old && old != want && CHECK_FLAG (old->status, RIB_ENTRY_REMOVED))
+    rib_unlink (rn, old);
+}
+
+/* The coalescing window closed, flush every prefix that changed in it. */
+static int
+rib_fib_timer_expire (struct thread *thread)
+{
+  rib_dest_t *dest;
+  struct route_node *rn;
+  unsigned long count = 0;
+
+  rib_fib_timer = NULL;
+
+  while ((dest = TAILQ_FIRST (&rib_fib_queue)) != NULL)
+    {
+      TAILQ_REMOVE (&rib_fib_queue, dest, fib_q_entries);
+      UNSET_FLAG (dest->flags, RIB_DEST_FIB_QUEUED);
+      rn = dest->rnode;
+
+      rib_fib_flush (rn);
+      count++;
+
+      /* Nexthop tracking looked at the prefix when it was selected,
+         before the kernel had it. */
+      zebra_rnh_trigger (rn);
+
+      rib_gc_dest (rn);
+      route_unlock_node (rn);
+    }
+
+  rib_fib_stats.pending = 0;
+  if (count > rib_fib_stats.max_flush)
+    rib_fib_stats.max_flush = count;
+
+  kernel_route_flush ();
+  return 0;
+}
+
+/* Best-path selection is done with a prefix.  Without a coalescing
+   window the kernel is updated right away.  Otherwise the first change
+   to a prefix puts it on the flush queue, where further changes are
+   folded into it, and only the difference between what the kernel has
+   and what is selected once the window closes is sent. */
+static void
+rib_fib_update (struct route_node *rn)
+{
+  rib_dest_t *dest = rib_dest_from_rnode (rn);
+
+  if (CHECK_FLAG (dest->flags, RIB_DEST_FIB_QUEUED))
+    return;
+
+  if (! rib_fib_coalesce_window
+      || (! dest->fib_ops && ! CHECK_FLAG (dest->flags, RIB_DEST_FIB_CHANGED)))
+    {
+      rib_fib_flush (rn);
+      return;
+    }
+
+  SET_FLAG (dest->flags, RIB_DEST_FIB_QUEUED);
+  TAILQ_INSERT_TAIL (&rib_fib_queue, dest, fib_q_entries);
+  route_lock_node (rn);
+  rib_fib_stats.pending++;
+
+  if (! rib_fib_timer)
+    rib_fib_timer = thread_add_timer_msec (zebrad.master,
+					   rib_fib_timer_expire, NULL,
+					   rib_fib_coalesce_window);
+}
+
 /* Core function for processing routing information base. */
 static void
 rib_process (struct route_node *rn)
@@ -1245,15 +1542,14 @@ rib_process (struct route_node *rn)
   struct rib *fib = NULL;
   struct rib *select = NULL;
   struct rib *del = NULL;
-  int installed = 0;
-  struct nexthop *nexthop = NULL, *tnexthop;
-  int recursing;
   char buf[INET6_ADDRSTRLEN];
   rib_table_info_t *info;
+  rib_dest_t *dest;
 
   assert (rn);
 
   info = rn->table->info;
+  dest = rib_dest_from_rnode (rn);
 
   if (IS_ZEBRA_DEBUG_RIB || IS_ZEBRA_DEBUG_RIB_Q)
     inet_ntop (rn->p.family, &rn->p.u.prefix, buf, INET6_ADDRSTRLEN);
@@ -1268,10 +1564,13 @@ rib_process (struct route_node *rn)
         }
       
       /* Unlock removed routes, so they'll be freed, bar the FIB entry,
-       * which we need to do do further work with below.
+       * which we need to do do further work with below, and the route
+       * the kernel still has, which goes at the next flush.
        */
       if (CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED))
         {
+          if (rib == dest->kernel && rib != fib)
+            continue;
           if (rib != fib)
             {
               if (IS_ZEBRA_DEBUG_RIB)
@@ -1355,36 +1654,22 @@ rib_process (struct route_node *rn)
       if (CHECK_FLAG (select->flags, ZEBRA_FLAG_CHANGED))
         {
 	  zfpm_trigger_update (rn, "updating existing route");
+	  zebra_rnh_trigger (rn);
 
           redistribute_delete (&rn->p, select);
           if (! RIB_SYSTEM_ROUTE (select))
-            rib_uninstall_kernel (rn, select);
+            {
+              /* Reinstalled with its new nexthops at the flush. */
+              SET_FLAG (dest->flags, RIB_DEST_FIB_CHANGED);
+              dest->fib_ops += 2;
+            }
 
           /* Set real nexthop. */
+          rib_fib_keep (rn, select);
           nexthop_active_update (rn, select, 1);
   
-          if (! RIB_SYSTEM_ROUTE (select))
-            rib_install_kernel (rn, select);
           redistribute_add (&rn->p, select);
         }
-      else if (! RIB_SYSTEM_ROUTE (select))
-        {
-          /* Housekeeping code to deal with 
-             race conditions in kernel with linux
-             netlink reporting interface up before IPv4 or IPv6 protocol
-             is ready to add routes.
-             This makes sure the routes are IN the kernel.
-           */
-
-          for (ALL_NEXTHOPS_RO(select->nexthop, nexthop, tnexthop, recursing))
-            if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
-            {
-              installed = 1;
-              break;
-            }
-          if (! installed) 
-            rib_install_kernel (rn, select);
-        }
       goto end;
     }
 
@@ -1399,13 +1684,15 @@ rib_process (struct route_node *rn)
           buf, rn->p.prefixlen, fib);
 
       zfpm_trigger_update (rn, "removing existing route");
+      zebra_rnh_trigger (rn);
 
       redistribute_delete (&rn->p, fib);
       if (! RIB_SYSTEM_ROUTE (fib))
-	rib_uninstall_kernel (rn, fib);
+	dest->fib_ops++;
       UNSET_FLAG (fib->flags, ZEBRA_FLAG_SELECTED);
 
       /* Set real nexthop. */
+      rib_fib_keep (rn, fib);
       nexthop_active_update (rn, fib, 1);
     }
 
@@ -1420,18 +1707,21 @@ rib_process (struct route_node *rn)
           rn->p.prefixlen, select);
 
       zfpm_trigger_update (rn, "new route selected");
+      zebra_rnh_trigger (rn);
 
       /* Set real nexthop. */
+      rib_fib_keep (rn, select);
       nexthop_active_update (rn, select, 1);
 
       if (! RIB_SYSTEM_ROUTE (select))
-        rib_install_kernel (rn, select);
+        dest->fib_ops++;
       SET_FLAG (select->flags, ZEBRA_FLAG_SELECTED);
       redistribute_add (&rn->p, select);
     }
 
-  /* FIB route was removed, should be deleted */
-  if (del)
+  /* FIB route was removed, should be deleted, unless the kernel has
+   * it still. */
+  if (del && del != dest->kernel)
     {
       if (IS_ZEBRA_DEBUG_RIB)
         zlog_debug ("%s: %s/%d: Deleting fib %p, rn %p", __func__, buf,
@@ -1443,6 +1733,9 @@ end:
   if (IS_ZEBRA_DEBUG_RIB_Q)
     zlog_debug ("%s: %s/%d: rn %p dequeued", __func__, buf, rn->p.prefixlen, rn);
 
+  if (dest)
+    rib_fib_update (rn);
+
   /*
    * Check if the dest can be deleted now.
    */
@@ -1500,6 +1793,13 @@ meta_queue_process (struct work_queue *dummy, void *data)
   return mq->size ? WQ_REQUEUE : WQ_SUCCESS;
 }
 
+/* The RIB work queue ran dry, hand the kernel whatever it has queued. */
+static void
+meta_queue_process_complete (struct work_queue *dummy)
+{
+  kernel_route_flush ();
+}
+
 /*
  * Map from rib types to queue type (priority) in meta queue
  */
@@ -1593,7 +1893,7 @@ rib_queue_add (struct zebra_t *zebra, struct route_node *rn)
    * holder, if necessary, then push the work into it in any case.
    * This semantics was introduced after 0.99.9 release.
    */
-  if (!zebra->ribq->items->count)
+  if (!work_queue_item_count (zebra->ribq))
     work_queue_add (zebra->ribq, zebra->mq);
 
   rib_meta_queue_add (zebra->mq, rn);
@@ -1641,6 +1941,7 @@ rib_queue_init (struct zebra_t *zebra)
   /* fill in the work queue spec */
   zebra->ribq->spec.workfunc = &meta_queue_process;
   zebra->ribq->spec.errorfunc = NULL;
+  zebra->ribq->spec.completion_func = &meta_queue_process_complete;
   /* XXX: TODO: These should be runtime configurable via vty */
   zebra->ribq->spec.max_retries = 3;
   zebra->ribq->spec.hold = rib_process_hold_time;
@@ -1790,6 +2091,7 @@ rib_unlink (struct route_node *rn, struct rib *rib)
     }
 
   /* free RIB and nexthops */
+  kernel_route_forget (rib);
   nexthops_free(rib->nexthop);
   XFREE (MTYPE_RIB, rib);
 
@@ -2073,18 +2375,13 @@ void rib_lookup_and_pushup (struct prefix_ipv4 * p)
     rib_queue_add (&zebrad, rn);
 }
 
-int
-rib_add_ipv4_multipath (struct prefix_ipv4 *p, struct rib *rib, safi_t safi)
+static void
+rib_add_ipv4_node (struct route_table *table, struct prefix_ipv4 *p,
+		   struct rib *rib)
 {
-  struct route_table *table;
   struct route_node *rn;
   struct rib *same;
   struct nexthop *nexthop;
-  
-  /* Lookup table.  */
-  table = vrf_table (AFI_IP, safi, 0);
-  if (! table)
-    return 0;
 
   /* Make it sure prefixlen is applied to the prefix. */
   apply_mask_ipv4 (p);
@@ -2142,6 +2439,76 @@ rib_add_ipv4_multipath (struct prefix_ipv4 *p, struct rib *rib, safi_t safi)
   }
   
   route_unlock_node (rn);
+}
+
+int
+rib_add_ipv4_multipath (struct prefix_ipv4 *p, struct rib *rib, safi_t safi)
+{
+  struct route_table *table;
+
+  /* Lookup table.  */
+  table = vrf_table (AFI_IP, safi, 0);
+  if (! table)
+    return 0;
+
+  rib_add_ipv4_node (table, p, rib);
+  return 0;
+}
+
+/* A new route with the same attributes and nexthops as the given one. */
+static struct rib *
+rib_copy (struct rib *rib)
+{
+  struct rib *new;
+  struct nexthop *nexthop, *copy;
+
+  new = XCALLOC (MTYPE_RIB, sizeof (struct rib));
+  new->type = rib->type;
+  new->flags = rib->flags;
+  new->distance = rib->distance;
+  new->metric = rib->metric;
+  new->table = rib->table;
+  new->uptime = rib->uptime;
+
+  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    {
+      copy = XCALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+      copy->type = nexthop->type;
+      copy->ifindex = nexthop->ifindex;
+      if (nexthop->ifname)
+	copy->ifname = XSTRDUP (0, nexthop->ifname);
+      copy->gate = nexthop->gate;
+      copy->src = nexthop->src;
+      nexthop_add (new, copy);
+    }
+  return new;
+}
+
+/* Add 'count' routes that differ from 'rib' in prefix and, unless
+   'metric' is NULL, metric only.  'rib' itself goes in last. */
+int
+rib_add_ipv4_bulk (struct prefix_ipv4 *p, u_int32_t *metric, int count,
+		   struct rib *rib, safi_t safi)
+{
+  struct route_table *table;
+  struct rib *new;
+  int i;
+
+  table = vrf_table (AFI_IP, safi, 0);
+  if (! table || ! count)
+    {
+      nexthops_free (rib->nexthop);
+      XFREE (MTYPE_RIB, rib);
+      return 0;
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      new = (i < count - 1) ? rib_copy (rib) : rib;
+      if (metric)
+	new->metric = metric[i];
+      rib_add_ipv4_node (table, &p[i], new);
+    }
   return 0;
 }
 
@@ -3289,16 +3656,14 @@ rib_close_table (struct route_table *table)
 
   if (table)
     for (rn = route_top (table); rn; rn = route_next (rn))
-      RNODE_FOREACH_RIB (rn, rib)
-        {
-          if (!CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED))
-	    continue;
-
-	  zfpm_trigger_update (rn, NULL);
+      {
+        RNODE_FOREACH_RIB (rn, rib)
+          if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED))
+	    zfpm_trigger_update (rn, NULL);
 
-	  if (! RIB_SYSTEM_ROUTE (rib))
-	    rib_uninstall_kernel (rn, rib);
-        }
+	/* Whatever the kernel has, not what is waiting to go in. */
+	rib_fib_withdraw (rn);
+      }
 }
 
 /* Close all RIB tables.  */
@@ -3307,6 +3672,7 @@ rib_close (void)
 {
   rib_close_table (vrf_table (AFI_IP, SAFI_UNICAST, 0));
   rib_close_table (vrf_table (AFI_IP6, SAFI_UNICAST, 0));
+  kernel_route_flush ();
 }
 
 /* Routing information base initialize. */
@@ -0,0 +1,398 @@
+/*
+ * Zebra registered nexthop tracking
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Clients register nexthop addresses with ZEBRA_NEXTHOP_REGISTER and
+   get a ZEBRA_NEXTHOP_UPDATE straight away and again whenever the
+   route resolving the address changes, instead of polling with
+   ZEBRA_IPV4_NEXTHOP_LOOKUP.  rib_process() reports every prefix whose
+   selected route changed; the registered addresses covered by that
+   prefix are queued and re-resolved from an event once the current
+   batch of RIB work is done. */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "memory.h"
+#include "stream.h"
+#include "linklist.h"
+#include "thread.h"
+#include "command.h"
+#include "log.h"
+#include "zclient.h"
+
+#include "zebra/rib.h"
+#include "zebra/zserv.h"
+#include "zebra/zebra_rnh.h"
+#include "zebra/debug.h"
+
+extern struct zebra_t zebrad;
+
+/* Registered nexthops, by address family. */
+static struct route_table *rnh_table[AFI_MAX];
+
+/* Nexthops whose resolution may have changed. */
+static struct list *rnh_dirty;
+static struct thread *t_rnh_eval;
+
+/* Scratch buffer for resolving. */
+static struct stream *rnh_stream;
+
+/* Encode the route currently resolving RNH into S in the format of
+   the synchronous nexthop lookup replies: metric, nexthop count and
+   the nexthops of the matching route installed in the FIB. */
+static void
+rnh_resolve (struct rnh *rnh, struct stream *s)
+{
+  struct prefix *p = &rnh->node->p;
+  struct rib *rib = NULL;
+  struct nexthop *nexthop;
+  unsigned long nump;
+  u_char num;
+
+  if (p->family == AF_INET)
+    rib = rib_match_ipv4 (p->u.prefix4);
+#ifdef HAVE_IPV6
+  else if (p->family == AF_INET6)
+    rib = rib_match_ipv6 (&p->u.prefix6);
+#endif /* HAVE_IPV6 */
+
+  if (! rib)
+    {
+      stream_putl (s, 0);
+      stream_putc (s, 0);
+      return;
+    }
+
+  stream_putl (s, rib->metric);
+  num = 0;
+  nump = stream_get_endp (s);
+  stream_putc (s, 0);
+  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+      {
+	stream_putc (s, nexthop->type);
+	switch (nexthop->type)
+	  {
+	  case ZEBRA_NEXTHOP_IPV4:
+	    stream_put_in_addr (s, &nexthop->gate.ipv4);
+	    break;
+	  case ZEBRA_NEXTHOP_IPV4_IFINDEX:
+	    stream_put_in_addr (s, &nexthop->gate.ipv4);
+	    stream_putl (s, nexthop->ifindex);
+	    break;
+#ifdef HAVE_IPV6
+	  case ZEBRA_NEXTHOP_IPV6:
+	    stream_put (s, &nexthop->gate.ipv6, 16);
+	    break;
+	  case ZEBRA_NEXTHOP_IPV6_IFINDEX:
+	  case ZEBRA_NEXTHOP_IPV6_IFNAME:
+	    stream_put (s, &nexthop->gate.ipv6, 16);
+	    stream_putl (s, nexthop->ifindex);
+	    break;
+#endif /* HAVE_IPV6 */
+	  case ZEBRA_NEXTHOP_IFINDEX:
+	  case ZEBRA_NEXTHOP_IFNAME:
+	    stream_putl (s, nexthop->ifindex);
+	    break;
+	  default:
+	    /* do nothing */
+	    break;
+	  }
+	num++;
+      }
+  stream_putc_at (s, nump, num);
+}
+
+/* Resolve RNH again and send the result to all its clients if it
+   changed since the last time.  CLIENT, if given, is sent the result
+   in any case. */
+static void
+rnh_evaluate (struct rnh *rnh, struct zserv *client)
+{
+  struct stream *s = rnh_stream;
+  struct listnode *node;
+  struct zserv *c;
+  size_t len;
+
+  stream_reset (s);
+  rnh_resolve (rnh, s);
+  len = stream_get_endp (s);
+
+  if (rnh->state && rnh->state_len == len
+      && memcmp (rnh->state, STREAM_DATA (s), len) == 0)
+    {
+      if (client)
+	zsend_nexthop_update (client, &rnh->node->p, rnh->state, len);
+      return;
+    }
+
+  if (rnh->state)
+    XFREE (MTYPE_RNH, rnh->state);
+  rnh->state = XMALLOC (MTYPE_RNH, len);
+  memcpy (rnh->state, STREAM_DATA (s), len);
+  rnh->state_len = len;
+
+  if (IS_ZEBRA_DEBUG_EVENT)
+    {
+      char buf[INET6_ADDRSTRLEN];
+
+      zlog_debug ("nexthop %s resolution changed, %u nexthops",
+		  inet_ntop (rnh->node->p.family, &rnh->node->p.u.prefix,
+			     buf, sizeof (buf)),
+		  stream_getc_from (s, 4));
+    }
+
+  for (ALL_LIST_ELEMENTS_RO (rnh->client_list, node, c))
+    zsend_nexthop_update (c, &rnh->node->p, rnh->state, len);
+}
+
+static int
+rnh_eval_dirty (struct thread *t)
+{
+  struct listnode *node;
+  struct rnh *rnh;
+
+  t_rnh_eval = NULL;
+
+  while ((node = listhead (rnh_dirty)) != NULL)
+    {
+      rnh = listgetdata (node);
+      list_delete_node (rnh_dirty, node);
+      rnh->dirty = 0;
+      rnh_evaluate (rnh, NULL);
+    }
+  return 0;
+}
+
+static void
+rnh_free (struct rnh *rnh)
+{
+  struct route_node *rn = rnh->node;
+
+  if (rnh->dirty)
+    listnode_delete (rnh_dirty, rnh);
+  list_delete (rnh->client_list);
+  if (rnh->state)
+    XFREE (MTYPE_RNH, rnh->state);
+  XFREE (MTYPE_RNH, rnh);
+
+  rn->info = NULL;
+  route_unlock_node (rn);
+}
+
+static struct route_table *
+rnh_table_get (struct prefix *p)
+{
+  if (p->family == AF_INET)
+    return rnh_table[AFI_IP];
+#ifdef HAVE_IPV6
+  if (p->family == AF_INET6)
+    return rnh_table[AFI_IP6];
+#endif /* HAVE_IPV6 */
+  return NULL;
+}
+
+/* Register CLIENT's interest in the host address P. */
+void
+zebra_rnh_register (struct zserv *client, struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct rnh *rnh;
+
+  if ((table = rnh_table_get (p)) == NULL)
+    return;
+
+  rn = route_node_get (table, p);
+  if (rn->info)
+    {
+      rnh = rn->info;
+      route_unlock_node (rn);
+    }
+  else
+    {
+      rnh = XCALLOC (MTYPE_RNH, sizeof (struct rnh));
+      rnh->node = rn;
+      rnh->client_list = list_new ();
+      rn->info = rnh;
+    }
+
+  if (! listnode_lookup (rnh->client_list, client))
+    listnode_add (rnh->client_list, client);
+
+  rnh_evaluate (rnh, client);
+}
+
+void
+zebra_rnh_unregister (struct zserv *client, struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct rnh *rnh;
+
+  if ((table = rnh_table_get (p)) == NULL)
+    return;
+
+  rn = route_node_lookup (table, p);
+  if (! rn)
+    return;
+  route_unlock_node (rn);
+
+  if ((rnh = rn->info) == NULL)
+    return;
+
+  listnode_delete (rnh->client_list, client);
+  if (listcount (rnh->client_list) == 0)
+    rnh_free (rnh);
+}
+
+/* Forget every registration of a closing client. */
+void
+zebra_rnh_client_cleanup (struct zserv *client)
+{
+  struct route_node *rn;
+  struct rnh *rnh;
+  afi_t afi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    if (rnh_table[afi])
+      for (rn = route_top (rnh_table[afi]); rn; rn = route_next (rn))
+	if ((rnh = rn->info) != NULL)
+	  {
+	    listnode_delete (rnh->client_list, client);
+	    if (listcount (rnh->client_list) == 0)
+	      rnh_free (rnh);
+	  }
+}
+
+/* The selected route of RN changed.  Queue the registered nexthops
+   it may resolve, i.e. all those inside its prefix. */
+void
+zebra_rnh_trigger (struct route_node *rn)
+{
+  rib_table_info_t *info = rn->table->info;
+  struct route_table *table;
+  struct route_node *start;
+  struct route_node *node;
+  struct rnh *rnh;
+
+  /* Nexthops are only resolved in the default unicast tables. */
+  if (info->safi != SAFI_UNICAST
+      || rn->table != vrf_table (info->afi, SAFI_UNICAST, 0))
+    return;
+
+  table = rnh_table[info->afi];
+  if (! table || ! table->top)
+    return;
+
+  start = route_node_get (table, &rn->p);
+  for (node = route_lock_node (start); node;
+       node = route_next_until (node, start))
+    if ((rnh = node->info) != NULL && ! rnh->dirty)
+      {
+	rnh->dirty = 1;
+	listnode_add (rnh_dirty, rnh);
+      }
+  route_unlock_node (start);
+
+  if (listcount (rnh_dirty) && ! t_rnh_eval)
+    t_rnh_eval = thread_add_event (zebrad.master, rnh_eval_dirty, NULL, 0);
+}
+
+static void
+rnh_show (struct vty *vty, afi_t afi)
+{
+  struct route_node *rn;
+  struct listnode *node;
+  struct zserv *client;
+  struct rnh *rnh;
+  u_int32_t metric;
+  char buf[INET6_ADDRSTRLEN];
+
+  if (! rnh_table[afi])
+    return;
+
+  for (rn = route_top (rnh_table[afi]); rn; rn = route_next (rn))
+    if ((rnh = rn->info) != NULL)
+      {
+	vty_out (vty, "%s%s",
+		 inet_ntop (rn->p.family, &rn->p.u.prefix, buf, sizeof (buf)),
+		 VTY_NEWLINE);
+
+	/* Metric and nexthop count lead the encoded state. */
+	if (rnh->state && rnh->state[4])
+	  {
+	    memcpy (&metric, rnh->state, 4);
+	    vty_out (vty, " resolved, metric %u, %u nexthop(s)%s",
+		     ntohl (metric), rnh->state[4], VTY_NEWLINE);
+	  }
+	else
+	  vty_out (vty, " unresolved%s", VTY_NEWLINE);
+
+	vty_out (vty, " Client list:");
+	for (ALL_LIST_ELEMENTS_RO (rnh->client_list, node, client))
+	  vty_out (vty, " fd %d", client->sock);
+	vty_out (vty, "%s", VTY_NEWLINE);
+      }
+}
+
+DEFUN (show_ip_nht,
+       show_ip_nht_cmd,
+       "show ip nht",
+       SHOW_STR
+       IP_STR
+       "IP nexthop tracking table\n")
+{
+  rnh_show (vty, AFI_IP);
+  return CMD_SUCCESS;
+}
+
+#ifdef HAVE_IPV6
+DEFUN (show_ipv6_nht,
+       show_ipv6_nht_cmd,
+       "show ipv6 nht",
+       SHOW_STR
+       IPV6_STR
+       "IPv6 nexthop tracking table\n")
+{
+  rnh_show (vty, AFI_IP6);
+  return CMD_SUCCESS;
+}
+#endif /* HAVE_IPV6 */
+
+void
+zebra_rnh_init (void)
+{
+  rnh_table[AFI_IP] = route_table_init ();
+#ifdef HAVE_IPV6
+  rnh_table[AFI_IP6] = route_table_init ();
+#endif /* HAVE_IPV6 */
+  rnh_dirty = list_new ();
+  rnh_stream = stream_new (ZEBRA_MAX_PACKET_SIZ);
+
+  install_element (VIEW_NODE, &show_ip_nht_cmd);
+  install_element (ENABLE_NODE, &show_ip_nht_cmd);
+#ifdef HAVE_IPV6
+  install_element (VIEW_NODE, &show_ipv6_nht_cmd);
+  install_element (ENABLE_NODE, &show_ipv6_nht_cmd);
+#endif /* HAVE_IPV6 */
+}
@@ -0,0 +1,52 @@
+/*
+ * Zebra registered nexthop tracking
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_RNH_H
+#define _ZEBRA_RNH_H
+
+#include "prefix.h"
+#include "table.h"
+
+/* A nexthop address some client asked to be kept informed about. */
+struct rnh
+{
+  /* Node in the registered nexthop table, keyed by the address. */
+  struct route_node *node;
+
+  /* Resolution last sent to the clients, encoded as the body of a
+     ZEBRA_NEXTHOP_UPDATE message following the address. */
+  u_char *state;
+  size_t state_len;
+
+  /* Registered clients. */
+  struct list *client_list;
+
+  /* Queued for re-evaluation. */
+  u_char dirty;
+};
+
+extern void zebra_rnh_init (void);
+extern void zebra_rnh_register (struct zserv *, struct prefix *);
+extern void zebra_rnh_unregister (struct zserv *, struct prefix *);
+extern void zebra_rnh_client_cleanup (struct zserv *);
+extern void zebra_rnh_trigger (struct route_node *);
+
+#endif /* _ZEBRA_RNH_H */
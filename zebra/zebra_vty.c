@@ -1277,6 +1277,77 @@ DEFUN (show_ip_protocol,
     return CMD_SUCCESS;
 }
 
+DEFUN (fib_coalesce_window,
+       fib_coalesce_window_cmd,
+       "fib coalesce-window <1-10000>",
+       "Forwarding table updates\n"
+       "Hold kernel route updates to fold repeated changes to a prefix\n"
+       "Milliseconds\n")
+{
+  u_int32_t window;
+
+  VTY_GET_INTEGER_RANGE ("coalesce window", window, argv[0], 1, 10000);
+  rib_fib_coalesce_window = window;
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_fib_coalesce_window,
+       no_fib_coalesce_window_cmd,
+       "no fib coalesce-window",
+       NO_STR
+       "Forwarding table updates\n"
+       "Hold kernel route updates to fold repeated changes to a prefix\n")
+{
+  rib_fib_coalesce_window = 0;
+  return CMD_SUCCESS;
+}
+
+ALIAS (no_fib_coalesce_window,
+       no_fib_coalesce_window_val_cmd,
+       "no fib coalesce-window <1-10000>",
+       NO_STR
+       "Forwarding table updates\n"
+       "Hold kernel route updates to fold repeated changes to a prefix\n"
+       "Milliseconds\n")
+
+DEFUN (show_zebra_fib_stats,
+       show_zebra_fib_stats_cmd,
+       "show zebra fib stats",
+       SHOW_STR
+       "Zebra information\n"
+       "Forwarding table updates\n"
+       "Kernel update coalescing statistics\n")
+{
+#define FIB_SHOW_STAT(name, value) \
+  vty_out (vty, "%-40s %10lu%s", name, (unsigned long) (value), VTY_NEWLINE)
+
+  FIB_SHOW_STAT ("Coalescing window (msec)", rib_fib_coalesce_window);
+  FIB_SHOW_STAT ("Kernel operations requested", rib_fib_stats.requested);
+  FIB_SHOW_STAT ("Kernel operations emitted", rib_fib_stats.emitted);
+  FIB_SHOW_STAT ("Kernel operations suppressed", rib_fib_stats.suppressed);
+  FIB_SHOW_STAT ("Prefixes flushed", rib_fib_stats.flushes);
+  FIB_SHOW_STAT ("Most prefixes flushed at once", rib_fib_stats.max_flush);
+  FIB_SHOW_STAT ("Prefixes waiting", rib_fib_stats.pending);
+
+#undef FIB_SHOW_STAT
+  return CMD_SUCCESS;
+}
+
+DEFUN (clear_zebra_fib_stats,
+       clear_zebra_fib_stats_cmd,
+       "clear zebra fib stats",
+       CLEAR_STR
+       "Zebra information\n"
+       "Forwarding table updates\n"
+       "Kernel update coalescing statistics\n")
+{
+  unsigned long pending = rib_fib_stats.pending;
+
+  memset (&rib_fib_stats, 0, sizeof rib_fib_stats);
+  rib_fib_stats.pending = pending;
+  return CMD_SUCCESS;
+}
+
 /*
  * Show IP mroute command to dump the BGP Multicast
  * routing table
@@ -2169,6 +2240,10 @@ static int config_write_protocol(struct vty *vty)
       vty_out (vty, "ip protocol %s route-map %s%s", "any",
                proto_rm[AFI_IP][ZEBRA_ROUTE_MAX], VTY_NEWLINE);
 
+  if (rib_fib_coalesce_window)
+    vty_out (vty, "fib coalesce-window %u%s", rib_fib_coalesce_window,
+             VTY_NEWLINE);
+
   return 1;
 }   
 
@@ -2189,6 +2264,12 @@ zebra_vty_init (void)
   install_element (CONFIG_NODE, &no_ip_protocol_cmd);
   install_element (VIEW_NODE, &show_ip_protocol_cmd);
   install_element (ENABLE_NODE, &show_ip_protocol_cmd);
+  install_element (CONFIG_NODE, &fib_coalesce_window_cmd);
+  install_element (CONFIG_NODE, &no_fib_coalesce_window_cmd);
+  install_element (CONFIG_NODE, &no_fib_coalesce_window_val_cmd);
+  install_element (VIEW_NODE, &show_zebra_fib_stats_cmd);
+  install_element (ENABLE_NODE, &show_zebra_fib_stats_cmd);
+  install_element (ENABLE_NODE, &clear_zebra_fib_stats_cmd);
   install_element (CONFIG_NODE, &ip_route_cmd);
   install_element (CONFIG_NODE, &ip_route_flags_cmd);
   install_element (CONFIG_NODE, &ip_route_flags2_cmd);
@@ -36,12 +36,14 @@
 #include "privs.h"
 #include "network.h"
 #include "buffer.h"
+#include "zring.h"
 
 #include "zebra/zserv.h"
 #include "zebra/router-id.h"
 #include "zebra/redistribute.h"
 #include "zebra/debug.h"
 #include "zebra/ipforward.h"
+#include "zebra/zebra_rnh.h"
 
 /* Event list of zebra. */
 enum event { ZEBRA_SERV, ZEBRA_READ, ZEBRA_WRITE };
@@ -53,6 +55,10 @@ static void zebra_event (enum event event, int sock, struct zserv *client);
 extern struct zebra_privs_t zserv_privs;
 
 static void zebra_client_close (struct zserv *client);
+static int zserv_ring_read (struct thread *);
+
+/* Ring messages handled before other threads get a turn. */
+#define ZSERV_RING_BUDGET 256
 
 static int
 zserv_delayed_close(struct thread *thread)
@@ -106,6 +112,7 @@ zebra_server_send_message(struct zserv *client)
 {
   if (client->t_suicide)
     return -1;
+  client->sock_sent++;
   switch (buffer_write(client->wb, client->sock, STREAM_DATA(client->obuf),
 		       stream_get_endp(client->obuf)))
     {
@@ -140,6 +147,26 @@ zserv_create_header (struct stream *s, uint16_t cmd)
   stream_putw (s, cmd);
 }
 
+/* Route messages take the ring, if the client passed one, and the
+   socket when it has not, or when the ring is full. */
+static int
+zebra_server_send_route (struct zserv *client)
+{
+  struct stream *s = client->obuf;
+
+  if (client->ring && ! client->t_suicide
+      && zring_put (&client->ring->tx, s, client->sock_sent) == 0)
+    {
+      if (! zring_wake (&client->ring->tx))
+	return 0;
+
+      stream_reset (s);
+      zserv_create_header (s, ZEBRA_RING_KICK);
+      stream_putw_at (s, 0, stream_get_endp (s));
+    }
+  return zebra_server_send_message (client);
+}
+
 static void
 zserv_encode_interface (struct stream *s, struct interface *ifp)
 {
@@ -459,7 +486,7 @@ zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
   /* Write packet size. */
   stream_putw_at (s, 0, stream_get_endp (s));
 
-  return zebra_server_send_message(client);
+  return zebra_server_send_route (client);
 }
 
 #ifdef HAVE_IPV6
@@ -662,6 +689,27 @@ zsend_ipv4_import_lookup (struct zserv *client, struct prefix_ipv4 *p)
   return zebra_server_send_message(client);
 }
 
+/* Resolution of a registered nexthop, see zebra_rnh.c.  STATE is
+   the metric, nexthop count and nexthops in lookup reply format. */
+int
+zsend_nexthop_update (struct zserv *client, struct prefix *p,
+		      u_char *state, size_t len)
+{
+  struct stream *s;
+
+  s = client->obuf;
+  stream_reset (s);
+
+  zserv_create_header (s, ZEBRA_NEXTHOP_UPDATE);
+  stream_putc (s, p->family);
+  stream_put (s, &p->u.prefix, prefix_blen (p));
+  stream_put (s, state, len);
+
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zebra_server_send_message(client);
+}
+
 /* Router-id is updated. Send ZEBRA_ROUTER_ID_ADD to client. */
 int
 zsend_router_id_update (struct zserv *client, struct prefix *p)
@@ -737,19 +785,59 @@ zread_interface_delete (struct zserv *client, u_short length)
  * Parse the ZEBRA_IPV4_ROUTE_ADD sent from client. Update rib and
  * add kernel route. 
  */
-static int
-zread_ipv4_add (struct zserv *client, u_short length)
+/* Nexthops of an IPv4 route add, as zapi_ipv4_route() puts them. */
+static void
+zread_ipv4_nexthops (struct stream *s, struct rib *rib)
 {
   int i;
-  struct rib *rib;
-  struct prefix_ipv4 p;
-  u_char message;
   struct in_addr nexthop;
   u_char nexthop_num;
   u_char nexthop_type;
-  struct stream *s;
   unsigned int ifindex;
   u_char ifname_len;
+
+  nexthop_num = stream_getc (s);
+
+  for (i = 0; i < nexthop_num; i++)
+    {
+      nexthop_type = stream_getc (s);
+
+      switch (nexthop_type)
+	{
+	case ZEBRA_NEXTHOP_IFINDEX:
+	  ifindex = stream_getl (s);
+	  nexthop_ifindex_add (rib, ifindex);
+	  break;
+	case ZEBRA_NEXTHOP_IFNAME:
+	  ifname_len = stream_getc (s);
+	  stream_forward_getp (s, ifname_len);
+	  break;
+	case ZEBRA_NEXTHOP_IPV4:
+	  nexthop.s_addr = stream_get_ipv4 (s);
+	  nexthop_ipv4_add (rib, &nexthop, NULL);
+	  break;
+	case ZEBRA_NEXTHOP_IPV4_IFINDEX:
+	  nexthop.s_addr = stream_get_ipv4 (s);
+	  ifindex = stream_getl (s);
+	  nexthop_ipv4_ifindex_add (rib, &nexthop, NULL, ifindex);
+	  break;
+	case ZEBRA_NEXTHOP_IPV6:
+	  stream_forward_getp (s, IPV6_MAX_BYTELEN);
+	  break;
+	case ZEBRA_NEXTHOP_BLACKHOLE:
+	  nexthop_blackhole_add (rib);
+	  break;
+	}
+    }
+}
+
+static int
+zread_ipv4_add (struct zserv *client, u_short length)
+{
+  struct rib *rib;
+  struct prefix_ipv4 p;
+  u_char message;
+  struct stream *s;
   safi_t safi;	
 
 
@@ -774,41 +862,7 @@ zread_ipv4_add (struct zserv *client, u_short length)
 
   /* Nexthop parse. */
   if (CHECK_FLAG (message, ZAPI_MESSAGE_NEXTHOP))
-    {
-      nexthop_num = stream_getc (s);
-
-      for (i = 0; i < nexthop_num; i++)
-	{
-	  nexthop_type = stream_getc (s);
-
-	  switch (nexthop_type)
-	    {
-	    case ZEBRA_NEXTHOP_IFINDEX:
-	      ifindex = stream_getl (s);
-	      nexthop_ifindex_add (rib, ifindex);
-	      break;
-	    case ZEBRA_NEXTHOP_IFNAME:
-	      ifname_len = stream_getc (s);
-	      stream_forward_getp (s, ifname_len);
-	      break;
-	    case ZEBRA_NEXTHOP_IPV4:
-	      nexthop.s_addr = stream_get_ipv4 (s);
-	      nexthop_ipv4_add (rib, &nexthop, NULL);
-	      break;
-	    case ZEBRA_NEXTHOP_IPV4_IFINDEX:
-	      nexthop.s_addr = stream_get_ipv4 (s);
-	      ifindex = stream_getl (s);
-	      nexthop_ipv4_ifindex_add (rib, &nexthop, NULL, ifindex);
-	      break;
-	    case ZEBRA_NEXTHOP_IPV6:
-	      stream_forward_getp (s, IPV6_MAX_BYTELEN);
-	      break;
-            case ZEBRA_NEXTHOP_BLACKHOLE:
-              nexthop_blackhole_add (rib);
-              break;
-            }
-	}
-    }
+    zread_ipv4_nexthops (s, rib);
 
   /* Distance. */
   if (CHECK_FLAG (message, ZAPI_MESSAGE_DISTANCE))
@@ -824,19 +878,59 @@ zread_ipv4_add (struct zserv *client, u_short length)
   return 0;
 }
 
+/* Nexthops of an IPv4 route delete.  Only the last gateway and
+   interface index given are used to find the route. */
+static struct in_addr *
+zread_ipv4_delete_nexthops (struct stream *s, struct in_addr *nexthop,
+			    unsigned long *ifindex)
+{
+  int i;
+  struct in_addr *nexthop_p = NULL;
+  u_char nexthop_num;
+  u_char nexthop_type;
+  u_char ifname_len;
+
+  nexthop_num = stream_getc (s);
+
+  for (i = 0; i < nexthop_num; i++)
+    {
+      nexthop_type = stream_getc (s);
+
+      switch (nexthop_type)
+	{
+	case ZEBRA_NEXTHOP_IFINDEX:
+	  *ifindex = stream_getl (s);
+	  break;
+	case ZEBRA_NEXTHOP_IFNAME:
+	  ifname_len = stream_getc (s);
+	  stream_forward_getp (s, ifname_len);
+	  break;
+	case ZEBRA_NEXTHOP_IPV4:
+	  nexthop->s_addr = stream_get_ipv4 (s);
+	  nexthop_p = nexthop;
+	  break;
+	case ZEBRA_NEXTHOP_IPV4_IFINDEX:
+	  nexthop->s_addr = stream_get_ipv4 (s);
+	  nexthop_p = nexthop;
+	  *ifindex = stream_getl (s);
+	  break;
+	case ZEBRA_NEXTHOP_IPV6:
+	  stream_forward_getp (s, IPV6_MAX_BYTELEN);
+	  break;
+	}
+    }
+  return nexthop_p;
+}
+
 /* Zebra server IPv4 prefix delete function. */
 static int
 zread_ipv4_delete (struct zserv *client, u_short length)
 {
-  int i;
   struct stream *s;
   struct zapi_ipv4 api;
   struct in_addr nexthop, *nexthop_p;
   unsigned long ifindex;
   struct prefix_ipv4 p;
-  u_char nexthop_num;
-  u_char nexthop_type;
-  u_char ifname_len;
   
   s = client->ibuf;
   ifindex = 0;
@@ -857,37 +951,7 @@ zread_ipv4_delete (struct zserv *client, u_short length)
 
   /* Nexthop, ifindex, distance, metric. */
   if (CHECK_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP))
-    {
-      nexthop_num = stream_getc (s);
-
-      for (i = 0; i < nexthop_num; i++)
-	{
-	  nexthop_type = stream_getc (s);
-
-	  switch (nexthop_type)
-	    {
-	    case ZEBRA_NEXTHOP_IFINDEX:
-	      ifindex = stream_getl (s);
-	      break;
-	    case ZEBRA_NEXTHOP_IFNAME:
-	      ifname_len = stream_getc (s);
-	      stream_forward_getp (s, ifname_len);
-	      break;
-	    case ZEBRA_NEXTHOP_IPV4:
-	      nexthop.s_addr = stream_get_ipv4 (s);
-	      nexthop_p = &nexthop;
-	      break;
-	    case ZEBRA_NEXTHOP_IPV4_IFINDEX:
-	      nexthop.s_addr = stream_get_ipv4 (s);
-	      nexthop_p = &nexthop;
-	      ifindex = stream_getl (s);
-	      break;
-	    case ZEBRA_NEXTHOP_IPV6:
-	      stream_forward_getp (s, IPV6_MAX_BYTELEN);
-	      break;
-	    }
-	}
-    }
+    nexthop_p = zread_ipv4_delete_nexthops (s, &nexthop, &ifindex);
 
   /* Distance. */
   if (CHECK_FLAG (api.message, ZAPI_MESSAGE_DISTANCE))
@@ -906,6 +970,118 @@ zread_ipv4_delete (struct zserv *client, u_short length)
   return 0;
 }
 
+/* Prefixes of a bulk route message.  A message holds no more of them
+   than it has bytes. */
+static struct prefix_ipv4 zread_bulk_prefix[ZEBRA_MAX_PACKET_SIZ];
+static u_int32_t zread_bulk_metric[ZEBRA_MAX_PACKET_SIZ];
+
+/* Read the prefix count and the prefixes of a bulk route message, with
+   their metrics if it has them.  Returns how many were read whole. */
+static int
+zread_ipv4_bulk_prefixes (struct zserv *client, u_char message)
+{
+  struct stream *s = client->ibuf;
+  struct prefix_ipv4 *p;
+  u_int16_t count;
+  size_t need;
+  int i;
+
+  count = stream_getw (s);
+  for (i = 0; i < count && i < ZEBRA_MAX_PACKET_SIZ; i++)
+    {
+      p = &zread_bulk_prefix[i];
+      if (STREAM_READABLE (s) < 1)
+	break;
+
+      memset (p, 0, sizeof (struct prefix_ipv4));
+      p->family = AF_INET;
+      p->prefixlen = stream_getc (s);
+
+      need = PSIZE (p->prefixlen);
+      if (CHECK_FLAG (message, ZAPI_MESSAGE_METRIC))
+	need += 4;
+      if (p->prefixlen > IPV4_MAX_BITLEN || STREAM_READABLE (s) < need)
+	break;
+
+      stream_get (&p->prefix, s, PSIZE (p->prefixlen));
+      if (CHECK_FLAG (message, ZAPI_MESSAGE_METRIC))
+	zread_bulk_metric[i] = stream_getl (s);
+      else
+	zread_bulk_metric[i] = 0;
+    }
+
+  if (i < count)
+    zlog_warn ("%s: client %d announced %u prefixes, %d were there",
+	       __func__, client->sock, count, i);
+
+  client->bulk_msgs++;
+  client->bulk_routes += i;
+  return i;
+}
+
+/* Zebra server IPv4 bulk route add, see zapi_ipv4_route() for the
+   layout.  Everything but prefix and metric is read once. */
+static int
+zread_ipv4_bulk_add (struct zserv *client, u_short length)
+{
+  struct rib *rib;
+  u_char message;
+  struct stream *s;
+  safi_t safi;
+  int count;
+
+  s = client->ibuf;
+
+  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
+  rib->type = stream_getc (s);
+  rib->flags = stream_getc (s);
+  message = stream_getc (s);
+  safi = stream_getw (s);
+  rib->uptime = time (NULL);
+
+  if (CHECK_FLAG (message, ZAPI_MESSAGE_NEXTHOP))
+    zread_ipv4_nexthops (s, rib);
+  if (CHECK_FLAG (message, ZAPI_MESSAGE_DISTANCE))
+    rib->distance = stream_getc (s);
+  rib->table = zebrad.rtm_table_default;
+
+  count = zread_ipv4_bulk_prefixes (client, message);
+  rib_add_ipv4_bulk (zread_bulk_prefix, zread_bulk_metric, count, rib, safi);
+  return 0;
+}
+
+/* Zebra server IPv4 bulk route delete. */
+static int
+zread_ipv4_bulk_delete (struct zserv *client, u_short length)
+{
+  struct stream *s;
+  struct zapi_ipv4 api;
+  struct in_addr nexthop, *nexthop_p;
+  unsigned long ifindex;
+  int i, count;
+
+  s = client->ibuf;
+  ifindex = 0;
+  nexthop.s_addr = 0;
+  nexthop_p = NULL;
+
+  api.type = stream_getc (s);
+  api.flags = stream_getc (s);
+  api.message = stream_getc (s);
+  api.safi = stream_getw (s);
+
+  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP))
+    nexthop_p = zread_ipv4_delete_nexthops (s, &nexthop, &ifindex);
+  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_DISTANCE))
+    api.distance = stream_getc (s);
+
+  count = zread_ipv4_bulk_prefixes (client, api.message);
+  for (i = 0; i < count; i++)
+    rib_delete_ipv4 (api.type, api.flags, &zread_bulk_prefix[i], nexthop_p,
+		     ifindex, client->rtm_table, api.safi);
+  return 0;
+}
+
 /* Nexthop lookup for IPv4. */
 static int
 zread_ipv4_nexthop_lookup (struct zserv *client, u_short length)
@@ -933,6 +1109,43 @@ zread_ipv4_import_lookup (struct zserv *client, u_short length)
   return zsend_ipv4_import_lookup (client, &p);
 }
 
+/* Register or unregister a list of nexthop addresses, each encoded
+   as family and address. */
+static int
+zread_nexthop_register (int command, struct zserv *client, u_short length)
+{
+  struct stream *s;
+  struct prefix p;
+  size_t end;
+
+  s = client->ibuf;
+  end = stream_get_getp (s) + length;
+
+  while (stream_get_getp (s) < end)
+    {
+      memset (&p, 0, sizeof (struct prefix));
+      p.family = stream_getc (s);
+      if (p.family == AF_INET)
+	p.prefixlen = IPV4_MAX_BITLEN;
+#ifdef HAVE_IPV6
+      else if (p.family == AF_INET6)
+	p.prefixlen = IPV6_MAX_BITLEN;
+#endif /* HAVE_IPV6 */
+      else
+	{
+	  zlog_warn ("%s: unknown address family %u", __func__, p.family);
+	  return -1;
+	}
+      stream_get (&p.u.prefix, s, prefix_blen (&p));
+
+      if (command == ZEBRA_NEXTHOP_REGISTER)
+	zebra_rnh_register (client, &p);
+      else
+	zebra_rnh_unregister (client, &p);
+    }
+  return 0;
+}
+
 #ifdef HAVE_IPV6
 /* Zebra server IPv6 prefix add function. */
 static int
@@ -1104,14 +1317,59 @@ zread_router_id_delete (struct zserv *client, u_short length)
   return 0;
 }
 
+/* Answer a hello with the capabilities zebra shares with the client. */
+static int
+zsend_hello (struct zserv *client)
+{
+  struct stream *s;
+
+  s = client->obuf;
+  stream_reset (s);
+
+  zserv_create_header (s, ZEBRA_HELLO);
+  stream_putl (s, client->capabilities);
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zebra_server_send_message (client);
+}
+
 /* Tie up route-type and client->sock */
 static void
-zread_hello (struct zserv *client)
+zread_hello (struct zserv *client, u_short length)
 {
   /* type of protocol (lib/zebra.h) */
   u_char proto;
   proto = stream_getc (client->ibuf);
 
+  /* Clients that predate capabilities send the route type only, and
+     are not answered. */
+  if (length >= 5)
+    {
+      client->capabilities = stream_getl (client->ibuf) & ZAPI_CAPABILITIES;
+
+      /* The rings came with the hello, if at all. */
+      if (CHECK_FLAG (client->capabilities, ZAPI_CAPABILITY_RING)
+	  && client->ring_fd >= 0 && ! client->ring)
+	{
+	  client->ring = zring_shm_attach (client->ring_fd);
+	  client->ring_fd = -1;
+	}
+      if (client->ring)
+	{
+	  if (! client->rbuf)
+	    client->rbuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
+	}
+      else
+	UNSET_FLAG (client->capabilities, ZAPI_CAPABILITY_RING);
+      zsend_hello (client);
+    }
+  client->hello = 1;
+  if (client->ring_fd >= 0)
+    {
+      close (client->ring_fd);
+      client->ring_fd = -1;
+    }
+
   /* accept only dynamic routing protocols */
   if ((proto < ZEBRA_ROUTE_MAX)
   &&  (proto > ZEBRA_ROUTE_STATIC))
@@ -1159,14 +1417,25 @@ zebra_client_close (struct zserv *client)
       client->sock = -1;
     }
 
+  /* Drop nexthop registrations. */
+  zebra_rnh_client_cleanup (client);
+
   /* Free stream buffers. */
   if (client->ibuf)
     stream_free (client->ibuf);
   if (client->obuf)
     stream_free (client->obuf);
+  if (client->rbuf)
+    stream_free (client->rbuf);
   if (client->wb)
     buffer_free(client->wb);
 
+  /* Unmap the rings. */
+  if (client->ring)
+    zring_shm_free (client->ring);
+  if (client->ring_fd >= 0)
+    close (client->ring_fd);
+
   /* Release threads. */
   if (client->t_read)
     thread_cancel (client->t_read);
@@ -1174,6 +1443,8 @@ zebra_client_close (struct zserv *client)
     thread_cancel (client->t_write);
   if (client->t_suicide)
     thread_cancel (client->t_suicide);
+  if (client->t_ring)
+    thread_cancel (client->t_ring);
 
   /* Free client structure. */
   listnode_delete (zebrad.client_list, client);
@@ -1190,6 +1461,7 @@ zebra_client_create (int sock)
 
   /* Make client input/output buffer. */
   client->sock = sock;
+  client->ring_fd = -1;
   client->ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   client->obuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   client->wb = buffer_new(0);
@@ -1204,6 +1476,203 @@ zebra_client_create (int sock)
   zebra_event (ZEBRA_READ, sock, client);
 }
 
+/* Read from the client socket, picking up the rings a client passes
+   with its hello. */
+static ssize_t
+zserv_read_try (struct zserv *client, int sock, size_t size)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (sizeof (int))];
+  } control;
+  ssize_t nbytes;
+  int fd;
+
+  if (client->hello)
+    return stream_read_try (client->ibuf, sock, size);
+
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  nbytes = stream_recvmsg (client->ibuf, sock, &msg, 0, size);
+  if (nbytes < 0)
+    {
+      if (ERRNO_IO_RETRY (errno))
+	return -2;
+      zlog_warn ("%s: recvmsg failed on fd %d: %s", __func__, sock,
+		 safe_strerror (errno));
+      return -1;
+    }
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+	&& cmsg->cmsg_len >= CMSG_LEN (sizeof (int)))
+      {
+	memcpy (&fd, CMSG_DATA (cmsg), sizeof (int));
+	if (client->ring_fd < 0)
+	  client->ring_fd = fd;
+	else
+	  close (fd);
+      }
+  return nbytes;
+}
+
+static void
+zebra_client_dispatch (struct zserv *client, uint16_t command,
+		       uint16_t length)
+{
+  switch (command) 
+    {
+    case ZEBRA_ROUTER_ID_ADD:
+      zread_router_id_add (client, length);
+      break;
+    case ZEBRA_ROUTER_ID_DELETE:
+      zread_router_id_delete (client, length);
+      break;
+    case ZEBRA_INTERFACE_ADD:
+      zread_interface_add (client, length);
+      break;
+    case ZEBRA_INTERFACE_DELETE:
+      zread_interface_delete (client, length);
+      break;
+    case ZEBRA_IPV4_ROUTE_ADD:
+      zread_ipv4_add (client, length);
+      break;
+    case ZEBRA_IPV4_ROUTE_DELETE:
+      zread_ipv4_delete (client, length);
+      break;
+#ifdef HAVE_IPV6
+    case ZEBRA_IPV6_ROUTE_ADD:
+      zread_ipv6_add (client, length);
+      break;
+    case ZEBRA_IPV6_ROUTE_DELETE:
+      zread_ipv6_delete (client, length);
+      break;
+#endif /* HAVE_IPV6 */
+    case ZEBRA_REDISTRIBUTE_ADD:
+      zebra_redistribute_add (command, client, length);
+      break;
+    case ZEBRA_REDISTRIBUTE_DELETE:
+      zebra_redistribute_delete (command, client, length);
+      break;
+    case ZEBRA_REDISTRIBUTE_DEFAULT_ADD:
+      zebra_redistribute_default_add (command, client, length);
+      break;
+    case ZEBRA_REDISTRIBUTE_DEFAULT_DELETE:
+      zebra_redistribute_default_delete (command, client, length);
+      break;
+    case ZEBRA_IPV4_NEXTHOP_LOOKUP:
+      zread_ipv4_nexthop_lookup (client, length);
+      break;
+#ifdef HAVE_IPV6
+    case ZEBRA_IPV6_NEXTHOP_LOOKUP:
+      zread_ipv6_nexthop_lookup (client, length);
+      break;
+#endif /* HAVE_IPV6 */
+    case ZEBRA_IPV4_IMPORT_LOOKUP:
+      zread_ipv4_import_lookup (client, length);
+      break;
+    case ZEBRA_HELLO:
+      zread_hello (client, length);
+      break;
+    case ZEBRA_IPV4_ROUTE_BULK_ADD:
+      zread_ipv4_bulk_add (client, length);
+      break;
+    case ZEBRA_IPV4_ROUTE_BULK_DELETE:
+      zread_ipv4_bulk_delete (client, length);
+      break;
+    case ZEBRA_RING_KICK:
+      /* The ring is read after every message. */
+      break;
+    case ZEBRA_NEXTHOP_REGISTER:
+    case ZEBRA_NEXTHOP_UNREGISTER:
+      zread_nexthop_register (command, client, length);
+      break;
+    default:
+      zlog_info ("Zebra received unknown command %d", command);
+      break;
+    }
+}
+
+/* Handle up to BUDGET messages from the client's ring, or all that can
+   be before its next socket message if BUDGET is 0.  Returns -1 if the
+   client was closed. */
+static int
+zserv_ring_process (struct zserv *client, int budget)
+{
+  struct zring *ring = &client->ring->rx;
+  struct stream *s;
+  uint16_t length, command;
+  uint8_t marker, version;
+  int ret, n = 0;
+
+  /* Handlers read from ibuf, which may hold part of a socket
+     message. */
+  s = client->ibuf;
+  client->ibuf = client->rbuf;
+
+  while ((ret = zring_get (ring, client->ibuf, client->sock_read))
+	 == ZRING_MSG)
+    {
+      length = stream_getw (client->ibuf);
+      marker = stream_getc (client->ibuf);
+      version = stream_getc (client->ibuf);
+      command = stream_getw (client->ibuf);
+      if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION
+	  || length != stream_get_endp (client->ibuf))
+	{
+	  ret = ZRING_ERROR;
+	  break;
+	}
+
+      if (IS_ZEBRA_DEBUG_PACKET && IS_ZEBRA_DEBUG_RECV)
+	zlog_debug ("zebra message received from ring [%s] %d",
+		    zserv_command_string (command), length);
+
+      zebra_client_dispatch (client, command, length - ZEBRA_HEADER_SIZE);
+      if (client->t_suicide || ++n == budget)
+	break;
+    }
+
+  client->rbuf = client->ibuf;
+  client->ibuf = s;
+
+  if (ret == ZRING_ERROR)
+    zlog_warn ("%s: socket %d bad message in ring, closing", __func__,
+	       client->sock);
+  if (ret == ZRING_ERROR || client->t_suicide)
+    {
+      zebra_client_close (client);
+      return -1;
+    }
+  if (! budget)
+    return 0;
+
+  /* Out of budget, or the ring ran dry and the client must kick us,
+     unless it put more in meanwhile. */
+  if (ret == ZRING_MSG || (ret == ZRING_EMPTY && zring_sleep (ring)))
+    if (! client->t_ring)
+      client->t_ring = thread_add_event (zebrad.master, zserv_ring_read,
+					 client, 0);
+  return 0;
+}
+
+static int
+zserv_ring_read (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
+
+  client->t_ring = NULL;
+  return zserv_ring_process (client, ZSERV_RING_BUDGET);
+}
+
 /* Handler of zebra service request. */
 static int
 zebra_client_read (struct thread *thread)
@@ -1229,8 +1698,8 @@ zebra_client_read (struct thread *thread)
   if ((already = stream_get_endp(client->ibuf)) < ZEBRA_HEADER_SIZE)
     {
       ssize_t nbyte;
-      if (((nbyte = stream_read_try (client->ibuf, sock,
-				     ZEBRA_HEADER_SIZE-already)) == 0) ||
+      if (((nbyte = zserv_read_try (client, sock,
+				    ZEBRA_HEADER_SIZE-already)) == 0) ||
 	  (nbyte == -1))
 	{
 	  if (IS_ZEBRA_DEBUG_EVENT)
@@ -1309,64 +1778,12 @@ zebra_client_read (struct thread *thread)
     zlog_debug ("zebra message received [%s] %d", 
 	       zserv_command_string (command), length);
 
-  switch (command) 
-    {
-    case ZEBRA_ROUTER_ID_ADD:
-      zread_router_id_add (client, length);
-      break;
-    case ZEBRA_ROUTER_ID_DELETE:
-      zread_router_id_delete (client, length);
-      break;
-    case ZEBRA_INTERFACE_ADD:
-      zread_interface_add (client, length);
-      break;
-    case ZEBRA_INTERFACE_DELETE:
-      zread_interface_delete (client, length);
-      break;
-    case ZEBRA_IPV4_ROUTE_ADD:
-      zread_ipv4_add (client, length);
-      break;
-    case ZEBRA_IPV4_ROUTE_DELETE:
-      zread_ipv4_delete (client, length);
-      break;
-#ifdef HAVE_IPV6
-    case ZEBRA_IPV6_ROUTE_ADD:
-      zread_ipv6_add (client, length);
-      break;
-    case ZEBRA_IPV6_ROUTE_DELETE:
-      zread_ipv6_delete (client, length);
-      break;
-#endif /* HAVE_IPV6 */
-    case ZEBRA_REDISTRIBUTE_ADD:
-      zebra_redistribute_add (command, client, length);
-      break;
-    case ZEBRA_REDISTRIBUTE_DELETE:
-      zebra_redistribute_delete (command, client, length);
-      break;
-    case ZEBRA_REDISTRIBUTE_DEFAULT_ADD:
-      zebra_redistribute_default_add (command, client, length);
-      break;
-    case ZEBRA_REDISTRIBUTE_DEFAULT_DELETE:
-      zebra_redistribute_default_delete (command, client, length);
-      break;
-    case ZEBRA_IPV4_NEXTHOP_LOOKUP:
-      zread_ipv4_nexthop_lookup (client, length);
-      break;
-#ifdef HAVE_IPV6
-    case ZEBRA_IPV6_NEXTHOP_LOOKUP:
-      zread_ipv6_nexthop_lookup (client, length);
-      break;
-#endif /* HAVE_IPV6 */
-    case ZEBRA_IPV4_IMPORT_LOOKUP:
-      zread_ipv4_import_lookup (client, length);
-      break;
-    case ZEBRA_HELLO:
-      zread_hello (client);
-      break;
-    default:
-      zlog_info ("Zebra received unknown command %d", command);
-      break;
-    }
+  /* What the client put in the ring before this message comes first. */
+  if (client->ring && zserv_ring_process (client, 0) < 0)
+    return -1;
+
+  zebra_client_dispatch (client, command, length);
+  client->sock_read++;
 
   if (client->t_suicide)
     {
@@ -1377,6 +1794,9 @@ zebra_client_read (struct thread *thread)
 
   stream_reset (client->ibuf);
   zebra_event (ZEBRA_READ, sock, client);
+
+  if (client->ring)
+    return zserv_ring_process (client, ZSERV_RING_BUDGET);
   return 0;
 }
 
@@ -1636,7 +2056,17 @@ DEFUN (show_zebra_client,
   struct zserv *client;
 
   for (ALL_LIST_ELEMENTS_RO (zebrad.client_list, node, client))
-    vty_out (vty, "Client fd %d%s", client->sock, VTY_NEWLINE);
+    {
+      vty_out (vty, "Client fd %d%s", client->sock, VTY_NEWLINE);
+      if (CHECK_FLAG (client->capabilities, ZAPI_CAPABILITY_ROUTE_BULK))
+	vty_out (vty, "  Bulk route messages %lu, routes %lu%s",
+		 client->bulk_msgs, client->bulk_routes, VTY_NEWLINE);
+      if (client->ring)
+	vty_out (vty, "  Ring messages in %lu, out %lu, "
+		 "sent on the socket when full %lu, wakeups %lu%s",
+		 client->ring->rx.msgs, client->ring->tx.msgs,
+		 client->ring->tx.full, client->ring->tx.wakeups, VTY_NEWLINE);
+    }
   
   return CMD_SUCCESS;
 }
@@ -66,6 +66,26 @@ struct zserv
 
   /* Router-id information. */
   u_char ridinfo;
+
+  /* ZAPI_CAPABILITY_* agreed on in the client's hello. */
+  u_int32_t capabilities;
+
+  /* Bulk route messages and the routes they carried. */
+  u_long bulk_msgs;
+  u_long bulk_routes;
+
+  /* Messages sent and read on the socket, which order those in the
+     ring, see lib/zring.h. */
+  u_int32_t sock_sent;
+  u_int32_t sock_read;
+
+  /* Shared-memory ring passed with the hello, held in ring_fd until
+     the hello is read.  Ring messages are read into rbuf. */
+  u_char hello;
+  int ring_fd;
+  struct zring_shm *ring;
+  struct stream *rbuf;
+  struct thread *t_ring;
 };
 
 /* Zebra instance */
@@ -107,6 +127,8 @@ extern int zsend_interface_update (int, struct zserv *, struct interface *);
 extern int zsend_route_multipath (int, struct zserv *, struct prefix *, 
                                   struct rib *);
 extern int zsend_router_id_update(struct zserv *, struct prefix *);
+extern int zsend_nexthop_update (struct zserv *, struct prefix *, u_char *,
+                                 size_t);
 
 extern pid_t pid;
 